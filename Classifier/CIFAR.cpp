@@ -21,10 +21,10 @@ void LoadCIFARData(ImageSet& imageSet, const std::string& imageFilename, bool is
 	  throw std::runtime_error("Invalid label.");
 	}
 	++data;
-	auto vectorData = std::make_unique<double[]>(imageSize);
+	auto vectorData = std::make_unique<Real[]>(imageSize);
 	for (uint32_t j = 0; j < imageSize; ++j)
 	{
-	  vectorData[j] = double(*data) / 255.0;
+	  vectorData[j] = Real(*data / 255.0);
 	  ++data;
 	}
 	auto& image = *new Image(move(vectorData), 3, 32, 32, label);
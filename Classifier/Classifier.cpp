@@ -4,7 +4,10 @@
 #include "Faces.h"
 #include "Trainer.h"
 
-static void TestNetwork(FeedForwardNetwork& network, const ImageSet& imageSet, std::ostream& os)
+// The int8 activation ranges are calibrated on up to this many images, spread evenly through the training set.
+static const size_t calibrationImageCount = 1000;
+
+static void TestNetwork(FeedForwardNetwork& network, const ImageSet& imageSet, std::ostream& os, bool int8)
 {
   os << "Dataset," << imageSet.Name() << std::endl
 	<< "Training epochs," << network.EpochsTrained() << std::endl << std::endl;
@@ -16,8 +19,21 @@ static void TestNetwork(FeedForwardNetwork& network, const ImageSet& imageSet, s
   LOG(Info) << "Network architecture:" << std::endl << network;
   LOG(Info) << "Testing on " << imageSet.Name() << " dataset.";
   LOG(Info) << "Using " << network.ThreadCount() << " threads.";
+  std::unique_ptr<QuantizedNetwork> quantized;
+  if (int8)
+  {
+	const std::vector<Image*>& trainingSet = imageSet.TrainingSet();
+	if (trainingSet.empty())
+	  throw std::runtime_error("-int8 needs the training set to calibrate the quantized network.");
+	std::vector<Image*> calibrationImages;
+	size_t step = std::max<size_t>(1, trainingSet.size() / calibrationImageCount);
+	for (size_t i = 0; i < trainingSet.size() && calibrationImages.size() < calibrationImageCount; i += step)
+	  calibrationImages.push_back(trainingSet[i]);
+	LOG(Info) << "Calibrating the int8 network on " << calibrationImages.size() << " training images.";
+	quantized = std::make_unique<QuantizedNetwork>(network, calibrationImages);
+  }
   auto testingStart = std::chrono::steady_clock::now();
-  network.SaveAccuracyStatistics(imageSet, os);
+  network.SaveAccuracyStatistics(imageSet, os, quantized.get());
   auto testingEnd = std::chrono::steady_clock::now();
   LOG(Info) << "Testing completed in "
 	<< std::chrono::duration_cast<std::chrono::milliseconds>(testingEnd - testingStart).count() << " ms." << std::endl;
@@ -29,8 +45,12 @@ int main(int argc, char* argv[])
   std::string dataSet;
   std::vector<std::string> files;
   std::string outputFile;
+  std::string exportFile;
   bool dry = false;
   bool test = false;
+  bool channelBlocked = false;
+  bool builtInGemm = false;
+  bool int8 = false;
 
   try
   {
@@ -44,7 +64,15 @@ int main(int argc, char* argv[])
 	  {
 		std::string arg = argv[ai];
 		StringUtils::ToLower(arg);
-		if (arg == "-dataset")
+		if (arg == "-builtingemm")
+		{
+		  builtInGemm = true;
+		}
+		else if (arg == "-channelblocked")
+		{
+		  channelBlocked = true;
+		}
+		else if (arg == "-dataset")
 		{
 		  if (++ai == argc)
 			throw std::runtime_error("-dataset must be followed by the data set name.");
@@ -55,6 +83,16 @@ int main(int argc, char* argv[])
 		{
 		  dry = true;
 		}
+		else if (arg == "-exportcpp")
+		{
+		  if (++ai == argc)
+			throw std::runtime_error("-exportcpp must be followed by a file name.");
+		  exportFile = argv[ai];
+		}
+		else if (arg == "-int8")
+		{
+		  int8 = true;
+		}
 		else if (arg == "-output")
 		{
 		  if (++ai == argc)
@@ -86,6 +124,20 @@ int main(int argc, char* argv[])
 	return 1;
   }
 
+  if (!exportFile.empty())
+  {
+	if (test || dry)
+	{
+	  std::cerr << "-exportcpp cannot be used with -test or -dry" << std::endl;
+	  return 1;
+	}
+	if (files.size() != 1)
+	{
+	  std::cerr << "-exportcpp needs exactly one network file." << std::endl;
+	  return 1;
+	}
+  }
+
   if (test)
   {
 	if (dry)
@@ -106,6 +158,16 @@ int main(int argc, char* argv[])
 	  std::cerr << "-output can only be used with -test" << std::endl;
 	  return 1;
 	}
+	if (channelBlocked)
+	{
+	  std::cerr << "-channelblocked can only be used with -test" << std::endl;
+	  return 1;
+	}
+	if (int8)
+	{
+	  std::cerr << "-int8 can only be used with -test" << std::endl;
+	  return 1;
+	}
   }
 
   if (files.empty())
@@ -118,6 +180,21 @@ int main(int argc, char* argv[])
   try
   {
 	logAdaptor.reset(new LogFileAdaptor(Utils::GetEnv("FISHNET_LOG_DIR"), "Classifier"));
+	if (builtInGemm)
+	  UseExternalBlas(false);
+	LOG(Info) << "Matrix products use " << (UseExternalBlas() ? "the external BLAS library." : "FishNet's built in kernels.");
+	// Start the worker threads once, and have every network that is tested or trained share them.
+	ThreadPool::Shared(threadCount);
+	if (!exportFile.empty())
+	{
+	  std::unique_ptr<FeedForwardNetwork> network = FeedForwardNetwork::Load(files[0], threadCount);
+	  std::ofstream ofs(exportFile.c_str(), std::ofstream::trunc);
+	  if (!ofs.good())
+		throw std::runtime_error("Failed to open file " + exportFile + " for writing.");
+	  CppGenerator::Generate(*network, network->Name(), ofs);
+	  LOG(Info) << "Saved " << files[0] << " as C++ to " << exportFile;
+	  return 0;
+	}
 	ImageSetLoader imageSetLoader(dry);
 	if (test)
 	{
@@ -140,7 +217,8 @@ int main(int argc, char* argv[])
 	  for (const std::string& file : files)
 	  {
 		std::unique_ptr<FeedForwardNetwork> network = FeedForwardNetwork::Load(file, threadCount);
-		TestNetwork(*network, imageSet, os);
+		network->ChannelBlocked(channelBlocked);
+		TestNetwork(*network, imageSet, os, int8);
 		os << std::endl;
 	  }
 	}
@@ -52,11 +52,11 @@ void LoadMNISTData(ImageSet& imageSet, const std::string& imageFilename, const s
   unsigned char* data = imageBuffer.get();
   for (uint32_t i = 0; i < imageCount; ++i)
   {
-	auto vectorData = std::make_unique<double[]>(28 * 28);
+	auto vectorData = std::make_unique<Real[]>(28 * 28);
 	for (uint32_t j = 0; j < 28 * 28; ++j)
 	{
-	  // Convert the pixel value into a double ranging from 0 to 1.
-	  vectorData[j] = double(*data) / 255.0;
+	  // Convert the pixel value into a number ranging from 0 to 1.
+	  vectorData[j] = Real(*data / 255.0);
 	  ++data;
 	}
 
@@ -32,7 +32,7 @@ Image& LoadPGMImage(const std::string& fileName, uint32_t label)
   }
   int pixelBytes(maxVal < 256.0 ? 1 : 2);
   uint32_t pixelCount = width * height;
-  auto vectorData = std::make_unique<double[]>(pixelCount);
+  auto vectorData = std::make_unique<Real[]>(pixelCount);
   if (magic == "P5")
   {
 	// Skip 1 byte of whitespace.
@@ -47,7 +47,7 @@ Image& LoadPGMImage(const std::string& fileName, uint32_t label)
 	{
 	  for (uint32_t i = 0; i < pixelCount; ++i)
 	  {
-		vectorData[i] = double(*data) / maxVal;
+		vectorData[i] = Real(*data / maxVal);
 		++data;
 	  }
 	}
@@ -60,7 +60,7 @@ Image& LoadPGMImage(const std::string& fileName, uint32_t label)
 		pixel <<= 8;
 		pixel |= *data;
 		++data;
-		vectorData[i] = double(pixel) / maxVal;
+		vectorData[i] = Real(pixel / maxVal);
 	  }
 	}
   }
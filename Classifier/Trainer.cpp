@@ -26,6 +26,12 @@ std::ostream& operator<<(std::ostream& os, const Job& job)
   }
   if (job.Network().WeightDecay() != 0.0)
 	os << "Weight  decay: " << job.Network().WeightDecay() << std::endl;
+  if (job.Network().MixedPrecision())
+	os << "Mixed precision: activations and derivatives are kept as bfloat16." << std::endl;
+  if (job.Network().WeightUpdateMode() != FeedForwardNetwork::WeightUpdateModes::Synchronous)
+	os << "Weight updates: " << FeedForwardNetwork::WeightUpdateModeName(job.Network().WeightUpdateMode()) << std::endl;
+  if (job.Network().WeightUpdateMode() == FeedForwardNetwork::WeightUpdateModes::LocalSgd)
+	os << "Averaging interval: " << job.Network().AveragingInterval() << " minibatches" << std::endl;
   if (!job.Network().Name().empty())
 	os << "Network name: " << job.Network().Name() << std::endl;
   os << "Network architecture:" << std::endl << job.Network();
@@ -60,6 +66,9 @@ void Trainer::LoadJobList(const std::string& fileName)
   double learningRateDecay = 0.0;
   double learningRateDecayPoint = 0.0;
   double weightDecay = 0.0;
+  bool mixedPrecision = false;
+  FeedForwardNetwork::WeightUpdateModes weightUpdateMode = FeedForwardNetwork::WeightUpdateModes::Synchronous;
+  uint32_t averagingInterval = 8;
 
   const ImageSet* imageSet = nullptr;
 
@@ -79,7 +88,15 @@ void Trainer::LoadJobList(const std::string& fileName)
 		continue;
 	  std::string& first = fields.front();
 	  StringUtils::ToLower(first);
-	  if (first == "dataset")
+	  if (first == "averaging interval")
+	  {
+		if (fields.size() < 2 || fields[1].empty())
+		  throw std::runtime_error("Averaging interval is missing.");
+		averagingInterval = std::stoi(fields[1]);
+		if (averagingInterval < 1)
+		  throw std::runtime_error("Averaging interval must be at least 1.");
+	  }
+	  else if (first == "dataset")
 	  {
 		if (fields.size() < 2 || fields[1].empty())
 		  throw std::runtime_error("Dataset name is missing.");
@@ -143,8 +160,12 @@ void Trainer::LoadJobList(const std::string& fileName)
 		if (epochs == 0)
 		  throw std::runtime_error("Epochs has not been specified.");
 		std::string name = fields.size() >= 2 && !fields[1].empty() ? fields[1] : imageSet->Name();
-		_jobs.emplace_back(std::make_unique<Job>(*imageSet, LoadNetwork(name, is, lineNo, *imageSet, learningRate, weightDecay),
-		  epochs, giveUpAfter, miniBatchSize, learningRateDecay, learningRateDecayPoint));
+		auto network = LoadNetwork(name, is, lineNo, *imageSet, learningRate, weightDecay);
+		network->MixedPrecision(mixedPrecision);
+		network->WeightUpdateMode(weightUpdateMode);
+		network->AveragingInterval(averagingInterval);
+		_jobs.emplace_back(std::make_unique<Job>(*imageSet, std::move(network), epochs, giveUpAfter, miniBatchSize,
+		  learningRateDecay, learningRateDecayPoint));
 	  }
 	  else if (first == "network file")
 	  {
@@ -163,9 +184,26 @@ void Trainer::LoadJobList(const std::string& fileName)
 		  network->WeightDecay(weightDecay);
 		if (network->Name().empty())
 		  network->Name(imageSet->Name());
+		network->MixedPrecision(mixedPrecision);
+		network->WeightUpdateMode(weightUpdateMode);
+		network->AveragingInterval(averagingInterval);
 		_jobs.emplace_back(std::make_unique<Job>(*imageSet, std::move(network), epochs,
 		  giveUpAfter, miniBatchSize, learningRateDecay, learningRateDecayPoint));
 	  }
+	  else if (first == "precision")
+	  {
+		// The element type is chosen when FishNet is built, so a job can only check that it is running on the right build.
+		// Mixed precision trains in either build, keeping the activations and derivatives as bfloat16.
+		if (fields.size() < 2 || fields[1].empty())
+		  throw std::runtime_error("Precision is missing.");
+		StringUtils::ToLower(fields[1]);
+		if (fields[1] != "single" && fields[1] != "double" && fields[1] != "mixed")
+		  throw std::runtime_error("Precision must be single, double or mixed.");
+		mixedPrecision = fields[1] == "mixed";
+		bool single = fields[1] == "single";
+		if (!mixedPrecision && single != (sizeof(Real) == sizeof(float)))
+		  throw std::runtime_error("This job needs a " + fields[1] + " precision build. Build FishNet with make Precision=" + fields[1] + ".");
+	  }
 	  else if (first == "weight decay")
 	  {
 		if (fields.size() < 2 || fields[1].empty())
@@ -174,6 +212,27 @@ void Trainer::LoadJobList(const std::string& fileName)
 		if (weightDecay > 1.0 || weightDecay <= 0.0)
 		  throw std::runtime_error("Weight decay must be greater than or equal to 0 and less than 1.");
 	  }
+	  else if (first == "weight updates")
+	  {
+		if (fields.size() < 2 || fields[1].empty())
+		  throw std::runtime_error("Weight update mode is missing.");
+		StringUtils::ToLower(fields[1]);
+		std::string modeNames;
+		bool found = false;
+		for (auto mode : FeedForwardNetwork::AllWeightUpdateModes())
+		{
+		  std::string name = FeedForwardNetwork::WeightUpdateModeName(mode);
+		  StringUtils::ToLower(name);
+		  if (fields[1] == name)
+		  {
+			weightUpdateMode = mode;
+			found = true;
+		  }
+		  modeNames += (modeNames.empty() ? "" : ", ") + name;
+		}
+		if (!found)
+		  throw std::runtime_error("Weight updates must be one of " + modeNames + ".");
+	  }
 	  else if (!first.empty())
 	  {
 		throw std::runtime_error("Invalid parameter: " + first);
@@ -33,5 +33,9 @@
 #include <Utils.h>
 #include <StringUtils.h>
 #include <CostFunction.h>
+#include <CppGenerator.h>
 #include <FeedForwardNetwork.h>
+#include <Gemm.h>
 #include <Layer.h>
+#include <QuantizedNetwork.h>
+#include <ThreadPool.h>
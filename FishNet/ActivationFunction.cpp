@@ -33,8 +33,8 @@ std::unique_ptr<ActivationFunction> ActivationFunction::Load(std::ifstream& is)
 
 void ReLU::Apply(Tensor& tensor) const noexcept
 {
-  double* v = tensor.Elements();
-  const double* end = v + tensor.Size();
+  Real* v = tensor.Elements();
+  const Real* end = v + tensor.Size();
   while (v < end)
   {
 	if (*v < 0.0)
@@ -49,9 +49,9 @@ void ReLU::ApplyDerivative(Tensor& input, Tensor& output) const
   if (input.Size() != output.Size())
 	throw std::runtime_error("Parameters to ApplyDerivative must be the same size.");
 #endif
-  const double* in = input.Elements();
-  double* out = output.Elements();
-  const double* end = in + input.Size();
+  const Real* in = input.Elements();
+  Real* out = output.Elements();
+  const Real* end = in + input.Size();
   while (in < end)
   {
 	if (*in <= 0.0)
@@ -65,8 +65,8 @@ void ReLU::ApplyDerivative(Tensor& input, Tensor& output) const
 
 void LeakyReLU::Apply(Tensor& tensor) const noexcept
 {
-  double* v = tensor.Elements();
-  const double* end = v + tensor.Size();
+  Real* v = tensor.Elements();
+  const Real* end = v + tensor.Size();
   while (v < end)
   {
 	if (*v < 0.0)
@@ -81,9 +81,9 @@ void LeakyReLU::ApplyDerivative(Tensor& input, Tensor& output) const
   if (input.Size() != output.Size())
 	throw std::runtime_error("Parameters to ApplyDerivative must be the same size.");
 #endif
-  const double* in = input.Elements();
-  double* out = output.Elements();
-  const double* end = in + input.Size();
+  const Real* in = input.Elements();
+  Real* out = output.Elements();
+  const Real* end = in + input.Size();
   while (in < end)
   {
 	if (*in <= 0.0)
@@ -103,8 +103,8 @@ void LeakyReLU::Save(std::ofstream& os) const
 
 void Sigmoid::Apply(Tensor& tensor) const noexcept
 {
-  double* v = tensor.Elements();
-  const double* end = v + tensor.Size();
+  Real* v = tensor.Elements();
+  const Real* end = v + tensor.Size();
   while (v < end)
   {
 	*v = 1.0 / (1.0 + exp(-(*v)));
@@ -118,12 +118,12 @@ void Sigmoid::ApplyDerivative(Tensor& input, Tensor& output) const
   if (input.Size() != output.Size())
 	throw std::runtime_error("Parameters to ApplyDerivative must be the same size.");
 #endif
-  const double* in = input.Elements();
-  double* out = output.Elements();
-  const double* end = in + input.Size();
+  const Real* in = input.Elements();
+  Real* out = output.Elements();
+  const Real* end = in + input.Size();
   while (in < end)
   {
-	double sig = 1.0 / (1.0 + exp(-(*in)));
+	Real sig = 1.0 / (1.0 + exp(-(*in)));
 	*out = sig * (1.0 - sig);
 	++in;
 	++out;
@@ -132,8 +132,8 @@ void Sigmoid::ApplyDerivative(Tensor& input, Tensor& output) const
 
 void TanH::Apply(Tensor& tensor) const noexcept
 {
-  double* v = tensor.Elements();
-  const double* end = v + tensor.Size();
+  Real* v = tensor.Elements();
+  const Real* end = v + tensor.Size();
   while (v < end)
   {
 	*v = 2.0 / (1.0 + exp(-2.0 * *v)) - 1.0;
@@ -147,12 +147,12 @@ void TanH::ApplyDerivative(Tensor& input, Tensor& output) const
   if (input.Size() != output.Size())
 	throw std::runtime_error("Parameters to ApplyDerivative must be the same size.");
 #endif
-  const double* in = input.Elements();
-  double* out = output.Elements();
-  const double* end = in + input.Size();
+  const Real* in = input.Elements();
+  Real* out = output.Elements();
+  const Real* end = in + input.Size();
   while (in < end)
   {
-	double tanh = 2.0 / (1.0 + exp(-2.0 * *in)) - 1.0;
+	Real tanh = 2.0 / (1.0 + exp(-2.0 * *in)) - 1.0;
 	*out = 1.0 - (tanh * tanh);
 	++in;
 	++out;
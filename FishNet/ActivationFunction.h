@@ -13,6 +13,7 @@ public:
   virtual std::string Description() const = 0;
   virtual void Apply(Tensor&) const noexcept = 0;
   virtual void ApplyDerivative(Tensor& input, Tensor& output) const = 0;
+  virtual std::unique_ptr<ActivationFunction> Clone() const = 0;
   virtual void Save(std::ofstream&) const;
   static std::unique_ptr<ActivationFunction> Load(std::ifstream&);
 };
@@ -25,6 +26,7 @@ public:
   virtual std::string Description() const noexcept override { return "ReLU"; }
   virtual void Apply(Tensor&) const noexcept override;
   virtual void ApplyDerivative(Tensor& input, Tensor& output) const override;
+  virtual std::unique_ptr<ActivationFunction> Clone() const override { return std::make_unique<ReLU>(); }
 };
 
 class LeakyReLU : public ActivationFunction
@@ -41,6 +43,7 @@ public:
   double Leakiness() const noexcept { return _leakiness; }
   virtual void Apply(Tensor&) const noexcept override;
   virtual void ApplyDerivative(Tensor& input, Tensor& output) const override;
+  virtual std::unique_ptr<ActivationFunction> Clone() const override { return std::make_unique<LeakyReLU>(_leakiness); }
   virtual void Save(std::ofstream&) const override;
 private:
   double _leakiness;
@@ -54,6 +57,7 @@ public:
   virtual std::string Description() const override { return "Sigmoid"; }
   virtual void Apply(Tensor&) const noexcept override;
   virtual void ApplyDerivative(Tensor& input, Tensor& output) const override;
+  virtual std::unique_ptr<ActivationFunction> Clone() const override { return std::make_unique<Sigmoid>(); }
 };
 
 class TanH : public ActivationFunction
@@ -64,4 +68,5 @@ public:
   virtual std::string Description() const override { return "TanH"; }
   virtual void Apply(Tensor&) const noexcept override;
   virtual void ApplyDerivative(Tensor& input, Tensor& output) const override;
+  virtual std::unique_ptr<ActivationFunction> Clone() const override { return std::make_unique<TanH>(); }
 };
\ No newline at end of file
@@ -0,0 +1,70 @@
+#include "stdafx.h"
+#include "BFloat16Tensor.h"
+
+namespace
+{
+
+inline uint16_t ToBFloat16(Real value)
+{
+  float f = static_cast<float>(value);
+  uint32_t bits;
+  memcpy(&bits, &f, sizeof(bits));
+  // Round to nearest, with ties going to the value whose last bit is even. A NaN must stay a NaN rather than being
+  // rounded up into an infinity, so it just has its low bits cut off and the quiet bit set.
+  if ((bits & 0x7fffffff) > 0x7f800000)
+	return static_cast<uint16_t>((bits >> 16) | 0x40);
+  bits += 0x7fff + ((bits >> 16) & 1);
+  return static_cast<uint16_t>(bits >> 16);
+}
+
+inline Real FromBFloat16(uint16_t value)
+{
+  uint32_t bits = static_cast<uint32_t>(value) << 16;
+  float f;
+  memcpy(&f, &bits, sizeof(f));
+  return f;
+}
+
+}
+
+BFloat16Tensor::BFloat16Tensor(uint32_t hyperplanes, uint32_t planes, uint32_t rows, uint32_t columns)
+  : _elements(std::make_unique<uint16_t[]>(hyperplanes * planes * rows * columns)),
+	_size(hyperplanes * planes * rows * columns)
+{
+}
+
+void BFloat16Tensor::Pack(const Tensor& t)
+{
+#ifdef _DEBUG
+  if (t.Size() != _size)
+	throw std::runtime_error("BFloat16Tensor::Pack - tensor is the wrong size.");
+#endif
+  const Real* in = t.Elements();
+  uint16_t* out = _elements.get();
+  for (uint32_t i = 0; i < _size; ++i)
+	out[i] = ToBFloat16(in[i]);
+}
+
+void BFloat16Tensor::Unpack(Tensor& t) const
+{
+#ifdef _DEBUG
+  if (t.Size() != _size)
+	throw std::runtime_error("BFloat16Tensor::Unpack - tensor is the wrong size.");
+#endif
+  const uint16_t* in = _elements.get();
+  Real* out = t.Elements();
+  for (uint32_t i = 0; i < _size; ++i)
+	out[i] = FromBFloat16(in[i]);
+}
+
+void BFloat16Tensor::MultiplyInto(Tensor& t) const
+{
+#ifdef _DEBUG
+  if (t.Size() != _size)
+	throw std::runtime_error("BFloat16Tensor::MultiplyInto - tensor is the wrong size.");
+#endif
+  const uint16_t* in = _elements.get();
+  Real* out = t.Elements();
+  for (uint32_t i = 0; i < _size; ++i)
+	out[i] *= FromBFloat16(in[i]);
+}
@@ -0,0 +1,23 @@
+#pragma once
+
+#include "Tensor.h"
+
+// A tensor whose elements are stored as bfloat16, which is the top half of a float. It has the range of a float but
+// only 8 bits of precision, which is enough for the activations and derivatives that training keeps between the
+// forward and backward passes, in half the space of a float. The arithmetic is always done on ordinary Tensors.
+class BFloat16Tensor
+{
+public:
+  BFloat16Tensor(uint32_t hyperplanes, uint32_t planes, uint32_t rows, uint32_t columns);
+  // Stores the elements of a tensor with the same number of elements, rounding each one to the nearest bfloat16.
+  void Pack(const Tensor&);
+  void Unpack(Tensor&) const;
+  // Multiplies each element of the tensor by the matching element of this one.
+  void MultiplyInto(Tensor&) const;
+  uint32_t Size() const { return _size; }
+private:
+  std::unique_ptr<uint16_t[]> _elements;
+  uint32_t _size;
+};
+
+using BFloat16TensorPtr = std::unique_ptr<BFloat16Tensor>;
@@ -0,0 +1,222 @@
+#include "stdafx.h"
+#include "ConvolutionKernels.h"
+#include "Tensor.h"
+
+namespace
+{
+
+// Calculates columnBlock adjacent outputs of filterBlock filters. The sums are kept in registers, and every input
+// value that is loaded is used by all the filters in the block. input points to the top left input of the first output.
+// A filterSize or stride of 0 means that it is only known at run time.
+template <uint32_t filterSize, uint32_t stride, uint32_t filterBlock, uint32_t columnBlock>
+inline void ConvolveTile(const DirectConvolution& shape, const Real* input, const Real* weights, const Real* biases,
+  Real* output)
+{
+  const uint32_t size = filterSize ? filterSize : shape.filterSize;
+  const uint32_t step = stride ? stride : shape.stride;
+  size_t inputPlaneSize = shape.inputRows * shape.inputColumns;
+  uint32_t filterArea = size * size;
+  size_t filterWeightSize = shape.inputChannelCount * filterArea;
+  size_t outputPlaneSize = shape.outputRows * shape.outputColumns;
+  Real sums[filterBlock][columnBlock];
+  for (uint32_t i = 0; i < filterBlock; ++i)
+  {
+	for (uint32_t j = 0; j < columnBlock; ++j)
+	  sums[i][j] = biases[i];
+  }
+  for (uint32_t inputChannel = 0; inputChannel < shape.inputChannelCount; ++inputChannel)
+  {
+	const Real* channelWeights = weights + (inputChannel * filterArea);
+	const Real* in = input + (inputChannel * inputPlaneSize);
+	for (uint32_t filterRow = 0; filterRow < size; ++filterRow)
+	{
+	  for (uint32_t filterCol = 0; filterCol < size; ++filterCol)
+	  {
+		Real weight[filterBlock];
+		for (uint32_t i = 0; i < filterBlock; ++i)
+		  weight[i] = channelWeights[(i * filterWeightSize) + filterCol];
+		for (uint32_t j = 0; j < columnBlock; ++j)
+		{
+		  Real value = in[(j * step) + filterCol];
+		  for (uint32_t i = 0; i < filterBlock; ++i)
+			sums[i][j] += weight[i] * value;
+		}
+	  }
+	  channelWeights += size;
+	  in += shape.inputColumns;
+	}
+  }
+  for (uint32_t i = 0; i < filterBlock; ++i)
+  {
+	for (uint32_t j = 0; j < columnBlock; ++j)
+	  output[(i * outputPlaneSize) + j] = sums[i][j];
+  }
+}
+
+template <uint32_t filterSize, uint32_t stride, uint32_t filterBlock>
+void ConvolveRows(const DirectConvolution& shape, const Real* input, const Real* weights, const Real* biases, Real* output,
+  uint32_t firstRow, uint32_t endRow)
+{
+  const uint32_t columnBlock = 8;
+  const uint32_t step = stride ? stride : shape.stride;
+  for (uint32_t row = firstRow; row < endRow; ++row)
+  {
+	const Real* inputRow = input + (row * step * shape.inputColumns);
+	Real* outputRow = output + (row * shape.outputColumns);
+	uint32_t col = 0;
+	for (; col + columnBlock <= shape.outputColumns; col += columnBlock)
+	  ConvolveTile<filterSize, stride, filterBlock, columnBlock>(shape, inputRow + (col * step), weights, biases, outputRow + col);
+	for (; col < shape.outputColumns; ++col)
+	  ConvolveTile<filterSize, stride, filterBlock, 1>(shape, inputRow + (col * step), weights, biases, outputRow + col);
+  }
+}
+
+// Works through the output in bands of rows, doing every filter for one band before moving on to the next. The
+// rows of input that a band reads are small enough to stay in the L2 cache while each block of filters passes over them.
+template <uint32_t filterSize, uint32_t stride>
+void ConvolveDirect(const DirectConvolution& shape, uint32_t filterCount, const Real* input, const Real* weights,
+  const Real* biases, Real* output)
+{
+  const size_t cacheSize = 128 * 1024;
+  // Once the loops over a 5x5 filter are unrolled, a tile of 4 filters needs more registers than there are.
+  const uint32_t filterBlock = filterSize == 5 ? 2 : 4;
+  size_t bandRowSize = sizeof(Real) * shape.inputChannelCount * shape.inputColumns * shape.stride;
+  uint32_t bandRows = static_cast<uint32_t>(std::max<size_t>(1, cacheSize / bandRowSize));
+  size_t filterWeightSize = shape.inputChannelCount * shape.filterSize * shape.filterSize;
+  size_t outputPlaneSize = shape.outputRows * shape.outputColumns;
+  for (uint32_t firstRow = 0; firstRow < shape.outputRows; firstRow += bandRows)
+  {
+	uint32_t endRow = std::min(firstRow + bandRows, shape.outputRows);
+	uint32_t filter = 0;
+	for (; filter + filterBlock <= filterCount; filter += filterBlock)
+	{
+	  ConvolveRows<filterSize, stride, filterBlock>(shape, input, weights + (filter * filterWeightSize), biases + filter,
+		output + (filter * outputPlaneSize), firstRow, endRow);
+	}
+	const Real* remainingWeights = weights + (filter * filterWeightSize);
+	Real* remainingOutput = output + (filter * outputPlaneSize);
+	switch (filterCount - filter)
+	{
+	  case 3:
+		ConvolveRows<filterSize, stride, 3>(shape, input, remainingWeights, biases + filter, remainingOutput, firstRow, endRow);
+		break;
+	  case 2:
+		ConvolveRows<filterSize, stride, 2>(shape, input, remainingWeights, biases + filter, remainingOutput, firstRow, endRow);
+		break;
+	  case 1:
+		ConvolveRows<filterSize, stride, 1>(shape, input, remainingWeights, biases + filter, remainingOutput, firstRow, endRow);
+		break;
+	}
+  }
+}
+
+// Calculates a block of filters for columnBlock adjacent outputs of a channel blocked convolution. Each input value
+// is multiplied by the contiguous weights of all the filters in the block, so the inner loop works on whole blocks.
+template <uint32_t filterSize, uint32_t columnBlock>
+inline void ConvolveChannelBlockedTile(const DirectConvolution& shape, const Real* input, const Real* weights,
+  const Real* biases, Real* output)
+{
+  const uint32_t blockSize = Tensor::ChannelBlockSize;
+  const uint32_t size = filterSize ? filterSize : shape.filterSize;
+  uint32_t inputBlocks = Tensor::ChannelBlocks(shape.inputChannelCount);
+  size_t inputBlockSize = size_t(shape.inputRows) * shape.inputColumns * blockSize;
+  size_t inputRowSize = shape.inputColumns * blockSize;
+  Real sums[columnBlock][blockSize];
+  for (uint32_t j = 0; j < columnBlock; ++j)
+  {
+	for (uint32_t k = 0; k < blockSize; ++k)
+	  sums[j][k] = biases[k];
+  }
+  for (uint32_t inputBlock = 0; inputBlock < inputBlocks; ++inputBlock)
+  {
+	const Real* in = input + (inputBlock * inputBlockSize);
+	for (uint32_t filterRow = 0; filterRow < size; ++filterRow)
+	{
+	  for (uint32_t filterCol = 0; filterCol < size; ++filterCol)
+	  {
+		const Real* values = in + (filterCol * blockSize);
+		for (uint32_t inputChannel = 0; inputChannel < blockSize; ++inputChannel)
+		{
+		  for (uint32_t j = 0; j < columnBlock; ++j)
+		  {
+			Real value = values[(j * shape.stride * blockSize) + inputChannel];
+			for (uint32_t k = 0; k < blockSize; ++k)
+			  sums[j][k] += value * weights[k];
+		  }
+		  weights += blockSize;
+		}
+	  }
+	  in += inputRowSize;
+	}
+  }
+  for (uint32_t j = 0; j < columnBlock; ++j)
+  {
+	for (uint32_t k = 0; k < blockSize; ++k)
+	  output[(j * blockSize) + k] = sums[j][k];
+  }
+}
+
+template <uint32_t filterSize>
+void ConvolveChannelBlockedPlanes(const DirectConvolution& shape, uint32_t filterCount, const Real* input,
+  const Real* weights, const Real* biases, Real* output)
+{
+  const uint32_t blockSize = Tensor::ChannelBlockSize;
+  const uint32_t columnBlock = 4;
+  size_t blockWeightSize = size_t(Tensor::ChannelBlocks(shape.inputChannelCount)) * shape.filterSize * shape.filterSize *
+	blockSize * blockSize;
+  size_t inputRowSize = shape.inputColumns * blockSize;
+  for (uint32_t filterBlock = 0; filterBlock < Tensor::ChannelBlocks(filterCount); ++filterBlock)
+  {
+	for (uint32_t row = 0; row < shape.outputRows; ++row)
+	{
+	  const Real* inputRow = input + (row * shape.stride * inputRowSize);
+	  uint32_t col = 0;
+	  for (; col + columnBlock <= shape.outputColumns; col += columnBlock)
+	  {
+		ConvolveChannelBlockedTile<filterSize, columnBlock>(shape, inputRow + (col * shape.stride * blockSize), weights, biases,
+		  output + (col * blockSize));
+	  }
+	  for (; col < shape.outputColumns; ++col)
+		ConvolveChannelBlockedTile<filterSize, 1>(shape, inputRow + (col * shape.stride * blockSize), weights, biases, output + (col * blockSize));
+	  output += shape.outputColumns * blockSize;
+	}
+	weights += blockWeightSize;
+	biases += blockSize;
+  }
+}
+
+// Kernels for the filter sizes and strides that the job files use, indexed by (filterSize - 1) / 2 and stride - 1.
+const DirectConvolutionKernel specializedKernels[3][2] =
+{
+  { ConvolveDirect<1, 1>, ConvolveDirect<1, 2> },
+  { ConvolveDirect<3, 1>, ConvolveDirect<3, 2> },
+  { ConvolveDirect<5, 1>, ConvolveDirect<5, 2> }
+};
+
+}
+
+DirectConvolutionKernel GetDirectConvolutionKernel(uint32_t filterSize, uint32_t stride)
+{
+  if ((filterSize == 1 || filterSize == 3 || filterSize == 5) && (stride == 1 || stride == 2))
+	return specializedKernels[(filterSize - 1) / 2][stride - 1];
+  return ConvolveDirect<0, 0>;
+}
+
+void ConvolveChannelBlocked(const DirectConvolution& shape, uint32_t filterCount, const Real* input, const Real* weights,
+  const Real* biases, Real* output)
+{
+  switch (shape.filterSize)
+  {
+	case 1:
+	  ConvolveChannelBlockedPlanes<1>(shape, filterCount, input, weights, biases, output);
+	  break;
+	case 3:
+	  ConvolveChannelBlockedPlanes<3>(shape, filterCount, input, weights, biases, output);
+	  break;
+	case 5:
+	  ConvolveChannelBlockedPlanes<5>(shape, filterCount, input, weights, biases, output);
+	  break;
+	default:
+	  ConvolveChannelBlockedPlanes<0>(shape, filterCount, input, weights, biases, output);
+  }
+}
@@ -0,0 +1,30 @@
+#pragma once
+
+#include "Tensor.h"
+
+// The dimensions of a direct convolution over an input that needs no padding.
+struct DirectConvolution
+{
+  uint32_t inputChannelCount;
+  uint32_t inputRows;
+  uint32_t inputColumns;
+  uint32_t filterSize;
+  uint32_t stride;
+  uint32_t outputRows;
+  uint32_t outputColumns;
+};
+
+// Convolves the input planes with filterCount filters, each with a bias, writing one output plane per filter.
+typedef void (*DirectConvolutionKernel)(const DirectConvolution&, uint32_t filterCount, const Real* input,
+  const Real* weights, const Real* biases, Real* output);
+
+// Returns a kernel compiled for the given filter size and stride, so that the loops over the filter can be unrolled.
+// Other sizes and strides get a kernel which reads them from the DirectConvolution at run time.
+DirectConvolutionKernel GetDirectConvolutionKernel(uint32_t filterSize, uint32_t stride);
+
+// Convolves an input in the channel blocked layout (see Tensor::ToChannelBlocked) and writes a channel blocked output.
+// The weights for each block of filters are ordered by input channel block, filter row, filter column, input channel
+// and then filter, so that the weights of a whole block of filters for one input value are contiguous. There must be a
+// bias for every filter in the last block, including the ones that only pad it out.
+void ConvolveChannelBlocked(const DirectConvolution&, uint32_t filterCount, const Real* input, const Real* weights,
+  const Real* biases, Real* output);
@@ -0,0 +1,167 @@
+#include "stdafx.h"
+#include "ConvolutionTuner.h"
+#include <StringUtils.h>
+
+std::mutex ConvolutionTuner::_mutex;
+std::map<std::string, ConvolutionTuner::Cache> ConvolutionTuner::_caches;
+
+bool ConvolutionTuner::Shape::operator<(const Shape& other) const
+{
+  return std::tie(inputChannelCount, inputRows, inputColumns, filterCount, filterSize, stride, zeroPadding) <
+	std::tie(other.inputChannelCount, other.inputRows, other.inputColumns, other.filterCount, other.filterSize, other.stride,
+	  other.zeroPadding);
+}
+
+void ConvolutionTuner::Tune(ConvolutionalLayer& layer)
+{
+  std::string fileName;
+  try
+  {
+	fileName = CacheFileName();
+  }
+  catch (const std::exception&)
+  {
+  }
+  Tune(layer, fileName);
+}
+
+void ConvolutionTuner::Tune(ConvolutionalLayer& layer, const std::string& cacheFileName)
+{
+  Shape shape = LayerShape(layer);
+  std::unique_lock<std::mutex> lock(_mutex);
+  auto loaded = _caches.find(cacheFileName);
+  if (loaded == _caches.end())
+	loaded = _caches.emplace(cacheFileName, LoadCache(cacheFileName)).first;
+  Cache& cache = loaded->second;
+  auto cached = cache.find(shape);
+  if (cached != cache.end() && layer.SupportsAlgorithm(cached->second))
+  {
+	layer.Algorithm(cached->second);
+	return;
+  }
+  ConvolutionalLayer::Algorithms algorithm = FastestAlgorithm(shape);
+  cache[shape] = algorithm;
+  SaveToCache(cacheFileName, shape, algorithm);
+  layer.Algorithm(algorithm);
+}
+
+std::string ConvolutionTuner::CacheFileName()
+{
+  std::string saveDir = Utils::GetEnv("FISHNET_SAVE_DIR");
+  if (saveDir.empty())
+	throw std::runtime_error("FISHNET_SAVE_DIR is empty.");
+  if (saveDir.back() != PATH_SEPARATOR)
+	saveDir += PATH_SEPARATOR;
+  // The timings depend on how FishNet was built, so each build with a different element type, vector instructions or
+  // matrix library keeps its own file.
+  std::string build = sizeof(Real) == sizeof(float) ? "single" : "double";
+#if defined(__AVX512F__)
+  build += "-avx512";
+#elif defined(__AVX2__)
+  build += "-avx2";
+#elif defined(__AVX__)
+  build += "-avx";
+#endif
+#ifdef FISHNET_BLAS
+  build += "-blas";
+#endif
+  return saveDir + "ConvolutionTuning-" + build + ".txt";
+}
+
+ConvolutionTuner::Shape ConvolutionTuner::LayerShape(const ConvolutionalLayer& layer)
+{
+  return Shape { layer.InputChannelCount(), layer.InputRows(), layer.InputColumns(), layer.OutputPlanes(), layer.FilterSize(),
+	layer.Stride(), layer.ZeroPadding() };
+}
+
+// Times a feed forward pass and both backpropagation passes, since they are all done for every training example.
+// Each algorithm is run once before it is timed so that the scratch buffers are already allocated, and the best
+// of a few runs is taken so that the choice isn't thrown off by other work on the machine.
+ConvolutionalLayer::Algorithms ConvolutionTuner::FastestAlgorithm(const Shape& shape)
+{
+  ConvolutionalLayer layer(shape.inputChannelCount, shape.inputRows, shape.inputColumns, shape.filterCount, shape.filterSize,
+	shape.stride, shape.zeroPadding, nullptr);
+  layer.InitializeWeights();
+  Tensor input(shape.inputChannelCount, shape.inputRows, shape.inputColumns);
+  Randomizer(1.0).Fill(input);
+  Tensor output(layer.OutputPlanes(), layer.OutputRows(), layer.OutputColumns());
+  Tensor delta(layer.OutputPlanes(), layer.OutputRows(), layer.OutputColumns());
+  Randomizer(1.0).Fill(delta);
+  Tensor error(shape.inputChannelCount, shape.inputRows, shape.inputColumns);
+  Tensor nablaW(layer.Weights());
+  Tensor nablaB(layer.Biases());
+
+  const int runs = 3;
+  ConvolutionalLayer::Algorithms fastest = layer.Algorithm();
+  auto fastestTime = std::chrono::steady_clock::duration::max();
+  std::stringstream timings;
+  for (auto algorithm : ConvolutionalLayer::AllAlgorithms())
+  {
+	if (!layer.SupportsAlgorithm(algorithm))
+	  continue;
+	layer.Algorithm(algorithm);
+	auto bestTime = std::chrono::steady_clock::duration::max();
+	for (int run = 0; run <= runs; ++run)
+	{
+	  auto start = std::chrono::steady_clock::now();
+	  layer.FeedForward(input, output, nullptr);
+	  layer.BackpropagateError(delta, error, nullptr);
+	  layer.UpdateWeightAndBiasErrors(delta, input, nablaW, nablaB, nullptr);
+	  auto time = std::chrono::steady_clock::now() - start;
+	  if (run > 0)
+		bestTime = std::min(bestTime, time);
+	}
+	timings << ' ' << ConvolutionalLayer::AlgorithmName(algorithm) << ' '
+	  << std::chrono::duration_cast<std::chrono::microseconds>(bestTime).count() << " us";
+	if (bestTime < fastestTime)
+	{
+	  fastest = algorithm;
+	  fastestTime = bestTime;
+	}
+  }
+  LOG(Info) << "Convolution timings for " << shape.inputChannelCount << 'x' << shape.inputRows << 'x' << shape.inputColumns
+	<< " input, " << shape.filterCount << " filters of size " << shape.filterSize << ", stride " << shape.stride
+	<< ", zero padding " << shape.zeroPadding << ':' << timings.str() << ". Using " << ConvolutionalLayer::AlgorithmName(fastest) << '.';
+  return fastest;
+}
+
+// Each line of the cache file holds the shape of a layer followed by the name of the algorithm chosen for it.
+// Lines with algorithms that this version doesn't know about are ignored.
+ConvolutionTuner::Cache ConvolutionTuner::LoadCache(const std::string& fileName)
+{
+  Cache cache;
+  if (fileName.empty())
+	return cache;
+  std::ifstream is(fileName);
+  std::string line;
+  while (std::getline(is, line))
+  {
+	std::istringstream ss(line);
+	Shape shape;
+	std::string algorithmName;
+	ss >> shape.inputChannelCount >> shape.inputRows >> shape.inputColumns >> shape.filterCount >> shape.filterSize
+	  >> shape.stride >> shape.zeroPadding >> algorithmName;
+	if (!ss)
+	  continue;
+	for (auto algorithm : ConvolutionalLayer::AllAlgorithms())
+	{
+	  if (algorithmName == ConvolutionalLayer::AlgorithmName(algorithm))
+		cache[shape] = algorithm;
+	}
+  }
+  return cache;
+}
+
+void ConvolutionTuner::SaveToCache(const std::string& fileName, const Shape& shape, ConvolutionalLayer::Algorithms algorithm)
+{
+  if (fileName.empty())
+	return;
+  std::ofstream os(fileName, std::ofstream::app);
+  if (!os.good())
+  {
+	LOG(Warning) << "Failed to open file " << fileName << " for writing.";
+	return;
+  }
+  os << shape.inputChannelCount << ' ' << shape.inputRows << ' ' << shape.inputColumns << ' ' << shape.filterCount << ' '
+	<< shape.filterSize << ' ' << shape.stride << ' ' << shape.zeroPadding << ' ' << ConvolutionalLayer::AlgorithmName(algorithm) << '\n';
+}
@@ -0,0 +1,39 @@
+#pragma once
+
+#include "ConvolutionalLayer.h"
+
+// Picks the fastest convolution algorithm for a layer by timing each algorithm that the layer supports on a
+// layer of the same shape. The results are kept in a file in FISHNET_SAVE_DIR, so each shape is only timed
+// once by each build of FishNet. If FISHNET_SAVE_DIR isn't set or is empty, the results are only remembered until the
+// program exits.
+class ConvolutionTuner
+{
+public:
+  static void Tune(ConvolutionalLayer&);
+  // Keeps the results in the given file instead, or only in memory if the file name is empty.
+  static void Tune(ConvolutionalLayer&, const std::string& cacheFileName);
+  static std::string CacheFileName();
+private:
+  struct Shape
+  {
+	uint32_t inputChannelCount;
+	uint32_t inputRows;
+	uint32_t inputColumns;
+	uint32_t filterCount;
+	uint32_t filterSize;
+	uint32_t stride;
+	uint32_t zeroPadding;
+	bool operator<(const Shape& other) const;
+  };
+
+  using Cache = std::map<Shape, ConvolutionalLayer::Algorithms>;
+
+  static Shape LayerShape(const ConvolutionalLayer&);
+  static ConvolutionalLayer::Algorithms FastestAlgorithm(const Shape&);
+  static Cache LoadCache(const std::string& fileName);
+  static void SaveToCache(const std::string& fileName, const Shape&, ConvolutionalLayer::Algorithms);
+
+  static std::mutex _mutex;
+  // The results from each file that has been used, which is read the first time it's used.
+  static std::map<std::string, Cache> _caches;
+};
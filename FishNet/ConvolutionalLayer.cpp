@@ -1,5 +1,151 @@
 #include "stdafx.h"
 #include "ConvolutionalLayer.h"
+#include "Gemm.h"
+
+namespace
+{
+
+// Each thread needs its own workspace for patch matrices and transformed tiles because FeedForward is called
+// concurrently by all the trainers. Some algorithms need more than one buffer at a time, so there are a few of them.
+Real* ScratchBuffer(uint32_t index, size_t size)
+{
+  thread_local std::vector<Real> buffers[3];
+  std::vector<Real>& buffer = buffers[index];
+  if (buffer.size() < size)
+	buffer.resize(size);
+  return buffer.data();
+}
+
+Complex* SpectrumBuffer(uint32_t index, size_t size)
+{
+  thread_local std::vector<Complex> buffers[2];
+  std::vector<Complex>& buffer = buffers[index];
+  if (buffer.size() < size)
+	buffer.resize(size);
+  return buffer.data();
+}
+
+// The matrices for the Winograd minimal filtering algorithms F(2x2, 3x3) and F(4x4, 3x3), as given by
+// Lavin and Gray, "Fast Algorithms for Convolutional Neural Networks". An output tile is
+// AT * [(G * g * GT) . (BT * d * B)] * A, where g is a 3x3 filter and d is an input tile.
+struct WinogradTransform
+{
+  uint32_t tileSize;
+  uint32_t inputTileSize;
+  const Real* bt;
+  const Real* g;
+  const Real* at;
+};
+
+const Real f2x2BT[16] =
+{
+  1.0,  0.0, -1.0,  0.0,
+  0.0,  1.0,  1.0,  0.0,
+  0.0, -1.0,  1.0,  0.0,
+  0.0,  1.0,  0.0, -1.0
+};
+
+const Real f2x2G[12] =
+{
+  1.0,  0.0, 0.0,
+  0.5,  0.5, 0.5,
+  0.5, -0.5, 0.5,
+  0.0,  0.0, 1.0
+};
+
+const Real f2x2AT[8] =
+{
+  1.0, 1.0,  1.0,  0.0,
+  0.0, 1.0, -1.0, -1.0
+};
+
+const Real f4x4BT[36] =
+{
+  4.0,  0.0, -5.0,  0.0, 1.0, 0.0,
+  0.0, -4.0, -4.0,  1.0, 1.0, 0.0,
+  0.0,  4.0, -4.0, -1.0, 1.0, 0.0,
+  0.0, -2.0, -1.0,  2.0, 1.0, 0.0,
+  0.0,  2.0, -1.0, -2.0, 1.0, 0.0,
+  0.0,  4.0,  0.0, -5.0, 0.0, 1.0
+};
+
+const Real f4x4G[18] =
+{
+  1.0 / 4.0,   0.0,         0.0,
+  -1.0 / 6.0,  -1.0 / 6.0,  -1.0 / 6.0,
+  -1.0 / 6.0,  1.0 / 6.0,   -1.0 / 6.0,
+  1.0 / 24.0,  1.0 / 12.0,  1.0 / 6.0,
+  1.0 / 24.0,  -1.0 / 12.0, 1.0 / 6.0,
+  0.0,         0.0,         1.0
+};
+
+const Real f4x4AT[24] =
+{
+  1.0, 1.0,  1.0, 1.0,  1.0, 0.0,
+  0.0, 1.0, -1.0, 2.0, -2.0, 0.0,
+  0.0, 1.0,  1.0, 4.0,  4.0, 0.0,
+  0.0, 1.0, -1.0, 8.0, -8.0, 1.0
+};
+
+const WinogradTransform f2x2Transform = { 2, 4, f2x2BT, f2x2G, f2x2AT };
+const WinogradTransform f4x4Transform = { 4, 6, f4x4BT, f4x4G, f4x4AT };
+
+const WinogradTransform& GetWinogradTransform(uint32_t tileSize)
+{
+  return tileSize == 4 ? f4x4Transform : f2x2Transform;
+}
+
+// Calculates l * x * transpose(l), where l is a p by q matrix and x is a q by q matrix. Element (i, j) of l is
+// at l[i * rowStride + j * columnStride], so passing swapped strides uses the transpose of the stored matrix.
+void Sandwich(const Real* l, uint32_t p, uint32_t q, uint32_t rowStride, uint32_t columnStride, const Real* x, Real* result)
+{
+  Real lx[36];
+  for (uint32_t i = 0; i < p; ++i)
+  {
+	for (uint32_t j = 0; j < q; ++j)
+	{
+	  Real sum = 0.0;
+	  for (uint32_t k = 0; k < q; ++k)
+		sum += l[(i * rowStride) + (k * columnStride)] * x[(k * q) + j];
+	  lx[(i * q) + j] = sum;
+	}
+  }
+  for (uint32_t i = 0; i < p; ++i)
+  {
+	for (uint32_t j = 0; j < p; ++j)
+	{
+	  Real sum = 0.0;
+	  for (uint32_t k = 0; k < q; ++k)
+		sum += lx[(i * q) + k] * l[(j * rowStride) + (k * columnStride)];
+	  result[(i * p) + j] = sum;
+	}
+  }
+}
+
+// Copies planes of rows by columns values into the middle of planes with padding zeros on all four sides.
+void PadPlanes(const Real* input, uint32_t planes, uint32_t rows, uint32_t columns, uint32_t rowPadding,
+  uint32_t columnPadding, Real* paddedInput)
+{
+  uint32_t paddedColumns = columns + (2 * columnPadding);
+  size_t paddingRowsSize = sizeof(Real) * rowPadding * paddedColumns;
+  for (uint32_t plane = 0; plane < planes; ++plane)
+  {
+	memset(paddedInput, 0, paddingRowsSize);
+	paddedInput += rowPadding * paddedColumns;
+	for (uint32_t row = 0; row < rows; ++row)
+	{
+	  memset(paddedInput, 0, sizeof(Real) * columnPadding);
+	  memcpy(paddedInput + columnPadding, input, sizeof(Real) * columns);
+	  memset(paddedInput + columnPadding + columns, 0, sizeof(Real) * columnPadding);
+	  paddedInput += paddedColumns;
+	  input += columns;
+	}
+	memset(paddedInput, 0, paddingRowsSize);
+	paddedInput += rowPadding * paddedColumns;
+  }
+}
+
+}
 
 ConvolutionalLayer::ConvolutionalLayer(TensorPtr&& weights, TensorPtr&& biases,
   uint32_t inputRows, uint32_t inputColumns, uint32_t stride, uint32_t zeroPadding, std::unique_ptr<::ActivationFunction>&& activationFunction)
@@ -11,7 +157,11 @@ ConvolutionalLayer::ConvolutionalLayer(TensorPtr&& weights, TensorPtr&& biases,
 	_filterCount(_weights->Hyperplanes()),
 	_filterSize(_weights->Rows()),
 	_stride(stride),
-	_zeroPadding(zeroPadding)
+	_zeroPadding(zeroPadding),
+	_algorithm(Algorithms::Direct),
+	_feedForwardKernel(GetDirectConvolutionKernel(_filterSize, _stride)),
+	_backpropagationKernel(GetDirectConvolutionKernel(_filterSize, 1)),
+	_channelBlockedWeightsStale(true)
 {
   if (_zeroPadding >= _filterSize)
 	throw std::runtime_error("Zero padding must be less than the size of the filter.");
@@ -20,6 +170,8 @@ ConvolutionalLayer::ConvolutionalLayer(TensorPtr&& weights, TensorPtr&& biases,
   if (_filterCount != _biases->Size())
 	throw std::runtime_error("There must be 1 bias for each filter.");
   CalculateFilterInfo();
+  _algorithm = ChooseAlgorithm();
+  RefreshWeightCache();
 }
 
 ConvolutionalLayer::ConvolutionalLayer(uint32_t inputChannelCount, uint32_t inputRows, uint32_t inputColumns, uint32_t filterCount,
@@ -32,8 +184,21 @@ ConvolutionalLayer::ConvolutionalLayer(uint32_t inputChannelCount, uint32_t inpu
 	_filterCount(filterCount),
 	_filterSize(filterSize),
 	_stride(stride),
-	_zeroPadding(zeroPadding)
+	_zeroPadding(zeroPadding),
+	_algorithm(Algorithms::Direct),
+	_feedForwardKernel(GetDirectConvolutionKernel(_filterSize, _stride)),
+	_backpropagationKernel(GetDirectConvolutionKernel(_filterSize, 1)),
+	_channelBlockedWeightsStale(true)
 {
+  _algorithm = ChooseAlgorithm();
+}
+
+std::unique_ptr<Layer> ConvolutionalLayer::Clone() const
+{
+  auto clone = std::make_unique<ConvolutionalLayer>(std::make_unique<Tensor>(*_weights), std::make_unique<Tensor>(*_biases),
+	_inputRows, _inputColumns, _stride, _zeroPadding, _activationFunction ? _activationFunction->Clone() : nullptr);
+  clone->Algorithm(_algorithm);
+  return clone;
 }
 
 void ConvolutionalLayer::InitializeWeights()
@@ -46,6 +211,7 @@ void ConvolutionalLayer::InitializeWeights()
 	Randomizer randomizer(2.0 / sqrt(double(_filterSize * _filterSize * _inputChannelCount)));
 	randomizer.Fill(*_weights);
 	CalculateFilterInfo();
+	RefreshWeightCache();
   }
 }
 
@@ -56,6 +222,192 @@ void ConvolutionalLayer::Description(std::ostream& os) const
   if (_zeroPadding != 0)
 	os << ", zero padding: "	<< _zeroPadding;
   os << ", activation: "	<< (_activationFunction ? _activationFunction->Description() : "None");
+  os << ", algorithm: " << AlgorithmName(_algorithm);
+}
+
+const std::vector<ConvolutionalLayer::Algorithms>& ConvolutionalLayer::AllAlgorithms()
+{
+  static const std::vector<Algorithms> algorithms { Algorithms::Direct, Algorithms::Gemm, Algorithms::WinogradF2x2,
+	Algorithms::WinogradF4x4, Algorithms::Fft };
+  return algorithms;
+}
+
+const char* ConvolutionalLayer::AlgorithmName(Algorithms algorithm)
+{
+  switch (algorithm)
+  {
+	case Algorithms::Direct:
+	  return "Direct";
+	case Algorithms::Gemm:
+	  return "Gemm";
+	case Algorithms::WinogradF2x2:
+	  return "WinogradF2x2";
+	case Algorithms::WinogradF4x4:
+	  return "WinogradF4x4";
+	case Algorithms::Fft:
+	  return "Fft";
+	default:
+	  return "Unknown";
+  }
+}
+
+ConvolutionalLayer::Algorithms ConvolutionalLayer::ChooseAlgorithm() const
+{
+  // Expanding or transforming the input costs about as much as one filter's worth of direct convolution, so the
+  // other algorithms only pay off when there are several filters to share the work.
+  if (_filterCount < 4)
+	return Algorithms::Direct;
+  // Transforming the tiles is only cheap relative to the products between them when there are many
+  // channels and filters. Larger output tiles need fewer transforms, provided the output isn't mostly padding.
+  if (SupportsAlgorithm(Algorithms::WinogradF4x4) && _inputChannelCount * _filterCount >= 2048)
+	return _outputRows >= 8 && _outputColumns >= 8 ? Algorithms::WinogradF4x4 : Algorithms::WinogradF2x2;
+  // The Fft algorithm transforms every input and output plane and then does a complex multiply-add for each
+  // filter, input channel and frequency, whatever the filter size. The weights are measured against one
+  // multiply-add of the matrix product.
+  Real transformArea = Real(FourierTransformRows()) * FourierTransformColumns();
+  Real spectrumSize = Real(FourierTransformRows()) * ((FourierTransformColumns() / 2) + 1);
+  Real fftCost = (5.0 * (_inputChannelCount + _filterCount) * transformArea * log2(transformArea)) +
+	(8.0 * _inputChannelCount * _filterCount * spectrumSize);
+  Real gemmCost = Real(_inputChannelCount) * _filterCount * _filterSize * _filterSize * _outputRows * _outputColumns;
+  return fftCost < gemmCost ? Algorithms::Fft : Algorithms::Gemm;
+}
+
+bool ConvolutionalLayer::SupportsAlgorithm(Algorithms algorithm) const
+{
+  if (algorithm == Algorithms::WinogradF2x2 || algorithm == Algorithms::WinogradF4x4)
+	return _filterSize == 3 && _stride == 1;
+  return true;
+}
+
+void ConvolutionalLayer::Algorithm(Algorithms algorithm)
+{
+  if (!SupportsAlgorithm(algorithm))
+	throw std::runtime_error("The Winograd convolution algorithms require 3x3 filters with a stride of 1.");
+  _algorithm = algorithm;
+  RefreshWeightCache();
+}
+
+void ConvolutionalLayer::RefreshWeightCache()
+{
+  if (_weights && _algorithm == Algorithms::Fft)
+	RefreshFilterSpectra();
+  else
+  {
+	_fourierTransform = nullptr;
+	_filterSpectra = nullptr;
+  }
+  if (_weights && (_algorithm == Algorithms::WinogradF2x2 || _algorithm == Algorithms::WinogradF4x4))
+	RefreshTransformedWeights();
+  else
+	_transformedWeights = nullptr;
+  if (_weights && _algorithm == Algorithms::Direct && _stride == 1)
+	RefreshFlippedWeights();
+  else
+	_flippedWeights = nullptr;
+  _channelBlockedWeightsStale = true;
+}
+
+void ConvolutionalLayer::RefreshChannelBlockedWeights() const
+{
+  const uint32_t blockSize = Tensor::ChannelBlockSize;
+  uint32_t filterBlocks = Tensor::ChannelBlocks(_filterCount);
+  uint32_t inputBlocks = Tensor::ChannelBlocks(_inputChannelCount);
+  uint32_t filterArea = _filterSize * _filterSize;
+  if (!_channelBlockedWeights)
+  {
+	_channelBlockedWeights = std::make_unique<Tensor>(filterBlocks, inputBlocks, filterArea * blockSize, blockSize);
+	_channelBlockedBiases = std::make_unique<Tensor>(filterBlocks * blockSize);
+  }
+  // The weights for the channels and filters that only pad out the last blocks stay zero.
+  for (uint32_t filter = 0; filter < _filterCount; ++filter)
+  {
+	for (uint32_t inputChannel = 0; inputChannel < _inputChannelCount; ++inputChannel)
+	{
+	  const Real* weights = _weights->ElementAddress(filter, inputChannel, 0, 0);
+	  Real* blocked = _channelBlockedWeights->ElementAddress(filter / blockSize, inputChannel / blockSize, 0, 0) +
+		((inputChannel % blockSize) * blockSize) + (filter % blockSize);
+	  for (uint32_t i = 0; i < filterArea; ++i)
+		blocked[i * blockSize * blockSize] = weights[i];
+	}
+	_channelBlockedBiases->Set(filter, _biases->Get(filter));
+  }
+}
+
+void ConvolutionalLayer::RefreshFlippedWeights()
+{
+  if (!_flippedWeights)
+	_flippedWeights = std::make_unique<Tensor>(_inputChannelCount, _filterCount, _filterSize, _filterSize);
+  uint32_t filterArea = _filterSize * _filterSize;
+  const Real* weights = _weights->Elements();
+  for (uint32_t filter = 0; filter < _filterCount; ++filter)
+  {
+	for (uint32_t inputChannel = 0; inputChannel < _inputChannelCount; ++inputChannel)
+	{
+	  Real* flipped = _flippedWeights->ElementAddress(inputChannel, filter, 0, 0);
+	  for (uint32_t i = 0; i < filterArea; ++i)
+		flipped[filterArea - 1 - i] = weights[i];
+	  weights += filterArea;
+	}
+  }
+}
+
+void ConvolutionalLayer::RefreshTransformedWeights()
+{
+  const WinogradTransform& transform = GetWinogradTransform(WinogradTileSize());
+  uint32_t transformedTileSize = transform.inputTileSize * transform.inputTileSize;
+  if (!_transformedWeights || _transformedWeights->Planes() != transformedTileSize)
+	_transformedWeights = std::make_unique<Tensor>(transformedTileSize, _filterCount, _inputChannelCount);
+  size_t matrixSize = _filterCount * _inputChannelCount;
+  Real* transformedWeights = _transformedWeights->Elements();
+  const Real* filterWeights = _weights->Elements();
+  Real u[36];
+  for (size_t i = 0; i < matrixSize; ++i)
+  {
+	Sandwich(transform.g, transform.inputTileSize, 3, 3, 1, filterWeights, u);
+	for (uint32_t j = 0; j < transformedTileSize; ++j)
+	  transformedWeights[(j * matrixSize) + i] = u[j];
+	filterWeights += 9;
+  }
+}
+
+// The transform only has to be big enough to hold the part of the padded input that the filters pass over,
+// since the correlation is circular and the outputs which wrap around are never read.
+uint32_t ConvolutionalLayer::FourierTransformRows() const
+{
+  return FourierTransform::SmoothSize(((_outputRows - 1) * _stride) + _filterSize);
+}
+
+uint32_t ConvolutionalLayer::FourierTransformColumns() const
+{
+  return FourierTransform::SmoothSize(((_outputColumns - 1) * _stride) + _filterSize);
+}
+
+void ConvolutionalLayer::RefreshFilterSpectra()
+{
+  if (!_fourierTransform)
+  {
+	_fourierTransform = std::make_unique<RealFourierTransform2D>(FourierTransformRows(), FourierTransformColumns());
+	_filterSpectra = std::make_unique<Complex[]>(size_t(_filterCount) * _inputChannelCount * _fourierTransform->SpectrumSize());
+  }
+  uint32_t transformColumns = _fourierTransform->Columns();
+  uint32_t spectrumSize = _fourierTransform->SpectrumSize();
+  uint32_t filterArea = _filterSize * _filterSize;
+  Real* paddedFilter = ScratchBuffer(0, _fourierTransform->Rows() * transformColumns);
+  memset(paddedFilter, 0, sizeof(Real) * _fourierTransform->Rows() * transformColumns);
+  // The transform works in place on its output, so each spectrum is worked out in this thread's own buffer and only
+  // copied into the layer once it is finished. Hogwild trainers refresh the spectra while the others are reading them.
+  Complex* transformed = SpectrumBuffer(1, spectrumSize);
+  const Real* filterWeights = _weights->Elements();
+  Complex* spectrum = _filterSpectra.get();
+  for (size_t i = 0; i < size_t(_filterCount) * _inputChannelCount; ++i)
+  {
+	for (int32_t row = 0; row < _filterSize; ++row)
+	  memcpy(paddedFilter + (row * transformColumns), filterWeights + (row * _filterSize), sizeof(Real) * _filterSize);
+	_fourierTransform->Forward(paddedFilter, transformed);
+	std::copy_n(transformed, spectrumSize, spectrum);
+	filterWeights += filterArea;
+	spectrum += spectrumSize;
+  }
 }
 
 void ConvolutionalLayer::FeedForward(const Tensor& inputs, Tensor& outputs, const DropoutMask*) const
@@ -74,110 +426,510 @@ void ConvolutionalLayer::FeedForward(const Tensor& inputs, Tensor& outputs, cons
   if (outputs.Columns() != (_inputColumns + (2 * _zeroPadding) - _filterSize) / _stride + 1)
 	throw std::runtime_error("ConvolutionalLayer::FeedForward - output tensor has the wrong number of columns.");
 #endif
-  double* output = outputs.Elements();
+  switch (_algorithm)
+  {
+	case Algorithms::Gemm:
+	  FeedForwardGemm(inputs, outputs);
+	  break;
+	case Algorithms::WinogradF2x2:
+	case Algorithms::WinogradF4x4:
+	  FeedForwardWinograd(inputs, outputs);
+	  break;
+	case Algorithms::Fft:
+	  FeedForwardFft(inputs, outputs);
+	  break;
+	default:
+	  FeedForwardDirect(inputs, outputs);
+  }
+}
+
+void ConvolutionalLayer::FeedForwardChannelBlocked(const Tensor& inputs, Tensor& outputs) const
+{
+  const uint32_t blockSize = Tensor::ChannelBlockSize;
+#ifdef _DEBUG
+  if (inputs.Hyperplanes() != Tensor::ChannelBlocks(_inputChannelCount) || inputs.Planes() != uint32_t(_inputRows) ||
+	inputs.Rows() != uint32_t(_inputColumns) || inputs.Columns() != blockSize)
+	throw std::runtime_error("ConvolutionalLayer::FeedForwardChannelBlocked - input tensor has the wrong dimensions.");
+  if (outputs.Hyperplanes() != Tensor::ChannelBlocks(_filterCount) || outputs.Planes() != _outputRows ||
+	outputs.Rows() != _outputColumns || outputs.Columns() != blockSize)
+	throw std::runtime_error("ConvolutionalLayer::FeedForwardChannelBlocked - output tensor has the wrong dimensions.");
+#endif
+  // Each row of a channel blocked plane is blockSize times as long, so the columns are padded by that many values.
+  const Real* input = inputs.Elements();
+  uint32_t inputRows = _inputRows + (2 * _zeroPadding);
+  uint32_t inputColumns = _inputColumns + (2 * _zeroPadding);
   if (_zeroPadding > 0)
   {
-	int32_t endRow = _inputRows + _zeroPadding - _filterSize + 1;
-	int32_t endCol = _inputColumns + _zeroPadding - _filterSize + 1;
-	for (uint32_t filter = 0; filter < _filterCount; ++filter)
+	Real* paddedInput = ScratchBuffer(0, size_t(inputs.Hyperplanes()) * inputRows * inputColumns * blockSize);
+	PadPlanes(input, inputs.Hyperplanes(), _inputRows, _inputColumns * blockSize, _zeroPadding, _zeroPadding * blockSize,
+	  paddedInput);
+	input = paddedInput;
+  }
+  if (_channelBlockedWeightsStale.load(std::memory_order_acquire))
+  {
+	std::unique_lock<std::mutex> lock(_channelBlockedMutex);
+	if (_channelBlockedWeightsStale.load(std::memory_order_relaxed))
 	{
-	  double filterBias = _biases->Get(filter);
-	  for (int32_t inputRow = -_zeroPadding; inputRow < endRow; inputRow += _stride)
+	  RefreshChannelBlockedWeights();
+	  _channelBlockedWeightsStale.store(false, std::memory_order_release);
+	}
+  }
+  DirectConvolution shape { _inputChannelCount, inputRows, inputColumns, uint32_t(_filterSize), uint32_t(_stride),
+	_outputRows, _outputColumns };
+  ConvolveChannelBlocked(shape, _filterCount, input, _channelBlockedWeights->Elements(), _channelBlockedBiases->Elements(),
+	outputs.Elements());
+}
+
+void ConvolutionalLayer::FeedForwardDirect(const Tensor& inputs, Tensor& outputs) const
+{
+  // With zero padding, a padded copy of the input is made first, so that the filters never have to be clipped
+  // at the edges and the same kernel can be used for every output.
+  const Real* input = inputs.Elements();
+  uint32_t inputRows = _inputRows + (2 * _zeroPadding);
+  uint32_t inputColumns = _inputColumns + (2 * _zeroPadding);
+  if (_zeroPadding > 0)
+  {
+	Real* paddedInput = ScratchBuffer(0, size_t(_inputChannelCount) * inputRows * inputColumns);
+	PadPlanes(input, _inputChannelCount, _inputRows, _inputColumns, _zeroPadding, _zeroPadding, paddedInput);
+	input = paddedInput;
+  }
+  DirectConvolution shape { _inputChannelCount, inputRows, inputColumns, uint32_t(_filterSize), uint32_t(_stride),
+	_outputRows, _outputColumns };
+  _feedForwardKernel(shape, _filterCount, input, _weights->Elements(), _biases->Elements(), outputs.Elements());
+}
+
+void ConvolutionalLayer::FeedForwardGemm(const Tensor& inputs, Tensor& outputs) const
+{
+  // The patch matrix has one row for each weight in a filter and one column for each output position,
+  // so multiplying the filterCount by patchSize weight matrix by it gives the output planes directly.
+  uint32_t patchSize = _inputChannelCount * _filterSize * _filterSize;
+  uint32_t outputPlaneSize = _outputRows * _outputColumns;
+  Real* patches = ScratchBuffer(0, size_t(patchSize) * outputPlaneSize);
+  ExpandInputPatches(inputs.Elements(), patches);
+
+  Real* output = outputs.Elements();
+  for (uint32_t filter = 0; filter < _filterCount; ++filter)
+  {
+	Real filterBias = _biases->Get(filter);
+	Real* outputPlaneEnd = output + outputPlaneSize;
+	for (Real* o = output; o < outputPlaneEnd; ++o)
+	  *o = filterBias;
+	output = outputPlaneEnd;
+  }
+  MultiplyMatrices(false, false, _filterCount, outputPlaneSize, patchSize, _weights->Elements(), patchSize, patches, outputPlaneSize,
+	outputs.Elements(), outputPlaneSize);
+}
+
+void ConvolutionalLayer::ExpandInputPatches(const Real* input, Real* patches) const
+{
+  uint32_t outputPlaneSize = _outputRows * _outputColumns;
+  uint32_t inputPlaneSize = _inputRows * _inputColumns;
+  for (uint32_t inputChannel = 0; inputChannel < _inputChannelCount; ++inputChannel)
+  {
+	const Real* inputPlane = input + (inputChannel * inputPlaneSize);
+	for (int32_t filterRow = 0; filterRow < _filterSize; ++filterRow)
+	{
+	  for (int32_t filterCol = 0; filterCol < _filterSize; ++filterCol)
 	  {
-		int32_t filterStartRow = 0;
-		int32_t filterEndRow = _filterSize;
-		if (inputRow < 0)
-		{
-		  filterStartRow = -inputRow;
-		}
-		else if (inputRow + _filterSize > _inputRows)
-		{
-		  filterEndRow = _inputRows - inputRow;
-		}
-		size_t filterHeightTimesInputWidth = (filterEndRow - filterStartRow) * _inputColumns;
-		for (int32_t inputCol = -_zeroPadding; inputCol < endCol; inputCol += _stride)
+		// Output columns in [firstCol, endCol) read from inside the input, the rest read padding.
+		int32_t colOffset = filterCol - _zeroPadding;
+		int32_t firstCol = colOffset < 0 ? (-colOffset + _stride - 1) / _stride : 0;
+		int32_t endCol = (_inputColumns - colOffset + _stride - 1) / _stride;
+		firstCol = std::min(firstCol, int32_t(_outputColumns));
+		endCol = std::max(firstCol, std::min(endCol, int32_t(_outputColumns)));
+		Real* patch = patches;
+		for (uint32_t outputRow = 0; outputRow < _outputRows; ++outputRow)
 		{
-		  int32_t filterStartCol = 0;
-		  int32_t filterEndCol = _filterSize;
-		  if (inputCol < 0)
+		  int32_t inputRow = int32_t(outputRow) * _stride + filterRow - _zeroPadding;
+		  if (inputRow < 0 || inputRow >= _inputRows)
 		  {
-			filterStartCol = -inputCol;
+			memset(patch, 0, sizeof(Real) * _outputColumns);
 		  }
-		  else if (inputCol + _filterSize > _inputColumns)
+		  else
 		  {
-			filterEndCol = _inputColumns - inputCol;
+			int32_t col = 0;
+			for (; col < firstCol; ++col)
+			  patch[col] = 0.0;
+			const Real* in = inputPlane + (inputRow * _inputColumns) + (firstCol * _stride) + colOffset;
+			for (; col < endCol; ++col, in += _stride)
+			  patch[col] = *in;
+			for (; col < int32_t(_outputColumns); ++col)
+			  patch[col] = 0.0;
 		  }
-		  size_t filterWidth = filterEndCol - filterStartCol;
-		  size_t filterRowOffset = _filterSize - filterWidth;
-		  size_t rowOffset = _inputColumns - filterWidth;
-		  double activation = filterBias;
-		  for (uint32_t inputChannel = 0; inputChannel < _inputChannelCount; ++inputChannel)
+		  patch += _outputColumns;
+		}
+		patches += outputPlaneSize;
+	  }
+	}
+  }
+}
+
+void ConvolutionalLayer::AddPatchesToInput(const Real* patches, Real* input) const
+{
+  uint32_t outputPlaneSize = _outputRows * _outputColumns;
+  uint32_t inputPlaneSize = _inputRows * _inputColumns;
+  for (uint32_t inputChannel = 0; inputChannel < _inputChannelCount; ++inputChannel)
+  {
+	Real* inputPlane = input + (inputChannel * inputPlaneSize);
+	for (int32_t filterRow = 0; filterRow < _filterSize; ++filterRow)
+	{
+	  for (int32_t filterCol = 0; filterCol < _filterSize; ++filterCol)
+	  {
+		// Patch elements that were copied from the padding have nowhere to go.
+		int32_t colOffset = filterCol - _zeroPadding;
+		int32_t firstCol = colOffset < 0 ? (-colOffset + _stride - 1) / _stride : 0;
+		int32_t endCol = (_inputColumns - colOffset + _stride - 1) / _stride;
+		firstCol = std::min(firstCol, int32_t(_outputColumns));
+		endCol = std::max(firstCol, std::min(endCol, int32_t(_outputColumns)));
+		const Real* patch = patches;
+		for (uint32_t outputRow = 0; outputRow < _outputRows; ++outputRow)
+		{
+		  int32_t inputRow = int32_t(outputRow) * _stride + filterRow - _zeroPadding;
+		  if (inputRow >= 0 && inputRow < _inputRows)
 		  {
-			const double* weight = _weights->ElementAddress(filter, inputChannel, filterStartRow, filterStartCol);
-			const double* in = inputs.ElementAddress(inputChannel, std::max(inputRow, 0), std::max(inputCol, 0));
-			const double* inEnd = in + filterHeightTimesInputWidth;
-			do
-			{
-			  const double* weightRowEnd = weight + filterWidth;
-			  do
-			  {
-				activation += (*in * *weight);
-				++weight;
-				++in;
-			  } while (weight != weightRowEnd);
-			  weight += filterRowOffset;
-			  in += rowOffset;
-			} while (in < inEnd);
+			Real* in = inputPlane + (inputRow * _inputColumns) + (firstCol * _stride) + colOffset;
+			for (int32_t col = firstCol; col < endCol; ++col, in += _stride)
+			  *in += patch[col];
 		  }
-		  *output = activation;
-		  ++output;
+		  patch += _outputColumns;
 		}
+		patches += outputPlaneSize;
 	  }
 	}
   }
-  else
+}
+
+void ConvolutionalLayer::FeedForwardWinograd(const Tensor& inputs, Tensor& outputs) const
+{
+  const WinogradTransform& transform = GetWinogradTransform(WinogradTileSize());
+  uint32_t tileSize = transform.tileSize;
+  uint32_t inputTileSize = transform.inputTileSize;
+  uint32_t transformedTileSize = inputTileSize * inputTileSize;
+  uint32_t tileRows = (_outputRows + tileSize - 1) / tileSize;
+  uint32_t tileColumns = (_outputColumns + tileSize - 1) / tileSize;
+  uint32_t tileCount = tileRows * tileColumns;
+  size_t inputMatrixSize = size_t(_inputChannelCount) * tileCount;
+  size_t outputMatrixSize = size_t(_filterCount) * tileCount;
+  size_t weightMatrixSize = size_t(_filterCount) * _inputChannelCount;
+
+  Real* transformedInputs = ScratchBuffer(0, transformedTileSize * inputMatrixSize);
+  TransformInputTiles(inputs.Elements(), transformedInputs);
+
+  // Each element of the transformed tiles is independent, so the element-wise products summed over the
+  // input channels become one matrix multiplication per element.
+  Real* transformedOutputs = ScratchBuffer(1, transformedTileSize * outputMatrixSize);
+  memset(transformedOutputs, 0, sizeof(Real) * transformedTileSize * outputMatrixSize);
+  for (uint32_t i = 0; i < transformedTileSize; ++i)
   {
-	uint32_t rowOffset = _inputColumns - _filterSize;
-	uint32_t endRow = _inputRows - _filterSize + 1;
-	uint32_t endCol = rowOffset + 1;
-	uint32_t filterSizeTimesInputWidth = _filterSize * _inputColumns;
+	MultiplyMatrices(false, false, _filterCount, tileCount, _inputChannelCount, _transformedWeights->Elements() + (i * weightMatrixSize),
+	  _inputChannelCount, transformedInputs + (i * inputMatrixSize), tileCount, transformedOutputs + (i * outputMatrixSize), tileCount);
+  }
 
-	const double* filterWeights = _weights->Elements();
-	size_t filterWeightSize = _weights->Planes() * _weights->Rows() * _weights->Columns();
-	for (uint32_t filter = 0; filter < _filterCount; ++filter)
+  Real transformedTile[36];
+  Real outputTile[16];
+  for (uint32_t filter = 0; filter < _filterCount; ++filter)
+  {
+	Real filterBias = _biases->Get(filter);
+	Real* outputPlane = outputs.ElementAddress(filter, 0, 0);
+	uint32_t tile = 0;
+	for (uint32_t tileRow = 0; tileRow < tileRows; ++tileRow)
 	{
-	  double filterBias = _biases->Get(filter);
-	  for (uint32_t inputRow = 0; inputRow < endRow; inputRow += _stride)
+	  for (uint32_t tileCol = 0; tileCol < tileColumns; ++tileCol, ++tile)
 	  {
-		for (uint32_t inputCol = 0; inputCol < endCol; inputCol += _stride)
+		const Real* transformedOutput = transformedOutputs + (filter * tileCount) + tile;
+		for (uint32_t i = 0; i < transformedTileSize; ++i)
+		  transformedTile[i] = transformedOutput[i * outputMatrixSize];
+		Sandwich(transform.at, tileSize, inputTileSize, inputTileSize, 1, transformedTile, outputTile);
+		uint32_t rowEnd = std::min(tileSize, _outputRows - (tileRow * tileSize));
+		uint32_t colEnd = std::min(tileSize, _outputColumns - (tileCol * tileSize));
+		Real* output = outputPlane + (tileRow * tileSize * _outputColumns) + (tileCol * tileSize);
+		for (uint32_t row = 0; row < rowEnd; ++row)
 		{
-		  double activation = filterBias;
-		  const double* weight = filterWeights;
-		  for (uint32_t inputChannel = 0; inputChannel < _inputChannelCount; ++inputChannel)
+		  for (uint32_t col = 0; col < colEnd; ++col)
+			output[col] = outputTile[(row * tileSize) + col] + filterBias;
+		  output += _outputColumns;
+		}
+	  }
+	}
+  }
+}
+
+void ConvolutionalLayer::BackpropagateErrorWinograd(const Tensor& errorInThisLayer, Tensor& errorInPreviousLayer) const
+{
+  // The output is AT * (U . V) * A, so the error in V is the sum over filters of U times A * error * AT,
+  // and the error in each input tile is B * (error in V) * BT.
+  const WinogradTransform& transform = GetWinogradTransform(WinogradTileSize());
+  uint32_t tileSize = transform.tileSize;
+  uint32_t inputTileSize = transform.inputTileSize;
+  uint32_t transformedTileSize = inputTileSize * inputTileSize;
+  uint32_t tileRows = (_outputRows + tileSize - 1) / tileSize;
+  uint32_t tileColumns = (_outputColumns + tileSize - 1) / tileSize;
+  uint32_t tileCount = tileRows * tileColumns;
+  size_t inputMatrixSize = size_t(_inputChannelCount) * tileCount;
+  size_t outputMatrixSize = size_t(_filterCount) * tileCount;
+  size_t weightMatrixSize = size_t(_filterCount) * _inputChannelCount;
+
+  Real* transformedErrors = ScratchBuffer(1, transformedTileSize * outputMatrixSize);
+  TransformOutputErrorTiles(errorInThisLayer.Elements(), transformedErrors);
+
+  Real* transformedInputErrors = ScratchBuffer(0, transformedTileSize * inputMatrixSize);
+  memset(transformedInputErrors, 0, sizeof(Real) * transformedTileSize * inputMatrixSize);
+  for (uint32_t i = 0; i < transformedTileSize; ++i)
+  {
+	MultiplyMatrices(true, false, _inputChannelCount, tileCount, _filterCount, _transformedWeights->Elements() + (i * weightMatrixSize),
+	  _inputChannelCount, transformedErrors + (i * outputMatrixSize), tileCount, transformedInputErrors + (i * inputMatrixSize), tileCount);
+  }
+
+  Real transformedTile[36];
+  Real inputTile[36];
+  for (uint32_t inputChannel = 0; inputChannel < _inputChannelCount; ++inputChannel)
+  {
+	Real* errorPlane = errorInPreviousLayer.ElementAddress(inputChannel, 0, 0);
+	uint32_t tile = 0;
+	for (uint32_t tileRow = 0; tileRow < tileRows; ++tileRow)
+	{
+	  for (uint32_t tileCol = 0; tileCol < tileColumns; ++tileCol, ++tile)
+	  {
+		const Real* transformedInputError = transformedInputErrors + (inputChannel * tileCount) + tile;
+		for (uint32_t i = 0; i < transformedTileSize; ++i)
+		  transformedTile[i] = transformedInputError[i * inputMatrixSize];
+		Sandwich(transform.bt, inputTileSize, inputTileSize, 1, inputTileSize, transformedTile, inputTile);
+		// Input tiles overlap, and parts of them lie in the padding.
+		int32_t firstRow = int32_t(tileRow * tileSize) - _zeroPadding;
+		int32_t firstCol = int32_t(tileCol * tileSize) - _zeroPadding;
+		for (int32_t row = std::max(0, -firstRow); row < int32_t(inputTileSize) && firstRow + row < _inputRows; ++row)
+		{
+		  Real* error = errorPlane + ((firstRow + row) * _inputColumns) + firstCol;
+		  const Real* tileError = inputTile + (row * inputTileSize);
+		  for (int32_t col = std::max(0, -firstCol); col < int32_t(inputTileSize) && firstCol + col < _inputColumns; ++col)
+			error[col] += tileError[col];
+		}
+	  }
+	}
+  }
+}
+
+void ConvolutionalLayer::UpdateWeightErrorsWinograd(const Tensor& delta, const Tensor& previousLayerActivations, Tensor& nablaW) const
+{
+  // The error in the transformed filter U is the sum over tiles of (A * error * AT) . V. It is accumulated in the
+  // transformed domain and mapped back to the 3x3 filter with GT * (error in U) * G once at the end.
+  const WinogradTransform& transform = GetWinogradTransform(WinogradTileSize());
+  uint32_t tileSize = transform.tileSize;
+  uint32_t inputTileSize = transform.inputTileSize;
+  uint32_t transformedTileSize = inputTileSize * inputTileSize;
+  uint32_t tileCount = ((_outputRows + tileSize - 1) / tileSize) * ((_outputColumns + tileSize - 1) / tileSize);
+  size_t inputMatrixSize = size_t(_inputChannelCount) * tileCount;
+  size_t outputMatrixSize = size_t(_filterCount) * tileCount;
+  size_t weightMatrixSize = size_t(_filterCount) * _inputChannelCount;
+
+  Real* transformedInputs = ScratchBuffer(0, transformedTileSize * inputMatrixSize);
+  TransformInputTiles(previousLayerActivations.Elements(), transformedInputs);
+  Real* transformedErrors = ScratchBuffer(1, transformedTileSize * outputMatrixSize);
+  TransformOutputErrorTiles(delta.Elements(), transformedErrors);
+
+  Real* transformedWeightErrors = ScratchBuffer(2, transformedTileSize * weightMatrixSize);
+  memset(transformedWeightErrors, 0, sizeof(Real) * transformedTileSize * weightMatrixSize);
+  for (uint32_t i = 0; i < transformedTileSize; ++i)
+  {
+	MultiplyMatrices(false, true, _filterCount, _inputChannelCount, tileCount, transformedErrors + (i * outputMatrixSize), tileCount,
+	  transformedInputs + (i * inputMatrixSize), tileCount, transformedWeightErrors + (i * weightMatrixSize), _inputChannelCount);
+  }
+
+  Real transformedTile[36];
+  Real weightErrors[9];
+  Real* thisNablaW = nablaW.Elements();
+  for (size_t i = 0; i < weightMatrixSize; ++i)
+  {
+	for (uint32_t j = 0; j < transformedTileSize; ++j)
+	  transformedTile[j] = transformedWeightErrors[(j * weightMatrixSize) + i];
+	Sandwich(transform.g, 3, inputTileSize, 1, 3, transformedTile, weightErrors);
+	for (uint32_t j = 0; j < 9; ++j)
+	  thisNablaW[j] += weightErrors[j];
+	thisNablaW += 9;
+  }
+}
+
+void ConvolutionalLayer::TransformInputTiles(const Real* input, Real* transformedTiles) const
+{
+  // Calculates BT * d * B for every input tile d. The result for transformed element i of tile t in channel c
+  // is stored at transformedTiles[i * inputChannelCount * tileCount + c * tileCount + t].
+  const WinogradTransform& transform = GetWinogradTransform(WinogradTileSize());
+  uint32_t tileSize = transform.tileSize;
+  uint32_t inputTileSize = transform.inputTileSize;
+  uint32_t transformedTileSize = inputTileSize * inputTileSize;
+  uint32_t tileRows = (_outputRows + tileSize - 1) / tileSize;
+  uint32_t tileColumns = (_outputColumns + tileSize - 1) / tileSize;
+  uint32_t tileCount = tileRows * tileColumns;
+  size_t matrixSize = size_t(_inputChannelCount) * tileCount;
+  uint32_t inputPlaneSize = _inputRows * _inputColumns;
+  Real inputTile[36];
+  Real transformedTile[36];
+  for (uint32_t inputChannel = 0; inputChannel < _inputChannelCount; ++inputChannel)
+  {
+	const Real* inputPlane = input + (inputChannel * inputPlaneSize);
+	uint32_t tile = 0;
+	for (uint32_t tileRow = 0; tileRow < tileRows; ++tileRow)
+	{
+	  int32_t firstRow = int32_t(tileRow * tileSize) - _zeroPadding;
+	  for (uint32_t tileCol = 0; tileCol < tileColumns; ++tileCol, ++tile)
+	  {
+		int32_t firstCol = int32_t(tileCol * tileSize) - _zeroPadding;
+		Real* in = inputTile;
+		for (int32_t row = firstRow; row < firstRow + int32_t(inputTileSize); ++row)
+		{
+		  for (int32_t col = firstCol; col < firstCol + int32_t(inputTileSize); ++col)
 		  {
-			const double* in = inputs.ElementAddress(inputChannel, inputRow, inputCol);
-			const double* inEnd = in + filterSizeTimesInputWidth;
-			do
-			{
-			  const double* weightRowEnd = weight + _filterSize;
-			  do
-			  {
-				activation += (*in * *weight);
-				++weight;
-				++in;
-			  } while (weight != weightRowEnd);
-			  in += rowOffset;
-			} while (in < inEnd);
+			*in = (row >= 0 && row < _inputRows && col >= 0 && col < _inputColumns) ? inputPlane[(row * _inputColumns) + col] : 0.0;
+			++in;
+		  }
+		}
+		Sandwich(transform.bt, inputTileSize, inputTileSize, inputTileSize, 1, inputTile, transformedTile);
+		Real* transformed = transformedTiles + (inputChannel * tileCount) + tile;
+		for (uint32_t i = 0; i < transformedTileSize; ++i)
+		  transformed[i * matrixSize] = transformedTile[i];
+	  }
+	}
+  }
+}
+
+void ConvolutionalLayer::TransformOutputErrorTiles(const Real* errors, Real* transformedTiles) const
+{
+  // Calculates A * e * AT for every output error tile e, stored in the same order as TransformInputTiles.
+  const WinogradTransform& transform = GetWinogradTransform(WinogradTileSize());
+  uint32_t tileSize = transform.tileSize;
+  uint32_t inputTileSize = transform.inputTileSize;
+  uint32_t transformedTileSize = inputTileSize * inputTileSize;
+  uint32_t tileRows = (_outputRows + tileSize - 1) / tileSize;
+  uint32_t tileColumns = (_outputColumns + tileSize - 1) / tileSize;
+  uint32_t tileCount = tileRows * tileColumns;
+  size_t matrixSize = size_t(_filterCount) * tileCount;
+  uint32_t outputPlaneSize = _outputRows * _outputColumns;
+  Real errorTile[16];
+  Real transformedTile[36];
+  for (uint32_t filter = 0; filter < _filterCount; ++filter)
+  {
+	const Real* errorPlane = errors + (filter * outputPlaneSize);
+	uint32_t tile = 0;
+	for (uint32_t tileRow = 0; tileRow < tileRows; ++tileRow)
+	{
+	  for (uint32_t tileCol = 0; tileCol < tileColumns; ++tileCol, ++tile)
+	  {
+		Real* e = errorTile;
+		for (uint32_t row = tileRow * tileSize; row < (tileRow + 1) * tileSize; ++row)
+		{
+		  for (uint32_t col = tileCol * tileSize; col < (tileCol + 1) * tileSize; ++col)
+		  {
+			*e = (row < _outputRows && col < _outputColumns) ? errorPlane[(row * _outputColumns) + col] : 0.0;
+			++e;
 		  }
-		  *output = activation;
-		  ++output;
 		}
+		Sandwich(transform.at, inputTileSize, tileSize, 1, inputTileSize, errorTile, transformedTile);
+		Real* transformed = transformedTiles + (filter * tileCount) + tile;
+		for (uint32_t i = 0; i < transformedTileSize; ++i)
+		  transformed[i * matrixSize] = transformedTile[i];
 	  }
-	  filterWeights += filterWeightSize;
 	}
   }
 }
 
+void ConvolutionalLayer::FeedForwardFft(const Tensor& inputs, Tensor& outputs) const
+{
+  // Each output plane is the inverse transform of the sum over input channels of the input spectrum multiplied by
+  // the conjugate of the filter spectrum, sampled at every stride'th row and column.
+  uint32_t transformRows = _fourierTransform->Rows();
+  uint32_t transformColumns = _fourierTransform->Columns();
+  uint32_t spectrumSize = _fourierTransform->SpectrumSize();
+  Real* plane = ScratchBuffer(0, transformRows * transformColumns);
+  Complex* inputSpectra = SpectrumBuffer(0, size_t(_inputChannelCount) * spectrumSize);
+  Complex* outputSpectrum = SpectrumBuffer(1, spectrumSize);
+
+  // Only as much of the input as fits in the transform is needed.
+  int32_t rowCount = std::min(_inputRows, int32_t(transformRows) - _zeroPadding);
+  int32_t columnCount = std::min(_inputColumns, int32_t(transformColumns) - _zeroPadding);
+  memset(plane, 0, sizeof(Real) * transformRows * transformColumns);
+  for (uint32_t inputChannel = 0; inputChannel < _inputChannelCount; ++inputChannel)
+  {
+	const Real* input = inputs.ElementAddress(inputChannel, 0, 0);
+	Real* paddedInput = plane + (_zeroPadding * transformColumns) + _zeroPadding;
+	for (int32_t row = 0; row < rowCount; ++row)
+	  memcpy(paddedInput + (row * transformColumns), input + (row * _inputColumns), sizeof(Real) * columnCount);
+	_fourierTransform->Forward(plane, inputSpectra + (inputChannel * spectrumSize));
+  }
+
+  const Complex* filterSpectrum = _filterSpectra.get();
+  for (uint32_t filter = 0; filter < _filterCount; ++filter)
+  {
+	std::fill(outputSpectrum, outputSpectrum + spectrumSize, Complex());
+	const Complex* inputSpectrum = inputSpectra;
+	for (uint32_t inputChannel = 0; inputChannel < _inputChannelCount; ++inputChannel)
+	{
+	  for (uint32_t i = 0; i < spectrumSize; ++i)
+		outputSpectrum[i] += MultiplyConjugate(inputSpectrum[i], filterSpectrum[i]);
+	  inputSpectrum += spectrumSize;
+	  filterSpectrum += spectrumSize;
+	}
+	_fourierTransform->Inverse(outputSpectrum, plane);
+
+	Real filterBias = _biases->Get(filter);
+	Real* output = outputs.ElementAddress(filter, 0, 0);
+	for (uint32_t outputRow = 0; outputRow < _outputRows; ++outputRow)
+	{
+	  const Real* correlation = plane + (outputRow * _stride * transformColumns);
+	  for (uint32_t outputCol = 0; outputCol < _outputColumns; ++outputCol)
+		*output++ = correlation[outputCol * _stride] + filterBias;
+	}
+  }
+}
+
+void ConvolutionalLayer::BackpropagateErrorFft(const Tensor& errorInThisLayer, Tensor& errorInPreviousLayer) const
+{
+  // The error in the padded input is the sum over filters of the error, spread out by the stride, convolved
+  // with the filter, which is a product with the filter spectrum itself rather than its conjugate.
+  uint32_t transformRows = _fourierTransform->Rows();
+  uint32_t transformColumns = _fourierTransform->Columns();
+  uint32_t spectrumSize = _fourierTransform->SpectrumSize();
+  Real* plane = ScratchBuffer(0, transformRows * transformColumns);
+  Complex* errorSpectra = SpectrumBuffer(0, size_t(_filterCount) * spectrumSize);
+  Complex* inputErrorSpectrum = SpectrumBuffer(1, spectrumSize);
+
+  memset(plane, 0, sizeof(Real) * transformRows * transformColumns);
+  for (uint32_t filter = 0; filter < _filterCount; ++filter)
+  {
+	const Real* error = errorInThisLayer.ElementAddress(filter, 0, 0);
+	for (uint32_t outputRow = 0; outputRow < _outputRows; ++outputRow)
+	{
+	  Real* spreadError = plane + (outputRow * _stride * transformColumns);
+	  for (uint32_t outputCol = 0; outputCol < _outputColumns; ++outputCol)
+		spreadError[outputCol * _stride] = *error++;
+	}
+	_fourierTransform->Forward(plane, errorSpectra + (filter * spectrumSize));
+  }
+
+  size_t filterSpectrumStride = size_t(_inputChannelCount) * spectrumSize;
+  int32_t rowCount = std::min(_inputRows, int32_t(transformRows) - _zeroPadding);
+  int32_t columnCount = std::min(_inputColumns, int32_t(transformColumns) - _zeroPadding);
+  for (uint32_t inputChannel = 0; inputChannel < _inputChannelCount; ++inputChannel)
+  {
+	std::fill(inputErrorSpectrum, inputErrorSpectrum + spectrumSize, Complex());
+	const Complex* errorSpectrum = errorSpectra;
+	const Complex* filterSpectrum = _filterSpectra.get() + (inputChannel * spectrumSize);
+	for (uint32_t filter = 0; filter < _filterCount; ++filter)
+	{
+	  for (uint32_t i = 0; i < spectrumSize; ++i)
+		inputErrorSpectrum[i] += MultiplyComplex(errorSpectrum[i], filterSpectrum[i]);
+	  errorSpectrum += spectrumSize;
+	  filterSpectrum += filterSpectrumStride;
+	}
+	_fourierTransform->Inverse(inputErrorSpectrum, plane);
+
+	// Inputs beyond the end of the transform are never used, so their error stays zero.
+	Real* inputError = errorInPreviousLayer.ElementAddress(inputChannel, 0, 0);
+	const Real* paddedError = plane + (_zeroPadding * transformColumns) + _zeroPadding;
+	for (int32_t row = 0; row < rowCount; ++row)
+	  memcpy(inputError + (row * _inputColumns), paddedError + (row * transformColumns), sizeof(Real) * columnCount);
+  }
+}
+
 void ConvolutionalLayer::Save(std::ofstream& os) const
 {
   os.put((char)Types::Convolutional);
@@ -220,108 +972,128 @@ void ConvolutionalLayer::BackpropagateError(const Tensor& errorInThisLayer, Tens
   if (errorInThisLayer.Columns() != (_inputColumns + (_zeroPadding * 2) - _filterSize) / _stride + 1)
 	throw std::runtime_error("ConvolutionalLayer::BackpropagateError - error in this layer tensor has the wrong number of columns.");
 #endif
-  uint32_t outputRows = errorInThisLayer.Rows();
-  uint32_t outputCols = errorInThisLayer.Columns();
   errorInPreviousLayer.SetAllToZero();
-  if (_zeroPadding > 0)
+  switch (_algorithm)
   {
-	for (uint32_t filter = 0; filter < _filterCount; ++filter)
+	case Algorithms::Gemm:
+	  BackpropagateErrorGemm(errorInThisLayer, errorInPreviousLayer);
+	  break;
+	case Algorithms::WinogradF2x2:
+	case Algorithms::WinogradF4x4:
+	  BackpropagateErrorWinograd(errorInThisLayer, errorInPreviousLayer);
+	  break;
+	case Algorithms::Fft:
+	  BackpropagateErrorFft(errorInThisLayer, errorInPreviousLayer);
+	  break;
+	default:
+	  BackpropagateErrorDirect(errorInThisLayer, errorInPreviousLayer);
+  }
+}
+
+void ConvolutionalLayer::BackpropagateErrorDirect(const Tensor& errorInThisLayer, Tensor& errorInPreviousLayer) const
+{
+  if (_stride == 1)
+  {
+	// The error in the input is the convolution of the error, padded by filterSize - 1 - zeroPadding on each side,
+	// with the flipped filters, so it can be done by the same kernel as the feed forward pass.
+	uint32_t padding = _filterSize - 1 - _zeroPadding;
+	uint32_t errorRows = _outputRows + (2 * padding);
+	uint32_t errorColumns = _outputColumns + (2 * padding);
+	const Real* error = errorInThisLayer.Elements();
+	if (padding > 0)
 	{
-	  for (uint32_t inputChannel = 0; inputChannel < _inputChannelCount; ++inputChannel)
+	  Real* paddedError = ScratchBuffer(0, size_t(_filterCount) * errorRows * errorColumns);
+	  PadPlanes(error, _filterCount, _outputRows, _outputColumns, padding, padding, paddedError);
+	  error = paddedError;
+	}
+	Real* zeroBiases = ScratchBuffer(1, _inputChannelCount);
+	memset(zeroBiases, 0, sizeof(Real) * _inputChannelCount);
+	DirectConvolution shape { _filterCount, errorRows, errorColumns, uint32_t(_filterSize), 1, uint32_t(_inputRows),
+	  uint32_t(_inputColumns) };
+	_backpropagationKernel(shape, _inputChannelCount, error, _flippedWeights->Elements(), zeroBiases, errorInPreviousLayer.Elements());
+  }
+  else if (_zeroPadding > 0)
+  {
+	// Backpropagate into a padded plane, so that the filters never have to be clipped at the edges, and then
+	// keep the part of it that isn't padding.
+	uint32_t paddedRows = _inputRows + (2 * _zeroPadding);
+	uint32_t paddedColumns = _inputColumns + (2 * _zeroPadding);
+	size_t paddedPlaneSize = paddedRows * paddedColumns;
+	Real* paddedError = ScratchBuffer(0, _inputChannelCount * paddedPlaneSize);
+	memset(paddedError, 0, sizeof(Real) * _inputChannelCount * paddedPlaneSize);
+	BackpropagateErrorUnpadded(errorInThisLayer.Elements(), paddedError, paddedColumns, paddedPlaneSize);
+	for (uint32_t inputChannel = 0; inputChannel < _inputChannelCount; ++inputChannel)
+	{
+	  const Real* error = paddedError + (inputChannel * paddedPlaneSize) + (_zeroPadding * paddedColumns) + _zeroPadding;
+	  for (int32_t row = 0; row < _inputRows; ++row)
 	  {
-		const double* outputError = errorInThisLayer.ElementAddress(filter, 0, 0);
-		int32_t inputRow = -_zeroPadding;
-		for (uint32_t outputRow = 0; outputRow < outputRows; ++outputRow)
-		{
-		  int32_t filterStartRow = 0;
-		  int32_t filterEndRow = _filterSize;
-		  if (inputRow < 0)
-		  {
-			filterStartRow = -inputRow;
-		  }
-		  else if (inputRow + _filterSize > _inputRows)
-		  {
-			filterEndRow = _inputRows - inputRow;
-		  }
-
-		  int32_t inputCol = -_zeroPadding;
-		  for (uint32_t outputCol = 0; outputCol < outputCols; ++outputCol)
-		  {
-			int32_t filterStartCol = 0;
-			int32_t filterEndCol = _filterSize;
-			if (inputCol < 0)
-			{
-			  filterStartCol = -inputCol;
-			}
-			else if (inputCol + _filterSize > _inputColumns)
-			{
-			  filterEndCol = _inputColumns - inputCol;
-			}
-			size_t filterWidth = filterEndCol - filterStartCol;
-			size_t filterRowOffset = _filterSize - filterWidth;
-			size_t inputRowOffset = _inputColumns - filterWidth;
-
-			const double* weight = _weights->ElementAddress(filter, inputChannel, filterStartRow, filterStartCol);
-			// 
-			double* prevError = errorInPreviousLayer.ElementAddress(inputChannel, std::max(0, inputRow), std::max(0, inputCol));
-			for (int32_t filterRow = filterStartRow; filterRow < filterEndRow; ++filterRow)
-			{
-			  for (int32_t filterCol = filterStartCol; filterCol < filterEndCol; ++filterCol)
-			  {
-				*prevError += (*outputError * *weight);
-				++weight;
-				++prevError;
-			  }
-			  prevError += inputRowOffset;
-			  weight += filterRowOffset;
-			}
-			++outputError;
-			inputCol += _stride;
-		  }
-		  inputRow += _stride;
-		}
+		memcpy(errorInPreviousLayer.ElementAddress(inputChannel, row, 0), error, sizeof(Real) * _inputColumns);
+		error += paddedColumns;
 	  }
 	}
   }
   else
   {
-	double* inputChannelWeights = _weights->Elements();
-	size_t inputChannelWeightSize = _weights->Rows() * _weights->Columns();
-    uint32_t inputRowOffset = _inputColumns - _filterSize;
-	for (uint32_t filter = 0; filter < _filterCount; ++filter)
+	BackpropagateErrorUnpadded(errorInThisLayer.Elements(), errorInPreviousLayer.Elements(), _inputColumns,
+	  _inputRows * _inputColumns);
+  }
+}
+
+void ConvolutionalLayer::BackpropagateErrorUnpadded(const Real* errorInThisLayer, Real* errorInPreviousLayer,
+  uint32_t inputColumns, size_t inputPlaneSize) const
+{
+  const Real* inputChannelWeights = _weights->Elements();
+  size_t inputChannelWeightSize = _weights->Rows() * _weights->Columns();
+  uint32_t inputRowOffset = inputColumns - _filterSize;
+  uint32_t inputRowStride = inputColumns * _stride;
+  for (uint32_t filter = 0; filter < _filterCount; ++filter)
+  {
+	for (uint32_t inputChannel = 0; inputChannel < _inputChannelCount; ++inputChannel)
 	{
-	  for (uint32_t inputChannel = 0; inputChannel < _inputChannelCount; ++inputChannel)
+	  const Real* outputError = errorInThisLayer + (filter * _outputRows * _outputColumns);
+	  Real* inputRowError = errorInPreviousLayer + (inputChannel * inputPlaneSize);
+	  for (uint32_t outputRow = 0; outputRow < _outputRows; ++outputRow)
 	  {
-		const double* outputError = errorInThisLayer.ElementAddress(filter, 0, 0);
-		uint32_t inputRow = 0;
-		for (uint32_t outputRow = 0; outputRow < outputRows; ++outputRow)
+		Real* inputError = inputRowError;
+		for (uint32_t outputCol = 0; outputCol < _outputColumns; ++outputCol)
 		{
-  		  uint32_t inputCol = 0;
-		  for (uint32_t outputCol = 0; outputCol < outputCols; ++outputCol)
+		  const Real* weight = inputChannelWeights;
+		  Real* prevError = inputError;
+		  Real error = *outputError;
+		  for (int32_t filterRow = 0; filterRow < _filterSize; ++filterRow)
 		  {
-			double* weight = inputChannelWeights;
-			double* prevError = errorInPreviousLayer.ElementAddress(inputChannel, inputRow, inputCol);
-			for (int32_t filterRow = 0; filterRow < _filterSize; ++filterRow)
+			for (int32_t filterCol = 0; filterCol < _filterSize; ++filterCol)
 			{
-			  for (int32_t filterCol = 0; filterCol < _filterSize; ++filterCol)
-			  {
-				*prevError += (*outputError * *weight);
-				++weight;
-				++prevError;
-			  }
-			  prevError += inputRowOffset;
+			  *prevError += (error * *weight);
+			  ++weight;
+			  ++prevError;
 			}
-			++outputError;
-			inputCol += _stride;
+			prevError += inputRowOffset;
 		  }
-		  inputRow += _stride;
+		  ++outputError;
+		  inputError += _stride;
 		}
-		inputChannelWeights += inputChannelWeightSize;
+		inputRowError += inputRowStride;
 	  }
+	  inputChannelWeights += inputChannelWeightSize;
 	}
   }
 }
 
+void ConvolutionalLayer::BackpropagateErrorGemm(const Tensor& errorInThisLayer, Tensor& errorInPreviousLayer) const
+{
+  // Multiply the transposed weight matrix by the error to get the error in each element of the patch matrix,
+  // then add each patch element's error back to the input position it was copied from.
+  uint32_t patchSize = _inputChannelCount * _filterSize * _filterSize;
+  uint32_t outputPlaneSize = _outputRows * _outputColumns;
+  size_t patchMatrixSize = size_t(patchSize) * outputPlaneSize;
+  Real* patchErrors = ScratchBuffer(0, patchMatrixSize);
+  memset(patchErrors, 0, sizeof(Real) * patchMatrixSize);
+  MultiplyMatrices(true, false, patchSize, outputPlaneSize, _filterCount, _weights->Elements(), patchSize, errorInThisLayer.Elements(),
+	outputPlaneSize, patchErrors, outputPlaneSize);
+  AddPatchesToInput(patchErrors, errorInPreviousLayer.Elements());
+}
+
 void ConvolutionalLayer::UpdateWeightAndBiasErrors(const Tensor& delta, const Tensor& previousLayerActivations,
   Tensor& nablaW, Tensor& nablaB, const DropoutMask*)
 {
@@ -337,10 +1109,45 @@ void ConvolutionalLayer::UpdateWeightAndBiasErrors(const Tensor& delta, const Te
   if (!nablaB.DimensionsMatch(*_biases))
 	throw std::runtime_error("FullyConnectedLayer::UpdateWeightAndBiasErrors - Dimensions of nablaB do not match the bias dimensions.");
 #endif
+  switch (_algorithm)
+  {
+	// Correlating the spectra would need an inverse transform for every filter and input channel pair,
+	// which costs more than the matrix product, so the Fft algorithm uses Gemm for the weight errors.
+	case Algorithms::Gemm:
+	case Algorithms::Fft:
+	  UpdateWeightErrorsGemm(delta, previousLayerActivations, nablaW);
+	  break;
+	case Algorithms::WinogradF2x2:
+	case Algorithms::WinogradF4x4:
+	  UpdateWeightErrorsWinograd(delta, previousLayerActivations, nablaW);
+	  break;
+	default:
+	  UpdateWeightErrorsDirect(delta, previousLayerActivations, nablaW);
+  }
+
+  uint32_t deltaPlaneSize = delta.Rows() * delta.Columns();
+  Real* thisNablaB = nablaB.Elements();
+  for (uint32_t filter = 0; filter < _filterCount; ++filter)
+  {
+	Real biasUpdate = 0.0;
+	const Real* del = delta.ElementAddress(filter, 0, 0);
+	const Real* delEnd = del + deltaPlaneSize;
+	do
+	{
+	  biasUpdate += *del;
+	  ++del;
+	} while (del < delEnd);
+
+	*thisNablaB += biasUpdate;
+	++thisNablaB;
+  }
+}
+
+void ConvolutionalLayer::UpdateWeightErrorsDirect(const Tensor& delta, const Tensor& previousLayerActivations, Tensor& nablaW) const
+{
   uint32_t deltaPlaneSize = delta.Rows() * delta.Columns();
   uint32_t inputWidthTimesStride = _inputColumns * _stride;
-  double* thisNablaW = nablaW.Elements();
-  double* thisNablaB = nablaB.Elements();
+  Real* thisNablaW = nablaW.Elements();
   for (uint32_t filter = 0; filter < _filterCount; ++filter)
   {
 	if (_zeroPadding > 0)
@@ -355,14 +1162,14 @@ void ConvolutionalLayer::UpdateWeightAndBiasErrors(const Tensor& delta, const Te
 		  for (int32_t filterCol = 0; filterCol < _filterSize; ++filterCol)
 		  {
 			int32_t inputColSpan = filterColInfo->outputSpan * _stride;
-			const double* activation = previousLayerActivations.ElementAddress(inputChannel,
+			const Real* activation = previousLayerActivations.ElementAddress(inputChannel,
 			  filterRowInfo->inputStartOffset, filterColInfo->inputStartOffset);
-			const double* rowActivationEnd = activation + inputColSpan;
+			const Real* rowActivationEnd = activation + inputColSpan;
 			size_t activationOffset = inputWidthTimesStride - inputColSpan;
-			const double* activationEnd = activation + activationRowOffset;
-			const double* del = delta.ElementAddress(filter, filterRowInfo->outputStartOffset, filterColInfo->outputStartOffset);
+			const Real* activationEnd = activation + activationRowOffset;
+			const Real* del = delta.ElementAddress(filter, filterRowInfo->outputStartOffset, filterColInfo->outputStartOffset);
 			int32_t delOffset = delta.Columns() - filterColInfo->outputSpan;
-			double thisError = 0.0;
+			Real thisError = 0.0;
 			// Iterate over input rows.
 			do
 			{
@@ -393,15 +1200,15 @@ void ConvolutionalLayer::UpdateWeightAndBiasErrors(const Tensor& delta, const Te
 		{
 		  for (int32_t filterCol = 0; filterCol < _filterSize; ++filterCol)
 		  {
-			const double* rowFirstActivation = previousLayerActivations.ElementAddress(inputChannel, filterRow, filterCol);
-			const double* del = delta.ElementAddress(filter, 0, 0);
-			const double* delEnd = del + deltaPlaneSize;
-			double thisError = 0.0;
+			const Real* rowFirstActivation = previousLayerActivations.ElementAddress(inputChannel, filterRow, filterCol);
+			const Real* del = delta.ElementAddress(filter, 0, 0);
+			const Real* delEnd = del + deltaPlaneSize;
+			Real thisError = 0.0;
 			// Iterate over input rows.
 			do
 			{
-			  const double* activation = rowFirstActivation;
-			  const double* delRowEnd = del + delta.Columns();
+			  const Real* activation = rowFirstActivation;
+			  const Real* delRowEnd = del + delta.Columns();
 			  // Iterate over input columns.
 			  do
 			  {
@@ -417,21 +1224,20 @@ void ConvolutionalLayer::UpdateWeightAndBiasErrors(const Tensor& delta, const Te
 		}
 	  }
 	}
-
-	double biasUpdate = 0.0;
-	const double* del = delta.ElementAddress(filter, 0, 0);
-	const double* delEnd = del + deltaPlaneSize;
-	do
-	{
-	  biasUpdate += *del;
-	  ++del;
-	} while (del < delEnd);
-
-	*thisNablaB += biasUpdate;
-	++thisNablaB;
   }
 }
 
+void ConvolutionalLayer::UpdateWeightErrorsGemm(const Tensor& delta, const Tensor& previousLayerActivations, Tensor& nablaW) const
+{
+  // nablaW is the product of the error and the transposed patch matrix of the previous layer's activations.
+  uint32_t patchSize = _inputChannelCount * _filterSize * _filterSize;
+  uint32_t outputPlaneSize = _outputRows * _outputColumns;
+  Real* patches = ScratchBuffer(0, size_t(patchSize) * outputPlaneSize);
+  ExpandInputPatches(previousLayerActivations.Elements(), patches);
+  MultiplyMatrices(false, true, _filterCount, patchSize, outputPlaneSize, delta.Elements(), outputPlaneSize, patches, outputPlaneSize,
+	nablaW.Elements(), patchSize);
+}
+
 void ConvolutionalLayer::CalculateFilterInfo()
 {
   _filterRowInfo = std::make_unique<FilterInfo[]>(_filterSize);
@@ -442,13 +1248,13 @@ void ConvolutionalLayer::CalculateFilterInfo()
 
 void ConvolutionalLayer::CalculateFilterInfo(ConvolutionalLayer::FilterInfo* filterInfo, int32_t inputDimensionLength)
 {
+  // Element i of the filter starts offset places before the input. It first falls inside the input at the first output
+  // that moves it at least offset places along, and lands as far into the input as that output moves it past offset.
   for (int32_t i = 0; i < _zeroPadding; ++i)
   {
 	int32_t offset = _zeroPadding - i;
-	filterInfo[i].inputStartOffset = offset % _stride;
-	filterInfo[i].outputStartOffset = offset / _stride;
-	if (offset % _stride)
-	  ++filterInfo[i].outputStartOffset;
+	filterInfo[i].outputStartOffset = (offset + _stride - 1) / _stride;
+	filterInfo[i].inputStartOffset = (filterInfo[i].outputStartOffset * _stride) - offset;
   }
 
   for (int32_t i = _zeroPadding; i < _filterSize; ++i)
@@ -1,10 +1,19 @@
 #pragma once
 
+#include "ConvolutionKernels.h"
+#include "FFT.h"
 #include "Layer.h"
 
 class ConvolutionalLayer : public WeightedLayer
 {
 public:
+  // Direct runs the convolution loops over the input tensor. Gemm expands the input into a matrix of
+  // patches (im2col) and multiplies the filter bank by it, and does the backward passes as matrix products too.
+  // The Winograd algorithms compute 2x2 or 4x4 output tiles at a time from transformed input tiles and filters.
+  // They only work with 3x3 filters and a stride of 1. Fft multiplies the spectra of the input planes and filters,
+  // which makes the cost of the feed forward and backpropagation passes independent of the filter size.
+  enum class Algorithms { Direct = 0, Gemm = 1, WinogradF2x2 = 2, WinogradF4x4 = 3, Fft = 4 };
+
   // The weights Tensor is 4 dimensional.
   // The dimensions are weight row, weight column, input channel, and filter (output channel).
   // The bias Tensor is one-dimensional, with one bias for each filter.
@@ -14,13 +23,31 @@ public:
 	uint32_t filterSize, uint32_t stride, uint32_t zeroPadding, std::unique_ptr<::ActivationFunction>&&);
   ~ConvolutionalLayer() {}
   virtual void InitializeWeights() override;
+  virtual std::unique_ptr<Layer> Clone() const override;
   virtual void Description(std::ostream&) const override;
   virtual void Save(std::ofstream&) const override;
   virtual void SaveArchitecture(std::ostream&) const override;
   virtual void FeedForward(const Tensor& inputs, Tensor& outputs, const DropoutMask*) const override;
+  virtual bool SupportsChannelBlocked() const override { return true; }
+  virtual void FeedForwardChannelBlocked(const Tensor& inputs, Tensor& outputs) const override;
   virtual void BackpropagateError(const Tensor& errorInThisLayer, Tensor& errorInPreviousLayer, const DropoutMask*) const override;
   virtual void UpdateWeightAndBiasErrors(const Tensor& delta, const Tensor& previousLayerActivations,
 	Tensor& nablaW, Tensor& nablaB, const DropoutMask*) override;
+  virtual void RefreshWeightCache() override;
+  Algorithms Algorithm() const { return _algorithm; }
+  void Algorithm(Algorithms);
+  bool SupportsAlgorithm(Algorithms) const;
+  static const std::vector<Algorithms>& AllAlgorithms();
+  static const char* AlgorithmName(Algorithms);
+  uint32_t InputChannelCount() const { return _inputChannelCount; }
+  uint32_t InputRows() const { return _inputRows; }
+  uint32_t InputColumns() const { return _inputColumns; }
+  uint32_t FilterSize() const { return _filterSize; }
+  uint32_t Stride() const { return _stride; }
+  uint32_t ZeroPadding() const { return _zeroPadding; }
+  // Copies each patch of the input that a filter covers into a column of the patch matrix for the Gemm algorithm,
+  // which has one row for each weight in a filter and one column for each output position.
+  void ExpandInputPatches(const Real* input, Real* patches) const;
 private:
   struct FilterInfo
   {
@@ -29,9 +56,42 @@ private:
 	int outputSpan;
   };
 
+  Algorithms ChooseAlgorithm() const;
+  void FeedForwardDirect(const Tensor& inputs, Tensor& outputs) const;
+  void FeedForwardGemm(const Tensor& inputs, Tensor& outputs) const;
+  void BackpropagateErrorDirect(const Tensor& errorInThisLayer, Tensor& errorInPreviousLayer) const;
+  void BackpropagateErrorUnpadded(const Real* errorInThisLayer, Real* errorInPreviousLayer, uint32_t inputColumns,
+	size_t inputPlaneSize) const;
+  void BackpropagateErrorGemm(const Tensor& errorInThisLayer, Tensor& errorInPreviousLayer) const;
+  void UpdateWeightErrorsDirect(const Tensor& delta, const Tensor& previousLayerActivations, Tensor& nablaW) const;
+  void UpdateWeightErrorsGemm(const Tensor& delta, const Tensor& previousLayerActivations, Tensor& nablaW) const;
+  void AddPatchesToInput(const Real* patches, Real* input) const;
+  void FeedForwardWinograd(const Tensor& inputs, Tensor& outputs) const;
+  void BackpropagateErrorWinograd(const Tensor& errorInThisLayer, Tensor& errorInPreviousLayer) const;
+  void UpdateWeightErrorsWinograd(const Tensor& delta, const Tensor& previousLayerActivations, Tensor& nablaW) const;
+  void TransformInputTiles(const Real* input, Real* transformedTiles) const;
+  void TransformOutputErrorTiles(const Real* errors, Real* transformedTiles) const;
+  uint32_t WinogradTileSize() const { return _algorithm == Algorithms::WinogradF4x4 ? 4 : 2; }
+  void RefreshTransformedWeights();
+  void RefreshFlippedWeights();
+  void RefreshFilterSpectra();
+  void RefreshChannelBlockedWeights() const;
+  void FeedForwardFft(const Tensor& inputs, Tensor& outputs) const;
+  void BackpropagateErrorFft(const Tensor& errorInThisLayer, Tensor& errorInPreviousLayer) const;
+  uint32_t FourierTransformRows() const;
+  uint32_t FourierTransformColumns() const;
   void CalculateFilterInfo();
   void CalculateFilterInfo(ConvolutionalLayer::FilterInfo* filterInfo, int32_t inputDimensionLength);
 
+  // The filters transformed for the Winograd algorithms. There is a filterCount by inputChannelCount matrix for
+  // each element of the transformed tile.
+  TensorPtr _transformedWeights;
+  // The weights with the filter and input channel dimensions swapped and each filter rotated by 180 degrees. The
+  // Direct algorithm uses them to backpropagate through layers with a stride of 1.
+  TensorPtr _flippedWeights;
+  // The spectra of the filters for the Fft algorithm, for each filter and input channel in the same order as the weights.
+  std::unique_ptr<RealFourierTransform2D> _fourierTransform;
+  std::unique_ptr<Complex[]> _filterSpectra;
   std::unique_ptr<FilterInfo[]> _filterRowInfo;
   std::unique_ptr<FilterInfo[]> _filterColumnInfo;
   uint32_t _inputChannelCount;
@@ -41,4 +101,15 @@ private:
   int32_t _filterSize;
   int32_t  _stride;
   int32_t  _zeroPadding;
+  Algorithms _algorithm;
+  // The direct convolution kernels for this filter size, for the feed forward pass and for backpropagation with a stride of 1.
+  DirectConvolutionKernel _feedForwardKernel;
+  DirectConvolutionKernel _backpropagationKernel;
+  // The weights and biases for FeedForwardChannelBlocked, in the order described for ConvolveChannelBlocked. Training
+  // never uses them, so they are only built when FeedForwardChannelBlocked is first called after the weights change.
+  // Several threads can classify at once, so the first of them builds them while holding the mutex.
+  mutable TensorPtr _channelBlockedWeights;
+  mutable TensorPtr _channelBlockedBiases;
+  mutable std::atomic<bool> _channelBlockedWeightsStale;
+  mutable std::mutex _channelBlockedMutex;
 };
@@ -4,10 +4,10 @@
 
 double CrossEntropyCostFunction::TotalCost(const Tensor& outputActivations, const Tensor& targetActivations) const
 {
-  const double* end = outputActivations.Elements() + outputActivations.Size();
-  const double* target = targetActivations.Elements();
+  const Real* end = outputActivations.Elements() + outputActivations.Size();
+  const Real* target = targetActivations.Elements();
   double totalCost = 0.0;
-  for(const double* actual = outputActivations.Elements(); actual < end; ++actual)
+  for(const Real* actual = outputActivations.Elements(); actual < end; ++actual)
   {
 	if (*actual < 1.0 - 1e-7)
 	{
@@ -0,0 +1,301 @@
+#include "stdafx.h"
+#include "CppGenerator.h"
+#include "ConvolutionalLayer.h"
+#include "FeedForwardNetwork.h"
+
+namespace
+{
+
+// The kernels that the generated layers are instantiated from. They only use the standard library, so that the
+// generated file can be built on its own.
+const char* const kernels = R"(namespace
+{
+
+struct NoActivation
+{
+  static Real Apply(Real x, Real) { return x; }
+};
+
+struct ReLUActivation
+{
+  static Real Apply(Real x, Real) { return x < 0.0 ? Real(0.0) : x; }
+};
+
+struct LeakyReLUActivation
+{
+  static Real Apply(Real x, Real leakiness) { return x < 0.0 ? x * leakiness : x; }
+};
+
+struct SigmoidActivation
+{
+  static Real Apply(Real x, Real) { return Real(1.0 / (1.0 + std::exp(-x))); }
+};
+
+struct TanHActivation
+{
+  static Real Apply(Real x, Real) { return Real(2.0 / (1.0 + std::exp(-2.0 * x)) - 1.0); }
+};
+
+// Works out FB filters at XB neighbouring positions of one output row, starting at filter f and column ox. The
+// tile is added up in local sums, which the compiler can keep in registers while it goes through every weight.
+template <unsigned C, unsigned PH, unsigned PW, unsigned K, unsigned S, unsigned OW, unsigned FB, unsigned XB,
+  class Activation>
+inline void ConvolutionTile(const Real* weights, const Real* biases, const Real* in, Real* output, unsigned f,
+  unsigned oy, unsigned ox, unsigned planeSize, Real parameter)
+{
+  Real sums[FB][XB];
+  for (unsigned fb = 0; fb < FB; ++fb)
+    for (unsigned xb = 0; xb < XB; ++xb)
+      sums[fb][xb] = biases[f + fb];
+  for (unsigned c = 0; c < C; ++c)
+  {
+    for (unsigned ky = 0; ky < K; ++ky)
+    {
+      const Real* row = in + (size_t(c * PH + oy * S + ky) * PW) + (ox * S);
+      const Real* w = weights + (size_t(f * C + c) * K + ky) * K;
+      for (unsigned kx = 0; kx < K; ++kx)
+        for (unsigned fb = 0; fb < FB; ++fb)
+          for (unsigned xb = 0; xb < XB; ++xb)
+            sums[fb][xb] += w[(size_t(fb) * C * K * K) + kx] * row[xb * S + kx];
+    }
+  }
+  for (unsigned fb = 0; fb < FB; ++fb)
+    for (unsigned xb = 0; xb < XB; ++xb)
+      output[((f + fb) * planeSize) + (oy * OW) + ox + xb] = Activation::Apply(sums[fb][xb], parameter);
+}
+
+// The input has C planes of H by W, and the weights are in filter, input channel, row, column order. The output is
+// worked out in tiles of 8 filters by 8 columns, with smaller tiles at the edges.
+template <unsigned C, unsigned H, unsigned W, unsigned F, unsigned K, unsigned S, unsigned P, class Activation>
+inline void Convolution(const Real* weights, const Real* biases, const Real* input, Real* output, Real* padded,
+  Real parameter)
+{
+  constexpr unsigned PH = H + 2 * P;
+  constexpr unsigned PW = W + 2 * P;
+  constexpr unsigned OH = (PH - K) / S + 1;
+  constexpr unsigned OW = (PW - K) / S + 1;
+  constexpr unsigned FB = F < 8 ? F : 8;
+  constexpr unsigned XB = OW < 8 ? OW : 8;
+  constexpr unsigned FT = F % FB == 0 ? FB : F % FB;
+  constexpr unsigned XT = OW % XB == 0 ? XB : OW % XB;
+  const Real* in = input;
+  if (P > 0)
+  {
+    std::memset(padded, 0, sizeof(Real) * C * PH * PW);
+    for (unsigned c = 0; c < C; ++c)
+      for (unsigned y = 0; y < H; ++y)
+        std::memcpy(padded + (size_t(c * PH + y + P) * PW) + P, input + (size_t(c * H + y) * W), sizeof(Real) * W);
+    in = padded;
+  }
+  for (unsigned f = 0; f < F; f += FB)
+  {
+    for (unsigned oy = 0; oy < OH; ++oy)
+    {
+      unsigned ox = 0;
+      for (; ox + XB <= OW; ox += XB)
+      {
+        if (f + FB <= F)
+          ConvolutionTile<C, PH, PW, K, S, OW, FB, XB, Activation>(weights, biases, in, output, f, oy, ox, OH * OW, parameter);
+        else
+          ConvolutionTile<C, PH, PW, K, S, OW, FT, XB, Activation>(weights, biases, in, output, f, oy, ox, OH * OW, parameter);
+      }
+      if (ox < OW)
+      {
+        if (f + FB <= F)
+          ConvolutionTile<C, PH, PW, K, S, OW, FB, XT, Activation>(weights, biases, in, output, f, oy, ox, OH * OW, parameter);
+        else
+          ConvolutionTile<C, PH, PW, K, S, OW, FT, XT, Activation>(weights, biases, in, output, f, oy, ox, OH * OW, parameter);
+      }
+    }
+  }
+}
+
+template <unsigned C, unsigned H, unsigned W>
+inline void MaxPooling(const Real* input, Real* output)
+{
+  for (unsigned c = 0; c < C; ++c)
+  {
+    for (unsigned oy = 0; oy < H / 2; ++oy)
+    {
+      const Real* row1 = input + (size_t(c * H + 2 * oy) * W);
+      const Real* row2 = row1 + W;
+      Real* out = output + (size_t(c * (H / 2) + oy) * (W / 2));
+      for (unsigned ox = 0; ox < W / 2; ++ox)
+      {
+        Real m = row1[2 * ox];
+        if (row1[2 * ox + 1] > m)
+          m = row1[2 * ox + 1];
+        if (row2[2 * ox] > m)
+          m = row2[2 * ox];
+        if (row2[2 * ox + 1] > m)
+          m = row2[2 * ox + 1];
+        out[ox] = m;
+      }
+    }
+  }
+}
+
+// The weights have one row of N for each of the M neurons. Each row is added up in 8 separate sums, so the compiler
+// can vectorize it without reordering the additions itself.
+template <unsigned N, unsigned M, class Activation>
+inline void FullyConnected(const Real* weights, const Real* biases, const Real* input, Real* output, Real parameter)
+{
+  for (unsigned o = 0; o < M; ++o)
+  {
+    const Real* row = weights + (size_t(o) * N);
+    Real sums[8] = {};
+    unsigned i = 0;
+    for (; i + 8 <= N; i += 8)
+      for (unsigned l = 0; l < 8; ++l)
+        sums[l] += row[i + l] * input[i + l];
+    Real sum = biases[o];
+    for (; i < N; ++i)
+      sum += row[i] * input[i];
+    for (unsigned l = 0; l < 8; ++l)
+      sum += sums[l];
+    output[o] = Activation::Apply(sum, parameter);
+  }
+}
+
+}
+)";
+
+const char* ActivationName(const ActivationFunction* activationFunction)
+{
+  switch (activationFunction ? activationFunction->Type() : ActivationFunction::Types::None)
+  {
+	case ActivationFunction::Types::ReLU:
+	  return "ReLUActivation";
+	case ActivationFunction::Types::LeakyReLU:
+	  return "LeakyReLUActivation";
+	case ActivationFunction::Types::Sigmoid:
+	  return "SigmoidActivation";
+	case ActivationFunction::Types::TanH:
+	  return "TanHActivation";
+	default:
+	  return "NoActivation";
+  }
+}
+
+// The stream is set to write enough digits for a double to read back as the same value. A float is written as a
+// double too, since it then converts back to exactly the same float.
+void WriteReal(std::ostream& os, Real value)
+{
+  os << static_cast<double>(value);
+}
+
+void WriteArray(std::ostream& os, const std::string& name, const Tensor& t)
+{
+  os << "alignas(64) constexpr Real " << name << '[' << t.Size() << "] =\n{";
+  for (uint32_t i = 0; i < t.Size(); ++i)
+  {
+	os << (i % 8 == 0 ? "\n  " : " ");
+	WriteReal(os, t.Get(i));
+	if (i + 1 < t.Size())
+	  os << ',';
+  }
+  os << "\n};\n\n";
+}
+
+}
+
+void CppGenerator::Generate(FeedForwardNetwork& network, const std::string& nameSpace, std::ostream& os)
+{
+  if (network.Layers().empty())
+	throw std::runtime_error("CppGenerator - the network has no layers.");
+  for (const auto& layer : network.Layers())
+  {
+	if (!dynamic_cast<const WeightedLayer*>(layer.get()) && !dynamic_cast<const MaxPoolingLayer*>(layer.get()))
+	  throw std::runtime_error("CppGenerator - unsupported layer type.");
+  }
+  auto precision = os.precision(std::numeric_limits<double>::max_digits10);
+  for (auto& layer : network.Layers())
+	layer->SwitchToTestingWeights();
+  const Layer& topLayer = *network.TopLayer();
+  uint32_t outputSize = topLayer.OutputPlanes() * topLayer.OutputRows() * topLayer.OutputColumns();
+  os << "// Generated by FishNet from the network " << network.Name() << ", trained for " << network.EpochsTrained()
+	<< " epochs.\n"
+	<< "#include <cmath>\n#include <cstddef>\n#include <cstring>\n\n"
+	<< "namespace " << Identifier(nameSpace) << "\n{\n\n"
+	<< "typedef " << (sizeof(Real) == sizeof(float) ? "float" : "double") << " Real;\n\n"
+	<< "constexpr unsigned InputChannels = " << network.InputChannelCount() << ";\n"
+	<< "constexpr unsigned InputRows = " << network.InputRows() << ";\n"
+	<< "constexpr unsigned InputColumns = " << network.InputColumns() << ";\n"
+	<< "constexpr unsigned OutputSize = " << outputSize << ";\n\n"
+	<< kernels << '\n';
+
+  // Write the weights and the calls that make up the feed forward pass, keeping track of the shape of each layer's
+  // input and the size of the buffers that the calls need.
+  std::ostringstream calls;
+  calls.precision(std::numeric_limits<double>::max_digits10);
+  uint32_t channels = network.InputChannelCount();
+  uint32_t rows = network.InputRows();
+  uint32_t columns = network.InputColumns();
+  size_t bufferSize = 0;
+  const auto& layers = network.Layers();
+  for (size_t li = 0; li < layers.size(); ++li)
+  {
+	const Layer& layer = *layers[li];
+	std::string in = li == 0 ? "input" : (li % 2 == 1 ? "buffers[0]" : "buffers[1]");
+	std::string out = li + 1 == layers.size() ? "output" : (li % 2 == 0 ? "buffers[0]" : "buffers[1]");
+	std::string prefix = "layer" + std::to_string(li);
+	auto wl = dynamic_cast<const WeightedLayer*>(&layer);
+	auto cl = dynamic_cast<const ConvolutionalLayer*>(&layer);
+	if (wl)
+	{
+	  WriteArray(os, prefix + "Weights", wl->Weights());
+	  WriteArray(os, prefix + "Biases", wl->Biases());
+	  if (cl)
+	  {
+		calls << "  Convolution<" << channels << ", " << rows << ", " << columns << ", " << layer.OutputPlanes() << ", "
+		  << cl->FilterSize() << ", " << cl->Stride() << ", " << cl->ZeroPadding() << ", ";
+		bufferSize = std::max(bufferSize,
+		  size_t(channels) * (rows + 2 * cl->ZeroPadding()) * (columns + 2 * cl->ZeroPadding()));
+	  }
+	  else
+	  {
+		calls << "  FullyConnected<" << wl->Weights().Columns() << ", " << wl->Weights().Rows() << ", ";
+	  }
+	  calls << ActivationName(wl->ActivationFunction()) << ">(" << prefix << "Weights, " << prefix << "Biases, " << in
+		<< ", " << out << (cl ? ", buffers[2], " : ", ");
+	  auto leakyReLU = dynamic_cast<const LeakyReLU*>(wl->ActivationFunction());
+	  WriteReal(calls, leakyReLU ? static_cast<Real>(leakyReLU->Leakiness()) : Real(0.0));
+	  calls << ");\n";
+	}
+	else
+	{
+	  calls << "  MaxPooling<" << channels << ", " << rows << ", " << columns << ">(" << in << ", " << out << ");\n";
+	}
+	channels = layer.OutputPlanes();
+	rows = layer.OutputRows();
+	columns = layer.OutputColumns();
+	bufferSize = std::max(bufferSize, size_t(channels) * rows * columns);
+  }
+  for (auto& layer : network.Layers())
+	layer->SwitchToTrainingWeights();
+
+  os << "void FeedForward(const Real* input, Real* output)\n{\n"
+	<< "  alignas(64) static thread_local Real buffers[3][" << bufferSize << "];\n"
+	<< calls.str() << "}\n\n"
+	<< "unsigned Classify(const Real* input)\n{\n"
+	<< "  Real output[OutputSize];\n"
+	<< "  FeedForward(input, output);\n"
+	<< "  unsigned highest = 0;\n"
+	<< "  for (unsigned i = 1; i < OutputSize; ++i)\n"
+	<< "    if (output[i] > output[highest])\n"
+	<< "      highest = i;\n"
+	<< "  return highest;\n"
+	<< "}\n\n"
+	<< "}\n";
+  os.precision(precision);
+}
+
+std::string CppGenerator::Identifier(const std::string& name)
+{
+  std::string identifier;
+  for (char c : name)
+	identifier += isalnum(static_cast<unsigned char>(c)) ? c : '_';
+  if (identifier.empty() || isdigit(static_cast<unsigned char>(identifier[0])))
+	identifier = "Network" + identifier;
+  return identifier;
+}
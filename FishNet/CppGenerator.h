@@ -0,0 +1,23 @@
+#pragma once
+
+class FeedForwardNetwork;
+
+// Writes a trained network out as a self-contained C++ source file, for programs that only need to classify with one
+// fixed network and don't want to link FishNet. The weights become constexpr arrays and each layer is an
+// instantiation of a kernel template whose loop bounds are template arguments, so the compiler knows the exact shape
+// of every loop. The generated file only needs the standard library, and defines these in the given namespace:
+//
+//   typedef float or double Real;  (the same as this build of FishNet)
+//   constexpr unsigned InputChannels, InputRows, InputColumns, OutputSize;
+//   void FeedForward(const Real* input, Real* output);
+//   unsigned Classify(const Real* input);
+//
+// The input is laid out as planes, in the same order as a Tensor. Each thread gets its own activation buffers.
+class CppGenerator
+{
+public:
+  // Fully connected layers are written with their testing weights.
+  static void Generate(FeedForwardNetwork&, const std::string& nameSpace, std::ostream&);
+  // Turns a network name into something that can be used as a namespace.
+  static std::string Identifier(const std::string& name);
+};
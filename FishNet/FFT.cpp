@@ -0,0 +1,246 @@
+#include "stdafx.h"
+#include "FFT.h"
+
+namespace
+{
+
+// Rows and columns are copied into these while they are transformed. Each thread needs its own.
+Complex* ScratchBuffer(uint32_t index, size_t size)
+{
+  thread_local std::vector<Complex> buffers[3];
+  std::vector<Complex>& buffer = buffers[index];
+  if (buffer.size() < size)
+	buffer.resize(size);
+  return buffer.data();
+}
+
+}
+
+FourierTransform::FourierTransform(uint32_t size)
+  : _size(size),
+	_twiddles(std::make_unique<Complex[]>(size)),
+	_inverseTwiddles(std::make_unique<Complex[]>(size))
+{
+  if (size == 0 || SmoothSize(size) != size)
+	throw std::runtime_error("The size of a Fourier transform can only have factors of 2, 3 and 5.");
+  // Radix 4 passes need fewer multiplications than pairs of radix 2 passes, so they are used where possible.
+  uint32_t remaining = size;
+  for (uint32_t radix : { 4, 2, 3, 5 })
+  {
+	while (remaining % radix == 0 && remaining > 1)
+	{
+	  remaining /= radix;
+	  _factors.push_back(radix);
+	  _factors.push_back(remaining);
+	}
+  }
+  if (size == 1)
+  {
+	_factors.push_back(1);
+	_factors.push_back(1);
+  }
+  const double pi = 3.14159265358979323846;
+  for (uint32_t i = 0; i < size; ++i)
+  {
+	double angle = -2.0 * pi * i / size;
+	_twiddles[i] = Complex(cos(angle), sin(angle));
+	_inverseTwiddles[i] = std::conj(_twiddles[i]);
+  }
+}
+
+uint32_t FourierTransform::SmoothSize(uint32_t minimumSize)
+{
+  for (uint32_t size = std::max(minimumSize, 1U); ; ++size)
+  {
+	uint32_t remaining = size;
+	for (uint32_t factor : { 2, 3, 5 })
+	{
+	  while (remaining % factor == 0)
+		remaining /= factor;
+	}
+	if (remaining == 1)
+	  return size;
+  }
+}
+
+// A recursive decimation in time transform. The input is split into radix interleaved sequences, which are
+// transformed into consecutive blocks of the output and then combined with butterflies.
+void FourierTransform::Transform(Complex* output, const Complex* input, size_t twiddleStride, size_t inputStride,
+  const uint32_t* factors, const Complex* twiddles) const
+{
+  uint32_t radix = factors[0];
+  uint32_t m = factors[1];
+  size_t step = twiddleStride * inputStride;
+  if (m == 1)
+  {
+	for (uint32_t i = 0; i < radix; ++i)
+	  output[i] = input[i * step];
+  }
+  else
+  {
+	for (uint32_t i = 0; i < radix; ++i)
+	  Transform(output + (i * m), input + (i * step), twiddleStride * radix, inputStride, factors + 2, twiddles);
+  }
+
+  switch (radix)
+  {
+	case 1:
+	  break;
+	case 2:
+	  for (uint32_t k = 0; k < m; ++k)
+	  {
+		Complex t = MultiplyComplex(output[k + m], twiddles[k * twiddleStride]);
+		output[k + m] = output[k] - t;
+		output[k] += t;
+	  }
+	  break;
+	case 4:
+	{
+	  bool inverse = twiddles == _inverseTwiddles.get();
+	  for (uint32_t k = 0; k < m; ++k)
+	  {
+		Complex s0 = MultiplyComplex(output[k + m], twiddles[k * twiddleStride]);
+		Complex s1 = MultiplyComplex(output[k + (2 * m)], twiddles[2 * k * twiddleStride]);
+		Complex s2 = MultiplyComplex(output[k + (3 * m)], twiddles[3 * k * twiddleStride]);
+		Complex s5 = output[k] - s1;
+		output[k] += s1;
+		Complex s3 = s0 + s2;
+		Complex s4 = s0 - s2;
+		output[k + (2 * m)] = output[k] - s3;
+		output[k] += s3;
+		// s4 is multiplied by -i for the forward transform, and i for the inverse.
+		if (inverse)
+		{
+		  output[k + m] = Complex(s5.real() - s4.imag(), s5.imag() + s4.real());
+		  output[k + (3 * m)] = Complex(s5.real() + s4.imag(), s5.imag() - s4.real());
+		}
+		else
+		{
+		  output[k + m] = Complex(s5.real() + s4.imag(), s5.imag() - s4.real());
+		  output[k + (3 * m)] = Complex(s5.real() - s4.imag(), s5.imag() + s4.real());
+		}
+	  }
+	  break;
+	}
+	default:
+	{
+	  // A direct DFT of size radix for each group, which is fine for 3 and 5.
+	  Complex inputs[5];
+	  for (uint32_t u = 0; u < m; ++u)
+	  {
+		for (uint32_t i = 0; i < radix; ++i)
+		  inputs[i] = output[u + (i * m)];
+		for (uint32_t i = 0; i < radix; ++i)
+		{
+		  uint32_t k = u + (i * m);
+		  Complex sum = inputs[0];
+		  size_t twiddleIndex = 0;
+		  for (uint32_t q = 1; q < radix; ++q)
+		  {
+			twiddleIndex += twiddleStride * k;
+			if (twiddleIndex >= _size)
+			  twiddleIndex -= _size;
+			sum += MultiplyComplex(inputs[q], twiddles[twiddleIndex]);
+		  }
+		  output[k] = sum;
+		}
+	  }
+	}
+  }
+}
+
+RealFourierTransform2D::RealFourierTransform2D(uint32_t rows, uint32_t columns)
+  : _rowTransform(columns),
+	_columnTransform(rows),
+	_spectrumColumns((columns / 2) + 1)
+{
+}
+
+// Pairs of rows are transformed together as the real and imaginary parts of one complex row, and separated
+// using the symmetry of the spectra of real rows. Then the columns of the half spectrum are transformed.
+void RealFourierTransform2D::Forward(const Real* input, Complex* spectrum) const
+{
+  uint32_t rows = Rows();
+  uint32_t columns = Columns();
+  Complex* row = ScratchBuffer(0, columns);
+  Complex* rowSpectrum = ScratchBuffer(1, columns);
+  for (uint32_t r = 0; r < rows; r += 2)
+  {
+	const Real* first = input + (r * columns);
+	bool paired = r + 1 < rows;
+	if (paired)
+	{
+	  const Real* second = first + columns;
+	  for (uint32_t c = 0; c < columns; ++c)
+		row[c] = Complex(first[c], second[c]);
+	}
+	else
+	{
+	  for (uint32_t c = 0; c < columns; ++c)
+		row[c] = Complex(first[c], 0.0);
+	}
+	_rowTransform.Forward(row, 1, rowSpectrum);
+	Complex* firstSpectrum = spectrum + (r * _spectrumColumns);
+	Complex* secondSpectrum = firstSpectrum + _spectrumColumns;
+	for (uint32_t k = 0; k < _spectrumColumns; ++k)
+	{
+	  Complex z = rowSpectrum[k];
+	  Complex mirror = std::conj(rowSpectrum[k == 0 ? 0 : columns - k]);
+	  firstSpectrum[k] = 0.5 * (z + mirror);
+	  if (paired)
+	  {
+		Complex difference = z - mirror;
+		secondSpectrum[k] = Complex(0.5 * difference.imag(), -0.5 * difference.real());
+	  }
+	}
+  }
+
+  Complex* column = ScratchBuffer(0, rows);
+  for (uint32_t k = 0; k < _spectrumColumns; ++k)
+  {
+	_columnTransform.Forward(spectrum + k, _spectrumColumns, column);
+	for (uint32_t r = 0; r < rows; ++r)
+	  spectrum[(r * _spectrumColumns) + k] = column[r];
+  }
+}
+
+void RealFourierTransform2D::Inverse(const Complex* spectrum, Real* output) const
+{
+  uint32_t rows = Rows();
+  uint32_t columns = Columns();
+  Complex* rowSpectra = ScratchBuffer(2, SpectrumSize());
+  Complex* column = ScratchBuffer(0, rows);
+  for (uint32_t k = 0; k < _spectrumColumns; ++k)
+  {
+	_columnTransform.Inverse(spectrum + k, _spectrumColumns, column);
+	for (uint32_t r = 0; r < rows; ++r)
+	  rowSpectra[(r * _spectrumColumns) + k] = column[r];
+  }
+
+  // Two real rows come back as the real and imaginary parts of the inverse of first + i * second.
+  double scale = 1.0 / (rows * columns);
+  Complex* row = ScratchBuffer(0, columns);
+  Complex* values = ScratchBuffer(1, columns);
+  for (uint32_t r = 0; r < rows; r += 2)
+  {
+	const Complex* firstSpectrum = rowSpectra + (r * _spectrumColumns);
+	bool paired = r + 1 < rows;
+	const Complex* secondSpectrum = firstSpectrum + _spectrumColumns;
+	for (uint32_t c = 0; c < columns; ++c)
+	{
+	  Complex first = c < _spectrumColumns ? firstSpectrum[c] : std::conj(firstSpectrum[columns - c]);
+	  Complex second = !paired ? Complex() : c < _spectrumColumns ? secondSpectrum[c] : std::conj(secondSpectrum[columns - c]);
+	  row[c] = Complex(first.real() - second.imag(), first.imag() + second.real());
+	}
+	_rowTransform.Inverse(row, 1, values);
+	Real* firstOutput = output + (r * columns);
+	for (uint32_t c = 0; c < columns; ++c)
+	  firstOutput[c] = values[c].real() * scale;
+	if (paired)
+	{
+	  Real* secondOutput = firstOutput + columns;
+	  for (uint32_t c = 0; c < columns; ++c)
+		secondOutput[c] = values[c].imag() * scale;
+	}
+  }
+}
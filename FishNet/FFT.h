@@ -0,0 +1,65 @@
+#pragma once
+
+#include "Tensor.h"
+
+typedef std::complex<double> Complex;
+
+// A mixed radix fast Fourier transform for sizes whose only prime factors are 2, 3 and 5. The inverse
+// transform is not scaled, so applying both multiplies the input by the size.
+class FourierTransform
+{
+public:
+  FourierTransform(uint32_t size);
+  // Returns the smallest size at least as big as minimumSize which only has factors of 2, 3 and 5.
+  static uint32_t SmoothSize(uint32_t minimumSize);
+  uint32_t Size() const { return _size; }
+  // Element i of the input is at input[i * inputStride]. The output is contiguous and must not overlap the input.
+  void Forward(const Complex* input, size_t inputStride, Complex* output) const
+  {
+	Transform(output, input, 1, inputStride, _factors.data(), _twiddles.get());
+  }
+  void Inverse(const Complex* input, size_t inputStride, Complex* output) const
+  {
+	Transform(output, input, 1, inputStride, _factors.data(), _inverseTwiddles.get());
+  }
+private:
+  void Transform(Complex* output, const Complex* input, size_t twiddleStride, size_t inputStride, const uint32_t* factors,
+	const Complex* twiddles) const;
+
+  uint32_t _size;
+  // Pairs of radix and the size of the sub-transforms that each pass combines.
+  std::vector<uint32_t> _factors;
+  std::unique_ptr<Complex[]> _twiddles;
+  std::unique_ptr<Complex[]> _inverseTwiddles;
+};
+
+// The two dimensional transform of a rows by columns real matrix. Since the spectrum of a real matrix is
+// conjugate symmetric, only the first columns / 2 + 1 columns of it are stored.
+class RealFourierTransform2D
+{
+public:
+  RealFourierTransform2D(uint32_t rows, uint32_t columns);
+  uint32_t Rows() const { return _columnTransform.Size(); }
+  uint32_t Columns() const { return _rowTransform.Size(); }
+  uint32_t SpectrumColumns() const { return _spectrumColumns; }
+  uint32_t SpectrumSize() const { return Rows() * _spectrumColumns; }
+  void Forward(const Real* input, Complex* spectrum) const;
+  // Scaled, so that Inverse undoes Forward.
+  void Inverse(const Complex* spectrum, Real* output) const;
+private:
+  FourierTransform _rowTransform;
+  FourierTransform _columnTransform;
+  uint32_t _spectrumColumns;
+};
+
+// The multiplication operator of std::complex checks for infinities and NaNs, which stops it from being inlined.
+inline Complex MultiplyComplex(const Complex& a, const Complex& b)
+{
+  return Complex((a.real() * b.real()) - (a.imag() * b.imag()), (a.real() * b.imag()) + (a.imag() * b.real()));
+}
+
+// Multiplies a by the complex conjugate of b.
+inline Complex MultiplyConjugate(const Complex& a, const Complex& b)
+{
+  return Complex((a.real() * b.real()) + (a.imag() * b.imag()), (a.imag() * b.real()) - (a.real() * b.imag()));
+}
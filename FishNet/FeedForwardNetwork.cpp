@@ -3,9 +3,13 @@
 #include "CostFunction.h"
 #include "ImageSet.h"
 #include "ConvolutionalLayer.h"
+#include "ConvolutionTuner.h"
+#include "InferencePlan.h"
+#include "QuantizedNetwork.h"
+#include "ThreadPool.h"
 
 static const char* magicString = "FishNet123";
-static const uint16_t currentFileVersion = 6;
+static const uint16_t currentFileVersion = 7;
 
 namespace
 {
@@ -32,6 +36,23 @@ std::string FileNameBase(const std::string& saveDir, const std::string& networkN
   return ss.str();
 }
 
+// A view of a workspace with the dimensions of a batch of a layer's outputs.
+Tensor OutputView(const Tensor& workspace, const Layer& layer, uint32_t batchSize)
+{
+  return workspace.View(batchSize, layer.OutputPlanes(), layer.OutputRows(), layer.OutputColumns());
+}
+
+// The parameters from first up to last that make up share number share of shareCount shares of count parameters. The
+// shares start at multiples of a cache line's worth of parameters. The tensors aren't allocated on cache line boundaries,
+// so neighbouring shares can still meet partway through a line, but no more than one line is shared by any two threads.
+std::pair<size_t, size_t> ShareRange(size_t count, uint32_t share, uint32_t shareCount)
+{
+  const size_t lineSize = 64 / sizeof(Real);
+  size_t first = ((count * share) / shareCount) / lineSize * lineSize;
+  size_t last = share + 1 == shareCount ? count : ((count * (share + 1)) / shareCount) / lineSize * lineSize;
+  return { first, last };
+}
+
 }
 
 FeedForwardNetwork::FeedForwardNetwork(const std::string& name, uint32_t inputChannelCount, uint32_t inputRows, uint32_t inputColumns,
@@ -39,7 +60,9 @@ FeedForwardNetwork::FeedForwardNetwork(const std::string& name, uint32_t inputCh
   : _name(name), _costFunction(std::move(costFunction)), _inputChannelCount(inputChannelCount), _inputRows(inputRows),
 	_inputColumns(inputColumns), _threadCount(threadCount), _epochsTrained(epochsTrained),
 	_learningRate(learningRate), _weightDecay(weightDecay), _weightDecayMultiplier(1.0),
-	_oneHotCategories(nullptr), _busyWorkerCount(0)
+	_channelBlocked(false), _mixedPrecision(false), _weightUpdateMode(WeightUpdateModes::Synchronous),
+	_averagingInterval(8), 	_oneHotCategories(nullptr),
+	_threadPool(ThreadPool::Shared(threadCount))
 {
 }
 
@@ -47,6 +70,32 @@ FeedForwardNetwork::~FeedForwardNetwork()
 {
 }
 
+const std::vector<FeedForwardNetwork::WeightUpdateModes>& FeedForwardNetwork::AllWeightUpdateModes()
+{
+  static const std::vector<WeightUpdateModes> modes { WeightUpdateModes::Synchronous, WeightUpdateModes::Overlapped,
+	WeightUpdateModes::Hogwild, WeightUpdateModes::LocalSgd, WeightUpdateModes::OneStepStale };
+  return modes;
+}
+
+const char* FeedForwardNetwork::WeightUpdateModeName(WeightUpdateModes mode)
+{
+  switch (mode)
+  {
+	case WeightUpdateModes::Synchronous:
+	  return "Synchronous";
+	case WeightUpdateModes::Overlapped:
+	  return "Overlapped";
+	case WeightUpdateModes::Hogwild:
+	  return "Hogwild";
+	case WeightUpdateModes::LocalSgd:
+	  return "Local SGD";
+	case WeightUpdateModes::OneStepStale:
+	  return "One step stale";
+	default:
+	  return "Unknown";
+  }
+}
+
 void FeedForwardNetwork::AddFullyConnectedLayer(uint32_t layerSize, std::unique_ptr<::ActivationFunction>&& activationFunction,
   double keepProbability)
 {
@@ -97,8 +146,10 @@ void FeedForwardNetwork::AddConvolutionalLayer(uint32_t filterCount, uint32_t fi
 	inputRows = prevLayer.OutputRows();
 	inputColumns = prevLayer.OutputColumns();
   }
-  _layers.emplace_back(std::make_unique<ConvolutionalLayer>(inputChannelCount, inputRows, inputColumns, filterCount, filterSize,
-	stride, zeroPadding, std::move(activationFunction)));
+  auto layer = std::make_unique<ConvolutionalLayer>(inputChannelCount, inputRows, inputColumns, filterCount, filterSize,
+	stride, zeroPadding, std::move(activationFunction));
+  ConvolutionTuner::Tune(*layer);
+  _layers.emplace_back(std::move(layer));
 }
 
 void FeedForwardNetwork::AddMaxPoolingLayer()
@@ -137,6 +188,8 @@ void FeedForwardNetwork::Save(const std::string& fileName)
   }
   os.write(magicString, 10);
   os.write((const char*)&currentFileVersion, sizeof(uint16_t));
+  // The weights are stored as they are held, so the file records whether they are floats or doubles.
+  os.put((char)sizeof(Real));
   uint16_t nameLength = static_cast<uint16_t>(_name.size());
   os.write((const char*)&nameLength, sizeof(uint16_t));
   os.write(_name.c_str(), _name.size());
@@ -171,6 +224,9 @@ std::unique_ptr<FeedForwardNetwork> FeedForwardNetwork::Load(const std::string&
 	msg << fileName << " was saved by a newer version  of FishNet. Please upgrade your version to load it.";
 	throw std::runtime_error(msg.str());
   }
+  uint32_t elementSize = sizeof(double);
+  if (versionNumber >= 7)
+	elementSize = is.get();
   std::string name;
   if (versionNumber >= 6)
   {
@@ -178,7 +234,7 @@ std::unique_ptr<FeedForwardNetwork> FeedForwardNetwork::Load(const std::string&
 	is.read((char*)&nameLength, sizeof(uint16_t));
 	auto s = std::make_unique<char[]>(nameLength);
 	is.read(s.get(), nameLength);
-	name = s.get();
+	name.assign(s.get(), nameLength);
   }
   uint32_t inputChannelCount, inputRows, inputColumns;
   is.read((char*)&inputChannelCount, sizeof(uint32_t));
@@ -218,61 +274,74 @@ std::unique_ptr<FeedForwardNetwork> FeedForwardNetwork::Load(const std::string&
   double prevLayerKeepProbability = 1.0;
   for (uint16_t li = 0; li < numberOfLayers; ++li)
   {
-	auto layer = Layer::Load(is, inputChannelCount, inputRows, inputColumns, prevLayerKeepProbability);
+	auto layer = Layer::Load(is, inputChannelCount, inputRows, inputColumns, prevLayerKeepProbability, elementSize);
 	inputChannelCount = layer->OutputPlanes();
 	inputRows = layer->OutputRows();
 	inputColumns = layer->OutputColumns();
 	prevLayerKeepProbability = layer->KeepProbability();
+	auto convolutionalLayer = dynamic_cast<ConvolutionalLayer*>(layer.get());
+	if (convolutionalLayer)
+	  ConvolutionTuner::Tune(*convolutionalLayer);
 	network->AddLayer(std::move(layer));
   }
   LOG(Info) << "Loaded network " << fileName;
   return network;
 }
 
+std::unique_ptr<InferencePlan> FeedForwardNetwork::CompileForInference()
+{
+  // The plan takes copies of the fully connected layers' testing weights, so the training weights can be restored.
+  for (auto& layer : _layers)
+	layer->SwitchToTestingWeights();
+  auto plan = std::make_unique<InferencePlan>(*this);
+  for (auto& layer : _layers)
+	layer->SwitchToTrainingWeights();
+  return plan;
+}
+
 std::vector<uint32_t> FeedForwardNetwork::Classify(const ImageSet& imageSet)
 {
   // This should never happen unless the user really doesn't know what he's doing.
   if (imageSet.TestSet().size() < _threadCount)
 	throw std::runtime_error("Number of threads cannot be greater than the test set size.");
+  // The plan only passes activations between layers as planes.
+  if (_channelBlocked)
+	return ClassifyChannelBlocked(imageSet);
+  std::unique_ptr<InferencePlan> plan = CompileForInference();
+  const std::vector<Image*>& testSet = imageSet.TestSet();
+  std::vector<uint32_t> results(testSet.size());
+  uint32_t threadCount = std::max<uint32_t>(1, _threadCount);
+  // Split the test set between the threads.
+  _threadPool.Run(threadCount, [&plan, &testSet, &results, threadCount](uint32_t t)
+  {
+	InferencePlan::Workspace workspace(*plan);
+	size_t end = (testSet.size() * (t + 1)) / threadCount;
+	for (size_t i = (testSet.size() * t) / threadCount; i < end; ++i)
+	  results[i] = plan->Classify(testSet[i]->Inputs(), workspace);
+  });
+  return results;
+}
+
+std::vector<uint32_t> FeedForwardNetwork::ClassifyChannelBlocked(const ImageSet& imageSet)
+{
   for (auto& layer : _layers)
 	layer->SwitchToTestingWeights();
-  // Create _threadCount - 1 testers to run on background threads because we also test on the foreground thread.
-  std::vector<FeedForwardClassifier> backgroundTesters;
-  backgroundTesters.reserve(_threadCount - 1);
-  _backgroundThreads.reserve(_threadCount - 1);
-  _backgroundThreads.clear();
-  
-  std::vector<Image*>::const_iterator batchBegin = imageSet.TestSet().cbegin();
   uint32_t testSetSize = static_cast<uint32_t>(imageSet.TestSet().size());
-  uint32_t perThreadSize = testSetSize / _threadCount;
-  uint32_t remainder = testSetSize % _threadCount;
+  uint32_t threadCount = std::max<uint32_t>(1, _threadCount);
   std::vector<uint32_t> results(testSetSize, 0);
-  auto batchResults = results.begin();
-  for (uint32_t t = 0; t < _threadCount - 1; ++t)
+  _threadPool.Run(threadCount, [this, &imageSet, &results, testSetSize, threadCount](uint32_t t)
   {
-	uint32_t thisBatchSize = perThreadSize;
-	if (remainder > 0)
-	{
-	  ++thisBatchSize;
-	  --remainder;
-	}
-	backgroundTesters.emplace_back(*this, batchBegin, batchResults, thisBatchSize);
-	_backgroundThreads.emplace_back(&FeedForwardClassifier::ClassifyOnBackgroundThread, &backgroundTesters.back());
-	batchBegin += thisBatchSize;
-	batchResults += thisBatchSize;
-  }
-
-  FeedForwardClassifier foregroundTester(*this);
-  foregroundTester.Classify(batchBegin, batchResults, perThreadSize);
-
-  for (auto& thread : _backgroundThreads)
-	thread.join();
-  _backgroundThreads.clear();
-  
+	uint32_t begin = static_cast<uint32_t>((uint64_t(testSetSize) * t) / threadCount);
+	uint32_t end = static_cast<uint32_t>((uint64_t(testSetSize) * (t + 1)) / threadCount);
+	FeedForwardClassifier tester(*this);
+	tester.Classify(imageSet.TestSet().cbegin() + begin, results.begin() + begin, end - begin);
+  });
+  for (auto& layer : _layers)
+	layer->SwitchToTrainingWeights();
   return results;
 }
 
-void FeedForwardNetwork::SaveAccuracyStatistics(const ImageSet& imageSet, std::ostream& os)
+void FeedForwardNetwork::SaveAccuracyStatistics(const ImageSet& imageSet, std::ostream& os, const QuantizedNetwork* quantized)
 {
   std::vector<uint32_t> classifications = Classify(imageSet);
 
@@ -304,6 +373,18 @@ void FeedForwardNetwork::SaveAccuracyStatistics(const ImageSet& imageSet, std::o
   }
 
   os << std::endl << "Overall accuracy," << numberCorrect << std::endl;
+  if (quantized)
+  {
+	std::vector<uint32_t> quantizedClassifications = quantized->Classify(imageSet);
+	uint32_t quantizedCorrect = 0;
+	for (size_t ii = 0; ii < imageSet.TestSet().size(); ++ii)
+	{
+	  if (quantizedClassifications[ii] == imageSet.TestSet()[ii]->Category())
+		++quantizedCorrect;
+	}
+	os << "Int8 accuracy," << quantizedCorrect << std::endl;
+	LOG(Info) << "Accuracy " << numberCorrect << ", int8 accuracy " << quantizedCorrect << " out of " << imageSet.TestSet().size();
+  }
 }
 
 void FeedForwardNetwork::SaveWeightStatistics(std::ostream& os) const
@@ -347,7 +428,10 @@ void FeedForwardNetwork::Train(const ImageSet& imageSet, uint32_t epochs, uint32
   }
   if (giveUpAfter < epochs)
 	LOG(Info) << "Will stop training after " << giveUpAfter << " epochs without any improvement in accuracy.";
-  LOG(Info) << "Using " << _threadCount << " threads.";
+  LOG(Info) << "Using " << _threadCount << " threads, with " << WeightUpdateModeName(_weightUpdateMode)
+	<< " weight updates.";
+  if (_weightUpdateMode == WeightUpdateModes::LocalSgd)
+	LOG(Info) << "Averaging the trainers' weights every " << _averagingInterval << " minibatches.";
   LOG(Info) << "Learning rate: " << _learningRate << ", learning rate decay: " << learningRateDecay	<< ", weight decay: " << _weightDecay;
   LOG(Info) << "Network architecture:" << std::endl << *this;
 
@@ -369,9 +453,14 @@ void FeedForwardNetwork::Train(const ImageSet& imageSet, uint32_t epochs, uint32
 	_weightDecayMultiplier = 1.0 - (_weightDecay *  _learningRate);
 	statsFile << "Weight decay," << _weightDecay << std::endl;
   }
-  statsFile << "Minibatch size," << miniBatchSize << std::endl << std::endl;
+  statsFile << "Minibatch size," << miniBatchSize << std::endl
+	<< "Threads," << _threadCount << std::endl
+	<< "Weight updates," << WeightUpdateModeName(_weightUpdateMode) << std::endl;
+  if (_weightUpdateMode == WeightUpdateModes::LocalSgd)
+	statsFile << "Averaging interval," << _averagingInterval << std::endl;
+  statsFile << std::endl;
   SaveArchitecture(statsFile);
-  statsFile << std::endl << "Epoch,Training Loss,Testing Loss,Accuracy" << std::endl;
+  statsFile << std::endl << "Epoch,Training Loss,Testing Loss,Accuracy,Examples Per Second" << std::endl;
 
   // Create and initialize the weights of each layer. This won't do anything if the weights have been loaded from a file.
   for (auto& layer : _layers)
@@ -386,6 +475,8 @@ void FeedForwardNetwork::Train(const ImageSet& imageSet, uint32_t epochs, uint32
   double previousTrainingCost = 1e6;
   uint32_t highestNumberCorrect = 0;
   uint32_t bestEpoch = _epochsTrained;
+  std::chrono::steady_clock::duration totalTrainingTime(0);
+  uint64_t totalExamples = 0;
 
   StartTrainers();
 
@@ -394,11 +485,20 @@ void FeedForwardNetwork::Train(const ImageSet& imageSet, uint32_t epochs, uint32
 	auto trainingStart = std::chrono::steady_clock::now();
 	// Randomly shuffle the training data.
     std::shuffle(trainingData.begin(), trainingData.end(), shuffler);
+	_threadPool.ResetStatistics();
 	double trainingCost = TrainForOneEpoch(trainingData, miniBatchSize);
 	auto trainingEnd = std::chrono::steady_clock::now();
+	totalTrainingTime += trainingEnd - trainingStart;
+	totalExamples += trainingData.size();
+	double examplesPerSecond = trainingData.size() / std::chrono::duration<double>(trainingEnd - trainingStart).count();
 	LOG(Info) << "Training epoch " << _epochsTrained << " completed in "
 	  << std::chrono::duration_cast<std::chrono::milliseconds>(trainingEnd - trainingStart).count()
-	  << " ms. Average training cost: " << trainingCost << std::endl;
+	  << " ms, " << static_cast<uint64_t>(examplesPerSecond) << " examples per second. Average training cost: "
+	  << trainingCost << std::endl;
+	// The time that the trainers spent waiting to be handed a minibatch and for each other to finish it.
+	auto waitTime = std::chrono::duration_cast<std::chrono::milliseconds>(_threadPool.WaitTime()).count();
+	auto runTime = std::chrono::duration_cast<std::chrono::milliseconds>(_threadPool.RunTime()).count();
+	LOG(Info) << "Trainers waited for " << waitTime << " ms of their " << runTime << " ms on minibatches." << std::endl;
 	// When we're training with dropout, we need to switch to the weights without dropout for testing.
 	for (auto& layer : _layers)
 	  layer->SwitchToTestingWeights();
@@ -412,7 +512,8 @@ void FeedForwardNetwork::Train(const ImageSet& imageSet, uint32_t epochs, uint32
 	  << "Correctly determined " << numberCorrect << " out of " << imageSet.TestSet().size()
 	  << ", average testing cost: " << averageTestingCost << std::endl;
 	// Save learning statistics to the CSV file.
-	statsFile << _epochsTrained << ',' << trainingCost << ',' << averageTestingCost << ',' << numberCorrect << std::endl << std::flush;
+	statsFile << _epochsTrained << ',' << trainingCost << ',' << averageTestingCost << ',' << numberCorrect << ','
+	  << static_cast<uint64_t>(examplesPerSecond) << std::endl << std::flush;
 
 	if (numberCorrect > highestNumberCorrect)
 	{
@@ -439,170 +540,419 @@ void FeedForwardNetwork::Train(const ImageSet& imageSet, uint32_t epochs, uint32
 
   StopTrainers();
 
+  // So that jobs which only differ in how they update the weights can be compared.
+  if (totalExamples > 0)
+  {
+	double averageExamplesPerSecond = totalExamples / std::chrono::duration<double>(totalTrainingTime).count();
+	LOG(Info) << "Best accuracy: " << highestNumberCorrect << " out of " << imageSet.TestSet().size() << " after epoch "
+	  << bestEpoch << ", training at " << static_cast<uint64_t>(averageExamplesPerSecond) << " examples per second with "
+	  << WeightUpdateModeName(_weightUpdateMode) << " weight updates." << std::endl;
+  }
+
   statsFile << std::endl;
   SaveWeightStatistics(statsFile);
   statsFile << std::endl << "Network Classifications" << std::endl;
   SaveAccuracyStatistics(imageSet, statsFile);
 }
 
-void FeedForwardNetwork::SignalWorkerFinished()
+double FeedForwardNetwork::TrainForOneEpoch(const ImageSet& imageSet, const std::vector<Image*>& trainingData,
+  uint32_t miniBatchSize)
 {
-  std::unique_lock<std::mutex> lock(_mutex);
-  if (--_busyWorkerCount <= 0)
+  for (auto& layer : _layers)
+	layer->InitializeWeights();
+  _oneHotCategories = &imageSet.OneHotCategories();
+  _weightDecayMultiplier = 1.0 - (_weightDecay * _learningRate);
+  StartTrainers();
+  double trainingCost = 0.0;
+  try
+  {
+	trainingCost = TrainForOneEpoch(trainingData, miniBatchSize);
+  }
+  catch (...)
   {
-	if (_busyWorkerCount < 0)
-	  throw std::runtime_error("Busy worker count has become negative!");
-	_workersFinished.notify_one();
+	StopTrainers();
+	throw;
   }
+  StopTrainers();
+  return trainingCost;
 }
 
 double FeedForwardNetwork::TrainForOneEpoch(const std::vector<Image*>& trainingData, uint32_t miniBatchSize)
 {
   auto previousReportTime = std::chrono::steady_clock::now();
 
-  _foregroundTrainer->SetActivity(FeedForwardTrainer::Phases::Training);
-  for (auto& trainer : _backgroundTrainers)
-	trainer->SetActivity(FeedForwardTrainer::Phases::Training);
-
-  std::vector<Image*>::const_iterator begin = trainingData.cbegin();
+  for (auto& trainer : _trainers)
+	trainer->ResetTrainingCost();
 
-  uint32_t remaining = static_cast<uint32_t>(trainingData.size());
-  while (remaining > 0)
+  if (_weightUpdateMode == WeightUpdateModes::Hogwild)
   {
-	if (remaining < miniBatchSize)
-	  miniBatchSize = remaining;
-
-	// If there are fewer remaining examples than background threads, some threads will be unused this time.
-	uint32_t backgroundWorkerCount = std::min(miniBatchSize, static_cast<uint32_t>(_backgroundThreads.size()));
-	_busyWorkerCount = backgroundWorkerCount;
+	TrainHogwild(trainingData, miniBatchSize);
+  }
+  else if (_weightUpdateMode == WeightUpdateModes::LocalSgd)
+  {
+	TrainLocalSgd(trainingData, miniBatchSize);
+  }
+  else if (_weightUpdateMode == WeightUpdateModes::OneStepStale)
+  {
+	TrainOneStepStale(trainingData, miniBatchSize);
+  }
+  else
+  {
+	std::vector<Image*>::const_iterator begin = trainingData.cbegin();
+	uint32_t remaining = static_cast<uint32_t>(trainingData.size());
+	while (remaining > 0)
+	{
+	  if (remaining < miniBatchSize)
+		miniBatchSize = remaining;
 
-	uint32_t perThreadSize = miniBatchSize / _threadCount;
-	uint32_t remainder = miniBatchSize % _threadCount;
+	  // If there are fewer remaining examples than threads, some trainers will be unused this time.
+	  uint32_t trainerCount = std::min(miniBatchSize, static_cast<uint32_t>(_trainers.size()));
+	  if (_weightUpdateMode == WeightUpdateModes::Overlapped)
+	  {
+		TrainOnMiniBatchOverlapped(begin, miniBatchSize, trainerCount);
+	  }
+	  else
+	  {
+		TrainOnMiniBatch(begin, miniBatchSize, trainerCount);
+		UpdateWeights(trainerCount, _learningRate / miniBatchSize);
+	  }
+	  begin += miniBatchSize;
 
-	for (auto& trainer : _backgroundTrainers)
-	{
-	  uint32_t thisBatchSize = perThreadSize;
-	  if (remainder > 0)
+	  remaining -= miniBatchSize;
+	  if (remaining > 0)
 	  {
-		++thisBatchSize;
-		--remainder;
+		// Report progress every two minutes.
+		auto now = std::chrono::steady_clock::now();
+		if (std::chrono::duration_cast<std::chrono::seconds>(now - previousReportTime).count() >= 120)
+		{
+		  LOG(Info) << remaining << " training examples remaining in epoch." << std::endl;
+		  previousReportTime = now;
+		}
 	  }
-	  else if (thisBatchSize == 0)
-		break;
-	  trainer->AddBatch(begin, thisBatchSize);
-	  begin += thisBatchSize;
 	}
+  }
+
+  ++_epochsTrained;
+  double trainingCost = 0.0;
+  for (const auto& trainer : _trainers)
+	trainingCost += trainer->TotalTrainingCost();
+  trainingCost /= static_cast<double>(trainingData.size());
+  return trainingCost;
+}
+
+// Splits the minibatch between the first trainerCount trainers.
+void FeedForwardNetwork::TrainOnMiniBatch(std::vector<Image*>::const_iterator begin, uint32_t miniBatchSize,
+  uint32_t trainerCount)
+{
+  _threadPool.Run(trainerCount, [this, begin, miniBatchSize, trainerCount](uint32_t t)
+  {
+	uint32_t first = (miniBatchSize * t) / trainerCount;
+	uint32_t last = (miniBatchSize * (t + 1)) / trainerCount;
+	_trainers[t]->TrainOnMiniBatch(begin + first, last - first);
+  });
+}
 
-	if (perThreadSize > 0)
+// The updates are split into shares of each layer, ordered from the top layer down, which is the order that the
+// trainers finish with the layers. Each thread trains on parts of the minibatch until they have all been taken, and then
+// takes shares in turn, waiting for each share's layer to be finished by every trainer. Every part has been taken by
+// a running thread before any thread waits, so this works however many of the threads the pool can give it.
+void FeedForwardNetwork::TrainOnMiniBatchOverlapped(std::vector<Image*>::const_iterator begin, uint32_t miniBatchSize,
+  uint32_t trainerCount)
+{
+  uint32_t threadCount = static_cast<uint32_t>(_trainers.size());
+  double scalar = _learningRate / miniBatchSize;
+  std::vector<size_t> weightedLayers;
+  for (size_t li = _layers.size(); li-- > 0;)
+  {
+	if (dynamic_cast<WeightedLayer*>(_layers[li].get()))
+	  weightedLayers.push_back(li);
+  }
+  uint32_t shareCount = static_cast<uint32_t>(weightedLayers.size()) * threadCount;
+  ProgressCounters layersFinished(_threadPool, _layers.size());
+  std::vector<std::atomic<uint32_t>> sharesFinished(_layers.size());
+  std::atomic<uint32_t> nextPart(0);
+  std::atomic<uint32_t> nextShare(0);
+  _threadPool.Run(threadCount, [&](uint32_t)
+  {
+	for (uint32_t t = nextPart++; t < trainerCount; t = nextPart++)
+	{
+	  uint32_t first = (miniBatchSize * t) / trainerCount;
+	  uint32_t last = (miniBatchSize * (t + 1)) / trainerCount;
+	  _trainers[t]->TrainOnMiniBatch(begin + first, last - first, &layersFinished);
+	}
+	for (uint32_t s = nextShare++; s < shareCount; s = nextShare++)
 	{
-	  _foregroundTrainer->TrainOnMiniBatch(begin, perThreadSize);
-	  begin += perThreadSize;
+	  size_t li = weightedLayers[s / threadCount];
+	  layersFinished.WaitFor(li, trainerCount);
+	  UpdateShare(li, s % threadCount, threadCount, trainerCount, scalar);
+	  // The thread that finishes the last share of a layer rebuilds anything it keeps derived from its weights.
+	  if (++sharesFinished[li] == threadCount)
+		static_cast<WeightedLayer&>(*_layers[li]).RefreshWeightCache();
 	}
+  });
+}
 
-	WaitForBackgroundTrainers();
+// The weights are read and written by all the trainers at once without any locking, so a trainer can see some of
+// another trainer's update and not the rest. Each update is small enough that this makes little difference. The same
+// goes for the data that layers derive from their weights, which the trainers rebuild as they update them, so it can
+// be left out of step with the weights by two trainers rebuilding it at once. It is rebuilt once more when the
+// trainers have finished.
+void FeedForwardNetwork::TrainHogwild(const std::vector<Image*>& trainingData, uint32_t miniBatchSize)
+{
+  uint32_t exampleCount = static_cast<uint32_t>(trainingData.size());
+  uint32_t miniBatchCount = (exampleCount + miniBatchSize - 1) / miniBatchSize;
+  uint32_t trainerCount = std::min(miniBatchCount, static_cast<uint32_t>(_trainers.size()));
+  std::atomic<uint32_t> nextMiniBatch(0);
+  _threadPool.Run(trainerCount, [&](uint32_t t)
+  {
+	FeedForwardTrainer& trainer = *_trainers[t];
+	for (uint32_t mb = nextMiniBatch++; mb < miniBatchCount; mb = nextMiniBatch++)
+	{
+	  uint32_t first = mb * miniBatchSize;
+	  uint32_t count = std::min(miniBatchSize, exampleCount - first);
+	  trainer.TrainOnMiniBatch(trainingData.cbegin() + first, count);
+	  trainer.UpdateWeights(_learningRate / count, _weightDecayMultiplier);
+	}
+  });
+  RefreshWeightCaches();
+}
 
-	double scalar = _learningRate / miniBatchSize;
-	size_t li = 0;
-	for (auto& layer : _layers)
+// The epoch's training data is split into one shard for each trainer, which it works through a minibatch at a time,
+// updating its replica of the layers after each one. Every AveragingInterval minibatches the trainers stop, and the
+// replicas are averaged, so the only time the trainers wait for each other is while the replicas are averaged.
+void FeedForwardNetwork::TrainLocalSgd(const std::vector<Image*>& trainingData, uint32_t miniBatchSize)
+{
+  uint64_t exampleCount = trainingData.size();
+  uint32_t trainerCount = static_cast<uint32_t>(_trainers.size());
+  uint64_t longestShard = (exampleCount + trainerCount - 1) / trainerCount;
+  uint64_t examplesPerRound = uint64_t(miniBatchSize) * _averagingInterval;
+  uint64_t rounds = (longestShard + examplesPerRound - 1) / examplesPerRound;
+  for (uint64_t round = 0; round < rounds; ++round)
+  {
+	_threadPool.Run(trainerCount, [&](uint32_t t)
 	{
-	  auto wl = dynamic_cast<WeightedLayer*>(layer.get());
-	  if (wl)
+	  // The replica's weights were last changed by averaging them, so first rebuild anything derived from them.
+	  for (auto& layer : _replicas[t])
 	  {
-		if (_weightDecayMultiplier != 1.0)
-		  wl->DecayWeights(_weightDecayMultiplier);
-
-		for (size_t ti = 0; ti < backgroundWorkerCount; ++ti)
-		{
-		  const FeedForwardTrainer& trainer = *_backgroundTrainers[ti];
-		  wl->UpdateWeightsAndBiases(*trainer.NablaW()[li], *trainer.NablaB()[li], scalar);
-		}
-		if (perThreadSize > 0)
-		  wl->UpdateWeightsAndBiases(*_foregroundTrainer->NablaW()[li], *_foregroundTrainer->NablaB()[li], scalar);
+		auto wl = dynamic_cast<WeightedLayer*>(layer.get());
+		if (wl)
+		  wl->RefreshWeightCache();
 	  }
-	  ++li;
-	}
+	  FeedForwardTrainer& trainer = *_trainers[t];
+	  uint64_t shardBegin = (exampleCount * t) / trainerCount;
+	  uint64_t shardEnd = (exampleCount * (t + 1)) / trainerCount;
+	  uint64_t first = shardBegin + round * examplesPerRound;
+	  uint64_t end = std::min(shardEnd, first + examplesPerRound);
+	  while (first < end)
+	  {
+		uint32_t count = static_cast<uint32_t>(std::min<uint64_t>(miniBatchSize, end - first));
+		trainer.TrainOnMiniBatch(trainingData.cbegin() + first, count);
+		trainer.UpdateWeights(_learningRate / count, _weightDecayMultiplier);
+		first += count;
+	  }
+	});
+	AverageReplicas();
+  }
+  RefreshWeightCaches();
+}
 
-	remaining -= miniBatchSize;
-	if (remaining > 0)
+// Each minibatch is handed out in a single run. Every thread first applies its share of the previous minibatch's
+// errors, writing the new weights into _nextLayers, and then trains on its part of the minibatch with the weights in
+// _layers, which the update doesn't touch. Once the run has finished the two sets of layers are swapped. After the last
+// minibatch there is one more run, which only applies its errors.
+void FeedForwardNetwork::TrainOneStepStale(const std::vector<Image*>& trainingData, uint32_t miniBatchSize)
+{
+  uint32_t threadCount = static_cast<uint32_t>(_trainers.size());
+  std::vector<size_t> weightedLayers;
+  for (size_t li = 0; li < _layers.size(); ++li)
+  {
+	if (dynamic_cast<WeightedLayer*>(_layers[li].get()))
+	  weightedLayers.push_back(li);
+  }
+  std::vector<std::atomic<uint32_t>> sharesFinished(_layers.size());
+  std::vector<Image*>::const_iterator begin = trainingData.cbegin();
+  uint32_t remaining = static_cast<uint32_t>(trainingData.size());
+  // The number of trainers whose kept errors haven't been applied yet, and the scalar to apply them with.
+  uint32_t pendingTrainers = 0;
+  double pendingScalar = 0.0;
+  while (remaining > 0 || pendingTrainers > 0)
+  {
+	uint32_t count = std::min(miniBatchSize, remaining);
+	uint32_t trainerCount = std::min(count, threadCount);
+	for (auto& finished : sharesFinished)
+	  finished = 0;
+	_threadPool.Run(threadCount, [&](uint32_t t)
 	{
-	  // Report progress every two minutes.
-	  auto now = std::chrono::steady_clock::now();
-	  if (std::chrono::duration_cast<std::chrono::seconds>(now - previousReportTime).count() >= 120)
+	  for (size_t li = 0; pendingTrainers > 0 && li < weightedLayers.size(); ++li)
 	  {
-		LOG(Info) << remaining << " training examples remaining in epoch." << std::endl;
-		previousReportTime = now;
+		size_t layerIndex = weightedLayers[li];
+		UpdateNextShare(layerIndex, t, threadCount, pendingTrainers, pendingScalar);
+		// The thread that finishes the last share of a layer rebuilds anything it keeps derived from its weights.
+		if (++sharesFinished[layerIndex] == threadCount)
+		  static_cast<WeightedLayer&>(*_nextLayers[layerIndex]).RefreshWeightCache();
 	  }
-	}
+	  if (t < trainerCount)
+	  {
+		uint32_t first = (count * t) / trainerCount;
+		uint32_t last = (count * (t + 1)) / trainerCount;
+		_trainers[t]->TrainOnMiniBatch(begin + first, last - first);
+	  }
+	});
+	if (pendingTrainers > 0)
+	  _layers.swap(_nextLayers);
+	for (uint32_t t = 0; t < trainerCount; ++t)
+	  _trainers[t]->KeepErrors();
+	pendingTrainers = trainerCount;
+	pendingScalar = count > 0 ? _learningRate / count : 0.0;
+	begin += count;
+	remaining -= count;
   }
-
-  ++_epochsTrained;
-  double trainingCost = _foregroundTrainer->TotalTrainingCost();
-  for (const auto& trainer : _backgroundTrainers)
-	trainingCost += trainer->TotalTrainingCost();
-  trainingCost /= static_cast<double>(trainingData.size());
-  return trainingCost;
 }
 
-std::pair<uint32_t, double> FeedForwardNetwork::TestDuringTraining(const ImageSet& imageSet)
+void FeedForwardNetwork::UpdateWeights(uint32_t trainerCount, double scalar)
 {
-  std::vector<Image*>::const_iterator begin = imageSet.TestSet().cbegin();
-  uint32_t testSetSize = static_cast<uint32_t>(imageSet.TestSet().size());
-  uint32_t perThreadSize = testSetSize / _threadCount;
-  uint32_t remainder = testSetSize % _threadCount;
-
-  _busyWorkerCount = std::min(testSetSize, _threadCount - 1);
+  // Each thread sums the trainers' errors for its own share of every layer's weights and biases, and updates them.
+  uint32_t threadCount = static_cast<uint32_t>(_trainers.size());
+  _threadPool.Run(threadCount, [this, trainerCount, threadCount, scalar](uint32_t t)
+  {
+	for (size_t li = 0; li < _layers.size(); ++li)
+	{
+	  if (dynamic_cast<WeightedLayer*>(_layers[li].get()))
+		UpdateShare(li, t, threadCount, trainerCount, scalar);
+	}
+  });
+  RefreshWeightCaches();
+}
 
-  _foregroundTrainer->SetActivity(FeedForwardTrainer::Phases::Testing);
-  for (auto& trainer : _backgroundTrainers)
+void FeedForwardNetwork::AverageReplicas()
+{
+  std::vector<size_t> weightedLayers;
+  std::vector<std::vector<WeightedLayer*>> replicaLayers(_layers.size());
+  for (size_t li = 0; li < _layers.size(); ++li)
   {
-	uint32_t thisBatchSize = perThreadSize;
-	if (remainder > 0)
+	if (!dynamic_cast<WeightedLayer*>(_layers[li].get()))
+	  continue;
+	weightedLayers.push_back(li);
+	for (auto& replica : _replicas)
+	  replicaLayers[li].push_back(static_cast<WeightedLayer*>(replica[li].get()));
+  }
+  // Each thread averages its own share of every layer.
+  uint32_t threadCount = static_cast<uint32_t>(_trainers.size());
+  _threadPool.Run(threadCount, [&](uint32_t t)
+  {
+	for (size_t li : weightedLayers)
 	{
-	  ++thisBatchSize;
-	  --remainder;
+	  auto& wl = static_cast<WeightedLayer&>(*_layers[li]);
+	  auto [first, last] = ShareRange(wl.ParameterCount(), t, threadCount);
+	  if (first < last)
+		wl.AverageParameters(replicaLayers[li], first, last);
 	}
-	else if (thisBatchSize == 0)
-	  break;
-	trainer->SetActivity(FeedForwardTrainer::Phases::Testing);
-	trainer->AddBatch(begin, thisBatchSize);
-	begin += thisBatchSize;
+  });
+}
+
+// The layers rebuild anything they keep derived from their weights, one layer to a thread.
+void FeedForwardNetwork::RefreshWeightCaches()
+{
+  std::vector<WeightedLayer*> weightedLayers;
+  for (auto& layer : _layers)
+  {
+	auto wl = dynamic_cast<WeightedLayer*>(layer.get());
+	if (wl)
+	  weightedLayers.push_back(wl);
   }
+  _threadPool.Run(static_cast<uint32_t>(weightedLayers.size()), [&weightedLayers](uint32_t l)
+  {
+	weightedLayers[l]->RefreshWeightCache();
+  });
+}
 
-  std::pair<uint32_t, double> result = _foregroundTrainer->EvaluateAccuracy(begin, perThreadSize);
-  WaitForBackgroundTrainers();
+void FeedForwardNetwork::UpdateShare(size_t layerIndex, uint32_t share, uint32_t shareCount, uint32_t trainerCount,
+  double scalar)
+{
+  auto& wl = static_cast<WeightedLayer&>(*_layers[layerIndex]);
+  auto [first, last] = ShareRange(wl.ParameterCount(), share, shareCount);
+  if (first == last)
+	return;
+  std::vector<const Tensor*> nablaW;
+  std::vector<const Tensor*> nablaB;
+  for (uint32_t ti = 0; ti < trainerCount; ++ti)
+  {
+	nablaW.push_back(_trainers[ti]->NablaW()[layerIndex].get());
+	nablaB.push_back(_trainers[ti]->NablaB()[layerIndex].get());
+  }
+  wl.UpdateParameters(nablaW, nablaB, scalar, _weightDecayMultiplier, first, last);
+}
 
-  for (const auto& trainer : _backgroundTrainers)
+void FeedForwardNetwork::UpdateNextShare(size_t layerIndex, uint32_t share, uint32_t shareCount, uint32_t trainerCount,
+  double scalar)
+{
+  auto& wl = static_cast<WeightedLayer&>(*_layers[layerIndex]);
+  auto& next = static_cast<WeightedLayer&>(*_nextLayers[layerIndex]);
+  auto [first, last] = ShareRange(wl.ParameterCount(), share, shareCount);
+  if (first == last)
+	return;
+  std::vector<const Tensor*> nablaW;
+  std::vector<const Tensor*> nablaB;
+  for (uint32_t ti = 0; ti < trainerCount; ++ti)
   {
-	result.first += trainer->NumberCorrect();
-	result.second += trainer->TotalTestingCost();
+	nablaW.push_back(_trainers[ti]->KeptNablaW()[layerIndex].get());
+	nablaB.push_back(_trainers[ti]->KeptNablaB()[layerIndex].get());
   }
+  next.CopyParameters(wl, first, last);
+  next.UpdateParameters(nablaW, nablaB, scalar, _weightDecayMultiplier, first, last);
+}
 
+std::pair<uint32_t, double> FeedForwardNetwork::TestDuringTraining(const ImageSet& imageSet)
+{
+  uint32_t testSetSize = static_cast<uint32_t>(imageSet.TestSet().size());
+  uint32_t trainerCount = std::min(testSetSize, static_cast<uint32_t>(_trainers.size()));
+  std::vector<std::pair<uint32_t, double>> results(trainerCount);
+  _threadPool.Run(trainerCount, [this, &imageSet, &results, testSetSize, trainerCount](uint32_t t)
+  {
+	uint32_t begin = static_cast<uint32_t>((uint64_t(testSetSize) * t) / trainerCount);
+	uint32_t end = static_cast<uint32_t>((uint64_t(testSetSize) * (t + 1)) / trainerCount);
+	results[t] = _trainers[t]->EvaluateAccuracy(imageSet.TestSet().cbegin() + begin, end - begin);
+  });
+
+  std::pair<uint32_t, double> result(0, 0.0);
+  for (const auto& r : results)
+  {
+	result.first += r.first;
+	result.second += r.second;
+  }
   result.second /= static_cast<double>(testSetSize);
   return result;
 }
 
 void FeedForwardNetwork::StartTrainers()
 {
-  _foregroundTrainer = std::make_unique<FeedForwardTrainer>(*this);
-  // Create _threadCount - 1 trainers to run on background threads because we also train on the foreground thread.
-  _backgroundTrainers.reserve(_threadCount - 1);
-  _backgroundThreads.reserve(_threadCount - 1);
-  for (uint32_t t = 0; t < _threadCount - 1; ++t)
+  uint32_t threadCount = std::max<uint32_t>(1, _threadCount);
+  _trainers.reserve(threadCount);
+  if (_weightUpdateMode == WeightUpdateModes::LocalSgd)
+  {
+	_replicas.resize(threadCount);
+	for (uint32_t t = 0; t < threadCount; ++t)
+	{
+	  for (const auto& layer : _layers)
+		_replicas[t].emplace_back(layer->Clone());
+	  _trainers.emplace_back(std::make_unique<FeedForwardTrainer>(*this, _replicas[t]));
+	}
+	return;
+  }
+  if (_weightUpdateMode == WeightUpdateModes::OneStepStale)
   {
-	_backgroundTrainers.emplace_back(std::make_unique<FeedForwardTrainer>(*this));
-	_backgroundThreads.emplace_back(&FeedForwardTrainer::TrainOnBackgroundThread, _backgroundTrainers.back().get());
+	for (const auto& layer : _layers)
+	  _nextLayers.emplace_back(layer->Clone());
   }
+  for (uint32_t t = 0; t < threadCount; ++t)
+	_trainers.emplace_back(std::make_unique<FeedForwardTrainer>(*this));
 }
 
 void FeedForwardNetwork::StopTrainers()
 {
-  _foregroundTrainer = nullptr;
-  for (auto& trainer : _backgroundTrainers)
-	trainer->SignalTrainingDone();
-  for (auto& thread : _backgroundThreads)
-	thread.join();
-  _backgroundTrainers.clear();
-  _backgroundThreads.clear();
+  _trainers.clear();
+  _replicas.clear();
+  _nextLayers.clear();
 }
 
 std::ostream& operator<<(std::ostream& os, const FeedForwardNetwork& network)
@@ -619,8 +969,21 @@ std::ostream& operator<<(std::ostream& os, const FeedForwardNetwork& network)
 FeedForwardWorker::FeedForwardWorker(FeedForwardNetwork& network)
   : _network(network)
 {
+  bool previousLayerBlocked = false;
   for (const auto& layer : _network.Layers())
+  {
 	_activations.emplace_back(layer->OutputPlanes(), layer->OutputRows(), layer->OutputColumns());
+	// A run of channel blocked layers starts at a convolutional layer whose input has at least a block of channels,
+	// since converting an input image with only one or three channels would mostly add padding.
+	auto cl = dynamic_cast<ConvolutionalLayer*>(layer.get());
+	bool startsRun = cl && cl->InputChannelCount() >= Tensor::ChannelBlockSize && !previousLayerBlocked;
+	bool blocked = _network.ChannelBlocked() && layer->SupportsChannelBlocked() && (previousLayerBlocked || startsRun);
+	_channelBlockedInputs.emplace_back(blocked && startsRun ? std::make_unique<Tensor>(Tensor::ChannelBlocks(cl->InputChannelCount()),
+	  cl->InputRows(), cl->InputColumns(), Tensor::ChannelBlockSize) : nullptr);
+	_channelBlockedActivations.emplace_back(blocked ? std::make_unique<Tensor>(Tensor::ChannelBlocks(layer->OutputPlanes()),
+	  layer->OutputRows(), layer->OutputColumns(), Tensor::ChannelBlockSize) : nullptr);
+	previousLayerBlocked = blocked;
+  }
 }
 
 std::pair<uint32_t, double> FeedForwardWorker::EvaluateAccuracy(std::vector<Image*>::const_iterator begin, uint32_t count)
@@ -647,23 +1010,42 @@ std::pair<uint32_t, double> FeedForwardWorker::EvaluateAccuracy(std::vector<Imag
 void FeedForwardWorker::FeedForward(const Tensor& input)
 {
   const Tensor* layerInput = &input;
-  auto layerActivations = _activations.begin();
-  for (const auto& layer : _network.Layers())
+  size_t layerCount = _network.Layers().size();
+  for (size_t li = 0; li < layerCount; ++li)
   {
-	layer->FeedForward(*layerInput, *layerActivations, nullptr);
-	auto wl = dynamic_cast<WeightedLayer*>(layer.get());
+	const Layer& layer = *_network.Layers()[li];
+	Tensor* blockedActivations = _channelBlockedActivations[li].get();
+	Tensor& layerActivations = blockedActivations ? *blockedActivations : _activations[li];
+	if (blockedActivations)
+	{
+	  if (_channelBlockedInputs[li])
+	  {
+		layerInput->ToChannelBlocked(*_channelBlockedInputs[li]);
+		layerInput = _channelBlockedInputs[li].get();
+	  }
+	  layer.FeedForwardChannelBlocked(*layerInput, layerActivations);
+	}
+	else
+	{
+	  layer.FeedForward(*layerInput, layerActivations, nullptr);
+	}
+	// All the activation functions work element by element, so they can be applied to either layout.
+	auto wl = dynamic_cast<const WeightedLayer*>(&layer);
 	if (wl)
-	  wl->ApplyActivationFunction(*layerActivations);
-	layerInput = &*layerActivations;
-	++layerActivations;
+	  wl->ApplyActivationFunction(layerActivations);
+	// Convert back to planes at the end of a run of channel blocked layers.
+	if (blockedActivations && (li + 1 == layerCount || !_channelBlockedActivations[li + 1]))
+	{
+	  blockedActivations->FromChannelBlocked(_activations[li]);
+	  layerInput = &_activations[li];
+	}
+	else
+	{
+	  layerInput = &layerActivations;
+	}
   }
 }
 
-void FeedForwardClassifier::ClassifyOnBackgroundThread()
-{
-  Classify(_batchBegin, _resultsBegin, _batchSize);
-}
-
 void FeedForwardClassifier::Classify(std::vector<Image*>::const_iterator begin, std::vector<uint32_t>::iterator result, uint32_t count)
 {
   const Tensor& outputs = _activations.back();
@@ -679,69 +1061,95 @@ void FeedForwardClassifier::Classify(std::vector<Image*>::const_iterator begin,
 }
 
 FeedForwardTrainer::FeedForwardTrainer(FeedForwardNetwork& network)
-  : FeedForwardWorker(network),
-	_batchSize(0), _numberCorrect(0), _totalTrainingCost(0.0), _totalTestingCost(0.0),
-	_currentPhase(Phases::Training)
+  : FeedForwardTrainer(network, network.Layers())
 {
-  for (const auto& layer : _network.Layers())
+}
+
+FeedForwardTrainer::FeedForwardTrainer(FeedForwardNetwork& network, const FeedForwardNetwork::LayerVector& layers)
+  : FeedForwardWorker(network), _layers(layers),
+	_totalTrainingCost(0.0), _allocatedBatchSize(0)
+{
+  AllocateErrors();
+}
+
+void FeedForwardTrainer::AllocateErrors()
+{
+  for (const auto& layer : _layers)
   {
-	_delta.emplace_back(layer->OutputPlanes(), layer->OutputRows(), layer->OutputColumns());
 	auto wl = dynamic_cast<WeightedLayer*>(layer.get());
 	if (wl)
 	{
-	  _derivatives.emplace_back(std::make_unique<Tensor>(layer->OutputPlanes(), layer->OutputRows(), layer->OutputColumns()));
 	  _nablaB.emplace_back(std::make_unique<Tensor>(wl->Biases().Size()));
 	  const Tensor& weights = wl->Weights();
 	  _nablaW.emplace_back(std::make_unique<Tensor>(weights.Hyperplanes(), weights.Planes(), weights.Rows(), weights.Columns()));
 	}
 	else
 	{
-	  _derivatives.emplace_back(nullptr);
 	  _nablaB.emplace_back(nullptr);
 	  _nablaW.emplace_back(nullptr);
 	}
-	// Create a DropoutMask for all layers that use dropout.
-	auto fcn = dynamic_cast<FullyConnectedLayer*>(layer.get());
-	if (fcn && fcn->KeepProbability() < 1.0)
-	  _dropoutMasks.emplace_back(std::make_unique<DropoutMask>(fcn->KeepProbability(), fcn->Weights().Rows()));
-	else
-	  _dropoutMasks.emplace_back(nullptr);
   }
 }
 
-void FeedForwardTrainer::TrainOnBackgroundThread()
+// The tensors for a batch hold one example in each hyperplane. They only need to be reallocated when the size of the
+// batch changes, which is normally just for the last mini-batch of an epoch.
+void FeedForwardTrainer::AllocateBatch(const Tensor& exampleInputs, uint32_t batchSize)
 {
-  do
+  if (batchSize == _allocatedBatchSize)
+	return;
+  _allocatedBatchSize = batchSize;
+  _batchInputs = std::make_unique<Tensor>(batchSize, exampleInputs.Planes(), exampleInputs.Rows(), exampleInputs.Columns());
+  const Tensor& category = _network.OneHotCategories()->front();
+  _batchTargets = std::make_unique<Tensor>(batchSize, category.Planes(), category.Rows(), category.Columns());
+  _batchActivations.clear();
+  _derivatives.clear();
+  _delta.clear();
+  _dropoutMasks.clear();
+  _packedActivations.clear();
+  _packedDerivatives.clear();
+  _workspaces.clear();
+  const auto& layers = _layers;
+  bool mixedPrecision = _network.MixedPrecision();
+  uint32_t workspaceSize = 0;
+  for (size_t li = 0; li < layers.size(); ++li)
   {
-	WaitForNextBatch();
-	while (_currentPhase == Phases::Training)
+	const auto& layer = layers[li];
+	auto wl = dynamic_cast<WeightedLayer*>(layer.get());
+	if (mixedPrecision)
 	{
-	  TrainOnMiniBatch(_batchBegin, _batchSize);
-	  _batchSize = 0;
-	  _network.SignalWorkerFinished();
-	  WaitForNextBatch();
+	  workspaceSize = std::max(workspaceSize, batchSize * layer->OutputPlanes() * layer->OutputRows() * layer->OutputColumns());
+	  // The output layer's activations are only needed for the cost, which is worked out straight from the workspace.
+	  if (li + 1 < layers.size())
+		_packedActivations.emplace_back(std::make_unique<BFloat16Tensor>(batchSize, layer->OutputPlanes(), layer->OutputRows(), layer->OutputColumns()));
+	  else
+		_packedActivations.emplace_back(nullptr);
+	  if (wl)
+		_packedDerivatives.emplace_back(std::make_unique<BFloat16Tensor>(batchSize, layer->OutputPlanes(), layer->OutputRows(), layer->OutputColumns()));
+	  else
+		_packedDerivatives.emplace_back(nullptr);
 	}
-	while (_currentPhase == Phases::Testing)
+	else
 	{
-	  std::pair<uint32_t, double> result = EvaluateAccuracy(_batchBegin, _batchSize);
-	  _numberCorrect += result.first;
-	  _totalTestingCost += result.second;
-	  _batchSize = 0;
-	  _network.SignalWorkerFinished();
-	  WaitForNextBatch();
+	  _batchActivations.emplace_back(std::make_unique<Tensor>(batchSize, layer->OutputPlanes(), layer->OutputRows(), layer->OutputColumns()));
+	  _delta.emplace_back(std::make_unique<Tensor>(batchSize, layer->OutputPlanes(), layer->OutputRows(), layer->OutputColumns()));
+	  if (wl)
+		_derivatives.emplace_back(std::make_unique<Tensor>(batchSize, layer->OutputPlanes(), layer->OutputRows(), layer->OutputColumns()));
+	  else
+		_derivatives.emplace_back(nullptr);
 	}
-  } while (_currentPhase != Phases::Finished);
-}
-
-void FeedForwardTrainer::AddBatch(std::vector<Image*>::const_iterator batchBegin, uint32_t batchSize)
-{
-  std::unique_lock<std::mutex> lock(_mutex);
-  _batchBegin = batchBegin;
-  _batchSize = batchSize;
-  _nextBatchAvailable.notify_one();
+	// Create a DropoutMask for all layers that use dropout, with a separate pattern for each example in the batch.
+	auto fcn = dynamic_cast<FullyConnectedLayer*>(layer.get());
+	if (fcn && fcn->KeepProbability() < 1.0)
+	  _dropoutMasks.emplace_back(std::make_unique<DropoutMask>(fcn->KeepProbability(), fcn->Weights().Rows() * batchSize));
+	else
+	  _dropoutMasks.emplace_back(nullptr);
+  }
+  for (uint32_t i = 0; mixedPrecision && i < 4; ++i)
+	_workspaces.emplace_back(std::make_unique<Tensor>(workspaceSize));
 }
 
-void FeedForwardTrainer::TrainOnMiniBatch(std::vector<Image*>::const_iterator begin, uint32_t batchSize)
+void FeedForwardTrainer::TrainOnMiniBatch(std::vector<Image*>::const_iterator begin, uint32_t batchSize,
+  ProgressCounters* layersFinished)
 {
   for (auto& t : _nablaB)
   {
@@ -754,73 +1162,194 @@ void FeedForwardTrainer::TrainOnMiniBatch(std::vector<Image*>::const_iterator be
 	  t->SetAllToZero();
   }
 
-  auto end = begin + batchSize;
-  while (begin != end)
+  AllocateBatch((*begin)->Inputs(), batchSize);
+  for (uint32_t example = 0; example < batchSize; ++example)
   {
-	const Image& example = **begin;
-	BackPropagate(example.Inputs(), (*_network.OneHotCategories())[example.Category()]);
+	const Image& image = **begin;
+	Tensor inputs = _batchInputs->HyperplaneView(example);
+	inputs = image.Inputs();
+	Tensor target = _batchTargets->HyperplaneView(example);
+	target = (*_network.OneHotCategories())[image.Category()];
 	++begin;
   }
+  BackPropagate(*_batchInputs, *_batchTargets, layersFinished);
 }
 
-void FeedForwardTrainer::BackPropagate(const Tensor& example, const Tensor& correctOutput)
+// Runs the whole batch through each layer in turn, so that every layer's weights are read once per batch
+// rather than once per example.
+void FeedForwardTrainer::BackPropagate(const Tensor& examples, const Tensor& correctOutputs,
+  ProgressCounters* layersFinished)
 {
-  // Feed the example through the network so that we can
+  if (_network.MixedPrecision())
+  {
+	BackPropagateMixedPrecision(examples, correctOutputs, layersFinished);
+	return;
+  }
+  // Feed the examples through the network so that we can
   // calculate the cost at the output layer.
-  const Tensor* layerInput = &example;
-  auto layerActivations = _activations.begin();
+  const Tensor* layerInput = &examples;
+  auto layerActivations = _batchActivations.begin();
   auto layerDerivatives = _derivatives.begin();
   auto layerDropoutMask = _dropoutMasks.begin();
-  for (const auto& layer : _network.Layers())
+  for (const auto& layer : _layers)
   {
 	auto dropoutMask = layerDropoutMask->get();
 	if (dropoutMask)
 	  dropoutMask->Randomize();
-	layer->FeedForward(*layerInput, *layerActivations, dropoutMask);
+	layer->FeedForwardBatch(*layerInput, **layerActivations, dropoutMask);
 	auto wl = dynamic_cast<WeightedLayer*>(layer.get());
 	if (wl)
 	{
 	  if (wl->ActivationFunction())
 	  {
-		wl->ActivationFunction()->ApplyDerivative(*layerActivations, **layerDerivatives);
-		wl->ActivationFunction()->Apply(*layerActivations);
+		wl->ActivationFunction()->ApplyDerivative(**layerActivations, **layerDerivatives);
+		wl->ActivationFunction()->Apply(**layerActivations);
 	  }
 	  else
 	  {
-		**layerDerivatives = *layerActivations;
+		**layerDerivatives = **layerActivations;
 	  }
 	}
-	layerInput = &*layerActivations;
+	layerInput = layerActivations->get();
 	++layerActivations;
 	++layerDerivatives;
 	++layerDropoutMask;
   }
 
-  _totalTrainingCost += _network.CostFunction().TotalCost(_activations.back(), correctOutput);
+  // The cost function works element by element, so it gives the total for the batch.
+  _totalTrainingCost += _network.CostFunction().TotalCost(*_batchActivations.back(), correctOutputs);
   // Now do the backpropagation.
   // Calculate the error in the output layer.
-  _network.CostFunction().Derivatives(_activations.back(), correctOutput, _delta.back());
+  _network.CostFunction().Derivatives(*_batchActivations.back(), correctOutputs, *_delta.back());
+
+  for (size_t li = _layers.size() - 1; li > 0; --li)
+  {
+	Layer* layer = _layers[li].get();
+	auto wl = dynamic_cast<WeightedLayer*>(layer);
+	if (wl)
+	{
+	  _delta[li]->ComponentWiseMultiply(*_derivatives[li]);
+	  auto dropoutMask = _dropoutMasks[li].get();
+	  wl->BackpropagateErrorBatch(*_delta[li], *_delta[li - 1], dropoutMask);
+	  wl->UpdateWeightAndBiasErrorsBatch(*_delta[li], *_batchActivations[li - 1], *_nablaW[li], *_nablaB[li], dropoutMask);
+	  // This trainer won't use the layer's weights again.
+	  if (layersFinished)
+		layersFinished->Increment(li);
+	}
+	else
+	{
+	  auto mpl = dynamic_cast<MaxPoolingLayer*>(layer);
+	  if (mpl)
+		mpl->BackpropagateErrorBatch(*_batchActivations[li], *_batchActivations[li - 1], *_delta[li], *_delta[li - 1]);
+	}
+  }
+  // First layer must always be a WeightedLayer.
+  _delta.front()->ComponentWiseMultiply(*_derivatives.front());
+  static_cast<WeightedLayer&>(*_layers.front()).UpdateWeightAndBiasErrorsBatch(*_delta.front(),
+	examples, *_nablaW.front(), *_nablaB.front(), _dropoutMasks.front().get());
+  if (layersFinished)
+	layersFinished->Increment(0);
+}
+
+// The same as BackPropagate, except that each layer's activations and derivatives are packed as bfloat16 as soon as they
+// have been calculated, and only the packed copies are kept for the backward pass. The forward pass alternates the
+// activations between the first two workspaces and calculates the derivatives in the third. The backward pass
+// alternates the errors between the third and fourth, and unpacks the activations it needs into the first two.
+void FeedForwardTrainer::BackPropagateMixedPrecision(const Tensor& examples, const Tensor& correctOutputs,
+  ProgressCounters* layersFinished)
+{
+  const auto& layers = _layers;
+  uint32_t batchSize = examples.Hyperplanes();
+  size_t lastLayer = layers.size() - 1;
+  for (size_t li = 0; li < layers.size(); ++li)
+  {
+	Layer* layer = layers[li].get();
+	Tensor input = li == 0 ? examples.HyperplaneView(0, batchSize) : OutputView(*_workspaces[(li - 1) % 2], *layers[li - 1], batchSize);
+	Tensor activations = OutputView(*_workspaces[li % 2], *layer, batchSize);
+	auto dropoutMask = _dropoutMasks[li].get();
+	if (dropoutMask)
+	  dropoutMask->Randomize();
+	layer->FeedForwardBatch(input, activations, dropoutMask);
+	auto wl = dynamic_cast<WeightedLayer*>(layer);
+	if (wl)
+	{
+	  if (wl->ActivationFunction())
+	  {
+		Tensor derivatives = OutputView(*_workspaces[2], *layer, batchSize);
+		wl->ActivationFunction()->ApplyDerivative(activations, derivatives);
+		_packedDerivatives[li]->Pack(derivatives);
+		wl->ActivationFunction()->Apply(activations);
+	  }
+	  else
+	  {
+		_packedDerivatives[li]->Pack(activations);
+	  }
+	}
+	if (li < lastLayer)
+	  _packedActivations[li]->Pack(activations);
+  }
 
-  for (size_t li = _network.Layers().size() - 1; li > 0; --li)
+  Tensor outputs = OutputView(*_workspaces[lastLayer % 2], *layers.back(), batchSize);
+  _totalTrainingCost += _network.CostFunction().TotalCost(outputs, correctOutputs);
+  Tensor outputErrors = OutputView(*_workspaces[2], *layers.back(), batchSize);
+  _network.CostFunction().Derivatives(outputs, correctOutputs, outputErrors);
+
+  for (size_t li = lastLayer; li > 0; --li)
   {
-	Layer* layer = _network.Layers()[li].get();
+	Layer* layer = layers[li].get();
+	Tensor errors = OutputView(*_workspaces[2 + ((lastLayer - li) % 2)], *layer, batchSize);
+	Tensor previousErrors = OutputView(*_workspaces[2 + ((lastLayer - li + 1) % 2)], *layers[li - 1], batchSize);
+	Tensor previousActivations = OutputView(*_workspaces[0], *layers[li - 1], batchSize);
+	_packedActivations[li - 1]->Unpack(previousActivations);
 	auto wl = dynamic_cast<WeightedLayer*>(layer);
 	if (wl)
 	{
-	  _delta[li].ComponentWiseMultiply(*_derivatives[li]);
+	  _packedDerivatives[li]->MultiplyInto(errors);
 	  auto dropoutMask = _dropoutMasks[li].get();
-	  wl->BackpropagateError(_delta[li], _delta[li - 1], dropoutMask);
-	  wl->UpdateWeightAndBiasErrors(_delta[li], _activations[li - 1], *_nablaW[li], *_nablaB[li], dropoutMask);
+	  wl->BackpropagateErrorBatch(errors, previousErrors, dropoutMask);
+	  wl->UpdateWeightAndBiasErrorsBatch(errors, previousActivations, *_nablaW[li], *_nablaB[li], dropoutMask);
+	  if (layersFinished)
+		layersFinished->Increment(li);
 	}
 	else
 	{
 	  auto mpl = dynamic_cast<MaxPoolingLayer*>(layer);
 	  if (mpl)
-		mpl->BackpropagateError(_activations[li], _activations[li - 1], _delta[li], _delta[li - 1]);
+	  {
+		// Rounding keeps the order of the values, so the maximum still matches the input that it came from.
+		Tensor activations = OutputView(*_workspaces[1], *layer, batchSize);
+		_packedActivations[li]->Unpack(activations);
+		mpl->BackpropagateErrorBatch(activations, previousActivations, errors, previousErrors);
+	  }
 	}
   }
   // First layer must always be a WeightedLayer.
-  _delta.front().ComponentWiseMultiply(*_derivatives.front());
-  static_cast<WeightedLayer&>(*_network.Layers().front()).UpdateWeightAndBiasErrors(_delta.front(),
-	example, *_nablaW.front(), *_nablaB.front(), _dropoutMasks.front().get());
+  Tensor errors = OutputView(*_workspaces[2 + (lastLayer % 2)], *layers.front(), batchSize);
+  _packedDerivatives.front()->MultiplyInto(errors);
+  static_cast<WeightedLayer&>(*layers.front()).UpdateWeightAndBiasErrorsBatch(errors, examples, *_nablaW.front(),
+	*_nablaB.front(), _dropoutMasks.front().get());
+  if (layersFinished)
+	layersFinished->Increment(0);
+}
+
+void FeedForwardTrainer::UpdateWeights(double scalar, double decayFactor)
+{
+  for (size_t li = 0; li < _layers.size(); ++li)
+  {
+	auto wl = dynamic_cast<WeightedLayer*>(_layers[li].get());
+	if (wl)
+	{
+	  wl->UpdateParameters({ _nablaW[li].get() }, { _nablaB[li].get() }, scalar, decayFactor, 0, wl->ParameterCount());
+	  wl->RefreshWeightCache();
+	}
+  }
+}
+
+void FeedForwardTrainer::KeepErrors()
+{
+  std::swap(_nablaB, _keptNablaB);
+  std::swap(_nablaW, _keptNablaW);
+  // The first time, there were no kept errors to swap in.
+  if (_nablaB.empty())
+	AllocateErrors();
 }
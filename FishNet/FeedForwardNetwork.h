@@ -1,5 +1,6 @@
 #pragma once
 
+#include "BFloat16Tensor.h"
 #include "DropoutMask.h"
 #include "Layer.h"
 
@@ -7,11 +8,25 @@ class CostFunction;
 class FeedForwardTrainer;
 class Image;
 class ImageSet;
+class InferencePlan;
+class ProgressCounters;
+class QuantizedNetwork;
+class ThreadPool;
 
 class FeedForwardNetwork
 {
 public:
   using LayerVector = std::vector<std::unique_ptr<Layer>>;
+  // How the trainers' errors are applied to the weights. Synchronous splits each minibatch between the trainers and
+  // waits for them all to finish it. Overlapped starts on each layer as soon as every trainer has finished
+  // backpropagating through it, while the trainers are still working on the layers below. Hogwild gives each trainer
+  // whole minibatches and lets it apply its errors to the weights straight away, without waiting for or locking out
+  // the other trainers, which only wait for each other at the end of each epoch. LocalSgd gives each trainer its own copy
+  // of the layers to train on its own share of the training data, and only brings the trainers together to average
+  // their copies every AveragingInterval minibatches. OneStepStale applies each minibatch's errors while the trainers
+  // work on the next minibatch, which they do with the weights from before the last update. The new weights are written
+  // into a second copy of the layers, and the copies are swapped once the trainers have finished.
+  enum class WeightUpdateModes { Synchronous, Overlapped, Hogwild, LocalSgd, OneStepStale };
 
   FeedForwardNetwork(const std::string& name, uint32_t inputChannelCount, uint32_t inputRows, uint32_t inputColumns,
 	std::unique_ptr<::CostFunction>, uint32_t threadCount, uint16_t epochsTrained, double learningRate, double weightDecay);
@@ -33,6 +48,9 @@ public:
   {
 	return _layers.empty() ? nullptr : _layers.back().get();
   }
+  uint32_t InputChannelCount() const { return _inputChannelCount; }
+  uint32_t InputRows() const { return _inputRows; }
+  uint32_t InputColumns() const { return _inputColumns; }
   uint32_t ThreadCount() const { return _threadCount; }
   uint32_t EpochsTrained() const { return _epochsTrained; }
   double LearningRate() const { return _learningRate; }
@@ -50,23 +68,66 @@ public:
   {
 	_weightDecay = decay;
   }
+  // Whether classification and testing pass activations between convolutional and max pooling layers in the
+  // channel blocked layout. Training always uses planes.
+  bool ChannelBlocked() const { return _channelBlocked; }
+  void ChannelBlocked(bool channelBlocked)
+  {
+	_channelBlocked = channelBlocked;
+  }
+  // Whether training keeps the activations and derivatives that the backward pass needs as bfloat16, which halves the
+  // memory that each trainer works through. The weights and the sums of their errors stay at full precision.
+  bool MixedPrecision() const { return _mixedPrecision; }
+  void MixedPrecision(bool mixedPrecision)
+  {
+	_mixedPrecision = mixedPrecision;
+  }
+  WeightUpdateModes WeightUpdateMode() const { return _weightUpdateMode; }
+  void WeightUpdateMode(WeightUpdateModes mode)
+  {
+	_weightUpdateMode = mode;
+  }
+  static const std::vector<WeightUpdateModes>& AllWeightUpdateModes();
+  static const char* WeightUpdateModeName(WeightUpdateModes);
+  // How many minibatches each trainer trains on its own copy of the layers between averages, with LocalSgd weight updates.
+  uint32_t AveragingInterval() const { return _averagingInterval; }
+  void AveragingInterval(uint32_t interval)
+  {
+	_averagingInterval = interval;
+  }
+  // Builds a plan that classifies with the testing weights as they are now. Convolutional layers are used by
+  // the plan as they are, so it must not outlive the network.
+  std::unique_ptr<InferencePlan> CompileForInference();
   std::vector<uint32_t> Classify(const ImageSet&);
-  void SaveAccuracyStatistics(const ImageSet&, std::ostream&);
+  // If a quantized copy of the network is given, its accuracy is reported too.
+  void SaveAccuracyStatistics(const ImageSet&, std::ostream&, const QuantizedNetwork* = nullptr);
   void SaveWeightStatistics(std::ostream&) const;
   void SaveArchitecture(std::ostream&) const;
   void Train(const ImageSet&, uint32_t epochs, uint32_t giveUpAfter, uint32_t miniBatchSize,
 	double learningRateDecay, double learningRateDecayPoint, const std::string& saveDir);
-  void SignalWorkerFinished();
+  // Trains for one epoch on the examples in the order given, without testing or saving the network, and returns the
+  // average training cost.
+  double TrainForOneEpoch(const ImageSet&, const std::vector<Image*>& trainingData, uint32_t miniBatchSize);
 private:
+  std::vector<uint32_t> ClassifyChannelBlocked(const ImageSet&);
   double TrainForOneEpoch(const std::vector<Image*>& trainingData, uint32_t miniBatchSize);
+  void TrainOnMiniBatch(std::vector<Image*>::const_iterator begin, uint32_t miniBatchSize, uint32_t trainerCount);
+  void TrainOnMiniBatchOverlapped(std::vector<Image*>::const_iterator begin, uint32_t miniBatchSize, uint32_t trainerCount);
+  void TrainHogwild(const std::vector<Image*>& trainingData, uint32_t miniBatchSize);
+  void TrainLocalSgd(const std::vector<Image*>& trainingData, uint32_t miniBatchSize);
+  void TrainOneStepStale(const std::vector<Image*>& trainingData, uint32_t miniBatchSize);
+  // Applies the errors that the first trainerCount trainers have summed over a minibatch to the weights.
+  void UpdateWeights(uint32_t trainerCount, double scalar);
+  // Updates share number share of shareCount shares of a layer's weights and biases.
+  void UpdateShare(size_t layerIndex, uint32_t share, uint32_t shareCount, uint32_t trainerCount, double scalar);
+  // The same, except that the errors that the trainers have kept are applied, and the result is written into the share
+  // of the layer in _nextLayers.
+  void UpdateNextShare(size_t layerIndex, uint32_t share, uint32_t shareCount, uint32_t trainerCount, double scalar);
+  // Sets the weights and biases of the layers and of every replica to the mean of the replicas'.
+  void AverageReplicas();
+  void RefreshWeightCaches();
   std::pair<uint32_t, double> TestDuringTraining(const ImageSet&);
   void StartTrainers();
-  void WaitForBackgroundTrainers()
-  {
-	std::unique_lock<std::mutex> lock(_mutex);
-	if (_busyWorkerCount > 0)
-	  _workersFinished.wait(lock, [this] { return _busyWorkerCount == 0; });
-  }
   void StopTrainers();
 
   std::string _name;
@@ -80,16 +141,20 @@ private:
   double _learningRate;
   double _weightDecay;
   double _weightDecayMultiplier;
+  bool _channelBlocked;
+  bool _mixedPrecision;
+  WeightUpdateModes _weightUpdateMode;
+  uint32_t _averagingInterval;
 
   const std::vector<Tensor>* _oneHotCategories;
 
-  std::vector<std::thread> _backgroundThreads;
-  std::vector<std::unique_ptr<FeedForwardTrainer>> _backgroundTrainers;
-  std::unique_ptr<FeedForwardTrainer> _foregroundTrainer;
-
-  std::mutex _mutex;
-  std::condition_variable _workersFinished;
-  int32_t _busyWorkerCount;
+  ThreadPool& _threadPool;
+  // One trainer for each thread, where trainer t works on task t of the thread pool.
+  std::vector<std::unique_ptr<FeedForwardTrainer>> _trainers;
+  // With LocalSgd weight updates, the copy of the layers that each trainer trains on.
+  std::vector<LayerVector> _replicas;
+  // With OneStepStale weight updates, the layers that the next weights are written into while the trainers read _layers.
+  LayerVector _nextLayers;
 };
 
 std::ostream& operator<<(std::ostream&, const FeedForwardNetwork&);
@@ -104,78 +169,70 @@ protected:
 
   FeedForwardNetwork& _network;
   std::vector<Tensor> _activations;
+  // For the layers that run in the channel blocked layout, their output and, at the start of a run, their converted input.
+  std::vector<TensorPtr> _channelBlockedActivations;
+  std::vector<TensorPtr> _channelBlockedInputs;
 };
 
 class FeedForwardClassifier : public FeedForwardWorker
 {
 public:
   FeedForwardClassifier(FeedForwardNetwork& network)
-	: FeedForwardWorker(network), _batchSize(0) {}
-  FeedForwardClassifier(FeedForwardNetwork& network, std::vector<Image*>::const_iterator batchBegin,
-	std::vector<uint32_t>::iterator resultsBegin, uint32_t batchSize)
-	: FeedForwardWorker(network)
-  {
-	_batchBegin = batchBegin;
-	_resultsBegin = resultsBegin;
-	_batchSize = batchSize;
-  }
-  void ClassifyOnBackgroundThread();
+	: FeedForwardWorker(network) {}
   void Classify(std::vector<Image*>::const_iterator begin, std::vector<uint32_t>::iterator result, uint32_t count);
-private:
-  std::vector<Image*>::const_iterator _batchBegin;
-  std::vector<uint32_t>::iterator _resultsBegin;
-  uint32_t _batchSize;
 };
 
 class FeedForwardTrainer : public FeedForwardWorker
 {
 public:
-  enum class Phases { Training, Testing, Finished };
-
   FeedForwardTrainer(FeedForwardNetwork&);
+  // A trainer that trains a copy of the network's layers instead of the layers themselves.
+  FeedForwardTrainer(FeedForwardNetwork&, const FeedForwardNetwork::LayerVector& layers);
 
-  void TrainOnBackgroundThread();
-  void AddBatch(std::vector<Image*>::const_iterator begin, uint32_t batchSize);
-  void SetActivity(Phases phase)
+  void ResetTrainingCost()
   {
-	_currentPhase = phase;
-	_numberCorrect = 0;
 	_totalTrainingCost = 0.0;
-	_totalTestingCost = 0.0;
-  }
-  void SignalTrainingDone()
-  {
-	std::unique_lock<std::mutex> lock(_mutex);
-	_currentPhase = Phases::Finished;
-	_nextBatchAvailable.notify_one();
   }
 
-  void TrainOnMiniBatch(std::vector<Image*>::const_iterator begin, uint32_t batchSize);
-  void BackPropagate(const Tensor& example, const Tensor& correctOutput);
+  // If layersFinished is given, its counter li is incremented as soon as the trainer has finished with layer li, so
+  // that its weights can be updated while the trainer works on the layers below.
+  void TrainOnMiniBatch(std::vector<Image*>::const_iterator begin, uint32_t batchSize,
+	ProgressCounters* layersFinished = nullptr);
+  // Takes a batch of examples and their correct outputs, one in each hyperplane.
+  void BackPropagate(const Tensor& examples, const Tensor& correctOutputs, ProgressCounters* layersFinished = nullptr);
+  // Applies the errors summed over the last minibatch to the weights of the layers that this trainer trains, without
+  // waiting for any other trainer.
+  void UpdateWeights(double scalar, double decayFactor);
+  // Sets aside the errors summed over the last minibatch, so that they can be applied while the trainer works on the next.
+  void KeepErrors();
   const std::vector<TensorPtr>& NablaB() const { return _nablaB; }
   const std::vector<TensorPtr>& NablaW() const { return _nablaW; }
-  uint32_t NumberCorrect() const { return _numberCorrect; }
+  const std::vector<TensorPtr>& KeptNablaB() const { return _keptNablaB; }
+  const std::vector<TensorPtr>& KeptNablaW() const { return _keptNablaW; }
   double TotalTrainingCost() const { return _totalTrainingCost; }
-  double TotalTestingCost() const { return _totalTestingCost; }
 private:
-  void WaitForNextBatch()
-  {
-	std::unique_lock<std::mutex> lock(_mutex);
-	if (_batchSize == 0 && _currentPhase != Phases::Finished)
-	  _nextBatchAvailable.wait(lock, [this] { return _batchSize > 0 || _currentPhase == Phases::Finished; });
-  }
+  void AllocateErrors();
+  void AllocateBatch(const Tensor& exampleInputs, uint32_t batchSize);
+  void BackPropagateMixedPrecision(const Tensor& examples, const Tensor& correctOutputs,
+	ProgressCounters* layersFinished);
+
+  const FeedForwardNetwork::LayerVector& _layers;
+  TensorPtr _batchInputs;
+  TensorPtr _batchTargets;
+  std::vector<TensorPtr> _batchActivations;
   std::vector<TensorPtr> _derivatives;
-  std::vector<Tensor> _delta;
+  std::vector<TensorPtr> _delta;
   std::vector<TensorPtr> _nablaB;
   std::vector<TensorPtr> _nablaW;
+  std::vector<TensorPtr> _keptNablaB;
+  std::vector<TensorPtr> _keptNablaW;
   std::vector<DropoutMaskPtr> _dropoutMasks;
+  // In mixed precision, the activations and derivatives of each layer are kept as bfloat16, and the full precision
+  // tensors that the layers work on are views of four workspaces, each big enough for any layer's output.
+  std::vector<BFloat16TensorPtr> _packedActivations;
+  std::vector<BFloat16TensorPtr> _packedDerivatives;
+  std::vector<TensorPtr> _workspaces;
 
-  std::mutex _mutex;
-  std::condition_variable _nextBatchAvailable;
-  std::vector<Image*>::const_iterator _batchBegin;
-  uint32_t _batchSize;
-  uint32_t _numberCorrect;
   double _totalTrainingCost;
-  double _totalTestingCost;
-  std::atomic<Phases> _currentPhase;
+  uint32_t _allocatedBatchSize;
 };
@@ -0,0 +1,449 @@
+#include "stdafx.h"
+#include "Gemm.h"
+
+namespace
+{
+
+// The kernels are written in terms of a vector of Real elements of the widest kind that the compiler has been allowed to
+// use, so that building with -march=native (see build/common.mk) picks up AVX2 or AVX-512 without any other changes.
+#if defined(__AVX512F__)
+
+const uint32_t tileRows = 8;
+#ifdef FISHNET_SINGLE_PRECISION
+typedef __m512 Vector;
+const uint32_t vectorSize = 16;
+inline Vector Zero() { return _mm512_setzero_ps(); }
+inline Vector Broadcast(Real value) { return _mm512_set1_ps(value); }
+inline Vector Load(const Real* address) { return _mm512_loadu_ps(address); }
+inline void Store(Real* address, Vector v) { _mm512_storeu_ps(address, v); }
+inline Vector Add(Vector a, Vector b) { return _mm512_add_ps(a, b); }
+inline Vector MultiplyAdd(Vector a, Vector b, Vector c) { return _mm512_fmadd_ps(a, b, c); }
+inline Real Sum(Vector v) { return _mm512_reduce_add_ps(v); }
+#else
+typedef __m512d Vector;
+const uint32_t vectorSize = 8;
+inline Vector Zero() { return _mm512_setzero_pd(); }
+inline Vector Broadcast(Real value) { return _mm512_set1_pd(value); }
+inline Vector Load(const Real* address) { return _mm512_loadu_pd(address); }
+inline void Store(Real* address, Vector v) { _mm512_storeu_pd(address, v); }
+inline Vector Add(Vector a, Vector b) { return _mm512_add_pd(a, b); }
+inline Vector MultiplyAdd(Vector a, Vector b, Vector c) { return _mm512_fmadd_pd(a, b, c); }
+inline Real Sum(Vector v) { return _mm512_reduce_add_pd(v); }
+#endif
+
+#elif defined(__AVX2__) && (defined(__FMA__) || defined(_MSC_VER))
+
+const uint32_t tileRows = 6;
+#ifdef FISHNET_SINGLE_PRECISION
+typedef __m256 Vector;
+const uint32_t vectorSize = 8;
+inline Vector Zero() { return _mm256_setzero_ps(); }
+inline Vector Broadcast(Real value) { return _mm256_set1_ps(value); }
+inline Vector Load(const Real* address) { return _mm256_loadu_ps(address); }
+inline void Store(Real* address, Vector v) { _mm256_storeu_ps(address, v); }
+inline Vector Add(Vector a, Vector b) { return _mm256_add_ps(a, b); }
+inline Vector MultiplyAdd(Vector a, Vector b, Vector c) { return _mm256_fmadd_ps(a, b, c); }
+inline Real Sum(Vector v)
+{
+  __m128 sum = _mm_add_ps(_mm256_castps256_ps128(v), _mm256_extractf128_ps(v, 1));
+  sum = _mm_add_ps(sum, _mm_movehl_ps(sum, sum));
+  return _mm_cvtss_f32(_mm_add_ss(sum, _mm_shuffle_ps(sum, sum, 1)));
+}
+#else
+typedef __m256d Vector;
+const uint32_t vectorSize = 4;
+inline Vector Zero() { return _mm256_setzero_pd(); }
+inline Vector Broadcast(Real value) { return _mm256_set1_pd(value); }
+inline Vector Load(const Real* address) { return _mm256_loadu_pd(address); }
+inline void Store(Real* address, Vector v) { _mm256_storeu_pd(address, v); }
+inline Vector Add(Vector a, Vector b) { return _mm256_add_pd(a, b); }
+inline Vector MultiplyAdd(Vector a, Vector b, Vector c) { return _mm256_fmadd_pd(a, b, c); }
+inline Real Sum(Vector v)
+{
+  __m128d sum = _mm_add_pd(_mm256_castpd256_pd128(v), _mm256_extractf128_pd(v, 1));
+  return _mm_cvtsd_f64(_mm_add_sd(sum, _mm_unpackhi_pd(sum, sum)));
+}
+#endif
+
+#elif defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+
+const uint32_t tileRows = 4;
+#ifdef FISHNET_SINGLE_PRECISION
+typedef __m128 Vector;
+const uint32_t vectorSize = 4;
+inline Vector Zero() { return _mm_setzero_ps(); }
+inline Vector Broadcast(Real value) { return _mm_set1_ps(value); }
+inline Vector Load(const Real* address) { return _mm_loadu_ps(address); }
+inline void Store(Real* address, Vector v) { _mm_storeu_ps(address, v); }
+inline Vector Add(Vector a, Vector b) { return _mm_add_ps(a, b); }
+inline Vector MultiplyAdd(Vector a, Vector b, Vector c) { return _mm_add_ps(_mm_mul_ps(a, b), c); }
+inline Real Sum(Vector v)
+{
+  Vector sum = _mm_add_ps(v, _mm_movehl_ps(v, v));
+  return _mm_cvtss_f32(_mm_add_ss(sum, _mm_shuffle_ps(sum, sum, 1)));
+}
+#else
+typedef __m128d Vector;
+const uint32_t vectorSize = 2;
+inline Vector Zero() { return _mm_setzero_pd(); }
+inline Vector Broadcast(Real value) { return _mm_set1_pd(value); }
+inline Vector Load(const Real* address) { return _mm_loadu_pd(address); }
+inline void Store(Real* address, Vector v) { _mm_storeu_pd(address, v); }
+inline Vector Add(Vector a, Vector b) { return _mm_add_pd(a, b); }
+inline Vector MultiplyAdd(Vector a, Vector b, Vector c) { return _mm_add_pd(_mm_mul_pd(a, b), c); }
+inline Real Sum(Vector v) { return _mm_cvtsd_f64(_mm_add_sd(v, _mm_unpackhi_pd(v, v))); }
+#endif
+
+#else
+
+typedef Real Vector;
+const uint32_t vectorSize = 1;
+const uint32_t tileRows = 4;
+inline Vector Zero() { return 0; }
+inline Vector Broadcast(Real value) { return value; }
+inline Vector Load(const Real* address) { return *address; }
+inline void Store(Real* address, Vector v) { *address = v; }
+inline Vector Add(Vector a, Vector b) { return a + b; }
+inline Vector MultiplyAdd(Vector a, Vector b, Vector c) { return (a * b) + c; }
+inline Real Sum(Vector v) { return v; }
+
+#endif
+
+// The micro-kernel keeps a tile of tileRows rows by two vectors of c in registers.
+const uint32_t tileVectors = vectorSize > 1 ? 2 : 4;
+const uint32_t tileColumns = tileVectors * vectorSize;
+
+// A block of blockRows by blockDepth elements of a is packed so that it stays in the L2 cache while it is multiplied by
+// every tile column of a packed blockDepth by blockColumns panel of b, which stays in the L3 cache.
+const uint32_t blockDepth = 256;
+const uint32_t blockRows = 96;
+const uint32_t blockColumns = 2048;
+
+#ifdef FISHNET_BLAS
+std::atomic<bool> useExternalBlas(true);
+
+inline void BlasMultiplyMatrices(CBLAS_TRANSPOSE transposeA, CBLAS_TRANSPOSE transposeB, int m, int n, int k, const double* a,
+  int lda, const double* b, int ldb, double* c, int ldc)
+{
+  cblas_dgemm(CblasRowMajor, transposeA, transposeB, m, n, k, 1.0, a, lda, b, ldb, 1.0, c, ldc);
+}
+
+inline void BlasMultiplyMatrices(CBLAS_TRANSPOSE transposeA, CBLAS_TRANSPOSE transposeB, int m, int n, int k, const float* a,
+  int lda, const float* b, int ldb, float* c, int ldc)
+{
+  cblas_sgemm(CblasRowMajor, transposeA, transposeB, m, n, k, 1.0f, a, lda, b, ldb, 1.0f, c, ldc);
+}
+
+inline void BlasMultiplyMatrixByVector(CBLAS_TRANSPOSE transpose, int m, int n, const double* a, int lda, const double* x,
+  double* y)
+{
+  cblas_dgemv(CblasRowMajor, transpose, m, n, 1.0, a, lda, x, 1, 1.0, y, 1);
+}
+
+inline void BlasMultiplyMatrixByVector(CBLAS_TRANSPOSE transpose, int m, int n, const float* a, int lda, const float* x,
+  float* y)
+{
+  cblas_sgemv(CblasRowMajor, transpose, m, n, 1.0f, a, lda, x, 1, 1.0f, y, 1);
+}
+#endif
+
+// Each thread packs its own copies, since the layers are used by all the trainers at once.
+Real* PackBuffer(uint32_t index, size_t size)
+{
+  thread_local std::vector<Real> buffers[2];
+  std::vector<Real>& buffer = buffers[index];
+  if (buffer.size() < size)
+	buffer.resize(size);
+  return buffer.data();
+}
+
+// Copies a rows by depth block of op(a) into strips of tileRows rows. Each strip is stored column by column, so the
+// micro-kernel reads it in order, and the last strip is padded with zeros.
+void PackA(bool transpose, uint32_t rows, uint32_t depth, const Real* a, size_t lda, Real* packed)
+{
+  for (uint32_t i0 = 0; i0 < rows; i0 += tileRows)
+  {
+	uint32_t stripRows = std::min(tileRows, rows - i0);
+	for (uint32_t p = 0; p < depth; ++p)
+	{
+	  if (transpose)
+	  {
+		const Real* column = a + (p * lda) + i0;
+		for (uint32_t i = 0; i < stripRows; ++i)
+		  packed[i] = column[i];
+	  }
+	  else
+	  {
+		const Real* column = a + (i0 * lda) + p;
+		for (uint32_t i = 0; i < stripRows; ++i)
+		  packed[i] = column[i * lda];
+	  }
+	  for (uint32_t i = stripRows; i < tileRows; ++i)
+		packed[i] = 0.0;
+	  packed += tileRows;
+	}
+  }
+}
+
+// Copies a depth by columns block of op(b) into strips of tileColumns columns, each stored row by row.
+void PackB(bool transpose, uint32_t depth, uint32_t columns, const Real* b, size_t ldb, Real* packed)
+{
+  for (uint32_t j0 = 0; j0 < columns; j0 += tileColumns)
+  {
+	uint32_t stripColumns = std::min(tileColumns, columns - j0);
+	for (uint32_t p = 0; p < depth; ++p)
+	{
+	  if (transpose)
+	  {
+		const Real* row = b + (j0 * ldb) + p;
+		for (uint32_t j = 0; j < stripColumns; ++j)
+		  packed[j] = row[j * ldb];
+	  }
+	  else
+	  {
+		const Real* row = b + (p * ldb) + j0;
+		for (uint32_t j = 0; j < stripColumns; ++j)
+		  packed[j] = row[j];
+	  }
+	  for (uint32_t j = stripColumns; j < tileColumns; ++j)
+		packed[j] = 0.0;
+	  packed += tileColumns;
+	}
+  }
+}
+
+// Adds the product of a packed strip of a and a packed strip of b to a whole tile of c.
+inline void MultiplyTile(uint32_t depth, const Real* a, const Real* b, Real* c, size_t ldc)
+{
+  Vector sums[tileRows][tileVectors];
+  for (uint32_t i = 0; i < tileRows; ++i)
+  {
+	for (uint32_t v = 0; v < tileVectors; ++v)
+	  sums[i][v] = Zero();
+  }
+  for (uint32_t p = 0; p < depth; ++p)
+  {
+	Vector bv[tileVectors];
+	for (uint32_t v = 0; v < tileVectors; ++v)
+	  bv[v] = Load(b + (v * vectorSize));
+	for (uint32_t i = 0; i < tileRows; ++i)
+	{
+	  Vector av = Broadcast(a[i]);
+	  for (uint32_t v = 0; v < tileVectors; ++v)
+		sums[i][v] = MultiplyAdd(av, bv[v], sums[i][v]);
+	}
+	a += tileRows;
+	b += tileColumns;
+  }
+  for (uint32_t i = 0; i < tileRows; ++i)
+  {
+	Real* cRow = c + (i * ldc);
+	for (uint32_t v = 0; v < tileVectors; ++v)
+	  Store(cRow + (v * vectorSize), Add(Load(cRow + (v * vectorSize)), sums[i][v]));
+  }
+}
+
+// Multiplies packed blocks of a and b. Tiles on the bottom and right edges are worked out in a full sized tile first,
+// so that the micro-kernel never has to check its bounds.
+void MultiplyBlock(uint32_t rows, uint32_t columns, uint32_t depth, const Real* packedA, const Real* packedB, Real* c,
+  size_t ldc)
+{
+  Real edgeTile[tileRows * tileColumns];
+  for (uint32_t j0 = 0; j0 < columns; j0 += tileColumns)
+  {
+	uint32_t tileWidth = std::min(tileColumns, columns - j0);
+	const Real* bStrip = packedB + (size_t(j0) * depth);
+	for (uint32_t i0 = 0; i0 < rows; i0 += tileRows)
+	{
+	  uint32_t tileHeight = std::min(tileRows, rows - i0);
+	  const Real* aStrip = packedA + (size_t(i0) * depth);
+	  Real* cTile = c + (i0 * ldc) + j0;
+	  if (tileHeight == tileRows && tileWidth == tileColumns)
+	  {
+		MultiplyTile(depth, aStrip, bStrip, cTile, ldc);
+	  }
+	  else
+	  {
+		memset(edgeTile, 0, sizeof(edgeTile));
+		MultiplyTile(depth, aStrip, bStrip, edgeTile, tileColumns);
+		for (uint32_t i = 0; i < tileHeight; ++i)
+		{
+		  for (uint32_t j = 0; j < tileWidth; ++j)
+			cTile[(i * ldc) + j] += edgeTile[(i * tileColumns) + j];
+		}
+	  }
+	}
+  }
+}
+
+// Works out each element of y as the dot product of a row of a and x. Four rows are done at a time so that each element
+// of x is loaded once for every four multiply-adds.
+void MultiplyRowsByVector(uint32_t m, uint32_t n, const Real* a, size_t lda, const Real* x, Real* y)
+{
+  uint32_t vectorEnd = n - (n % vectorSize);
+  uint32_t i = 0;
+  for (; i + 4 <= m; i += 4)
+  {
+	const Real* a0 = a + (i * lda);
+	const Real* a1 = a0 + lda;
+	const Real* a2 = a1 + lda;
+	const Real* a3 = a2 + lda;
+	Vector sum0 = Zero();
+	Vector sum1 = Zero();
+	Vector sum2 = Zero();
+	Vector sum3 = Zero();
+	uint32_t j = 0;
+	for (; j < vectorEnd; j += vectorSize)
+	{
+	  Vector xv = Load(x + j);
+	  sum0 = MultiplyAdd(Load(a0 + j), xv, sum0);
+	  sum1 = MultiplyAdd(Load(a1 + j), xv, sum1);
+	  sum2 = MultiplyAdd(Load(a2 + j), xv, sum2);
+	  sum3 = MultiplyAdd(Load(a3 + j), xv, sum3);
+	}
+	Real y0 = Sum(sum0);
+	Real y1 = Sum(sum1);
+	Real y2 = Sum(sum2);
+	Real y3 = Sum(sum3);
+	for (; j < n; ++j)
+	{
+	  y0 += a0[j] * x[j];
+	  y1 += a1[j] * x[j];
+	  y2 += a2[j] * x[j];
+	  y3 += a3[j] * x[j];
+	}
+	y[i] += y0;
+	y[i + 1] += y1;
+	y[i + 2] += y2;
+	y[i + 3] += y3;
+  }
+  for (; i < m; ++i)
+  {
+	const Real* a0 = a + (i * lda);
+	Vector sum = Zero();
+	uint32_t j = 0;
+	for (; j < vectorEnd; j += vectorSize)
+	  sum = MultiplyAdd(Load(a0 + j), Load(x + j), sum);
+	Real y0 = Sum(sum);
+	for (; j < n; ++j)
+	  y0 += a0[j] * x[j];
+	y[i] += y0;
+  }
+}
+
+// Adds each row of a, scaled by the matching element of x, to y, so that a is read in order however long its rows are.
+// Four rows are done at a time so that each element of y is loaded and stored once for every four multiply-adds.
+void AddScaledRows(uint32_t m, uint32_t n, const Real* a, size_t lda, const Real* x, Real* y)
+{
+  uint32_t vectorEnd = n - (n % vectorSize);
+  uint32_t i = 0;
+  for (; i + 4 <= m; i += 4)
+  {
+	const Real* a0 = a + (i * lda);
+	const Real* a1 = a0 + lda;
+	const Real* a2 = a1 + lda;
+	const Real* a3 = a2 + lda;
+	Vector x0 = Broadcast(x[i]);
+	Vector x1 = Broadcast(x[i + 1]);
+	Vector x2 = Broadcast(x[i + 2]);
+	Vector x3 = Broadcast(x[i + 3]);
+	uint32_t j = 0;
+	for (; j < vectorEnd; j += vectorSize)
+	{
+	  Vector sum = MultiplyAdd(Load(a0 + j), x0, Load(y + j));
+	  sum = MultiplyAdd(Load(a1 + j), x1, sum);
+	  sum = MultiplyAdd(Load(a2 + j), x2, sum);
+	  Store(y + j, MultiplyAdd(Load(a3 + j), x3, sum));
+	}
+	for (; j < n; ++j)
+	  y[j] += (a0[j] * x[i]) + (a1[j] * x[i + 1]) + (a2[j] * x[i + 2]) + (a3[j] * x[i + 3]);
+  }
+  for (; i < m; ++i)
+  {
+	const Real* a0 = a + (i * lda);
+	Vector x0 = Broadcast(x[i]);
+	uint32_t j = 0;
+	for (; j < vectorEnd; j += vectorSize)
+	  Store(y + j, MultiplyAdd(Load(a0 + j), x0, Load(y + j)));
+	for (; j < n; ++j)
+	  y[j] += a0[j] * x[i];
+  }
+}
+
+}
+
+void MultiplyMatrices(bool transposeA, bool transposeB, uint32_t m, uint32_t n, uint32_t k, const Real* a, size_t lda,
+  const Real* b, size_t ldb, Real* c, size_t ldc)
+{
+  if (m == 0 || n == 0 || k == 0)
+	return;
+#ifdef FISHNET_BLAS
+  if (useExternalBlas)
+  {
+	BlasMultiplyMatrices(transposeA ? CblasTrans : CblasNoTrans, transposeB ? CblasTrans : CblasNoTrans, m, n, k,
+	  a, static_cast<int>(lda), b, static_cast<int>(ldb), c, static_cast<int>(ldc));
+	return;
+  }
+#endif
+  uint32_t panelColumns = std::min(blockColumns, ((n + tileColumns - 1) / tileColumns) * tileColumns);
+  Real* packedA = PackBuffer(0, size_t(blockRows) * blockDepth);
+  Real* packedB = PackBuffer(1, size_t(panelColumns) * blockDepth);
+  for (uint32_t j0 = 0; j0 < n; j0 += blockColumns)
+  {
+	uint32_t columns = std::min(blockColumns, n - j0);
+	for (uint32_t p0 = 0; p0 < k; p0 += blockDepth)
+	{
+	  uint32_t depth = std::min(blockDepth, k - p0);
+	  PackB(transposeB, depth, columns, transposeB ? b + (j0 * ldb) + p0 : b + (p0 * ldb) + j0, ldb, packedB);
+	  for (uint32_t i0 = 0; i0 < m; i0 += blockRows)
+	  {
+		uint32_t rows = std::min(blockRows, m - i0);
+		PackA(transposeA, rows, depth, transposeA ? a + (p0 * lda) + i0 : a + (i0 * lda) + p0, lda, packedA);
+		MultiplyBlock(rows, columns, depth, packedA, packedB, c + (i0 * ldc) + j0, ldc);
+	  }
+	}
+  }
+}
+
+void MultiplyMatrixByVector(bool transpose, uint32_t m, uint32_t n, const Real* a, size_t lda, const Real* x, Real* y)
+{
+#ifdef FISHNET_BLAS
+  if (useExternalBlas)
+  {
+	BlasMultiplyMatrixByVector(transpose ? CblasTrans : CblasNoTrans, m, n, a, static_cast<int>(lda), x, y);
+	return;
+  }
+#endif
+  if (transpose)
+	AddScaledRows(m, n, a, lda, x, y);
+  else
+	MultiplyRowsByVector(m, n, a, lda, x, y);
+}
+
+bool ExternalBlasAvailable()
+{
+#ifdef FISHNET_BLAS
+  return true;
+#else
+  return false;
+#endif
+}
+
+bool UseExternalBlas()
+{
+#ifdef FISHNET_BLAS
+  return useExternalBlas;
+#else
+  return false;
+#endif
+}
+
+void UseExternalBlas(bool use)
+{
+#ifdef FISHNET_BLAS
+  useExternalBlas = use;
+#else
+  if (use)
+	throw std::runtime_error("FishNet was not built with an external BLAS library.");
+#endif
+}
@@ -0,0 +1,22 @@
+#pragma once
+
+#include "Tensor.h"
+
+// The matrix products that the weighted layers are built on. All the matrices are row-major, and lda, ldb and ldc are
+// the number of elements from the start of one row to the start of the next, so the functions can work on parts of
+// larger matrices.
+
+// Adds the product of the m by k matrix op(a) and the k by n matrix op(b) to the m by n matrix c. op(a) is a, or if
+// transposeA is set, the transpose of a, which is then stored as a k by m matrix. op(b) is the same for b.
+void MultiplyMatrices(bool transposeA, bool transposeB, uint32_t m, uint32_t n, uint32_t k, const Real* a, size_t lda,
+  const Real* b, size_t ldb, Real* c, size_t ldc);
+
+// Adds the product of op(a) and the vector x to the vector y, where a is an m by n matrix and op(a) is a, or if transpose
+// is set, the transpose of a. x has as many elements as op(a) has columns, and y as many as it has rows.
+void MultiplyMatrixByVector(bool transpose, uint32_t m, uint32_t n, const Real* a, size_t lda, const Real* x, Real* y);
+
+// If FishNet was built with an external BLAS library (see build/common.mk), the products are handed to it by default.
+// It can be turned off to compare the library with the built in kernels.
+bool ExternalBlasAvailable();
+bool UseExternalBlas();
+void UseExternalBlas(bool use);
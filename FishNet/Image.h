@@ -5,7 +5,7 @@
 class Image
 {
   public:
-	Image(std::unique_ptr<double[]>&& data, uint32_t channels, uint32_t width, uint32_t height, uint32_t category)
+	Image(std::unique_ptr<Real[]>&& data, uint32_t channels, uint32_t width, uint32_t height, uint32_t category)
 	  : _inputs(move(data), channels, height, width), _category(category) {}
 	Tensor& Inputs() { return _inputs; }
 	const Tensor& Inputs() const { return _inputs; }
@@ -0,0 +1,213 @@
+#include "stdafx.h"
+#include "InferencePlan.h"
+#include "ConvolutionalLayer.h"
+#include "FeedForwardNetwork.h"
+#include "Gemm.h"
+
+namespace
+{
+
+// The activation functions, in the same form as ActivationFunction::Apply, so they can be inlined into the kernels.
+struct NoActivation
+{
+  static Real Apply(Real x, Real) { return x; }
+};
+
+struct ReLUActivation
+{
+  static Real Apply(Real x, Real) { return x < 0.0 ? Real(0.0) : x; }
+};
+
+struct LeakyReLUActivation
+{
+  static Real Apply(Real x, Real leakiness) { return x < 0.0 ? x * leakiness : x; }
+};
+
+struct SigmoidActivation
+{
+  static Real Apply(Real x, Real) { return Real(1.0 / (1.0 + exp(-x))); }
+};
+
+struct TanHActivation
+{
+  static Real Apply(Real x, Real) { return Real(2.0 / (1.0 + exp(-2.0 * x)) - 1.0); }
+};
+
+template <class Activation>
+inline void ApplyActivation(Real* v, size_t count, Real parameter)
+{
+  for (size_t i = 0; i < count; ++i)
+	v[i] = Activation::Apply(v[i], parameter);
+}
+
+// Works through the neurons in blocks, applying the activation function to each block as soon as it has been
+// calculated, while it is still in the L1 cache.
+template <class Activation>
+struct FullyConnectedKernel
+{
+  static void Run(const InferenceStep& step, const Tensor& input, Tensor& output, Real*)
+  {
+	const uint32_t rowBlock = 64;
+	uint32_t outputSize = static_cast<uint32_t>(step.biases.size());
+	const Real* weights = step.weights.data();
+	Real* out = output.Elements();
+	for (uint32_t row = 0; row < outputSize; row += rowBlock)
+	{
+	  uint32_t rows = std::min(rowBlock, outputSize - row);
+	  memcpy(out + row, step.biases.data() + row, sizeof(Real) * rows);
+	  MultiplyMatrixByVector(false, rows, step.inputSize, weights + (size_t(row) * step.inputSize), step.inputSize,
+		input.Elements(), out + row);
+	  ApplyActivation<Activation>(out + row, rows, step.activationParameter);
+	}
+  }
+};
+
+// The same matrix product as ConvolutionalLayer::FeedForwardGemm, but done for a block of output columns at a time,
+// starting from the biases and finishing with the activation function while the block is still in the cache.
+template <class Activation>
+struct ConvolutionGemmKernel
+{
+  static void Run(const InferenceStep& step, const Tensor& input, Tensor& output, Real* patches)
+  {
+	const uint32_t columnBlock = 128;
+	const ConvolutionalLayer& layer = *step.convolutional;
+	uint32_t patchSize = layer.InputChannelCount() * layer.FilterSize() * layer.FilterSize();
+	uint32_t outputPlaneSize = step.outputRows * step.outputColumns;
+	layer.ExpandInputPatches(input.Elements(), patches);
+	const Real* weights = layer.Weights().Elements();
+	const Real* biases = layer.Biases().Elements();
+	Real* out = output.Elements();
+	for (uint32_t column = 0; column < outputPlaneSize; column += columnBlock)
+	{
+	  uint32_t columns = std::min(columnBlock, outputPlaneSize - column);
+	  for (uint32_t filter = 0; filter < step.outputPlanes; ++filter)
+		std::fill_n(out + (size_t(filter) * outputPlaneSize) + column, columns, biases[filter]);
+	  MultiplyMatrices(false, false, step.outputPlanes, columns, patchSize, weights, patchSize, patches + column,
+		outputPlaneSize, out + column, outputPlaneSize);
+	  for (uint32_t filter = 0; filter < step.outputPlanes; ++filter)
+		ApplyActivation<Activation>(out + (size_t(filter) * outputPlaneSize) + column, columns, step.activationParameter);
+	}
+  }
+};
+
+// The other convolution algorithms keep transformed weights in the layer, so the layer does the convolution. The call
+// names the class, so it doesn't go through the virtual function table.
+template <class Activation>
+struct ConvolutionKernel
+{
+  static void Run(const InferenceStep& step, const Tensor& input, Tensor& output, Real*)
+  {
+	step.convolutional->ConvolutionalLayer::FeedForward(input, output, nullptr);
+	ApplyActivation<Activation>(output.Elements(), output.Size(), step.activationParameter);
+  }
+};
+
+void MaxPoolingKernel(const InferenceStep& step, const Tensor& input, Tensor& output, Real*)
+{
+  step.maxPooling->MaxPoolingLayer::FeedForward(input, output, nullptr);
+}
+
+template <template <class> class Kernel>
+InferenceStep::Kernel ResolveActivation(const ActivationFunction* activationFunction)
+{
+  switch (activationFunction ? activationFunction->Type() : ActivationFunction::Types::None)
+  {
+	case ActivationFunction::Types::ReLU:
+	  return Kernel<ReLUActivation>::Run;
+	case ActivationFunction::Types::LeakyReLU:
+	  return Kernel<LeakyReLUActivation>::Run;
+	case ActivationFunction::Types::Sigmoid:
+	  return Kernel<SigmoidActivation>::Run;
+	case ActivationFunction::Types::TanH:
+	  return Kernel<TanHActivation>::Run;
+	default:
+	  return Kernel<NoActivation>::Run;
+  }
+}
+
+}
+
+InferencePlan::Workspace::Workspace(const InferencePlan& plan)
+  : _first(plan._bufferSize), _second(plan._bufferSize), _scratch(std::make_unique<Real[]>(plan._scratchSize))
+{
+}
+
+InferencePlan::InferencePlan(const FeedForwardNetwork& network)
+  : _bufferSize(0), _scratchSize(0)
+{
+  for (const auto& layer : network.Layers())
+  {
+	InferenceStep step {};
+	step.outputPlanes = layer->OutputPlanes();
+	step.outputRows = layer->OutputRows();
+	step.outputColumns = layer->OutputColumns();
+	_bufferSize = std::max(_bufferSize, step.outputPlanes * step.outputRows * step.outputColumns);
+	auto wl = dynamic_cast<const WeightedLayer*>(layer.get());
+	if (wl)
+	{
+	  auto leakyReLU = dynamic_cast<const LeakyReLU*>(wl->ActivationFunction());
+	  if (leakyReLU)
+		step.activationParameter = static_cast<Real>(leakyReLU->Leakiness());
+	}
+	step.convolutional = dynamic_cast<const ConvolutionalLayer*>(layer.get());
+	step.maxPooling = dynamic_cast<const MaxPoolingLayer*>(layer.get());
+	if (step.convolutional)
+	{
+	  const ConvolutionalLayer& cl = *step.convolutional;
+	  if (cl.Algorithm() == ConvolutionalLayer::Algorithms::Gemm)
+	  {
+		step.kernel = ResolveActivation<ConvolutionGemmKernel>(wl->ActivationFunction());
+		_scratchSize = std::max(_scratchSize,
+		  size_t(cl.InputChannelCount()) * cl.FilterSize() * cl.FilterSize() * step.outputRows * step.outputColumns);
+	  }
+	  else
+	  {
+		step.kernel = ResolveActivation<ConvolutionKernel>(wl->ActivationFunction());
+	  }
+	}
+	else if (step.maxPooling)
+	{
+	  step.kernel = MaxPoolingKernel;
+	}
+	else if (wl)
+	{
+	  const Tensor& weights = wl->Weights();
+	  step.inputSize = weights.Columns();
+	  step.weights.assign(weights.Elements(), weights.Elements() + weights.Size());
+	  step.biases.assign(wl->Biases().Elements(), wl->Biases().Elements() + wl->Biases().Size());
+	  step.kernel = ResolveActivation<FullyConnectedKernel>(wl->ActivationFunction());
+	}
+	else
+	{
+	  throw std::runtime_error("InferencePlan - unsupported layer type.");
+	}
+	_steps.emplace_back(std::move(step));
+  }
+  if (_steps.empty())
+	throw std::runtime_error("InferencePlan - the network has no layers.");
+}
+
+Tensor InferencePlan::FeedForward(const Tensor& input, Workspace& workspace) const
+{
+  const InferenceStep* previous = nullptr;
+  for (size_t si = 0; si < _steps.size(); ++si)
+  {
+	const InferenceStep& step = _steps[si];
+	const Tensor& inputBuffer = si % 2 == 0 ? workspace._second : workspace._first;
+	const Tensor& outputBuffer = si % 2 == 0 ? workspace._first : workspace._second;
+	Tensor output = outputBuffer.View(1, step.outputPlanes, step.outputRows, step.outputColumns);
+	if (previous)
+	  step.kernel(step, inputBuffer.View(1, previous->outputPlanes, previous->outputRows, previous->outputColumns), output,
+		workspace._scratch.get());
+	else
+	  step.kernel(step, input, output, workspace._scratch.get());
+	previous = &step;
+  }
+  const Tensor& last = _steps.size() % 2 == 1 ? workspace._first : workspace._second;
+  return last.View(1, previous->outputPlanes, previous->outputRows, previous->outputColumns);
+}
+
+uint32_t InferencePlan::Classify(const Tensor& input, Workspace& workspace) const
+{
+  return FeedForward(input, workspace).HighestValueIndex();
+}
@@ -0,0 +1,57 @@
+#pragma once
+
+#include "Tensor.h"
+
+class ConvolutionalLayer;
+class FeedForwardNetwork;
+class MaxPoolingLayer;
+
+// One layer of an InferencePlan. The kernel is chosen for the layer type, algorithm and activation function when the
+// plan is compiled, and does the whole layer including its biases and activation function.
+struct InferenceStep
+{
+  typedef void (*Kernel)(const InferenceStep&, const Tensor& input, Tensor& output, Real* scratch);
+
+  Kernel kernel;
+  const ConvolutionalLayer* convolutional;
+  const MaxPoolingLayer* maxPooling;
+  // A fully connected layer's testing weights, one row for each neuron, and its biases.
+  std::vector<Real> weights;
+  std::vector<Real> biases;
+  uint32_t inputSize;
+  uint32_t outputPlanes;
+  uint32_t outputRows;
+  uint32_t outputColumns;
+  // The leakiness of a leaky ReLU.
+  Real activationParameter;
+};
+
+// An immutable form of a network for classification, made by FeedForwardNetwork::CompileForInference. Each layer is a
+// step with a direct pointer to its kernel, so there are no virtual calls or casts per image, and the activations
+// alternate between two buffers instead of one per layer. Convolutional layers are still run by the network's layers,
+// so the plan must not outlive the network, and has to be compiled again once the network has been trained further.
+class InferencePlan
+{
+public:
+  // Each thread that uses the plan needs one of these.
+  class Workspace
+  {
+  public:
+	explicit Workspace(const InferencePlan&);
+  private:
+	friend class InferencePlan;
+	Tensor _first;
+	Tensor _second;
+	std::unique_ptr<Real[]> _scratch;
+  };
+
+  explicit InferencePlan(const FeedForwardNetwork&);
+  // Returns a view of the output layer's activations, which is valid until the workspace is used again.
+  Tensor FeedForward(const Tensor& input, Workspace&) const;
+  uint32_t Classify(const Tensor& input, Workspace&) const;
+  size_t StepCount() const { return _steps.size(); }
+private:
+  std::vector<InferenceStep> _steps;
+  uint32_t _bufferSize;
+  size_t _scratchSize;
+};
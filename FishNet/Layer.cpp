@@ -1,11 +1,83 @@
 #include "stdafx.h"
 #include "ConvolutionalLayer.h"
 #include "DropoutMask.h"
+#include "Gemm.h"
+
+namespace
+{
+
+// Returns the errors with the ones for dropped out neurons set to zero, copied into a buffer for each thread so that the
+// layer can be shared by all the trainers. Without a mask the errors are returned as they are.
+const Real* KeptErrors(const Tensor& errors, const DropoutMask* dropoutMask)
+{
+  if (!dropoutMask)
+	return errors.Elements();
+  thread_local std::vector<Real> buffer;
+  if (buffer.size() < errors.Size())
+	buffer.resize(errors.Size());
+  const Real* error = errors.Elements();
+  const bool* keep = dropoutMask->Begin();
+  for (size_t i = 0; i < errors.Size(); ++i)
+	buffer[i] = keep[i] ? error[i] : 0.0;
+  return buffer.data();
+}
+
+// Sets elements[i] to elements[i] * decayFactor - (the sum of errors[t][i]) * scalar, from first up to last. The errors
+// are summed a block at a time, so the block stays in the L1 cache while each trainer's errors are added to it.
+void UpdateElements(Real* elements, const std::vector<const Real*>& errors, double scalar, double decayFactor,
+  size_t first, size_t last)
+{
+  const size_t blockSize = 256;
+  Real sums[blockSize];
+  Real s = static_cast<Real>(scalar);
+  Real decay = static_cast<Real>(decayFactor);
+  for (size_t block = first; block < last; block += blockSize)
+  {
+	size_t count = std::min(blockSize, last - block);
+	std::copy_n(errors.front() + block, count, sums);
+	for (size_t t = 1; t < errors.size(); ++t)
+	{
+	  const Real* error = errors[t] + block;
+	  for (size_t i = 0; i < count; ++i)
+		sums[i] += error[i];
+	}
+	Real* element = elements + block;
+	for (size_t i = 0; i < count; ++i)
+	  element[i] = element[i] * decay - sums[i] * s;
+  }
+}
+
+// Sets elements[i] and replicas[r][i] to the mean of replicas[r][i], from first up to last, a block at a time in the
+// same way as UpdateElements.
+void AverageElements(Real* elements, const std::vector<Real*>& replicas, size_t first, size_t last)
+{
+  const size_t blockSize = 256;
+  Real sums[blockSize];
+  Real scale = static_cast<Real>(1.0 / replicas.size());
+  for (size_t block = first; block < last; block += blockSize)
+  {
+	size_t count = std::min(blockSize, last - block);
+	std::copy_n(replicas.front() + block, count, sums);
+	for (size_t r = 1; r < replicas.size(); ++r)
+	{
+	  const Real* replica = replicas[r] + block;
+	  for (size_t i = 0; i < count; ++i)
+		sums[i] += replica[i];
+	}
+	Real* element = elements + block;
+	for (size_t i = 0; i < count; ++i)
+	  element[i] = sums[i] * scale;
+	for (Real* replica : replicas)
+	  std::copy_n(element, count, replica + block);
+  }
+}
+
+}
 
 void Randomizer::Fill(Tensor& tensor)
 {
-  double* dest = tensor.Elements();
-  const double* end = dest + tensor.Size();
+  Real* dest = tensor.Elements();
+  const Real* end = dest + tensor.Size();
   while (dest != end)
   {
 	*dest = _distribution(_generator);
@@ -16,7 +88,7 @@ void Randomizer::Fill(Tensor& tensor)
 std::default_random_engine Randomizer::_generator(static_cast<uint32_t>(std::chrono::system_clock::now().time_since_epoch().count()));
 
 std::unique_ptr<Layer> Layer::Load(std::ifstream& is, uint32_t inputChannelCount, uint32_t inputRows, uint32_t inputColumns,
-  double prevLayerKeepProbability)
+  double prevLayerKeepProbability, uint32_t elementSize)
 {
   switch(static_cast<Types>(is.get()))
   {
@@ -25,8 +97,8 @@ std::unique_ptr<Layer> Layer::Load(std::ifstream& is, uint32_t inputChannelCount
 	  auto activationFunction = ActivationFunction::Load(is);
 	  double keepProbability;
 	  is.read((char*)&keepProbability, sizeof(double));
-	  auto weights = Tensor::Load(is);
-	  auto biases = Tensor::Load(is);
+	  auto weights = Tensor::Load(is, elementSize);
+	  auto biases = Tensor::Load(is, elementSize);
 	  return std::make_unique<FullyConnectedLayer>(std::move(weights), std::move(biases), std::move(activationFunction),
 		keepProbability, prevLayerKeepProbability);
 	}
@@ -37,8 +109,8 @@ std::unique_ptr<Layer> Layer::Load(std::ifstream& is, uint32_t inputChannelCount
 	  is.read((char*)&stride, sizeof(uint32_t));
 	  uint32_t zeroPadding;
 	  is.read((char*)&zeroPadding, sizeof(uint32_t));
-	  auto weights = Tensor::Load(is);
-	  auto biases = Tensor::Load(is);
+	  auto weights = Tensor::Load(is, elementSize);
+	  auto biases = Tensor::Load(is, elementSize);
 	  return std::make_unique<ConvolutionalLayer>(std::move(weights), std::move(biases), inputRows, inputColumns, stride, zeroPadding,
 		std::move(activationFunction));
 	}
@@ -49,6 +121,34 @@ std::unique_ptr<Layer> Layer::Load(std::ifstream& is, uint32_t inputChannelCount
   }
 }
 
+void Layer::FeedForwardBatch(const Tensor& inputs, Tensor& outputs, const DropoutMask*) const
+{
+  for (uint32_t example = 0; example < inputs.Hyperplanes(); ++example)
+  {
+	Tensor output = outputs.HyperplaneView(example);
+	FeedForward(inputs.HyperplaneView(example), output, nullptr);
+  }
+}
+
+void WeightedLayer::BackpropagateErrorBatch(const Tensor& errorInThisLayer, Tensor& errorInPreviousLayer, const DropoutMask*) const
+{
+  for (uint32_t example = 0; example < errorInThisLayer.Hyperplanes(); ++example)
+  {
+	Tensor errorInPreviousLayerExample = errorInPreviousLayer.HyperplaneView(example);
+	BackpropagateError(errorInThisLayer.HyperplaneView(example), errorInPreviousLayerExample, nullptr);
+  }
+}
+
+void WeightedLayer::UpdateWeightAndBiasErrorsBatch(const Tensor& delta, const Tensor& previousLayerActivations,
+  Tensor& nablaW, Tensor& nablaB, const DropoutMask*)
+{
+  for (uint32_t example = 0; example < delta.Hyperplanes(); ++example)
+  {
+	UpdateWeightAndBiasErrors(delta.HyperplaneView(example), previousLayerActivations.HyperplaneView(example), nablaW, nablaB,
+	  nullptr);
+  }
+}
+
 void WeightedLayer::UpdateWeightsAndBiases(const Tensor& nablaW, const Tensor& nablaB, double scalar)
 {
 #ifdef _DEBUG
@@ -58,24 +158,83 @@ void WeightedLayer::UpdateWeightsAndBiases(const Tensor& nablaW, const Tensor& n
 	throw std::runtime_error("WeightedLayer::UpdateWeightsAndBiases - Dimensions of nablaB do not match the bias dimensions.");
 #endif
   // Update weights.
-  const double* end = _weights->Elements() + _weights->Size();
-  double* nw = nablaW.Elements();
-  for (double* w = _weights->Elements(); w < end; ++w, ++nw)
+  const Real* end = _weights->Elements() + _weights->Size();
+  Real* nw = nablaW.Elements();
+  for (Real* w = _weights->Elements(); w < end; ++w, ++nw)
 	*w -= (*nw * scalar);
   // Update biases.
   end = _biases->Elements() + _biases->Size();
-  double* nb = nablaB.Elements();
-  for (double* b = _biases->Elements(); b < end; ++b, ++nb)
+  Real* nb = nablaB.Elements();
+  for (Real* b = _biases->Elements(); b < end; ++b, ++nb)
 	*b -= (*nb * scalar);
 }
 
 void WeightedLayer::DecayWeights(double factor)
 {
-  const double* end = _weights->Elements() + _weights->Size();
-  for (double* w = _weights->Elements(); w < end; ++w)
+  const Real* end = _weights->Elements() + _weights->Size();
+  for (Real* w = _weights->Elements(); w < end; ++w)
 	*w *= factor;
 }
 
+void WeightedLayer::UpdateParameters(const std::vector<const Tensor*>& nablaW, const std::vector<const Tensor*>& nablaB,
+  double scalar, double decayFactor, size_t first, size_t last)
+{
+  if (nablaW.empty() || nablaW.size() != nablaB.size())
+	throw std::runtime_error("WeightedLayer::UpdateParameters - There must be the same number of weight and bias errors.");
+  size_t weightCount = _weights->Size();
+  if (first < weightCount)
+  {
+	std::vector<const Real*> errors;
+	for (const Tensor* n : nablaW)
+	  errors.push_back(n->Elements());
+	UpdateElements(_weights->Elements(), errors, scalar, decayFactor, first, std::min(last, weightCount));
+  }
+  if (last > weightCount)
+  {
+	std::vector<const Real*> errors;
+	for (const Tensor* n : nablaB)
+	  errors.push_back(n->Elements());
+	UpdateElements(_biases->Elements(), errors, scalar, 1.0, std::max(first, weightCount) - weightCount,
+	  last - weightCount);
+  }
+}
+
+void WeightedLayer::AverageParameters(const std::vector<WeightedLayer*>& replicas, size_t first, size_t last)
+{
+  if (replicas.empty())
+	throw std::runtime_error("WeightedLayer::AverageParameters - There must be at least one replica.");
+  size_t weightCount = _weights->Size();
+  if (first < weightCount)
+  {
+	std::vector<Real*> weights;
+	for (WeightedLayer* replica : replicas)
+	  weights.push_back(replica->_weights->Elements());
+	AverageElements(_weights->Elements(), weights, first, std::min(last, weightCount));
+  }
+  if (last > weightCount)
+  {
+	std::vector<Real*> biases;
+	for (WeightedLayer* replica : replicas)
+	  biases.push_back(replica->_biases->Elements());
+	AverageElements(_biases->Elements(), biases, std::max(first, weightCount) - weightCount, last - weightCount);
+  }
+}
+
+void WeightedLayer::CopyParameters(const WeightedLayer& source, size_t first, size_t last)
+{
+  if (source._weights->Size() != _weights->Size() || source._biases->Size() != _biases->Size())
+	throw std::runtime_error("WeightedLayer::CopyParameters - The layers must have the same number of weights and biases.");
+  size_t weightCount = _weights->Size();
+  if (first < weightCount)
+	std::copy(source._weights->Elements() + first, source._weights->Elements() + std::min(last, weightCount), _weights->Elements() + first);
+  if (last > weightCount)
+  {
+	size_t firstBias = std::max(first, weightCount) - weightCount;
+	std::copy(source._biases->Elements() + firstBias, source._biases->Elements() + (last - weightCount),
+	  _biases->Elements() + firstBias);
+  }
+}
+
 FullyConnectedLayer::FullyConnectedLayer(TensorPtr&& weights, TensorPtr&& biases, std::unique_ptr<::ActivationFunction>&& activationFunction,
   double keepProbability, double prevLayerKeepProbability)
   : WeightedLayer(std::move(weights), std::move(biases), std::move(activationFunction), 1, 1, weights->Rows()),
@@ -96,6 +255,12 @@ FullyConnectedLayer::FullyConnectedLayer(uint32_t inputSize, uint32_t layerSize,
 {
 }
 
+std::unique_ptr<Layer> FullyConnectedLayer::Clone() const
+{
+  return std::make_unique<FullyConnectedLayer>(std::make_unique<Tensor>(*_weights), std::make_unique<Tensor>(*_biases),
+	_activationFunction ? _activationFunction->Clone() : nullptr, _keepProbability, _prevLayerKeepProbability);
+}
+
 void FullyConnectedLayer::InitializeWeights()
 {
   if (_weights == nullptr)
@@ -127,19 +292,19 @@ void FullyConnectedLayer::FeedForward(const Tensor& inputs, Tensor& outputs, con
   if (outputs.Size() != _weights->Rows())
 	throw std::runtime_error("FullyConnectedLayer::FeedForward - Output tensor is the wrong size.");
 #endif
-  const double* weight = _weights->Elements();
-  const double* bias = _biases->Elements();
-  const double* inputEnd = inputs.Elements() + inputs.Size();
-  const double* outputEnd = outputs.Elements() + outputs.Size();
   if (dropoutMask)
   {
+	const Real* weight = _weights->Elements();
+	const Real* bias = _biases->Elements();
+	const Real* inputEnd = inputs.Elements() + inputs.Size();
+	const Real* outputEnd = outputs.Elements() + outputs.Size();
 	const bool* keep = dropoutMask->Begin();
-	for (double* output = outputs.Elements(); output != outputEnd; ++output)
+	for (Real* output = outputs.Elements(); output != outputEnd; ++output)
 	{
 	  if (*keep)
 	  {
-		double activation = *bias;
-		for (const double* input = inputs.Elements(); input != inputEnd; ++input)
+		Real activation = *bias;
+		for (const Real* input = inputs.Elements(); input != inputEnd; ++input)
 		{
 		  activation += *input * *weight;
 		  ++weight;
@@ -157,17 +322,9 @@ void FullyConnectedLayer::FeedForward(const Tensor& inputs, Tensor& outputs, con
   }
   else
   {
-	for (double* output = outputs.Elements(); output != outputEnd; ++output)
-	{
-	  double activation = *bias;
-	  for (const double* input = inputs.Elements(); input != inputEnd; ++input)
-	  {
-		activation += *input * *weight;
-		++weight;
-	  }
-	  *output = activation;
-	  ++bias;
-	}
+	memcpy(outputs.Elements(), _biases->Elements(), sizeof(Real) * outputs.Size());
+	MultiplyMatrixByVector(false, _weights->Rows(), _weights->Columns(), _weights->Elements(), _weights->Columns(),
+	  inputs.Elements(), outputs.Elements());
   }
 }
 
@@ -210,18 +367,18 @@ void FullyConnectedLayer::BackpropagateError(const Tensor& errorInThisLayer, Ten
   if (errorInPreviousLayer.Size() != _weights->Columns())
 	throw std::runtime_error("FullyConnectedLayer::BackpropagateError - Size of errorInPreviousLayer does not match input size.");
 #endif
-  const double* prevLayerErrorEnd = errorInPreviousLayer.Elements() + errorInPreviousLayer.Size();
-  const double* thisLayerErrorEnd = errorInThisLayer.Elements() + errorInThisLayer.Size();
+  const Real* prevLayerErrorEnd = errorInPreviousLayer.Elements() + errorInPreviousLayer.Size();
+  const Real* thisLayerErrorEnd = errorInThisLayer.Elements() + errorInThisLayer.Size();
   if (dropoutMask)
   {
 	errorInPreviousLayer.SetAllToZero();
-	const double* weight = _weights->Elements();
+	const Real* weight = _weights->Elements();
 	const bool* keep = dropoutMask->Begin();
-	for (double* thisLayerError = errorInThisLayer.Elements(); thisLayerError != thisLayerErrorEnd; ++thisLayerError)
+	for (Real* thisLayerError = errorInThisLayer.Elements(); thisLayerError != thisLayerErrorEnd; ++thisLayerError)
 	{
 	  if (*keep)
 	  {
-		for (double* prevLayerError = errorInPreviousLayer.Elements(); prevLayerError != prevLayerErrorEnd; ++prevLayerError)
+		for (Real* prevLayerError = errorInPreviousLayer.Elements(); prevLayerError != prevLayerErrorEnd; ++prevLayerError)
 		{
 		  *prevLayerError += (*weight * *thisLayerError);
 		  ++weight;
@@ -236,19 +393,11 @@ void FullyConnectedLayer::BackpropagateError(const Tensor& errorInThisLayer, Ten
   }
   else
   {
-	const double* weightColumnStart = _weights->Elements();
-	for (double* prevLayerError = errorInPreviousLayer.Elements(); prevLayerError != prevLayerErrorEnd; ++prevLayerError)
-	{
-	  const double* weight = weightColumnStart;
-	  double error = 0.0;
-	  for (double* thisLayerError = errorInThisLayer.Elements(); thisLayerError != thisLayerErrorEnd; ++thisLayerError)
-	  {
-		error += (*weight * *thisLayerError);
-		weight += _weights->Columns();
-	  }
-	  *prevLayerError = error;
-	  ++weightColumnStart;
-	}
+	// Walking down the columns of the weights would miss the cache on every load for a wide layer, so the rows are
+	// scaled by the errors and added up instead.
+	errorInPreviousLayer.SetAllToZero();
+	MultiplyMatrixByVector(true, _weights->Rows(), _weights->Columns(), _weights->Elements(), _weights->Columns(),
+	  errorInThisLayer.Elements(), errorInPreviousLayer.Elements());
   }
 }
 
@@ -263,18 +412,18 @@ void FullyConnectedLayer::UpdateWeightAndBiasErrors(const Tensor& delta, const T
 #endif
   // Do a vector multiplication of delta by the transpose of previousLayerActivations
   // and store the result in nablaW.
-  double* result = nablaW.Elements();
-  double* e1 = delta.Elements();
+  Real* result = nablaW.Elements();
+  Real* e1 = delta.Elements();
   if (dropoutMask)
   {
-	double* nb = nablaB.Elements();
+	Real* nb = nablaB.Elements();
 	const bool* keep = dropoutMask->Begin();
 	for (size_t r = 0; r < delta.Size(); ++r)
 	{
 	  if (*keep)
 	  {
 		*nb += *e1;
-		double* e2 = previousLayerActivations.Elements();
+		Real* e2 = previousLayerActivations.Elements();
 		for (size_t c = 0; c < previousLayerActivations.Size(); ++c)
 		{
 		  *result += (*e1 * *e2);
@@ -294,24 +443,86 @@ void FullyConnectedLayer::UpdateWeightAndBiasErrors(const Tensor& delta, const T
   else
   {
     nablaB.ComponentWiseAdd(delta);
-	for (size_t r = 0; r < delta.Size(); ++r)
+	MultiplyMatrices(false, false, delta.Size(), previousLayerActivations.Size(), 1, delta.Elements(), 1,
+	  previousLayerActivations.Elements(), previousLayerActivations.Size(), result, previousLayerActivations.Size());
+  }
+}
+
+// The batch of inputs is multiplied by the transposed weights in one matrix product, so the weights are only read
+// from memory once per batch rather than once per example.
+void FullyConnectedLayer::FeedForwardBatch(const Tensor& inputs, Tensor& outputs, const DropoutMask* dropoutMask) const
+{
+#ifdef _DEBUG
+  if (inputs.HyperplaneSize() != _weights->Columns())
+	throw std::runtime_error("FullyConnectedLayer::FeedForwardBatch - Input tensor is the wrong size.");
+  if (outputs.HyperplaneSize() != _weights->Rows() || outputs.Hyperplanes() != inputs.Hyperplanes())
+	throw std::runtime_error("FullyConnectedLayer::FeedForwardBatch - Output tensor is the wrong size.");
+#endif
+  uint32_t batchSize = inputs.Hyperplanes();
+  uint32_t inputSize = inputs.HyperplaneSize();
+  uint32_t outputSize = outputs.HyperplaneSize();
+  for (uint32_t example = 0; example < batchSize; ++example)
+	memcpy(outputs.Elements() + (example * outputSize), _biases->Elements(), sizeof(Real) * outputSize);
+  MultiplyMatrices(false, true, batchSize, outputSize, inputSize, inputs.Elements(), inputSize, _weights->Elements(), inputSize,
+	outputs.Elements(), outputSize);
+  if (dropoutMask)
+  {
+	Real* output = outputs.Elements();
+	const bool* keep = dropoutMask->Begin();
+	for (size_t i = 0; i < outputs.Size(); ++i)
 	{
-	  double* e2 = previousLayerActivations.Elements();
-	  for (size_t c = 0; c < previousLayerActivations.Size(); ++c)
-	  {
-		*result += (*e1 * *e2);
-		++e2;
-		++result;
-	  }
-	  ++e1;
+	  if (!keep[i])
+		output[i] = 0.0;
 	}
   }
 }
 
+void FullyConnectedLayer::BackpropagateErrorBatch(const Tensor& errorInThisLayer, Tensor& errorInPreviousLayer,
+  const DropoutMask* dropoutMask) const
+{
+#ifdef _DEBUG
+  if (errorInThisLayer.HyperplaneSize() != _weights->Rows())
+	throw std::runtime_error("FullyConnectedLayer::BackpropagateErrorBatch - Size of errorInThisLayer does not match layer size.");
+  if (errorInPreviousLayer.HyperplaneSize() != _weights->Columns() ||
+	errorInPreviousLayer.Hyperplanes() != errorInThisLayer.Hyperplanes())
+	throw std::runtime_error("FullyConnectedLayer::BackpropagateErrorBatch - Size of errorInPreviousLayer does not match input size.");
+#endif
+  uint32_t batchSize = errorInThisLayer.Hyperplanes();
+  uint32_t inputSize = errorInPreviousLayer.HyperplaneSize();
+  uint32_t outputSize = errorInThisLayer.HyperplaneSize();
+  errorInPreviousLayer.SetAllToZero();
+  MultiplyMatrices(false, false, batchSize, inputSize, outputSize, KeptErrors(errorInThisLayer, dropoutMask), outputSize,
+	_weights->Elements(), inputSize, errorInPreviousLayer.Elements(), inputSize);
+}
+
+void FullyConnectedLayer::UpdateWeightAndBiasErrorsBatch(const Tensor& delta, const Tensor& previousLayerActivations,
+  Tensor& nablaW, Tensor& nablaB, const DropoutMask* dropoutMask)
+{
+#ifdef _DEBUG
+  if (nablaW.Size() != _weights->Rows() * _weights->Columns())
+	throw std::runtime_error("FullyConnectedLayer::UpdateWeightAndBiasErrorsBatch - Size of nablaW does not match the number of weights.");
+  if (nablaB.Size() != _weights->Rows())
+	throw std::runtime_error("FullyConnectedLayer::UpdateWeightAndBiasErrorsBatch - Size of nablaB does not match the number of biases.");
+#endif
+  uint32_t batchSize = delta.Hyperplanes();
+  uint32_t inputSize = previousLayerActivations.HyperplaneSize();
+  uint32_t outputSize = delta.HyperplaneSize();
+  const Real* keptDelta = KeptErrors(delta, dropoutMask);
+  Real* nb = nablaB.Elements();
+  for (uint32_t example = 0; example < batchSize; ++example)
+  {
+	const Real* exampleDelta = keptDelta + (example * outputSize);
+	for (uint32_t r = 0; r < outputSize; ++r)
+	  nb[r] += exampleDelta[r];
+  }
+  MultiplyMatrices(true, false, outputSize, inputSize, batchSize, keptDelta, outputSize, previousLayerActivations.Elements(),
+	inputSize, nablaW.Elements(), inputSize);
+}
+
 void FullyConnectedLayer::SwitchToTrainingWeights()
 {
   if (_trainingWeights)
-	memcpy(_weights->Elements(), _trainingWeights->Elements(), sizeof(double) * _weights->Size());
+	memcpy(_weights->Elements(), _trainingWeights->Elements(), sizeof(Real) * _weights->Size());
 }
 
 void FullyConnectedLayer::SwitchToTestingWeights()
@@ -319,15 +530,20 @@ void FullyConnectedLayer::SwitchToTestingWeights()
   if (_trainingWeights)
   {
 	// First save the training weights.
-	memcpy(_trainingWeights->Elements(), _weights->Elements(), sizeof(double) * _weights->Size());
+	memcpy(_trainingWeights->Elements(), _weights->Elements(), sizeof(Real) * _weights->Size());
 	// Now scale all the weights to compensate for the absence dropout.
-	const double* end = _weights->Elements() + _weights->Size();
-	double scale = static_cast<double>(_prevLayerKeepProbability);
-	for (double* w = _weights->Elements(); w < end; ++w)
+	const Real* end = _weights->Elements() + _weights->Size();
+	Real scale = static_cast<Real>(_prevLayerKeepProbability);
+	for (Real* w = _weights->Elements(); w < end; ++w)
 	  *w *= scale;
   }
 }
 
+void Layer::FeedForwardChannelBlocked(const Tensor&, Tensor&) const
+{
+  throw std::runtime_error("This layer does not support the channel blocked layout.");
+}
+
 MaxPoolingLayer::MaxPoolingLayer(uint32_t inputChannelCount, uint32_t inputRows, uint32_t inputColumns)
   : Layer(inputChannelCount, inputRows / 2, inputColumns / 2),
 	_inputChannelCount(inputChannelCount), _inputRows(inputRows), _inputColumns(inputColumns)
@@ -336,6 +552,11 @@ MaxPoolingLayer::MaxPoolingLayer(uint32_t inputChannelCount, uint32_t inputRows,
 	throw std::runtime_error("Input dimensions to MaxPoolingLayer must be divisible by 2.");
 }
 
+std::unique_ptr<Layer> MaxPoolingLayer::Clone() const
+{
+  return std::make_unique<MaxPoolingLayer>(_inputChannelCount, _inputRows, _inputColumns);
+}
+
 void MaxPoolingLayer::Description(std::ostream& os) const
 {
   os << "Max pooling 2 by 2, input dimensions: " << _inputChannelCount << 'x' << _inputColumns << 'x' << _inputRows;
@@ -357,16 +578,16 @@ void MaxPoolingLayer::FeedForward(const Tensor& inputs, Tensor& outputs, const D
   if (outputs.Columns() != _outputColumns)
 	throw std::runtime_error("MaxPoolingLayer::FeedForward - output tensor has the wrong number of columns.");
 #endif
-  const double* row1 = inputs.Elements();
-  const double* row2 = row1 + _inputColumns;
-  const double* outputEnd = outputs.Elements() + outputs.Size();
-  double* output = outputs.Elements();
+  const Real* row1 = inputs.Elements();
+  const Real* row2 = row1 + _inputColumns;
+  const Real* outputEnd = outputs.Elements() + outputs.Size();
+  Real* output = outputs.Elements();
   while (output < outputEnd)
   {
-	const double* outputRowEnd = output + _outputColumns;
+	const Real* outputRowEnd = output + _outputColumns;
 	while (output < outputRowEnd)
 	{
-	  double out = *row1;
+	  Real out = *row1;
 	  ++row1;
 	  if (*row1 > out)
 		out = *row1;
@@ -385,6 +606,50 @@ void MaxPoolingLayer::FeedForward(const Tensor& inputs, Tensor& outputs, const D
   }
 }
 
+void MaxPoolingLayer::FeedForwardChannelBlocked(const Tensor& inputs, Tensor& outputs) const
+{
+#ifdef _DEBUG
+  if (inputs.Hyperplanes() != Tensor::ChannelBlocks(_inputChannelCount) || inputs.Planes() != _inputRows ||
+	inputs.Rows() != _inputColumns || inputs.Columns() != Tensor::ChannelBlockSize)
+	throw std::runtime_error("MaxPoolingLayer::FeedForwardChannelBlocked - input tensor has the wrong dimensions.");
+  if (outputs.Hyperplanes() != Tensor::ChannelBlocks(_inputChannelCount) || outputs.Planes() != _outputRows ||
+	outputs.Rows() != _outputColumns || outputs.Columns() != Tensor::ChannelBlockSize)
+	throw std::runtime_error("MaxPoolingLayer::FeedForwardChannelBlocked - output tensor has the wrong dimensions.");
+#endif
+  // The same as FeedForward, except that each step compares a whole block of channels.
+  const uint32_t blockSize = Tensor::ChannelBlockSize;
+  uint32_t inputRowSize = _inputColumns * blockSize;
+  const Real* row1 = inputs.Elements();
+  const Real* row2 = row1 + inputRowSize;
+  const Real* outputEnd = outputs.Elements() + outputs.Size();
+  Real* output = outputs.Elements();
+  while (output < outputEnd)
+  {
+	const Real* outputRowEnd = output + (_outputColumns * blockSize);
+	while (output < outputRowEnd)
+	{
+	  for (uint32_t k = 0; k < blockSize; ++k)
+		output[k] = std::max(std::max(row1[k], row1[blockSize + k]), std::max(row2[k], row2[blockSize + k]));
+	  row1 += 2 * blockSize;
+	  row2 += 2 * blockSize;
+	  output += blockSize;
+	}
+	row1 += inputRowSize;
+	row2 += inputRowSize;
+  }
+}
+
+void MaxPoolingLayer::BackpropagateErrorBatch(const Tensor& thisLayerActivations, const Tensor& previousLayerActivations,
+  const Tensor& errorInThisLayer, Tensor& errorInPreviousLayer) const
+{
+  for (uint32_t example = 0; example < errorInThisLayer.Hyperplanes(); ++example)
+  {
+	Tensor errorInPreviousLayerExample = errorInPreviousLayer.HyperplaneView(example);
+	BackpropagateError(thisLayerActivations.HyperplaneView(example), previousLayerActivations.HyperplaneView(example),
+	  errorInThisLayer.HyperplaneView(example), errorInPreviousLayerExample);
+  }
+}
+
 void MaxPoolingLayer::Save(std::ofstream& os) const
 {
   os.put((char)Types::MaxPooling);
@@ -425,19 +690,19 @@ void MaxPoolingLayer::BackpropagateError(const Tensor& thisLayerActivations, con
   if (errorInThisLayer.Columns() != _outputColumns)
 	throw std::runtime_error("MaxPoolingLayer::BackpropagateError - error in this layer tensor has the wrong number of columns.");
 #endif
-  const double* prevLayerActivationRow1 = previousLayerActivations.Elements();
-  const double* prevLayerActivationRow2 = prevLayerActivationRow1 + _inputColumns;
-  double* prevLayerErrorRow1 = errorInPreviousLayer.Elements();
-  double* prevLayerErrorRow2 = prevLayerErrorRow1 + _inputColumns;
-  const double* thisLayerError = errorInThisLayer.Elements();
-  const double* thisLayerActivationEnd = thisLayerActivations.Elements() + thisLayerActivations.Size();
-  const double* thisLayerActivation = thisLayerActivations.Elements();
+  const Real* prevLayerActivationRow1 = previousLayerActivations.Elements();
+  const Real* prevLayerActivationRow2 = prevLayerActivationRow1 + _inputColumns;
+  Real* prevLayerErrorRow1 = errorInPreviousLayer.Elements();
+  Real* prevLayerErrorRow2 = prevLayerErrorRow1 + _inputColumns;
+  const Real* thisLayerError = errorInThisLayer.Elements();
+  const Real* thisLayerActivationEnd = thisLayerActivations.Elements() + thisLayerActivations.Size();
+  const Real* thisLayerActivation = thisLayerActivations.Elements();
   while (thisLayerActivation < thisLayerActivationEnd)
   {
-	const double* thisLayerActivationRowEnd = thisLayerActivation + _outputColumns;
+	const Real* thisLayerActivationRowEnd = thisLayerActivation + _outputColumns;
 	while (thisLayerActivation < thisLayerActivationRowEnd)
 	{
-	  double activation = *thisLayerActivation;
+	  Real activation = *thisLayerActivation;
 	  // Set even row errors.
 	  *prevLayerErrorRow1 = (*prevLayerActivationRow1 == activation ? *thisLayerError : 0.0);
 	  ++prevLayerActivationRow1;
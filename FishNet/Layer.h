@@ -12,6 +12,8 @@ public:
 
   virtual ~Layer() {}
   virtual void InitializeWeights() {}
+  // A copy of the layer with its own copy of the weights, which can be trained apart from this one.
+  virtual std::unique_ptr<Layer> Clone() const = 0;
   uint32_t OutputPlanes() const { return _outputPlanes; }
   uint32_t OutputRows() const { return _outputRows; }
   uint32_t OutputColumns() const { return _outputColumns; }
@@ -20,8 +22,17 @@ public:
   virtual void Save(std::ofstream&) const = 0;
   virtual void SaveArchitecture(std::ostream&) const = 0;
   static std::unique_ptr<Layer> Load(std::ifstream&, uint32_t inputChannelCount, uint32_t inputRows, uint32_t inputColumns,
-	double prevLayerKeepProbability);
+	double prevLayerKeepProbability, uint32_t elementSize);
   virtual void FeedForward(const Tensor& inputs, Tensor& outputs, const DropoutMask*) const = 0;
+  // The batch versions of FeedForward, BackpropagateError and UpdateWeightAndBiasErrors take a batch of examples stacked
+  // as the hyperplanes of each tensor, and a DropoutMask that covers every example in turn. By default they run the
+  // single example versions on each example, without dropout. Layers which use dropout, or which can reuse each weight
+  // they load across the whole batch, override them.
+  virtual void FeedForwardBatch(const Tensor& inputs, Tensor& outputs, const DropoutMask*) const;
+  // Layers which can take and produce activations in the channel blocked layout (see Tensor::ToChannelBlocked) override
+  // these, so that a stack of them can pass activations from one to the next without converting them back to planes.
+  virtual bool SupportsChannelBlocked() const { return false; }
+  virtual void FeedForwardChannelBlocked(const Tensor& inputs, Tensor& outputs) const;
   virtual void SwitchToTrainingWeights() {}
   virtual void SwitchToTestingWeights() {}
 protected:
@@ -38,8 +49,26 @@ public:
   virtual void BackpropagateError(const Tensor& errorInThisLayer, Tensor& errorInPreviousLayer, const DropoutMask*) const = 0;
   virtual void UpdateWeightAndBiasErrors(const Tensor& delta, const Tensor& previousLayerActivations,
 	Tensor& nablaW, Tensor& nablaB, const DropoutMask*) = 0;
+  virtual void BackpropagateErrorBatch(const Tensor& errorInThisLayer, Tensor& errorInPreviousLayer, const DropoutMask*) const;
+  virtual void UpdateWeightAndBiasErrorsBatch(const Tensor& delta, const Tensor& previousLayerActivations,
+	Tensor& nablaW, Tensor& nablaB, const DropoutMask*);
   void UpdateWeightsAndBiases(const Tensor& nablaW, const Tensor& nablaB, double scalar);
   void DecayWeights(double factor);
+  // The weights followed by the biases.
+  size_t ParameterCount() const { return _weights->Size() + _biases->Size(); }
+  // Decays the weights and subtracts the sum of several trainers' errors, for the parameters from first up to last,
+  // counting them as ParameterCount does. The biases aren't decayed. This lets several threads each update their own
+  // share of the layer at once.
+  void UpdateParameters(const std::vector<const Tensor*>& nablaW, const std::vector<const Tensor*>& nablaB,
+	double scalar, double decayFactor, size_t first, size_t last);
+  // Sets the parameters from first up to last to the mean of the replicas' parameters, and then copies them back into
+  // the replicas, so that this layer and every replica hold the same parameters.
+  void AverageParameters(const std::vector<WeightedLayer*>& replicas, size_t first, size_t last);
+  // Copies the parameters from first up to last from a layer with weights and biases of the same size.
+  void CopyParameters(const WeightedLayer& source, size_t first, size_t last);
+  // Called once the weights have been changed, so that layers which keep data derived from their weights
+  // can rebuild it before the next feed forward.
+  virtual void RefreshWeightCache() {}
   void ApplyActivationFunction(Tensor& activations) const
   {
 	if (_activationFunction)
@@ -72,6 +101,7 @@ public:
 	double keepProbability = 1.0, double prevLayerKeepProbability = 1.0);
   ~FullyConnectedLayer() {}
   virtual void InitializeWeights() override;
+  virtual std::unique_ptr<Layer> Clone() const override;
   virtual void Description(std::ostream&) const override;
   virtual double KeepProbability() const override { return _keepProbability; }
   virtual void Save(std::ofstream&) const override;
@@ -80,6 +110,10 @@ public:
   virtual void BackpropagateError(const Tensor& errorInThisLayer, Tensor& errorInPreviousLayer, const DropoutMask*) const override;
   virtual void UpdateWeightAndBiasErrors(const Tensor& delta, const Tensor& previousLayerActivations,
 	Tensor& nablaW, Tensor& nablaB, const DropoutMask*) override;
+  virtual void FeedForwardBatch(const Tensor& inputs, Tensor& outputs, const DropoutMask*) const override;
+  virtual void BackpropagateErrorBatch(const Tensor& errorInThisLayer, Tensor& errorInPreviousLayer, const DropoutMask*) const override;
+  virtual void UpdateWeightAndBiasErrorsBatch(const Tensor& delta, const Tensor& previousLayerActivations,
+	Tensor& nablaW, Tensor& nablaB, const DropoutMask*) override;
   virtual void SwitchToTrainingWeights() override;
   virtual void SwitchToTestingWeights() override;
 private:
@@ -97,12 +131,17 @@ class MaxPoolingLayer : public Layer
 {
 public:
   MaxPoolingLayer(uint32_t inputChannelCount, uint32_t inputRows, uint32_t inputColumns);
+  virtual std::unique_ptr<Layer> Clone() const override;
   virtual void Description(std::ostream&) const override;
   virtual void Save(std::ofstream&) const override;
   virtual void SaveArchitecture(std::ostream&) const override;
   virtual void FeedForward(const Tensor& inputs, Tensor& outputs, const DropoutMask*) const override;
+  virtual bool SupportsChannelBlocked() const override { return true; }
+  virtual void FeedForwardChannelBlocked(const Tensor& inputs, Tensor& outputs) const override;
   void BackpropagateError(const Tensor& thisLayerActivations, const Tensor& previousLayerActivations,
 	const Tensor& errorInThisLayer, Tensor& errorInPreviousLayer) const;
+  void BackpropagateErrorBatch(const Tensor& thisLayerActivations, const Tensor& previousLayerActivations,
+	const Tensor& errorInThisLayer, Tensor& errorInPreviousLayer) const;
 private:
   uint32_t _inputChannelCount;
   uint32_t _inputRows;
@@ -0,0 +1,403 @@
+#include "stdafx.h"
+#include "QuantizedNetwork.h"
+#include "ConvolutionalLayer.h"
+#include "FeedForwardNetwork.h"
+#include "ImageSet.h"
+#include "ThreadPool.h"
+
+namespace
+{
+
+const int32_t maxActivation = 127;
+const int32_t maxWeight = 127;
+// Every row of weights and every patch of inputs is padded out with zeros to a multiple of this, so the kernels never
+// have a partial vector to deal with.
+const uint32_t inputAlignment = 64;
+
+// The kernels calculate the sums of the products of the unsigned activations in a and the signed weights in each of
+// rows rows of w, which are length apart. length is a multiple of inputAlignment. Each activation vector that is
+// loaded is used for all the rows.
+#if defined(__AVX512VNNI__)
+
+template <uint32_t rows>
+inline void DotProducts(const uint8_t* a, const int8_t* w, uint32_t length, int32_t* sums)
+{
+  __m512i acc[rows];
+  for (uint32_t r = 0; r < rows; ++r)
+	acc[r] = _mm512_setzero_si512();
+  for (uint32_t i = 0; i < length; i += 64)
+  {
+	__m512i activations = _mm512_loadu_si512(a + i);
+	for (uint32_t r = 0; r < rows; ++r)
+	  acc[r] = _mm512_dpbusd_epi32(acc[r], activations, _mm512_loadu_si512(w + (r * length) + i));
+  }
+  for (uint32_t r = 0; r < rows; ++r)
+	sums[r] = _mm512_reduce_add_epi32(acc[r]);
+}
+
+#elif defined(__AVX2__)
+
+inline int32_t Sum(__m256i v)
+{
+  __m128i sum = _mm_add_epi32(_mm256_castsi256_si128(v), _mm256_extracti128_si256(v, 1));
+  sum = _mm_add_epi32(sum, _mm_shuffle_epi32(sum, _MM_SHUFFLE(1, 0, 3, 2)));
+  sum = _mm_add_epi32(sum, _mm_shuffle_epi32(sum, _MM_SHUFFLE(2, 3, 0, 1)));
+  return _mm_cvtsi128_si32(sum);
+}
+
+template <uint32_t rows>
+inline void DotProducts(const uint8_t* a, const int8_t* w, uint32_t length, int32_t* sums)
+{
+#ifndef __AVXVNNI__
+  // maddubs adds pairs of products into 16 bits, which is why the activations only go up to 127.
+  const __m256i ones = _mm256_set1_epi16(1);
+#endif
+  __m256i acc[rows];
+  for (uint32_t r = 0; r < rows; ++r)
+	acc[r] = _mm256_setzero_si256();
+  for (uint32_t i = 0; i < length; i += 32)
+  {
+	__m256i activations = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(a + i));
+	for (uint32_t r = 0; r < rows; ++r)
+	{
+	  __m256i weights = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(w + (r * length) + i));
+#ifdef __AVXVNNI__
+	  acc[r] = _mm256_dpbusd_avx_epi32(acc[r], activations, weights);
+#else
+	  acc[r] = _mm256_add_epi32(acc[r], _mm256_madd_epi16(_mm256_maddubs_epi16(activations, weights), ones));
+#endif
+	}
+  }
+  for (uint32_t r = 0; r < rows; ++r)
+	sums[r] = Sum(acc[r]);
+}
+
+#elif defined(__SSE2__) || defined(_M_X64)
+
+inline int32_t Sum(__m128i v)
+{
+  v = _mm_add_epi32(v, _mm_shuffle_epi32(v, _MM_SHUFFLE(1, 0, 3, 2)));
+  v = _mm_add_epi32(v, _mm_shuffle_epi32(v, _MM_SHUFFLE(2, 3, 0, 1)));
+  return _mm_cvtsi128_si32(v);
+}
+
+// SSE2 has no byte multiplies, so both operands are widened to 16 bits. The weights are sign extended by putting them
+// in the high byte of each 16 bit lane and shifting them back down.
+template <uint32_t rows>
+inline void DotProducts(const uint8_t* a, const int8_t* w, uint32_t length, int32_t* sums)
+{
+  const __m128i zero = _mm_setzero_si128();
+  __m128i acc[rows];
+  for (uint32_t r = 0; r < rows; ++r)
+	acc[r] = _mm_setzero_si128();
+  for (uint32_t i = 0; i < length; i += 16)
+  {
+	__m128i activations = _mm_loadu_si128(reinterpret_cast<const __m128i*>(a + i));
+	__m128i low = _mm_unpacklo_epi8(activations, zero);
+	__m128i high = _mm_unpackhi_epi8(activations, zero);
+	for (uint32_t r = 0; r < rows; ++r)
+	{
+	  __m128i weights = _mm_loadu_si128(reinterpret_cast<const __m128i*>(w + (r * length) + i));
+	  __m128i lowWeights = _mm_srai_epi16(_mm_unpacklo_epi8(zero, weights), 8);
+	  __m128i highWeights = _mm_srai_epi16(_mm_unpackhi_epi8(zero, weights), 8);
+	  acc[r] = _mm_add_epi32(acc[r], _mm_add_epi32(_mm_madd_epi16(low, lowWeights), _mm_madd_epi16(high, highWeights)));
+	}
+  }
+  for (uint32_t r = 0; r < rows; ++r)
+	sums[r] = Sum(acc[r]);
+}
+
+#else
+
+template <uint32_t rows>
+inline void DotProducts(const uint8_t* a, const int8_t* w, uint32_t length, int32_t* sums)
+{
+  for (uint32_t r = 0; r < rows; ++r)
+  {
+	const int8_t* weights = w + (r * length);
+	int32_t sum = 0;
+	for (uint32_t i = 0; i < length; ++i)
+	  sum += static_cast<int32_t>(a[i]) * weights[i];
+	sums[r] = sum;
+  }
+}
+
+#endif
+
+inline uint32_t PaddedLength(uint32_t length)
+{
+  return (length + inputAlignment - 1) / inputAlignment * inputAlignment;
+}
+
+}
+
+struct QuantizedNetwork::QuantizedLayer
+{
+  const Layer& layer;
+  // Null for a max pooling layer, which runs at full precision since it only picks values out.
+  const WeightedLayer* weighted;
+  const ConvolutionalLayer* convolutional;
+  uint32_t outputChannels;
+  uint32_t inputSize;
+  uint32_t paddedInputSize;
+  // One padded row of weights for each filter or neuron.
+  std::vector<int8_t> weights;
+  // The scale of the inputs times the scale of each row of weights, which converts the integer sums back to Real.
+  std::vector<Real> outputScales;
+  // The zero point of the inputs times the sum of each row of weights, which is taken off the integer sums.
+  std::vector<int32_t> offsets;
+  std::vector<Real> biases;
+  Real inputScale;
+  int32_t zeroPoint;
+
+  QuantizedLayer(const Layer& l)
+	: layer(l), weighted(dynamic_cast<const WeightedLayer*>(&l)), convolutional(dynamic_cast<const ConvolutionalLayer*>(&l)),
+	  outputChannels(0), inputSize(0), paddedInputSize(0), inputScale(1.0), zeroPoint(0) {}
+
+  void QuantizeInputs(const Tensor& input, uint8_t* quantized) const;
+  void ExpandInputPatches(const uint8_t* input, uint8_t* patches) const;
+  void Multiply(const uint8_t* inputs, uint32_t inputCount, Real* outputs) const;
+};
+
+struct QuantizedNetwork::Workspace
+{
+  std::vector<Tensor> activations;
+  std::unique_ptr<uint8_t[]> quantizedInputs;
+  std::unique_ptr<uint8_t[]> patches;
+
+  Workspace(const std::vector<std::unique_ptr<QuantizedLayer>>& layers)
+  {
+	size_t inputSize = 0;
+	size_t patchesSize = 0;
+	for (const auto& ql : layers)
+	{
+	  activations.emplace_back(ql->layer.OutputPlanes(), ql->layer.OutputRows(), ql->layer.OutputColumns());
+	  if (ql->convolutional)
+	  {
+		const ConvolutionalLayer& cl = *ql->convolutional;
+		inputSize = std::max<size_t>(inputSize, cl.InputChannelCount() * cl.InputRows() * cl.InputColumns());
+		patchesSize = std::max<size_t>(patchesSize, ql->layer.OutputRows() * ql->layer.OutputColumns() * ql->paddedInputSize);
+	  }
+	  else if (ql->weighted)
+	  {
+		patchesSize = std::max<size_t>(patchesSize, ql->paddedInputSize);
+	  }
+	}
+	// Both start out zeroed, which covers the padding at the end of each patch. The padding can be left with values
+	// from a layer with wider patches, but the padding weights are zero so it doesn't matter.
+	quantizedInputs = std::make_unique<uint8_t[]>(inputSize);
+	patches = std::make_unique<uint8_t[]>(patchesSize);
+  }
+};
+
+void QuantizedNetwork::QuantizedLayer::QuantizeInputs(const Tensor& input, uint8_t* quantized) const
+{
+  Real inverseScale = Real(1.0) / inputScale;
+  Real offset = zeroPoint + Real(0.5);
+  const Real* in = input.Elements();
+  for (uint32_t i = 0; i < input.Size(); ++i)
+  {
+	Real q = in[i] * inverseScale + offset;
+	quantized[i] = static_cast<uint8_t>(q <= 0 ? 0 : std::min<int32_t>(static_cast<int32_t>(q), maxActivation));
+  }
+}
+
+// Lays the quantized input out as one row for each output position, holding the inputs that the filters cover in the
+// same order as their weights. Positions in the zero padding get the zero point.
+void QuantizedNetwork::QuantizedLayer::ExpandInputPatches(const uint8_t* input, uint8_t* patches) const
+{
+  const ConvolutionalLayer& cl = *convolutional;
+  uint32_t filterSize = cl.FilterSize();
+  int32_t inputRows = cl.InputRows();
+  int32_t inputColumns = cl.InputColumns();
+  size_t inputPlaneSize = size_t(inputRows) * inputColumns;
+  for (uint32_t outputRow = 0; outputRow < layer.OutputRows(); ++outputRow)
+  {
+	for (uint32_t outputColumn = 0; outputColumn < layer.OutputColumns(); ++outputColumn)
+	{
+	  uint8_t* patch = patches;
+	  int32_t firstRow = static_cast<int32_t>(outputRow * cl.Stride()) - static_cast<int32_t>(cl.ZeroPadding());
+	  int32_t firstColumn = static_cast<int32_t>(outputColumn * cl.Stride()) - static_cast<int32_t>(cl.ZeroPadding());
+	  for (uint32_t channel = 0; channel < cl.InputChannelCount(); ++channel)
+	  {
+		const uint8_t* plane = input + (channel * inputPlaneSize);
+		for (int32_t row = firstRow; row < firstRow + static_cast<int32_t>(filterSize); ++row)
+		{
+		  for (int32_t column = firstColumn; column < firstColumn + static_cast<int32_t>(filterSize); ++column)
+		  {
+			bool inside = row >= 0 && row < inputRows && column >= 0 && column < inputColumns;
+			*patch++ = inside ? plane[(row * inputColumns) + column] : static_cast<uint8_t>(zeroPoint);
+		  }
+		}
+	  }
+	  patches += paddedInputSize;
+	}
+  }
+}
+
+// inputs holds inputCount padded rows, which are the patches of a convolutional layer or the single input of a fully
+// connected one, and the outputs are written in planes, one for each filter or neuron.
+void QuantizedNetwork::QuantizedLayer::Multiply(const uint8_t* inputs, uint32_t inputCount, Real* outputs) const
+{
+  const uint32_t rowBlock = 4;
+  int32_t sums[rowBlock];
+  for (uint32_t i = 0; i < inputCount; ++i)
+  {
+	const uint8_t* input = inputs + (size_t(i) * paddedInputSize);
+	uint32_t channel = 0;
+	for (; channel < outputChannels; channel += rowBlock)
+	{
+	  const int8_t* w = weights.data() + (size_t(channel) * paddedInputSize);
+	  uint32_t rows = std::min(rowBlock, outputChannels - channel);
+	  if (rows == rowBlock)
+	  {
+		DotProducts<rowBlock>(input, w, paddedInputSize, sums);
+	  }
+	  else
+	  {
+		for (uint32_t r = 0; r < rows; ++r)
+		  DotProducts<1>(input, w + (r * paddedInputSize), paddedInputSize, sums + r);
+	  }
+	  for (uint32_t r = 0; r < rows; ++r)
+	  {
+		uint32_t c = channel + r;
+		outputs[(size_t(c) * inputCount) + i] = (sums[r] - offsets[c]) * outputScales[c] + biases[c];
+	  }
+	}
+  }
+}
+
+QuantizedNetwork::QuantizedNetwork(FeedForwardNetwork& network, const std::vector<Image*>& calibrationImages)
+  : _threadCount(network.ThreadCount())
+{
+  if (calibrationImages.empty())
+	throw std::runtime_error("QuantizedNetwork needs at least one image to calibrate the activation ranges.");
+  const auto& layers = network.Layers();
+  // Quantize the weights that are used for testing, which make up for the neurons that dropout left out in training.
+  for (auto& layer : layers)
+	layer->SwitchToTestingWeights();
+
+  // Run the full precision network on the calibration images to find the range of each layer's inputs. The ranges
+  // always include 0, so that it is represented exactly.
+  std::vector<Real> lowest(layers.size(), Real(0));
+  std::vector<Real> highest(layers.size(), Real(0));
+  std::vector<Tensor> activations;
+  for (const auto& layer : layers)
+	activations.emplace_back(layer->OutputPlanes(), layer->OutputRows(), layer->OutputColumns());
+  for (const Image* image : calibrationImages)
+  {
+	const Tensor* layerInput = &image->Inputs();
+	for (size_t li = 0; li < layers.size(); ++li)
+	{
+	  const Real* end = layerInput->Elements() + layerInput->Size();
+	  for (const Real* v = layerInput->Elements(); v < end; ++v)
+	  {
+		lowest[li] = std::min(lowest[li], *v);
+		highest[li] = std::max(highest[li], *v);
+	  }
+	  layers[li]->FeedForward(*layerInput, activations[li], nullptr);
+	  auto wl = dynamic_cast<const WeightedLayer*>(layers[li].get());
+	  if (wl)
+		wl->ApplyActivationFunction(activations[li]);
+	  layerInput = &activations[li];
+	}
+  }
+
+  for (size_t li = 0; li < layers.size(); ++li)
+  {
+	auto ql = std::make_unique<QuantizedLayer>(*layers[li]);
+	if (ql->weighted)
+	{
+	  const Tensor& weights = ql->weighted->Weights();
+	  ql->inputSize = ql->convolutional ? weights.HyperplaneSize() : weights.Columns();
+	  ql->outputChannels = weights.Size() / ql->inputSize;
+	  ql->paddedInputSize = PaddedLength(ql->inputSize);
+	  Real range = highest[li] - lowest[li];
+	  ql->inputScale = range > 0 ? range / maxActivation : Real(1);
+	  ql->zeroPoint = static_cast<int32_t>(std::lround(-lowest[li] / ql->inputScale));
+	  ql->weights.resize(size_t(ql->outputChannels) * ql->paddedInputSize, 0);
+	  for (uint32_t channel = 0; channel < ql->outputChannels; ++channel)
+	  {
+		// Each filter or neuron gets its own scale, so a row of small weights doesn't lose its precision to a row of
+		// large ones.
+		const Real* w = weights.Elements() + (size_t(channel) * ql->inputSize);
+		Real largest = 0;
+		for (uint32_t i = 0; i < ql->inputSize; ++i)
+		  largest = std::max(largest, std::abs(w[i]));
+		Real weightScale = largest > 0 ? largest / maxWeight : Real(1);
+		int8_t* q = ql->weights.data() + (size_t(channel) * ql->paddedInputSize);
+		int32_t sum = 0;
+		for (uint32_t i = 0; i < ql->inputSize; ++i)
+		{
+		  q[i] = static_cast<int8_t>(std::lround(w[i] / weightScale));
+		  sum += q[i];
+		}
+		ql->outputScales.push_back(ql->inputScale * weightScale);
+		ql->offsets.push_back(ql->zeroPoint * sum);
+		ql->biases.push_back(ql->weighted->Biases().Get(channel));
+	  }
+	}
+	_layers.emplace_back(std::move(ql));
+  }
+
+  for (auto& layer : layers)
+	layer->SwitchToTrainingWeights();
+}
+
+QuantizedNetwork::~QuantizedNetwork()
+{
+}
+
+void QuantizedNetwork::FeedForward(const Tensor& input, Workspace& workspace) const
+{
+  const Tensor* layerInput = &input;
+  for (size_t li = 0; li < _layers.size(); ++li)
+  {
+	const QuantizedLayer& ql = *_layers[li];
+	Tensor& outputs = workspace.activations[li];
+	if (ql.convolutional)
+	{
+	  ql.QuantizeInputs(*layerInput, workspace.quantizedInputs.get());
+	  ql.ExpandInputPatches(workspace.quantizedInputs.get(), workspace.patches.get());
+	  ql.Multiply(workspace.patches.get(), outputs.PlaneSize(), outputs.Elements());
+	}
+	else if (ql.weighted)
+	{
+	  ql.QuantizeInputs(*layerInput, workspace.patches.get());
+	  ql.Multiply(workspace.patches.get(), 1, outputs.Elements());
+	}
+	else
+	{
+	  ql.layer.FeedForward(*layerInput, outputs, nullptr);
+	}
+	if (ql.weighted)
+	  ql.weighted->ApplyActivationFunction(outputs);
+	layerInput = &outputs;
+  }
+}
+
+Tensor QuantizedNetwork::FeedForward(const Tensor& input) const
+{
+  Workspace workspace(_layers);
+  FeedForward(input, workspace);
+  return workspace.activations.back();
+}
+
+std::vector<uint32_t> QuantizedNetwork::Classify(const ImageSet& imageSet) const
+{
+  const std::vector<Image*>& testSet = imageSet.TestSet();
+  std::vector<uint32_t> results(testSet.size());
+  // Split the test set between the threads.
+  uint32_t threadCount = static_cast<uint32_t>(std::max<size_t>(1, std::min<size_t>(_threadCount, testSet.size())));
+  ThreadPool::Shared(threadCount).Run(threadCount, [this, &testSet, &results, threadCount](uint32_t t)
+  {
+	Workspace workspace(_layers);
+	size_t end = (testSet.size() * (t + 1)) / threadCount;
+	for (size_t i = (testSet.size() * t) / threadCount; i < end; ++i)
+	{
+	  FeedForward(testSet[i]->Inputs(), workspace);
+	  results[i] = workspace.activations.back().HighestValueIndex();
+	}
+  });
+  return results;
+}
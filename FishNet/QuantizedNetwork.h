@@ -0,0 +1,33 @@
+#pragma once
+
+#include "Tensor.h"
+
+class FeedForwardNetwork;
+class Image;
+class ImageSet;
+class Layer;
+
+// An inference only copy of a trained network with 8 bit weights and activations. The weights of each filter or
+// neuron are scaled to fit in an int8, and the inputs to each weighted layer are mapped onto 0 to 127 using the range
+// that the layer's inputs covered when the full precision network was run on a sample of training images. The
+// products are added up as integers and only converted back to Real to add the biases and apply the activation
+// function. The activations are kept to 7 bits so that the AVX2 kernel can add pairs of products in 16 bits without
+// them saturating, and every instruction set then gives the same results. The activation functions and max pooling
+// layers of the network are used as they are, so the network must outlive its quantized copy.
+class QuantizedNetwork
+{
+public:
+  QuantizedNetwork(FeedForwardNetwork&, const std::vector<Image*>& calibrationImages);
+  ~QuantizedNetwork();
+  std::vector<uint32_t> Classify(const ImageSet&) const;
+  // Runs one input through the network and returns the output layer's activations.
+  Tensor FeedForward(const Tensor& input) const;
+private:
+  struct QuantizedLayer;
+  struct Workspace;
+
+  void FeedForward(const Tensor& input, Workspace&) const;
+
+  std::vector<std::unique_ptr<QuantizedLayer>> _layers;
+  uint32_t _threadCount;
+};
@@ -2,7 +2,8 @@
 #include "Tensor.h"
 
 Tensor::Tensor(const std::initializer_list<double>& elements, uint32_t hyperplanes, uint32_t planes, uint32_t rows, uint32_t columns)
-  : _elements(std::make_unique<double[]>(elements.size())),
+  : _storage(std::make_unique<Real[]>(elements.size())),
+	_elements(_storage.get()),
 	_hyperplanes(hyperplanes), _planes(planes), _rows(rows), _columns(columns),
 	_planeSize(rows * columns),
 	_hyperplaneSize(_planeSize * planes),
@@ -10,17 +11,18 @@ Tensor::Tensor(const std::initializer_list<double>& elements, uint32_t hyperplan
 {
   if (elements.size() != _size)
 	throw std::runtime_error("Size of initializer list does not match dimensions of Tensor.");
-  memcpy(_elements.get(), elements.begin(), elements.size() * sizeof(double));
+  std::copy(elements.begin(), elements.end(), _elements);
 }
 
 Tensor::Tensor(const Tensor& that)
-  : _elements(std::make_unique<double[]>(that._size)),
+  : _storage(std::make_unique<Real[]>(that._size)),
+	_elements(_storage.get()),
 	_hyperplanes(that._hyperplanes), _planes(that._planes), _rows(that._rows), _columns(that._columns),
 	_planeSize(that._planeSize),
 	_hyperplaneSize(that._hyperplaneSize),
 	_size(that._size)
 {
-  memcpy(_elements.get(), that._elements.get(), sizeof(double) * _size);
+  memcpy(_elements, that._elements, sizeof(Real) * _size);
 }
 
 Tensor& Tensor::operator=(const Tensor& that)
@@ -34,9 +36,10 @@ Tensor& Tensor::operator=(const Tensor& that)
   if (_size != that._size)
   {
 	_size = that._size;
-	_elements.reset(new double[_size]);
+	_storage.reset(new Real[_size]);
+	_elements = _storage.get();
   }
-  memcpy(_elements.get(), that._elements.get(), sizeof(double) * _size);
+  memcpy(_elements, that._elements, sizeof(Real) * _size);
   return *this;
 }
 
@@ -46,10 +49,10 @@ void Tensor::ComponentWiseAdd(const Tensor& other, Tensor& result) const
   if (_size != other._size || _size != result._size)
 	throw std::runtime_error("All parameters to PairwiseSubtract must be the same size.");
 #endif
-  double* v1 = _elements.get();
-  const double* v2 = other._elements.get();
-  double* r = result._elements.get();
-  const double* end = r + result._size;
+  Real* v1 = _elements;
+  const Real* v2 = other._elements;
+  Real* r = result._elements;
+  const Real* end = r + result._size;
   while (r < end)
   {
 	*r = *v1 + *v2;
@@ -65,9 +68,9 @@ void Tensor::ComponentWiseAdd(const Tensor& other)
   if (_size != other._size)
 	throw std::runtime_error("The parameters to PairwiseSubtract must be the same size.");
 #endif
-  double* v1 = _elements.get();
-  const double* v2 = other._elements.get();
-  const double* end = v1 + _size;
+  Real* v1 = _elements;
+  const Real* v2 = other._elements;
+  const Real* end = v1 + _size;
   while (v1 < end)
   {
 	*v1 += *v2;
@@ -82,10 +85,10 @@ void Tensor::ComponentWiseSubtract(const Tensor& other, Tensor& result) const
   if (_size != other._size || _size != result._size)
 	throw std::runtime_error("All parameters to PairwiseSubtract must be the same size.");
 #endif
-  double* v1 = _elements.get();
-  const double* v2 = other._elements.get();
-  double* r = result._elements.get();
-  const double* end = r + result._size;
+  Real* v1 = _elements;
+  const Real* v2 = other._elements;
+  Real* r = result._elements;
+  const Real* end = r + result._size;
   while (r < end)
   {
 	*r = *v1 - *v2;
@@ -101,9 +104,9 @@ void Tensor::ComponentWiseSubtract(const Tensor& other)
   if (_size != other._size)
 	throw std::runtime_error("The parameters to PairwiseSubtract must be the same size.");
 #endif
-  double* v1 = _elements.get();
-  const double* v2 = other._elements.get();
-  const double* end = v1 + _size;
+  Real* v1 = _elements;
+  const Real* v2 = other._elements;
+  const Real* end = v1 + _size;
   while (v1 < end)
   {
 	*v1 -= *v2;
@@ -118,10 +121,10 @@ void Tensor::ComponentWiseMultiply(const Tensor& other, Tensor& result) const
   if (_size != other._size || _size != result._size)
 	throw std::runtime_error("All parameters to PairwiseSubtract must be the same size.");
 #endif
-  double* v1 = _elements.get();
-  const double* v2 = other._elements.get();
-  double* r = result._elements.get();
-  const double* end = r + result._size;
+  Real* v1 = _elements;
+  const Real* v2 = other._elements;
+  Real* r = result._elements;
+  const Real* end = r + result._size;
   while (r < end)
   {
 	*r = *v1 * *v2;
@@ -137,9 +140,9 @@ void Tensor::ComponentWiseMultiply(const Tensor& other)
   if (_size != other._size)
 	throw std::runtime_error("The parameters to PairwiseSubtract must be the same size.");
 #endif
-  double* v1 = _elements.get();
-  const double* v2 = other._elements.get();
-  const double* end = v1 + _size;
+  Real* v1 = _elements;
+  const Real* v2 = other._elements;
+  const Real* end = v1 + _size;
   while (v1 < end)
   {
 	*v1 *= *v2;
@@ -154,10 +157,10 @@ uint32_t Tensor::HighestValueIndex() const
   if (_size == 0)
 	throw std::runtime_error("HighestValueIndex called on empty Tensor.");
 #endif 
-  const double* v = _elements.get();
-  const double* end = v + _size;
-  const double* highestAddress = v;
-  double highest = *highestAddress;
+  const Real* v = _elements;
+  const Real* end = v + _size;
+  const Real* highestAddress = v;
+  Real highest = *highestAddress;
   while (++v < end)
   {
 	if (*v > highest)
@@ -167,7 +170,61 @@ uint32_t Tensor::HighestValueIndex() const
 	}
   }
 
-  return static_cast<uint32_t>(highestAddress - _elements.get());
+  return static_cast<uint32_t>(highestAddress - _elements);
+}
+
+Tensor Tensor::HyperplaneView(uint32_t first, uint32_t count) const
+{
+#ifdef _DEBUG
+  if (first + count > _hyperplanes)
+	throw std::runtime_error("Hyperplanes out of bounds for Tensor::HyperplaneView.");
+#endif
+  return Tensor(_elements + (first * _hyperplaneSize), count, _planes, _rows, _columns);
+}
+
+Tensor Tensor::View(uint32_t hyperplanes, uint32_t planes, uint32_t rows, uint32_t columns) const
+{
+#ifdef _DEBUG
+  if (hyperplanes * planes * rows * columns > _size)
+	throw std::runtime_error("Tensor::View - view is larger than the tensor.");
+#endif
+  return Tensor(_elements, hyperplanes, planes, rows, columns);
+}
+
+const uint32_t Tensor::ChannelBlockSize;
+
+void Tensor::ToChannelBlocked(Tensor& blocked) const
+{
+#ifdef _DEBUG
+  if (blocked._hyperplanes != ChannelBlocks(_planes) || blocked._planes != _rows || blocked._rows != _columns ||
+	blocked._columns != ChannelBlockSize)
+	throw std::runtime_error("Tensor::ToChannelBlocked - channel blocked tensor has the wrong dimensions.");
+#endif
+  Real* block = blocked._elements;
+  for (uint32_t plane = 0; plane < blocked._hyperplanes * ChannelBlockSize; ++plane)
+  {
+	uint32_t lane = plane % ChannelBlockSize;
+	Real* out = block + ((plane / ChannelBlockSize) * blocked._hyperplaneSize) + lane;
+	const Real* in = _elements + (plane * _planeSize);
+	for (uint32_t i = 0; i < _planeSize; ++i)
+	  out[i * ChannelBlockSize] = plane < _planes ? in[i] : 0.0;
+  }
+}
+
+void Tensor::FromChannelBlocked(Tensor& planar) const
+{
+#ifdef _DEBUG
+  if (_hyperplanes != ChannelBlocks(planar._planes) || _planes != planar._rows || _rows != planar._columns ||
+	_columns != ChannelBlockSize)
+	throw std::runtime_error("Tensor::FromChannelBlocked - planar tensor has the wrong dimensions.");
+#endif
+  for (uint32_t plane = 0; plane < planar._planes; ++plane)
+  {
+	const Real* in = _elements + ((plane / ChannelBlockSize) * _hyperplaneSize) + (plane % ChannelBlockSize);
+	Real* out = planar._elements + (plane * planar._planeSize);
+	for (uint32_t i = 0; i < planar._planeSize; ++i)
+	  out[i] = in[i * ChannelBlockSize];
+  }
 }
 
 void Tensor::GetStatistics(double& maxWeight, double& minWeight, double& avgWeight) const
@@ -175,8 +232,8 @@ void Tensor::GetStatistics(double& maxWeight, double& minWeight, double& avgWeig
   maxWeight = std::numeric_limits<double>::min();
   minWeight = std::numeric_limits<double>::max();
   avgWeight = 0.0;
-  const double* end = _elements.get() + _size;
-  for (const double* w = _elements.get(); w != end; ++w)
+  const Real* end = _elements + _size;
+  for (const Real* w = _elements; w != end; ++w)
   {
 	if (*w < minWeight)
 	  minWeight = *w;
@@ -193,10 +250,10 @@ void Tensor::Save(std::ofstream& os)
   os.write((const char*)&_planes, 4);
   os.write((const char*)&_rows, 4);
   os.write((const char*)&_columns, 4);
-  os.write((const char*)_elements.get(), _size * sizeof(double));
+  os.write((const char*)_elements, _size * sizeof(Real));
 }
 
-std::unique_ptr<Tensor> Tensor::Load(std::ifstream& is)
+std::unique_ptr<Tensor> Tensor::Load(std::ifstream& is, uint32_t elementSize)
 {
   uint32_t hyperplanes;
   uint32_t planes;
@@ -207,8 +264,27 @@ std::unique_ptr<Tensor> Tensor::Load(std::ifstream& is)
   is.read((char*)&rows, 4);
   is.read((char*)&columns, 4);
   uint32_t size = hyperplanes * planes * rows * columns;
-  auto elements = std::make_unique<double[]>(size);
-  is.read((char*)elements.get(), size * sizeof(double));
+  auto elements = std::make_unique<Real[]>(size);
+  if (elementSize == sizeof(Real))
+  {
+	is.read((char*)elements.get(), size * sizeof(Real));
+  }
+  else if (elementSize == sizeof(float))
+  {
+	auto fileElements = std::make_unique<float[]>(size);
+	is.read((char*)fileElements.get(), size * sizeof(float));
+	std::copy(fileElements.get(), fileElements.get() + size, elements.get());
+  }
+  else if (elementSize == sizeof(double))
+  {
+	auto fileElements = std::make_unique<double[]>(size);
+	is.read((char*)fileElements.get(), size * sizeof(double));
+	std::copy(fileElements.get(), fileElements.get() + size, elements.get());
+  }
+  else
+  {
+	throw std::runtime_error("Tensor::Load - unsupported element size.");
+  }
   return std::make_unique<Tensor>(std::move(elements), hyperplanes, planes, rows, columns);
 }
 
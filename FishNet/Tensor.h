@@ -1,16 +1,26 @@
 #pragma once
 
+// The type of the elements of every Tensor, and so of all the weights, activations and errors. Building with
+// Precision=single (see build/common.mk) makes it float, which halves the memory traffic and doubles the number of
+// elements in each vector register.
+#ifdef FISHNET_SINGLE_PRECISION
+typedef float Real;
+#else
+typedef double Real;
+#endif
+
 class Tensor
 {
 public:
   Tensor(uint32_t hyperplanes, uint32_t planes, uint32_t rows, uint32_t columns)
-	: _elements(std::make_unique<double[]>(hyperplanes * planes * rows * columns)),
+	: _storage(std::make_unique<Real[]>(hyperplanes * planes * rows * columns)),
+	  _elements(_storage.get()),
 	  _hyperplanes(hyperplanes), _planes(planes), _rows(rows), _columns(columns),
 	  _planeSize(rows * columns),
 	  _hyperplaneSize(_planeSize * planes),
 	  _size(_hyperplaneSize * hyperplanes)
   {
-	memset(_elements.get(), 0, sizeof(double) * _size);
+	memset(_elements, 0, sizeof(Real) * _size);
   }
   Tensor(uint32_t planes, uint32_t rows, uint32_t columns)
 	: Tensor(1, planes, rows, columns) {}
@@ -19,17 +29,18 @@ public:
   Tensor(uint32_t size)
 	: Tensor(1, 1, 1, size) {}
 
-  Tensor(std::unique_ptr<double[]>&& elements, uint32_t hyperplanes, uint32_t planes, uint32_t rows, uint32_t columns)
-	: _elements(std::move(elements)),
+  Tensor(std::unique_ptr<Real[]>&& elements, uint32_t hyperplanes, uint32_t planes, uint32_t rows, uint32_t columns)
+	: _storage(std::move(elements)),
+	  _elements(_storage.get()),
 	  _hyperplanes(hyperplanes), _planes(planes), _rows(rows), _columns(columns),
 	  _planeSize(rows * columns),
 	  _hyperplaneSize(_planeSize * planes),
 	  _size(_hyperplaneSize * hyperplanes) {}
-  Tensor(std::unique_ptr<double[]>&& elements, uint32_t planes, uint32_t rows, uint32_t columns)
+  Tensor(std::unique_ptr<Real[]>&& elements, uint32_t planes, uint32_t rows, uint32_t columns)
 	: Tensor(std::move(elements), 1, planes, rows, columns) {}
-  Tensor(std::unique_ptr<double[]>&& elements, uint32_t rows, uint32_t columns)
+  Tensor(std::unique_ptr<Real[]>&& elements, uint32_t rows, uint32_t columns)
 	: Tensor(std::move(elements), 1, 1, rows, columns) {}
-  Tensor(std::unique_ptr<double[]>&& elements, uint32_t size)
+  Tensor(std::unique_ptr<Real[]>&& elements, uint32_t size)
 	: Tensor(std::move(elements), 1, 1, 1, size) {}
   // Constructors for initializer_list
   Tensor(const std::initializer_list<double>& elements, uint32_t hyperplanes, uint32_t planes, uint32_t rows, uint32_t columns);
@@ -42,7 +53,8 @@ public:
   // Copy and move constructors
   Tensor(const Tensor&);
   Tensor(Tensor&& that) noexcept
-	: _elements(std::move(that._elements)),
+	: _storage(std::move(that._storage)),
+	  _elements(that._elements),
 	  _hyperplanes(that._hyperplanes),
 	  _planes(that._planes),
 	  _rows(that._rows),
@@ -51,6 +63,7 @@ public:
 	  _hyperplaneSize(that._hyperplaneSize),
 	  _size(that._size)
   {
+	that._elements = nullptr;
 	that._hyperplanes = 0;
 	that._planes = 0;
 	that._rows = 0;
@@ -62,12 +75,12 @@ public:
   ~Tensor() {}
   void SetAllToZero()
   {
-	memset(_elements.get(), 0, sizeof(double) * _size);
+	memset(_elements, 0, sizeof(Real) * _size);
   }
-  void Fill(double value)
+  void Fill(Real value)
   {
-	double* end = _elements.get() + _size;
-	for (double* v = _elements.get(); v < end; ++v)
+	Real* end = _elements + _size;
+	for (Real* v = _elements; v < end; ++v)
 	  *v = value;
   }
   Tensor& operator=(const Tensor&);
@@ -82,7 +95,7 @@ public:
   void ComponentWiseMultiply(const Tensor& other, Tensor& result) const;
   void ComponentWiseMultiply(const Tensor& other);
   uint32_t HighestValueIndex() const;
-  double Get(uint32_t i) const
+  Real Get(uint32_t i) const
   {
 #ifdef _DEBUG
 	if (i >= _size)
@@ -90,7 +103,7 @@ public:
 #endif
 	return _elements[i];
   }
-  void Set(uint32_t i, double value)
+  void Set(uint32_t i, Real value)
   {
 #ifdef _DEBUG
 	if (i >= _size)
@@ -98,7 +111,7 @@ public:
 #endif
 	_elements[i] = value;
   }
-  double Get(uint32_t row, uint32_t column) const
+  Real Get(uint32_t row, uint32_t column) const
   {
 #ifdef _DEBUG
 	if (_hyperplanes > 1 || _planes > 1)
@@ -114,7 +127,7 @@ public:
 #endif
 	return _elements[(_columns * row) + column];
   }
-  void Set(uint32_t row, uint32_t column, double value)
+  void Set(uint32_t row, uint32_t column, Real value)
   {
 #ifdef _DEBUG
 	if (_hyperplanes > 1 || _planes > 1)
@@ -130,7 +143,7 @@ public:
 #endif
 	_elements[(_columns * row) + column] = value;
   }
-  double Get(uint32_t plane, uint32_t row, uint32_t column) const
+  Real Get(uint32_t plane, uint32_t row, uint32_t column) const
   {
 #ifdef _DEBUG
 	if (_hyperplanes > 1)
@@ -148,7 +161,7 @@ public:
 #endif
 	return _elements[(_planeSize * plane) + (_columns * row) + column];
   }
-  void Set(uint32_t plane, uint32_t row, uint32_t column, double value)
+  void Set(uint32_t plane, uint32_t row, uint32_t column, Real value)
   {
 #ifdef _DEBUG
 	if (_hyperplanes > 1)
@@ -166,7 +179,7 @@ public:
 #endif
 	_elements[(_planeSize * plane) + (_columns * row) + column] = value;
   }
-  double Get(uint32_t hyperplane, uint32_t plane, uint32_t row, uint32_t column) const
+  Real Get(uint32_t hyperplane, uint32_t plane, uint32_t row, uint32_t column) const
   {
 #ifdef _DEBUG
 	if (hyperplane > _hyperplanes)
@@ -180,15 +193,15 @@ public:
 #endif
 	return _elements[(_hyperplaneSize * hyperplane) + (_planeSize * plane) + (_columns * row) + column];
   }
-  double* ElementAddress(uint32_t i)
+  Real* ElementAddress(uint32_t i)
   {
 #ifdef _DEBUG
 	if (i >= _size)
 	  throw std::runtime_error("Index out of bounds for Tensor::ElementAddress.");
 #endif
-	return _elements.get() + i;
+	return _elements + i;
   }
-  double* ElementAddress(uint32_t row, uint32_t column)
+  Real* ElementAddress(uint32_t row, uint32_t column)
   {
 #ifdef _DEBUG
 	if (_hyperplanes > 1 || _planes > 1)
@@ -202,9 +215,9 @@ public:
 	if (column > _columns)
 	  throw std::runtime_error("Column is out of bounds for Tensor::ElementAddress.");
 #endif
-	return _elements.get() + (_columns * row) + column;
+	return _elements + (_columns * row) + column;
   }
-  double* ElementAddress(uint32_t plane, uint32_t row, uint32_t column)
+  Real* ElementAddress(uint32_t plane, uint32_t row, uint32_t column)
   {
 #ifdef _DEBUG
 	if (_hyperplanes > 1)
@@ -220,9 +233,9 @@ public:
 	if (column > _columns)
 	  throw std::runtime_error("Column is out of bounds for Tensor::Get.");
 #endif
-	return _elements.get() + (_planeSize * plane) + (_columns * row) + column;
+	return _elements + (_planeSize * plane) + (_columns * row) + column;
   }
-  double* ElementAddress(uint32_t hyperPlane, uint32_t plane, uint32_t row, uint32_t column)
+  Real* ElementAddress(uint32_t hyperPlane, uint32_t plane, uint32_t row, uint32_t column)
   {
 #ifdef _DEBUG
 	if (hyperPlane > _hyperplanes)
@@ -234,22 +247,22 @@ public:
 	if (column > _columns)
 	  throw std::runtime_error("Column is out of bounds for Tensor::Get.");
 #endif
-	return _elements.get() + (_hyperplaneSize * hyperPlane) + (_planeSize * plane) + (_columns * row) + column;
+	return _elements + (_hyperplaneSize * hyperPlane) + (_planeSize * plane) + (_columns * row) + column;
   }
-  const double* ElementAddress(uint32_t i) const
+  const Real* ElementAddress(uint32_t i) const
   {
 	// Ugly but harmless little hack.
 	return const_cast<Tensor*>(this)->ElementAddress(i);
   }
-  const double* ElementAddress(uint32_t row, uint32_t column) const
+  const Real* ElementAddress(uint32_t row, uint32_t column) const
   {
 	return const_cast<Tensor*>(this)->ElementAddress(row, column);
   }
-  const double* ElementAddress(uint32_t plane, uint32_t row, uint32_t column) const
+  const Real* ElementAddress(uint32_t plane, uint32_t row, uint32_t column) const
   {
 	return const_cast<Tensor*>(this)->ElementAddress(plane, row, column);
   }
-  double* Elements() const { return _elements.get(); }
+  Real* Elements() const { return _elements; }
   uint32_t Hyperplanes() const { return _hyperplanes; }
   uint32_t Planes() const { return _planes; }
   uint32_t Rows() const { return _rows; }
@@ -257,11 +270,36 @@ public:
   uint32_t PlaneSize() const { return _planeSize; }
   uint32_t HyperplaneSize() const { return _hyperplaneSize; }
   uint32_t Size() const { return _size; }
+  // The channel blocked layout groups the planes of a 3 dimensional tensor into blocks of ChannelBlockSize and stores the
+  // values of a block at each position next to each other, so that a loop over channels reads contiguous memory. It is
+  // held in a tensor with dimensions (channel blocks, rows, columns, ChannelBlockSize). If the number of planes isn't a
+  // multiple of the block size, the last block is padded out with zeros.
+  static const uint32_t ChannelBlockSize = 4;
+  static uint32_t ChannelBlocks(uint32_t planes) { return (planes + ChannelBlockSize - 1) / ChannelBlockSize; }
+  void ToChannelBlocked(Tensor& blocked) const;
+  void FromChannelBlocked(Tensor& planar) const;
+  // Returns a tensor which refers to count hyperplanes of this one, starting at first, without copying them. A batch of
+  // examples is held as the hyperplanes of one tensor, and this gives a single example or a partly filled batch.
+  // The view is only valid for as long as this tensor is.
+  Tensor HyperplaneView(uint32_t first, uint32_t count = 1) const;
+  // Returns a tensor with the given dimensions which refers to the first elements of this one, so that one buffer can
+  // hold tensors of different shapes at different times. The view is only valid for as long as this tensor is.
+  Tensor View(uint32_t hyperplanes, uint32_t planes, uint32_t rows, uint32_t columns) const;
   void GetStatistics(double& maxWeight, double& minWeight, double& avgWeight) const;
   void Save(std::ofstream&);
-  static std::unique_ptr<Tensor> Load(std::ifstream&);
+  // elementSize is the size in bytes of the elements in the file, which can be either float or double.
+  static std::unique_ptr<Tensor> Load(std::ifstream&, uint32_t elementSize);
 private:
-  std::unique_ptr<double[]> _elements;
+  Tensor(Real* elements, uint32_t hyperplanes, uint32_t planes, uint32_t rows, uint32_t columns)
+	: _elements(elements),
+	  _hyperplanes(hyperplanes), _planes(planes), _rows(rows), _columns(columns),
+	  _planeSize(rows * columns),
+	  _hyperplaneSize(_planeSize * planes),
+	  _size(_hyperplaneSize * hyperplanes) {}
+
+  // Null if this tensor is a view of another one's elements.
+  std::unique_ptr<Real[]> _storage;
+  Real* _elements;
   uint32_t _hyperplanes;
   uint32_t _planes;
   uint32_t _rows;
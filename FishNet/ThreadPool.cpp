@@ -0,0 +1,251 @@
+#include "stdafx.h"
+#include "ThreadPool.h"
+
+namespace
+{
+
+// Tells the core that this thread is spinning, so that it gives way to the other hyperthread.
+inline void Pause()
+{
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+  _mm_pause();
+#else
+  std::this_thread::yield();
+#endif
+}
+
+// Checks for up to the given time whether a condition has become true, and returns whether it has.
+template <class Condition>
+bool Spin(std::chrono::steady_clock::duration time, Condition condition)
+{
+  auto deadline = std::chrono::steady_clock::now() + time;
+  while (!condition())
+  {
+	if (std::chrono::steady_clock::now() >= deadline)
+	  return false;
+	Pause();
+  }
+  return true;
+}
+
+}
+
+ThreadPool::ThreadPool(uint32_t threadCount)
+  : _threadCount(1), _spinTime(0), _running(false), _generation(0), _task(nullptr), _taskCount(0), _nextTask(0),
+	_busyWorkers(0), _waitTime(0), _runTime(0), _blockedWorkers(0), _callerBlocked(false), _stopping(false)
+{
+  AddWorkers(threadCount);
+}
+
+ThreadPool::~ThreadPool()
+{
+  StartRun();
+  _stopping = true;
+  for (auto& slot : _slots)
+	++slot->generation;
+  {
+	std::unique_lock<std::mutex> lock(_mutex);
+	_runAvailable.notify_all();
+  }
+  for (auto& worker : _workers)
+	worker.join();
+}
+
+ThreadPool& ThreadPool::Shared(uint32_t threadCount)
+{
+  static ThreadPool pool(threadCount);
+  if (pool.ThreadCount() < threadCount)
+	pool.AddWorkers(threadCount);
+  return pool;
+}
+
+std::chrono::nanoseconds ThreadPool::WaitTime() const
+{
+  return std::chrono::nanoseconds(_waitTime.load());
+}
+
+std::chrono::nanoseconds ThreadPool::RunTime() const
+{
+  return std::chrono::nanoseconds(_runTime.load());
+}
+
+void ThreadPool::ResetStatistics()
+{
+  _waitTime = 0;
+  _runTime = 0;
+}
+
+void ThreadPool::AddWorkers(uint32_t threadCount)
+{
+  StartRun();
+  while (_slots.size() + 1 < threadCount)
+  {
+	_slots.emplace_back(std::make_unique<Slot>());
+	Slot& slot = *_slots.back();
+	slot.generation = _generation;
+	// The worker might not start until after the first run has been handed to it, so it is told the generation to
+	// wait for a change from.
+	_workers.emplace_back(&ThreadPool::Work, this, std::ref(slot), _generation);
+  }
+  _threadCount = static_cast<uint32_t>(_slots.size()) + 1;
+  uint32_t cores = std::thread::hardware_concurrency();
+  Clock::duration spinTime = cores == 0 || _threadCount <= cores ? std::chrono::microseconds(200) : Clock::duration(0);
+  _spinTime = spinTime.count();
+  _running = false;
+}
+
+void ThreadPool::StartRun()
+{
+  while (_running.exchange(true))
+	std::this_thread::yield();
+}
+
+void ThreadPool::Run(uint32_t count, const Task& task)
+{
+  if (count == 0)
+	return;
+  uint32_t workerCount = std::min(count, _threadCount.load()) - 1;
+  if (workerCount == 0 || _running.exchange(true))
+  {
+	std::exception_ptr exception;
+	for (uint32_t i = 0; i < count; ++i)
+	{
+	  try
+	  {
+		task(i);
+	  }
+	  catch (...)
+	  {
+		if (!exception)
+		  exception = std::current_exception();
+	  }
+	}
+	if (exception)
+	  std::rethrow_exception(exception);
+	return;
+  }
+
+  // The workers read the task once they see their slot's new generation, so it has to be set first.
+  _task = &task;
+  _taskCount = count;
+  _exception = nullptr;
+  _nextTask.store(1, std::memory_order_relaxed);
+  _busyWorkers = workerCount;
+  ++_generation;
+  auto handedOut = Clock::now();
+  for (uint32_t w = 0; w < workerCount; ++w)
+	_slots[w]->generation = _generation;
+  if (_blockedWorkers > 0)
+  {
+	std::unique_lock<std::mutex> lock(_mutex);
+	_runAvailable.notify_all();
+  }
+
+  DoTask(0);
+  DoTasks();
+  auto finished = Clock::now();
+  WaitForWorkers();
+  auto end = Clock::now();
+
+  Clock::duration waitTime = end - finished;
+  for (uint32_t w = 0; w < workerCount; ++w)
+	waitTime += (_slots[w]->started - handedOut) + (end - _slots[w]->finished);
+  _waitTime += std::chrono::duration_cast<std::chrono::nanoseconds>(waitTime).count();
+  _runTime += std::chrono::duration_cast<std::chrono::nanoseconds>(end - handedOut).count() * (workerCount + 1);
+  std::exception_ptr exception = _exception;
+  _running = false;
+  if (exception)
+	std::rethrow_exception(exception);
+}
+
+void ThreadPool::Work(Slot& slot, uint64_t generation)
+{
+  for (;;)
+  {
+	WaitForRun(slot, generation);
+	generation = slot.generation;
+	if (_stopping)
+	  return;
+	slot.started = Clock::now();
+	DoTasks();
+	slot.finished = Clock::now();
+	// The calling thread checks _busyWorkers after it says that it is blocking, so either it sees that this was the
+	// last worker or this sees that it needs waking.
+	if (--_busyWorkers == 0 && _callerBlocked)
+	{
+	  std::unique_lock<std::mutex> lock(_mutex);
+	  _workersFinished.notify_one();
+	}
+  }
+}
+
+void ThreadPool::WaitForRun(Slot& slot, uint64_t generation)
+{
+  if (Spin(SpinTime(), [&slot, generation] { return slot.generation.load(std::memory_order_acquire) != generation; }))
+	return;
+  std::unique_lock<std::mutex> lock(_mutex);
+  ++_blockedWorkers;
+  _runAvailable.wait(lock, [&slot, generation] { return slot.generation != generation; });
+  --_blockedWorkers;
+}
+
+void ThreadPool::WaitForWorkers()
+{
+  if (Spin(SpinTime(), [this] { return _busyWorkers.load(std::memory_order_acquire) == 0; }))
+	return;
+  std::unique_lock<std::mutex> lock(_mutex);
+  _callerBlocked = true;
+  _workersFinished.wait(lock, [this] { return _busyWorkers == 0; });
+  _callerBlocked = false;
+}
+
+void ThreadPool::DoTasks()
+{
+  for (uint32_t i = _nextTask.fetch_add(1, std::memory_order_relaxed); i < _taskCount;
+	i = _nextTask.fetch_add(1, std::memory_order_relaxed))
+  {
+	DoTask(i);
+  }
+}
+
+void ThreadPool::DoTask(uint32_t index)
+{
+  try
+  {
+	(*_task)(index);
+  }
+  catch (...)
+  {
+	std::unique_lock<std::mutex> lock(_mutex);
+	if (!_exception)
+	  _exception = std::current_exception();
+  }
+}
+
+ProgressCounters::ProgressCounters(const ThreadPool& pool, size_t count)
+  : _spinTime(pool.SpinTime()), _counters(count), _blockedThreads(0)
+{
+}
+
+void ProgressCounters::Increment(size_t counter)
+{
+  // A waiting thread says that it is blocking before it checks the counter, so either it sees this increment or this
+  // sees that it needs waking.
+  ++_counters[counter];
+  if (_blockedThreads > 0)
+  {
+	std::unique_lock<std::mutex> lock(_mutex);
+	_changed.notify_all();
+  }
+}
+
+void ProgressCounters::WaitFor(size_t counter, uint32_t value)
+{
+  auto reached = [this, counter, value] { return _counters[counter] >= value; };
+  if (Spin(_spinTime, reached))
+	return;
+  std::unique_lock<std::mutex> lock(_mutex);
+  ++_blockedThreads;
+  _changed.wait(lock, reached);
+  --_blockedThreads;
+}
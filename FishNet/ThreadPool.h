@@ -0,0 +1,101 @@
+#pragma once
+
+// A fixed set of worker threads that training, testing and classification hand their work to, so that they don't
+// start and join threads of their own every time. The calling thread always does one share of the work itself.
+//
+// Training hands out a run for every minibatch, so the handoff has to be cheap. Each worker waits on its own slot, and
+// a run is handed out by writing a new generation number into the slots of the workers it needs, without taking a
+// lock. Workers then take tasks from a shared atomic counter, and the calling thread waits for the last of them to
+// finish. A waiting thread spins for a fifth of a millisecond before it blocks on a condition variable, unless there
+// are more threads than cores, when spinning would only take time from the threads doing the work.
+class ThreadPool
+{
+public:
+  using Task = std::function<void(uint32_t)>;
+
+  // threadCount includes the thread that calls Run, so the pool starts threadCount - 1 workers.
+  explicit ThreadPool(uint32_t threadCount);
+  ~ThreadPool();
+  ThreadPool(const ThreadPool&) = delete;
+  ThreadPool& operator=(const ThreadPool&) = delete;
+  // The pool that the whole process shares. It is started the first time it is asked for, and gets more workers if it
+  // is later asked for more threads than it has.
+  static ThreadPool& Shared(uint32_t threadCount);
+  uint32_t ThreadCount() const { return _threadCount; }
+  // How long a thread that is waiting for other threads in a run checks for a change before it blocks.
+  std::chrono::steady_clock::duration SpinTime() const { return Clock::duration(_spinTime.load()); }
+  // Calls task(0) to task(count - 1) and returns when they have all finished. task(0) runs on the calling thread and
+  // the others on whichever threads are free first. If any of them throws, the first exception is rethrown here.
+  // Runs don't overlap, so if another run is in progress, including one whose task called this, the tasks are all
+  // called on the calling thread.
+  void Run(uint32_t count, const Task& task);
+  // The time that the threads taking part in runs have spent waiting since the statistics were last reset. That is
+  // the time a worker takes to wake up, the time it then waits for the last thread to finish, and the time the
+  // calling thread waits for the workers.
+  std::chrono::nanoseconds WaitTime() const;
+  // The time that the threads taking part in runs have spent in them, including the time they have spent waiting.
+  std::chrono::nanoseconds RunTime() const;
+  void ResetStatistics();
+private:
+  using Clock = std::chrono::steady_clock;
+
+  struct Slot
+  {
+	// Changed by Run to hand this worker a run, and by the destructor to stop it.
+	std::atomic<uint64_t> generation;
+	// When the worker started and finished its part of the last run.
+	Clock::time_point started;
+	Clock::time_point finished;
+	// Keeps the next slot off this one's cache line.
+	char padding[64];
+  };
+
+  void AddWorkers(uint32_t threadCount);
+  // Waits for the run in progress to finish, and then stops another from starting.
+  void StartRun();
+  void Work(Slot& slot, uint64_t generation);
+  void WaitForRun(Slot& slot, uint64_t generation);
+  void WaitForWorkers();
+  void DoTasks();
+  void DoTask(uint32_t index);
+
+  std::vector<std::thread> _workers;
+  std::vector<std::unique_ptr<Slot>> _slots;
+  std::atomic<uint32_t> _threadCount;
+  // How long a thread checks for a change before it blocks, in clock ticks. Workers read it while more are being added.
+  std::atomic<Clock::rep> _spinTime;
+  // Set for the whole of a run, and while workers are added. The run's task, its number of tasks and its exception
+  // are only changed while no workers are taking part in it.
+  std::atomic<bool> _running;
+  uint64_t _generation;
+  const Task* _task;
+  uint32_t _taskCount;
+  std::exception_ptr _exception;
+  std::atomic<uint32_t> _nextTask;
+  std::atomic<uint32_t> _busyWorkers;
+  std::atomic<int64_t> _waitTime;
+  std::atomic<int64_t> _runTime;
+  // Threads that have finished spinning block on these.
+  std::mutex _mutex;
+  std::condition_variable _runAvailable;
+  std::condition_variable _workersFinished;
+  std::atomic<uint32_t> _blockedWorkers;
+  std::atomic<bool> _callerBlocked;
+  std::atomic<bool> _stopping;
+};
+
+// Counters that the threads taking part in a run can wait on until other threads in the run have counted them up to
+// a given value. A waiting thread spins for as long as the pool's threads do, and then blocks.
+class ProgressCounters
+{
+public:
+  ProgressCounters(const ThreadPool&, size_t count);
+  void Increment(size_t counter);
+  void WaitFor(size_t counter, uint32_t value);
+private:
+  std::chrono::steady_clock::duration _spinTime;
+  std::vector<std::atomic<uint32_t>> _counters;
+  std::mutex _mutex;
+  std::condition_variable _changed;
+  std::atomic<uint32_t> _blockedThreads;
+};
@@ -16,18 +16,29 @@
 #include <algorithm>
 #include <atomic>
 #include <chrono>
+#include <complex>
 #include <ctime>
 #include <condition_variable>
 #include <functional>
 #include <iomanip>
 #include <iostream>
+#include <map>
 #include <sstream>
 #include <memory>
 #include <mutex>
 #include <random>
 #include <stdio.h>
 #include <thread>
+#include <tuple>
 #include <vector>
 
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <immintrin.h>
+#endif
+
+#ifdef FISHNET_BLAS
+#include <cblas.h>
+#endif
+
 #include <Log.h>
 #include <Utils.h>
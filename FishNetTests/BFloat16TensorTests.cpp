@@ -0,0 +1,62 @@
+#include "stdafx.h"
+#include "CppUnitTest.h"
+#include "BFloat16Tensor.h"
+
+using namespace Microsoft::VisualStudio::CppUnitTestFramework;
+
+namespace FishNetTests
+{
+  TEST_CLASS(BFloat16TensorTests)
+  {
+  public:
+	TEST_METHOD(PackKeepsValuesThatFit)
+	{
+	  Tensor t({ 0.0, 1.0, -2.5, 0.15625, 65536.0, -0.0078125 });
+	  BFloat16Tensor packed(1, 1, 1, 6);
+	  packed.Pack(t);
+	  Tensor unpacked(6);
+	  packed.Unpack(unpacked);
+	  for (uint32_t i = 0; i < t.Size(); ++i)
+		Assert::AreEqual<double>(t.Get(i), unpacked.Get(i));
+	}
+
+	TEST_METHOD(PackRoundsToNearestEven)
+	{
+	  // Between 1 and 2 a bfloat16 has a step of 1/128. 1 + 1/256 is halfway between two values and goes to the even one,
+	  // 1 + 3/256 goes up to the even one, and anything past halfway goes up.
+	  Tensor t({ 1.0 + 1.0 / 256, 1.0 + 3.0 / 256, 1.0 + 1.0 / 256 + 1.0 / 4096, -(1.0 + 1.0 / 512) });
+	  BFloat16Tensor packed(1, 1, 1, 4);
+	  packed.Pack(t);
+	  Tensor unpacked(4);
+	  packed.Unpack(unpacked);
+	  Assert::AreEqual<double>(1.0, unpacked.Get(0));
+	  Assert::AreEqual<double>(1.0 + 2.0 / 128, unpacked.Get(1));
+	  Assert::AreEqual<double>(1.0 + 1.0 / 128, unpacked.Get(2));
+	  Assert::AreEqual<double>(-1.0, unpacked.Get(3));
+	}
+
+	TEST_METHOD(PackKeepsNaN)
+	{
+	  Tensor t({ std::numeric_limits<double>::quiet_NaN(), std::numeric_limits<double>::infinity() });
+	  BFloat16Tensor packed(1, 1, 1, 2);
+	  packed.Pack(t);
+	  Tensor unpacked(2);
+	  packed.Unpack(unpacked);
+	  Assert::IsTrue(std::isnan(unpacked.Get(0)));
+	  Assert::IsTrue(std::isinf(unpacked.Get(1)));
+	}
+
+	TEST_METHOD(MultiplyInto)
+	{
+	  Tensor derivatives({ 1.0, 0.0, 0.5, -2.0 }, 2, 2);
+	  BFloat16Tensor packed(1, 1, 2, 2);
+	  packed.Pack(derivatives);
+	  Tensor errors({ 3.0, 4.0, 5.0, 6.0 }, 2, 2);
+	  packed.MultiplyInto(errors);
+	  Assert::AreEqual<double>(3.0, errors.Get(0));
+	  Assert::AreEqual<double>(0.0, errors.Get(1));
+	  Assert::AreEqual<double>(2.5, errors.Get(2));
+	  Assert::AreEqual<double>(-12.0, errors.Get(3));
+	}
+  };
+}
@@ -6,6 +6,54 @@ using namespace Microsoft::VisualStudio::CppUnitTestFramework;
 
 namespace ConvolutionalBackpropagationTests
 {
+  // Run the backward passes of a layer using the given algorithm and check that the results match the direct convolution.
+  void CompareWithDirectBackpropagation(ConvolutionalLayer::Algorithms algorithm, uint32_t channels, uint32_t rows, uint32_t columns,
+	uint32_t filterCount, uint32_t filterSize, uint32_t stride, uint32_t zeroPadding)
+  {
+	ConvolutionalLayer layer(channels, rows, columns, filterCount, filterSize, stride, zeroPadding, nullptr);
+	layer.InitializeWeights();
+	Tensor activations(channels, rows, columns);
+	Randomizer(1.0).Fill(activations);
+	Tensor delta(layer.OutputPlanes(), layer.OutputRows(), layer.OutputColumns());
+	Randomizer(1.0).Fill(delta);
+
+	Tensor expectedError(channels, rows, columns);
+	Tensor expectedNablaW(layer.Weights());
+	Tensor expectedNablaB(layer.Biases());
+	layer.Algorithm(ConvolutionalLayer::Algorithms::Direct);
+	layer.BackpropagateError(delta, expectedError, nullptr);
+	layer.UpdateWeightAndBiasErrors(delta, activations, expectedNablaW, expectedNablaB, nullptr);
+
+	Tensor actualError(channels, rows, columns);
+	Tensor actualNablaW(layer.Weights());
+	Tensor actualNablaB(layer.Biases());
+	layer.Algorithm(algorithm);
+	layer.BackpropagateError(delta, actualError, nullptr);
+	layer.UpdateWeightAndBiasErrors(delta, activations, actualNablaW, actualNablaB, nullptr);
+
+	std::wostringstream shape;
+	shape << channels << 'x' << rows << 'x' << columns << " input with " << filterCount << " filters of size " << filterSize
+	  << ", stride " << stride << ", padding " << zeroPadding;
+	for (uint32_t i = 0; i < expectedError.Size(); ++i)
+	{
+	  std::wostringstream msg;
+	  msg << "Error mismatch at element " << i << " of " << shape.str();
+	  Assert::AreEqual(expectedError.Get(i), actualError.Get(i), 1e-9, msg.str().c_str());
+	}
+	for (uint32_t i = 0; i < expectedNablaW.Size(); ++i)
+	{
+	  std::wostringstream msg;
+	  msg << "Weight error mismatch at element " << i << " of " << shape.str();
+	  Assert::AreEqual(expectedNablaW.Get(i), actualNablaW.Get(i), 1e-9, msg.str().c_str());
+	}
+	for (uint32_t i = 0; i < expectedNablaB.Size(); ++i)
+	{
+	  std::wostringstream msg;
+	  msg << "Bias error mismatch at element " << i << " of " << shape.str();
+	  Assert::AreEqual(expectedNablaB.Get(i), actualNablaB.Get(i), 1e-9, msg.str().c_str());
+	}
+  }
+
   TEST_CLASS(ConvolutionalBackpropagationTests)
   {
   public:
@@ -1409,5 +1457,56 @@ namespace ConvolutionalBackpropagationTests
 		Assert::AreEqual(expectedBiasError, nablaB.Get(filter), 1e-5, msg.str().c_str());
 	  }
 	}
+
+	TEST_METHOD(GemmConvolutionalLayerBackpropagationMatchesDirect)
+	{
+	  CompareWithDirectBackpropagation(ConvolutionalLayer::Algorithms::Gemm, 1, 8, 8, 3, 3, 1, 0);
+	  CompareWithDirectBackpropagation(ConvolutionalLayer::Algorithms::Gemm, 1, 28, 28, 32, 5, 1, 2);
+	  CompareWithDirectBackpropagation(ConvolutionalLayer::Algorithms::Gemm, 3, 16, 16, 8, 5, 1, 2);
+	  CompareWithDirectBackpropagation(ConvolutionalLayer::Algorithms::Gemm, 4, 11, 9, 5, 4, 2, 2);
+	  CompareWithDirectBackpropagation(ConvolutionalLayer::Algorithms::Gemm, 2, 12, 15, 7, 3, 2, 1);
+	  CompareWithDirectBackpropagation(ConvolutionalLayer::Algorithms::Gemm, 6, 8, 8, 16, 1, 1, 0);
+	}
+
+	TEST_METHOD(PaddedDirectBackpropagationMatchesGemm)
+	{
+	  // With a stride of 1 the direct pass convolves a padded copy of the error, which needs no padding when the zero
+	  // padding is one less than the filter size. With a larger stride it backpropagates into a padded buffer and copies
+	  // out the part that isn't padding.
+	  for (uint32_t filterSize : { 2, 3, 4, 5 })
+	  {
+		for (uint32_t zeroPadding = 1; zeroPadding < filterSize; ++zeroPadding)
+		{
+		  for (uint32_t stride : { 1, 2, 3 })
+		  {
+			CompareWithDirectBackpropagation(ConvolutionalLayer::Algorithms::Gemm, 3, 10, 13, 4, filterSize, stride, zeroPadding);
+			CompareWithDirectBackpropagation(ConvolutionalLayer::Algorithms::Gemm, 3, 10, 13, 7, filterSize, stride, zeroPadding);
+		  }
+		}
+	  }
+	}
+
+	TEST_METHOD(WinogradConvolutionalLayerBackpropagationMatchesDirect)
+	{
+	  for (ConvolutionalLayer::Algorithms algorithm : { ConvolutionalLayer::Algorithms::WinogradF2x2, ConvolutionalLayer::Algorithms::WinogradF4x4 })
+	  {
+		CompareWithDirectBackpropagation(algorithm, 1, 8, 8, 4, 3, 1, 0);
+		CompareWithDirectBackpropagation(algorithm, 3, 32, 32, 16, 3, 1, 1);
+		CompareWithDirectBackpropagation(algorithm, 2, 13, 11, 5, 3, 1, 1);
+		CompareWithDirectBackpropagation(algorithm, 5, 7, 9, 6, 3, 1, 0);
+		CompareWithDirectBackpropagation(algorithm, 4, 6, 6, 3, 3, 1, 2);
+	  }
+	}
+
+
+	TEST_METHOD(FftConvolutionalLayerBackpropagationMatchesDirect)
+	{
+	  CompareWithDirectBackpropagation(ConvolutionalLayer::Algorithms::Fft, 1, 28, 28, 32, 5, 1, 2);
+	  CompareWithDirectBackpropagation(ConvolutionalLayer::Algorithms::Fft, 3, 32, 32, 8, 5, 1, 2);
+	  CompareWithDirectBackpropagation(ConvolutionalLayer::Algorithms::Fft, 4, 11, 9, 5, 4, 2, 2);
+	  CompareWithDirectBackpropagation(ConvolutionalLayer::Algorithms::Fft, 2, 13, 15, 7, 3, 2, 1);
+	  CompareWithDirectBackpropagation(ConvolutionalLayer::Algorithms::Fft, 5, 14, 14, 6, 7, 1, 0);
+	  CompareWithDirectBackpropagation(ConvolutionalLayer::Algorithms::Fft, 6, 8, 8, 16, 1, 1, 0);
+	}
   };
 }
@@ -1,11 +1,35 @@
 #include "stdafx.h"
 #include "CppUnitTest.h"
 #include "ConvolutionalLayer.h"
+#include "ConvolutionTuner.h"
 
 using namespace Microsoft::VisualStudio::CppUnitTestFramework;
 
 namespace ConvolutionalFeedForwardTests
 {
+  // Feed a random input through a layer using the given algorithm and check that the result matches the direct convolution.
+  void CompareWithDirectFeedForward(ConvolutionalLayer::Algorithms algorithm, uint32_t channels, uint32_t rows, uint32_t columns,
+	uint32_t filterCount, uint32_t filterSize, uint32_t stride, uint32_t zeroPadding)
+  {
+	ConvolutionalLayer layer(channels, rows, columns, filterCount, filterSize, stride, zeroPadding, nullptr);
+	layer.InitializeWeights();
+	Tensor input(channels, rows, columns);
+	Randomizer(1.0).Fill(input);
+	Tensor expected(layer.OutputPlanes(), layer.OutputRows(), layer.OutputColumns());
+	Tensor actual(layer.OutputPlanes(), layer.OutputRows(), layer.OutputColumns());
+	layer.Algorithm(ConvolutionalLayer::Algorithms::Direct);
+	layer.FeedForward(input, expected, nullptr);
+	layer.Algorithm(algorithm);
+	layer.FeedForward(input, actual, nullptr);
+	for (uint32_t i = 0; i < expected.Size(); ++i)
+	{
+	  std::wostringstream msg;
+	  msg << "Mismatch at element " << i << " of " << channels << 'x' << rows << 'x' << columns << " input with "
+		<< filterCount << " filters of size " << filterSize << ", stride " << stride << ", padding " << zeroPadding;
+	  Assert::AreEqual(expected.Get(i), actual.Get(i), 1e-9, msg.str().c_str());
+	}
+  }
+
   TEST_CLASS(ConvolutionalFeedForwardTests)
   {
   public:
@@ -1040,5 +1064,198 @@ namespace ConvolutionalFeedForwardTests
 		}
 	  }
 	}
+
+	TEST_METHOD(GemmConvolutionalLayerFeedForwardMatchesDirect)
+	{
+	  CompareWithDirectFeedForward(ConvolutionalLayer::Algorithms::Gemm, 1, 5, 5, 3, 3, 1, 0);
+	  CompareWithDirectFeedForward(ConvolutionalLayer::Algorithms::Gemm, 1, 28, 28, 32, 5, 1, 2);
+	  CompareWithDirectFeedForward(ConvolutionalLayer::Algorithms::Gemm, 3, 16, 16, 8, 5, 1, 2);
+	  CompareWithDirectFeedForward(ConvolutionalLayer::Algorithms::Gemm, 4, 11, 9, 5, 4, 2, 2);
+	  CompareWithDirectFeedForward(ConvolutionalLayer::Algorithms::Gemm, 2, 12, 15, 7, 3, 3, 1);
+	  CompareWithDirectFeedForward(ConvolutionalLayer::Algorithms::Gemm, 6, 8, 8, 16, 1, 1, 0);
+	}
+
+	TEST_METHOD(SpecializedDirectKernelsMatchGemm)
+	{
+	  // Cover each filter size and stride that has its own kernel, with filter counts that leave a partial block of filters.
+	  for (uint32_t filterSize : { 1, 3, 5 })
+	  {
+		for (uint32_t stride : { 1, 2 })
+		{
+		  CompareWithDirectFeedForward(ConvolutionalLayer::Algorithms::Gemm, 3, 13, 19, 7, filterSize, stride, 0);
+		  CompareWithDirectFeedForward(ConvolutionalLayer::Algorithms::Gemm, 2, 11, 10, 5, filterSize, stride, filterSize / 2);
+		}
+	  }
+	}
+
+	TEST_METHOD(DirectKernelTilesMatchGemm)
+	{
+	  // The direct kernels work on tiles of a block of filters by 8 output columns. Cover filter counts made of whole
+	  // blocks and ones that leave each size of partial block, and output widths of less than a tile, exactly a tile and
+	  // a tile or more with some columns left over. Padding of half the filter gives an output width of width for the
+	  // odd filter sizes, which have their own kernels, and one more for the size 4 filters, which use the general one.
+	  for (uint32_t filterSize : { 1, 3, 4, 5 })
+	  {
+		for (uint32_t stride : { 1, 2 })
+		{
+		  for (uint32_t filterCount : { 4, 6, 8, 9, 11 })
+		  {
+			for (uint32_t width : { 7, 8, 13, 23 })
+			{
+			  CompareWithDirectFeedForward(ConvolutionalLayer::Algorithms::Gemm, 2, 5, stride * (width - 1) + 1,
+				filterCount, filterSize, stride, filterSize / 2);
+			}
+		  }
+		}
+	  }
+	  // Enough input channels that the output is worked through in several bands of rows.
+	  CompareWithDirectFeedForward(ConvolutionalLayer::Algorithms::Gemm, 64, 13, 40, 6, 3, 1, 1);
+	}
+
+	TEST_METHOD(PaddedDirectConvolutionMatchesGemm)
+	{
+	  // The direct convolution works from a zero padded copy of the input. Cover every padding that each filter size
+	  // allows, with whole and partial blocks of filters.
+	  for (uint32_t filterSize : { 2, 3, 4, 5 })
+	  {
+		for (uint32_t zeroPadding = 1; zeroPadding < filterSize; ++zeroPadding)
+		{
+		  for (uint32_t stride : { 1, 2, 3 })
+		  {
+			CompareWithDirectFeedForward(ConvolutionalLayer::Algorithms::Gemm, 3, 10, 13, 4, filterSize, stride, zeroPadding);
+			CompareWithDirectFeedForward(ConvolutionalLayer::Algorithms::Gemm, 3, 10, 13, 7, filterSize, stride, zeroPadding);
+		  }
+		}
+	  }
+	}
+
+	TEST_METHOD(ChannelBlockedConvolutionalLayerFeedForwardMatchesDirect)
+	{
+	  // Channel and filter counts which aren't multiples of the block size check that the padding channels are ignored.
+	  for (auto& shape : std::vector<std::vector<uint32_t>>{ { 4, 9, 9, 8, 3, 1, 1 }, { 5, 12, 10, 7, 5, 1, 2 },
+		{ 3, 11, 13, 6, 3, 2, 0 }, { 8, 8, 8, 4, 1, 1, 0 } })
+	  {
+		ConvolutionalLayer layer(shape[0], shape[1], shape[2], shape[3], shape[4], shape[5], shape[6], nullptr);
+		layer.InitializeWeights();
+		Tensor input(shape[0], shape[1], shape[2]);
+		Randomizer(1.0).Fill(input);
+		Tensor expected(layer.OutputPlanes(), layer.OutputRows(), layer.OutputColumns());
+		layer.Algorithm(ConvolutionalLayer::Algorithms::Direct);
+		layer.FeedForward(input, expected, nullptr);
+		Tensor blockedInput(Tensor::ChannelBlocks(shape[0]), shape[1], shape[2], Tensor::ChannelBlockSize);
+		input.ToChannelBlocked(blockedInput);
+		Tensor blockedOutput(Tensor::ChannelBlocks(layer.OutputPlanes()), layer.OutputRows(), layer.OutputColumns(),
+		  Tensor::ChannelBlockSize);
+		layer.FeedForwardChannelBlocked(blockedInput, blockedOutput);
+		Tensor actual(layer.OutputPlanes(), layer.OutputRows(), layer.OutputColumns());
+		blockedOutput.FromChannelBlocked(actual);
+		for (uint32_t i = 0; i < expected.Size(); ++i)
+		{
+		  std::wostringstream msg;
+		  msg << "Mismatch at element " << i << " of " << shape[0] << 'x' << shape[1] << 'x' << shape[2] << " input with "
+			<< shape[3] << " filters of size " << shape[4] << ", stride " << shape[5] << ", padding " << shape[6];
+		  Assert::AreEqual(expected.Get(i), actual.Get(i), 1e-9, msg.str().c_str());
+		}
+	  }
+	}
+
+	TEST_METHOD(WinogradConvolutionalLayerFeedForwardMatchesDirect)
+	{
+	  for (ConvolutionalLayer::Algorithms algorithm : { ConvolutionalLayer::Algorithms::WinogradF2x2, ConvolutionalLayer::Algorithms::WinogradF4x4 })
+	  {
+		CompareWithDirectFeedForward(algorithm, 1, 8, 8, 4, 3, 1, 0);
+		CompareWithDirectFeedForward(algorithm, 3, 32, 32, 16, 3, 1, 1);
+		CompareWithDirectFeedForward(algorithm, 2, 13, 11, 5, 3, 1, 1);
+		CompareWithDirectFeedForward(algorithm, 5, 7, 9, 6, 3, 1, 0);
+		CompareWithDirectFeedForward(algorithm, 4, 6, 6, 3, 3, 1, 2);
+	  }
+	}
+
+	TEST_METHOD(WinogradRequires3x3FiltersWithStride1)
+	{
+	  ConvolutionalLayer layer(2, 12, 12, 4, 3, 2, 1, nullptr);
+	  Assert::IsTrue(!layer.SupportsAlgorithm(ConvolutionalLayer::Algorithms::WinogradF2x2));
+	  bool caught = false;
+	  try
+	  {
+		layer.Algorithm(ConvolutionalLayer::Algorithms::WinogradF4x4);
+	  }
+	  catch (const std::exception& e)
+	  {
+		caught = true;
+		Assert::AreEqual<std::string>("The Winograd convolution algorithms require 3x3 filters with a stride of 1.", e.what());
+	  }
+	  Assert::IsTrue(caught);
+	}
+
+	TEST_METHOD(FftConvolutionalLayerFeedForwardMatchesDirect)
+	{
+	  CompareWithDirectFeedForward(ConvolutionalLayer::Algorithms::Fft, 1, 28, 28, 32, 5, 1, 2);
+	  CompareWithDirectFeedForward(ConvolutionalLayer::Algorithms::Fft, 3, 32, 32, 8, 5, 1, 2);
+	  CompareWithDirectFeedForward(ConvolutionalLayer::Algorithms::Fft, 4, 11, 9, 5, 4, 2, 2);
+	  CompareWithDirectFeedForward(ConvolutionalLayer::Algorithms::Fft, 2, 13, 15, 7, 3, 3, 1);
+	  CompareWithDirectFeedForward(ConvolutionalLayer::Algorithms::Fft, 5, 14, 14, 6, 7, 1, 0);
+	  CompareWithDirectFeedForward(ConvolutionalLayer::Algorithms::Fft, 6, 8, 8, 16, 1, 1, 0);
+	}
+
+	TEST_METHOD(TunerPicksSupportedAlgorithm)
+	{
+	  const char* fileName = "ConvolutionTunerPicksTest.tmp";
+	  std::remove(fileName);
+	  ConvolutionalLayer layer(2, 12, 12, 8, 3, 2, 1, nullptr);
+	  layer.InitializeWeights();
+	  ConvolutionTuner::Tune(layer, fileName);
+	  Assert::IsTrue(layer.SupportsAlgorithm(layer.Algorithm()));
+	  // The second layer of the same shape gets the same algorithm, from the cache.
+	  ConvolutionalLayer sameShape(2, 12, 12, 8, 3, 2, 1, nullptr);
+	  ConvolutionTuner::Tune(sameShape, fileName);
+	  Assert::IsTrue(layer.Algorithm() == sameShape.Algorithm());
+	  std::remove(fileName);
+	}
+
+	TEST_METHOD(TunerSavesAndReloadsResults)
+	{
+	  const char* fileName = "ConvolutionTunerSaveTest.tmp";
+	  const char* copyName = "ConvolutionTunerReloadTest.tmp";
+	  // A result that the tuner must take from the file rather than timing the layer again.
+	  std::string savedGemm = std::string("2 12 12 8 3 2 1 ") + ConvolutionalLayer::AlgorithmName(ConvolutionalLayer::Algorithms::Gemm);
+	  {
+		std::ofstream os(fileName);
+		os << savedGemm << '\n';
+	  }
+	  ConvolutionalLayer saved(2, 12, 12, 8, 3, 2, 1, nullptr);
+	  ConvolutionTuner::Tune(saved, fileName);
+	  Assert::IsTrue(saved.Algorithm() == ConvolutionalLayer::Algorithms::Gemm);
+	  // A new shape is timed, and its result added to the file.
+	  ConvolutionalLayer timed(3, 10, 10, 4, 3, 1, 1, nullptr);
+	  ConvolutionTuner::Tune(timed, fileName);
+	  std::string timedResult = std::string("3 10 10 4 3 1 1 ") + ConvolutionalLayer::AlgorithmName(timed.Algorithm());
+	  std::vector<std::string> lines;
+	  {
+		std::ifstream is(fileName);
+		for (std::string line; std::getline(is, line);)
+		  lines.push_back(line);
+	  }
+	  Assert::AreEqual<size_t>(2, lines.size());
+	  Assert::AreEqual(savedGemm, lines[0]);
+	  Assert::AreEqual(timedResult, lines[1]);
+	  // A file that hasn't been read yet with the same results gives the same algorithm without timing it again.
+	  {
+		std::ofstream os(copyName);
+		os << lines[0] << '\n' << lines[1] << '\n';
+	  }
+	  ConvolutionalLayer reloaded(3, 10, 10, 4, 3, 1, 1, nullptr);
+	  ConvolutionTuner::Tune(reloaded, copyName);
+	  Assert::IsTrue(reloaded.Algorithm() == timed.Algorithm());
+	  size_t copyLines = 0;
+	  {
+		std::ifstream is(copyName);
+		for (std::string line; std::getline(is, line);)
+		  ++copyLines;
+	  }
+	  std::remove(fileName);
+	  std::remove(copyName);
+	  Assert::AreEqual<size_t>(2, copyLines);
+	}
   };
 }
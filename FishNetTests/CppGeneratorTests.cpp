@@ -0,0 +1,80 @@
+#include "stdafx.h"
+#include "CppUnitTest.h"
+#include "ConvolutionalLayer.h"
+#include "CostFunction.h"
+#include "CppGenerator.h"
+#include "FeedForwardNetwork.h"
+#include "InferencePlan.h"
+// Generated from MakeNetwork below. If the generator changes, GeneratedCodeIsUpToDate fails and the file has to be
+// written again with CppGenerator::Generate(*MakeNetwork(), "GeneratedTestNetwork", ...).
+#include "GeneratedTestNetwork.h"
+
+using namespace Microsoft::VisualStudio::CppUnitTestFramework;
+
+namespace FishNetTests
+{
+  TEST_CLASS(CppGeneratorTests)
+  {
+  public:
+	TEST_METHOD(GeneratedCodeIsUpToDate)
+	{
+	  std::ostringstream generated;
+	  CppGenerator::Generate(*MakeNetwork(), "GeneratedTestNetwork", generated);
+	  std::string fileName(__FILE__);
+	  fileName = fileName.substr(0, fileName.find_last_of("/\\") + 1) + "GeneratedTestNetwork.h";
+	  std::ifstream ifs(fileName);
+	  Assert::IsTrue(ifs.good());
+	  std::stringstream expected;
+	  expected << ifs.rdbuf();
+	  Assert::IsTrue(expected.str() == generated.str());
+	}
+
+	TEST_METHOD(GeneratedCodeMatchesNetwork)
+	{
+	  auto network = MakeNetwork();
+	  std::unique_ptr<InferencePlan> plan = network->CompileForInference();
+	  InferencePlan::Workspace workspace(*plan);
+	  Tensor input(GeneratedTestNetwork::InputChannels, GeneratedTestNetwork::InputRows, GeneratedTestNetwork::InputColumns);
+	  for (uint32_t n = 0; n < 10; ++n)
+	  {
+		for (uint32_t i = 0; i < input.Size(); ++i)
+		  input.Set(i, ((i * 13 + n * 29) % 41) / 40.0);
+		Tensor expected = plan->FeedForward(input, workspace);
+		Assert::AreEqual<uint32_t>(GeneratedTestNetwork::OutputSize, expected.Size());
+		Real output[GeneratedTestNetwork::OutputSize];
+		GeneratedTestNetwork::FeedForward(input.Elements(), output);
+		for (uint32_t i = 0; i < expected.Size(); ++i)
+		  Assert::AreEqual(expected.Get(i), output[i], 1e-12);
+		Assert::AreEqual(expected.HighestValueIndex(), GeneratedTestNetwork::Classify(input.Elements()));
+	  }
+	}
+
+  private:
+	// The weights are fractions with a small denominator rather than random numbers, so that the generated file is
+	// the same whichever standard library built it. All the layer types and activation functions are covered, as well
+	// as padding, a stride of 2 and a fully connected layer with dropout, whose testing weights are written out.
+	static std::unique_ptr<FeedForwardNetwork> MakeNetwork()
+	{
+	  auto network = std::make_unique<FeedForwardNetwork>("generated test", 2, 8, 8,
+		std::make_unique<CrossEntropyCostFunction>(), 1, 0, 0.1, 0.0);
+	  network->AddLayer(std::make_unique<ConvolutionalLayer>(Fill(0, 4, 2, 3, 3), Fill(1, 1, 1, 1, 4), 8, 8, 1, 1,
+		std::make_unique<LeakyReLU>(0.125)));
+	  network->AddLayer(std::make_unique<MaxPoolingLayer>(4, 8, 8));
+	  network->AddLayer(std::make_unique<ConvolutionalLayer>(Fill(2, 3, 4, 3, 3), Fill(3, 1, 1, 1, 3), 4, 4, 2, 1,
+		std::make_unique<TanH>()));
+	  network->AddLayer(std::make_unique<FullyConnectedLayer>(Fill(4, 1, 1, 9, 12), Fill(5, 1, 1, 1, 9),
+		std::make_unique<ReLU>(), 0.5));
+	  network->AddLayer(std::make_unique<FullyConnectedLayer>(Fill(6, 1, 1, 5, 9), Fill(7, 1, 1, 1, 5),
+		std::make_unique<Sigmoid>(), 1.0, 0.5));
+	  return network;
+	}
+
+	static TensorPtr Fill(uint32_t seed, uint32_t hyperplanes, uint32_t planes, uint32_t rows, uint32_t columns)
+	{
+	  auto t = std::make_unique<Tensor>(hyperplanes, planes, rows, columns);
+	  for (uint32_t i = 0; i < t->Size(); ++i)
+		t->Set(i, (int32_t((i * 37 + seed * 11) % 101) - 50) / 128.0);
+	  return t;
+	}
+  };
+}
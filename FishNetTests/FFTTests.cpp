@@ -0,0 +1,72 @@
+#include "stdafx.h"
+#include "CppUnitTest.h"
+#include "FFT.h"
+
+using namespace Microsoft::VisualStudio::CppUnitTestFramework;
+
+namespace FishNetTests
+{
+  TEST_CLASS(FFTTests)
+  {
+  public:
+	TEST_METHOD(SmoothSize)
+	{
+	  Assert::AreEqual<uint32_t>(1, FourierTransform::SmoothSize(1));
+	  Assert::AreEqual<uint32_t>(12, FourierTransform::SmoothSize(11));
+	  Assert::AreEqual<uint32_t>(32, FourierTransform::SmoothSize(32));
+	  Assert::AreEqual<uint32_t>(36, FourierTransform::SmoothSize(33));
+	  Assert::AreEqual<uint32_t>(75, FourierTransform::SmoothSize(73));
+	}
+
+	TEST_METHOD(ForwardTransformMatchesDiscreteFourierTransform)
+	{
+	  const double pi = 3.14159265358979323846;
+	  for (uint32_t size : { 1, 2, 3, 4, 5, 8, 12, 20, 30, 36, 45, 64 })
+	  {
+		std::vector<Complex> input(size);
+		for (uint32_t i = 0; i < size; ++i)
+		  input[i] = Complex(sin(i * 0.7) + 0.1 * i, cos(i * 1.3));
+		std::vector<Complex> output(size);
+		FourierTransform(size).Forward(input.data(), 1, output.data());
+		for (uint32_t k = 0; k < size; ++k)
+		{
+		  Complex expected;
+		  for (uint32_t i = 0; i < size; ++i)
+			expected += input[i] * std::polar(1.0, -2.0 * pi * i * k / size);
+		  std::wostringstream msg;
+		  msg << "Mismatch at element " << k << " of transform of size " << size;
+		  Assert::AreEqual(expected.real(), output[k].real(), 1e-9, msg.str().c_str());
+		  Assert::AreEqual(expected.imag(), output[k].imag(), 1e-9, msg.str().c_str());
+		}
+	  }
+	}
+
+	TEST_METHOD(RealTransform2DInverseRestoresInput)
+	{
+	  for (auto& size : std::vector<std::pair<uint32_t, uint32_t>>{ { 1, 1 }, { 4, 4 }, { 5, 6 }, { 9, 10 }, { 12, 15 }, { 20, 20 } })
+	  {
+		RealFourierTransform2D transform(size.first, size.second);
+		std::vector<double> input(size.first * size.second);
+		for (uint32_t i = 0; i < input.size(); ++i)
+		  input[i] = sin(i * 0.37) - 0.2;
+		std::vector<Complex> spectrum(transform.SpectrumSize());
+		transform.Forward(input.data(), spectrum.data());
+		std::wostringstream msg;
+		msg << "Wrong DC component of " << size.first << 'x' << size.second << " transform";
+		double sum = 0.0;
+		for (double value : input)
+		  sum += value;
+		Assert::AreEqual(sum, spectrum[0].real(), 1e-9, msg.str().c_str());
+
+		std::vector<double> output(input.size());
+		transform.Inverse(spectrum.data(), output.data());
+		for (uint32_t i = 0; i < input.size(); ++i)
+		{
+		  std::wostringstream msg;
+		  msg << "Mismatch at element " << i << " of " << size.first << 'x' << size.second << " transform";
+		  Assert::AreEqual(input[i], output[i], 1e-12, msg.str().c_str());
+		}
+	  }
+	}
+  };
+}
@@ -0,0 +1,322 @@
+#include "stdafx.h"
+#include "CppUnitTest.h"
+#include "ConvolutionalLayer.h"
+#include "CostFunction.h"
+#include "FeedForwardNetwork.h"
+#include "ImageSet.h"
+
+using namespace Microsoft::VisualStudio::CppUnitTestFramework;
+
+namespace FishNetTests
+{
+  TEST_CLASS(FeedForwardNetworkTests)
+  {
+  public:
+	TEST_METHOD(OverlappedUpdatesMatchSynchronous)
+	{
+	  const uint32_t threadCount = 3;
+	  const uint32_t exampleCount = 12;
+	  ImageSet imageSet("overlapped", { "a", "b", "c", "d" }, 3, 8, 8);
+	  AddImages(imageSet, exampleCount, 11, false);
+
+	  auto synchronous = MakeNetwork(threadCount, 1.0);
+	  auto overlapped = CopyNetwork(*synchronous, threadCount, FeedForwardNetwork::WeightUpdateModes::Overlapped);
+
+	  // One minibatch, split between the three trainers.
+	  double synchronousCost = synchronous->TrainForOneEpoch(imageSet, imageSet.TrainingSet(), exampleCount);
+	  double overlappedCost = overlapped->TrainForOneEpoch(imageSet, imageSet.TrainingSet(), exampleCount);
+
+	  Assert::AreEqual(synchronousCost, overlappedCost);
+	  AssertSameParameters(synchronous->Layers(), overlapped->Layers());
+	}
+
+	TEST_METHOD(OneStepStaleMatchesHandSteppedUpdates)
+	{
+	  const uint32_t threadCount = 2;
+	  const uint32_t miniBatchSize = 3;
+	  ImageSet imageSet("stale", { "a", "b", "c", "d" }, 3, 8, 8);
+	  // The last minibatch is a partial one.
+	  AddImages(imageSet, 11, 13, false);
+	  const std::vector<Image*>& examples = imageSet.TrainingSet();
+
+	  auto reference = MakeNetwork(threadCount, 1.0);
+	  auto stale = CopyNetwork(*reference, threadCount, FeedForwardNetwork::WeightUpdateModes::OneStepStale);
+	  stale->TrainForOneEpoch(imageSet, examples, miniBatchSize);
+
+	  // There is no update before the first minibatch, so its errors are applied just as they are synchronously. After
+	  // that, each minibatch's errors are found with the weights from before the previous minibatch's errors were applied.
+	  FeedForwardNetwork::LayerVector previous = CloneLayers(reference->Layers());
+	  std::vector<Image*> firstMiniBatch(examples.cbegin(), examples.cbegin() + miniBatchSize);
+	  reference->TrainForOneEpoch(imageSet, firstMiniBatch, miniBatchSize);
+	  for (uint32_t first = miniBatchSize; first < examples.size(); first += miniBatchSize)
+	  {
+		uint32_t count = std::min(miniBatchSize, static_cast<uint32_t>(examples.size()) - first);
+		uint32_t trainerCount = std::min(count, threadCount);
+		std::vector<std::unique_ptr<FeedForwardTrainer>> trainers;
+		for (uint32_t t = 0; t < trainerCount; ++t)
+		{
+		  uint32_t begin = (count * t) / trainerCount;
+		  uint32_t end = (count * (t + 1)) / trainerCount;
+		  trainers.emplace_back(std::make_unique<FeedForwardTrainer>(*reference, previous));
+		  trainers.back()->TrainOnMiniBatch(examples.cbegin() + first + begin, end - begin);
+		}
+		FeedForwardNetwork::LayerVector current = CloneLayers(reference->Layers());
+		for (size_t li = 0; li < reference->Layers().size(); ++li)
+		{
+		  auto wl = dynamic_cast<WeightedLayer*>(reference->Layers()[li].get());
+		  if (!wl)
+			continue;
+		  std::vector<const Tensor*> nablaW;
+		  std::vector<const Tensor*> nablaB;
+		  for (const auto& trainer : trainers)
+		  {
+			nablaW.push_back(trainer->NablaW()[li].get());
+			nablaB.push_back(trainer->NablaB()[li].get());
+		  }
+		  wl->UpdateParameters(nablaW, nablaB, 0.1 / count, 1.0 - 0.01 * 0.1, 0, wl->ParameterCount());
+		  wl->RefreshWeightCache();
+		}
+		trainers.clear();
+		previous = std::move(current);
+	  }
+
+	  AssertSameParameters(reference->Layers(), stale->Layers());
+	}
+
+	TEST_METHOD(LocalSgdWithOneTrainerMatchesSynchronous)
+	{
+	  ImageSet imageSet("local", { "a", "b", "c", "d" }, 3, 8, 8);
+	  AddImages(imageSet, 11, 19, false);
+	  auto synchronous = MakeNetwork(1, 1.0);
+	  auto local = CopyNetwork(*synchronous, 1, FeedForwardNetwork::WeightUpdateModes::LocalSgd);
+	  // The epoch ends with the second of three minibatches between averages.
+	  local->AveragingInterval(3);
+
+	  double synchronousCost = synchronous->TrainForOneEpoch(imageSet, imageSet.TrainingSet(), 3);
+	  double localCost = local->TrainForOneEpoch(imageSet, imageSet.TrainingSet(), 3);
+
+	  Assert::AreEqual(synchronousCost, localCost);
+	  AssertSameParameters(synchronous->Layers(), local->Layers());
+	}
+
+	TEST_METHOD(LocalSgdAveragesReplicasAtEndOfEpoch)
+	{
+	  const uint32_t threadCount = 3;
+	  const uint32_t miniBatchSize = 2;
+	  const uint32_t averagingInterval = 2;
+	  ImageSet imageSet("local", { "a", "b", "c", "d" }, 3, 8, 8);
+	  // Shards of 6, 7 and 7 examples, so that every trainer stops partway through its second interval.
+	  AddImages(imageSet, 20, 23, false);
+	  const std::vector<Image*>& examples = imageSet.TrainingSet();
+	  auto network = MakeNetwork(threadCount, 1.0);
+	  network->WeightUpdateMode(FeedForwardNetwork::WeightUpdateModes::LocalSgd);
+	  network->AveragingInterval(averagingInterval);
+	  FeedForwardNetwork::LayerVector averaged = CloneLayers(network->Layers());
+	  network->TrainForOneEpoch(imageSet, examples, miniBatchSize);
+
+	  // The network lets its replicas go at the end of the epoch, so train replicas of the same layers by hand and check
+	  // that the network's layers hold their average, as every replica does once it has been averaged.
+	  std::vector<FeedForwardNetwork::LayerVector> replicas(threadCount);
+	  std::vector<std::unique_ptr<FeedForwardTrainer>> trainers;
+	  for (uint32_t t = 0; t < threadCount; ++t)
+	  {
+		replicas[t] = CloneLayers(averaged);
+		trainers.emplace_back(std::make_unique<FeedForwardTrainer>(*network, replicas[t]));
+	  }
+	  for (uint32_t round = 0; round < 2; ++round)
+	  {
+		for (uint32_t t = 0; t < threadCount; ++t)
+		{
+		  for (auto& layer : replicas[t])
+		  {
+			auto wl = dynamic_cast<WeightedLayer*>(layer.get());
+			if (wl)
+			  wl->RefreshWeightCache();
+		  }
+		  uint32_t shardEnd = static_cast<uint32_t>((examples.size() * (t + 1)) / threadCount);
+		  uint32_t first = static_cast<uint32_t>((examples.size() * t) / threadCount) +
+			round * miniBatchSize * averagingInterval;
+		  uint32_t end = std::min(shardEnd, first + miniBatchSize * averagingInterval);
+		  for (; first < end; first += miniBatchSize)
+		  {
+			uint32_t count = std::min(miniBatchSize, end - first);
+			trainers[t]->TrainOnMiniBatch(examples.cbegin() + first, count);
+			trainers[t]->UpdateWeights(0.1 / count, 1.0 - 0.01 * 0.1);
+		  }
+		}
+		for (size_t li = 0; li < averaged.size(); ++li)
+		{
+		  auto wl = dynamic_cast<WeightedLayer*>(averaged[li].get());
+		  if (!wl)
+			continue;
+		  std::vector<WeightedLayer*> replicaLayers;
+		  for (auto& replica : replicas)
+			replicaLayers.push_back(static_cast<WeightedLayer*>(replica[li].get()));
+		  wl->AverageParameters(replicaLayers, 0, wl->ParameterCount());
+		}
+	  }
+
+	  AssertSameParameters(averaged, network->Layers());
+	  for (const auto& replica : replicas)
+		AssertSameParameters(replica, network->Layers());
+	}
+
+	TEST_METHOD(HogwildWithOneTrainerMatchesSynchronous)
+	{
+	  ImageSet imageSet("hogwild", { "a", "b", "c", "d" }, 3, 8, 8);
+	  AddImages(imageSet, 11, 29, false);
+	  auto synchronous = MakeNetwork(1, 1.0);
+	  auto hogwild = CopyNetwork(*synchronous, 1, FeedForwardNetwork::WeightUpdateModes::Hogwild);
+
+	  double synchronousCost = synchronous->TrainForOneEpoch(imageSet, imageSet.TrainingSet(), 3);
+	  double hogwildCost = hogwild->TrainForOneEpoch(imageSet, imageSet.TrainingSet(), 3);
+
+	  Assert::AreEqual(synchronousCost, hogwildCost);
+	  AssertSameParameters(synchronous->Layers(), hogwild->Layers());
+	}
+
+	TEST_METHOD(HogwildWithSeveralTrainersKeepsWeightsFinite)
+	{
+	  ImageSet imageSet("hogwild", { "a", "b", "c", "d" }, 3, 8, 8);
+	  AddImages(imageSet, 32, 31, false);
+	  auto network = MakeNetwork(4, 1.0);
+	  network->WeightUpdateMode(FeedForwardNetwork::WeightUpdateModes::Hogwild);
+	  FeedForwardNetwork::LayerVector initial = CloneLayers(network->Layers());
+
+	  double cost = network->TrainForOneEpoch(imageSet, imageSet.TrainingSet(), 2);
+
+	  Assert::IsTrue(std::isfinite(cost));
+	  bool changed = false;
+	  for (size_t li = 0; li < initial.size(); ++li)
+	  {
+		auto before = dynamic_cast<const WeightedLayer*>(initial[li].get());
+		if (!before)
+		  continue;
+		auto after = static_cast<const WeightedLayer*>(network->Layers()[li].get());
+		for (uint32_t i = 0; i < after->Weights().Size(); ++i)
+		{
+		  Assert::IsTrue(std::isfinite(after->Weights().Get(i)));
+		  changed = changed || after->Weights().Get(i) != before->Weights().Get(i);
+		}
+		for (uint32_t i = 0; i < after->Biases().Size(); ++i)
+		  Assert::IsTrue(std::isfinite(after->Biases().Get(i)));
+	  }
+	  Assert::IsTrue(changed);
+	}
+
+	TEST_METHOD(HogwildLeavesWeightCachesUpToDate)
+	{
+	  ImageSet imageSet("hogwild", { "a", "b", "c", "d" }, 3, 8, 8);
+	  AddImages(imageSet, 24, 37, false);
+	  const Tensor& input = imageSet.TrainingSet().front()->Inputs();
+	  // Each of these algorithms feeds forward with data derived from the weights, which the trainers rebuild as they go.
+	  for (auto algorithm : { ConvolutionalLayer::Algorithms::WinogradF2x2, ConvolutionalLayer::Algorithms::WinogradF4x4,
+		ConvolutionalLayer::Algorithms::Fft })
+	  {
+		auto network = MakeNetwork(3, 1.0);
+		auto& layer = static_cast<ConvolutionalLayer&>(*network->Layers().front());
+		layer.Algorithm(algorithm);
+		network->WeightUpdateMode(FeedForwardNetwork::WeightUpdateModes::Hogwild);
+		network->TrainForOneEpoch(imageSet, imageSet.TrainingSet(), 2);
+
+		// Gemm works from the weights themselves.
+		auto gemm = std::unique_ptr<ConvolutionalLayer>(static_cast<ConvolutionalLayer*>(layer.Clone().release()));
+		gemm->Algorithm(ConvolutionalLayer::Algorithms::Gemm);
+		Tensor expected(layer.OutputPlanes(), layer.OutputRows(), layer.OutputColumns());
+		Tensor actual(layer.OutputPlanes(), layer.OutputRows(), layer.OutputColumns());
+		gemm->FeedForward(input, expected, nullptr);
+		layer.FeedForward(input, actual, nullptr);
+		for (uint32_t i = 0; i < expected.Size(); ++i)
+		  Assert::AreEqual(expected.Get(i), actual.Get(i), 1e-9);
+	  }
+	}
+
+	TEST_METHOD(ChannelBlockedClassifyKeepsTrainingWeights)
+	{
+	  ImageSet imageSet("classify", { "a", "b", "c", "d" }, 3, 8, 8);
+	  AddImages(imageSet, 8, 17, true);
+	  // Dropout on the first fully connected layer makes the second scale its weights for testing.
+	  auto network = MakeNetwork(2, 0.5);
+	  auto last = static_cast<const WeightedLayer*>(network->Layers().back().get());
+	  std::vector<Real> trainingWeights(last->Weights().Elements(), last->Weights().Elements() + last->Weights().Size());
+
+	  std::vector<uint32_t> planar = network->Classify(imageSet);
+	  network->ChannelBlocked(true);
+	  std::vector<uint32_t> first = network->Classify(imageSet);
+	  std::vector<uint32_t> second = network->Classify(imageSet);
+
+	  Assert::IsTrue(planar == first);
+	  Assert::IsTrue(first == second);
+	  for (uint32_t i = 0; i < last->Weights().Size(); ++i)
+		Assert::AreEqual(trainingWeights[i], last->Weights().Get(i));
+	}
+
+  private:
+	// Adds images of random pixels, whose categories are taken in turn.
+	static void AddImages(ImageSet& imageSet, uint32_t count, uint32_t seed, bool isTest)
+	{
+	  std::default_random_engine generator(seed);
+	  std::uniform_real_distribution<double> pixel(0.0, 1.0);
+	  uint32_t size = imageSet.Channels() * imageSet.Height() * imageSet.Width();
+	  for (uint32_t i = 0; i < count; ++i)
+	  {
+		auto data = std::make_unique<Real[]>(size);
+		for (uint32_t j = 0; j < size; ++j)
+		  data[j] = static_cast<Real>(pixel(generator));
+		imageSet.AddImage(*new Image(std::move(data), imageSet.Channels(), imageSet.Width(), imageSet.Height(),
+		  i % static_cast<uint32_t>(imageSet.Categories().size())), isTest);
+	  }
+	}
+
+	// A network of each kind of layer for 3x8x8 images in four categories, with its weights initialized. The
+	// probability of keeping each output of the first fully connected layer is keepProbability.
+	static std::unique_ptr<FeedForwardNetwork> MakeNetwork(uint32_t threadCount, double keepProbability)
+	{
+	  auto network = std::make_unique<FeedForwardNetwork>("test", 3, 8, 8, std::make_unique<CrossEntropyCostFunction>(),
+		threadCount, 0, 0.1, 0.01);
+	  network->AddConvolutionalLayer(4, 3, 1, 1, std::make_unique<ReLU>());
+	  network->AddMaxPoolingLayer();
+	  network->AddFullyConnectedLayer(20, std::make_unique<ReLU>(), keepProbability);
+	  network->AddFullyConnectedLayer(4, std::make_unique<Sigmoid>(), 1.0);
+	  for (auto& layer : network->Layers())
+		layer->InitializeWeights();
+	  return network;
+	}
+
+	// The same layers, with copies of the same weights.
+	static std::unique_ptr<FeedForwardNetwork> CopyNetwork(const FeedForwardNetwork& network, uint32_t threadCount,
+	  FeedForwardNetwork::WeightUpdateModes weightUpdateMode)
+	{
+	  auto copy = std::make_unique<FeedForwardNetwork>("copy", 3, 8, 8, std::make_unique<CrossEntropyCostFunction>(),
+		threadCount, 0, 0.1, 0.01);
+	  for (const auto& layer : network.Layers())
+		copy->AddLayer(layer->Clone());
+	  copy->WeightUpdateMode(weightUpdateMode);
+	  return copy;
+	}
+
+	static FeedForwardNetwork::LayerVector CloneLayers(const FeedForwardNetwork::LayerVector& layers)
+	{
+	  FeedForwardNetwork::LayerVector clones;
+	  for (const auto& layer : layers)
+		clones.emplace_back(layer->Clone());
+	  return clones;
+	}
+
+	static void AssertSameParameters(const FeedForwardNetwork::LayerVector& expected,
+	  const FeedForwardNetwork::LayerVector& actual)
+	{
+	  for (size_t li = 0; li < expected.size(); ++li)
+	  {
+		auto expectedLayer = dynamic_cast<const WeightedLayer*>(expected[li].get());
+		if (!expectedLayer)
+		  continue;
+		auto actualLayer = static_cast<const WeightedLayer*>(actual[li].get());
+		for (uint32_t i = 0; i < expectedLayer->Weights().Size(); ++i)
+		  Assert::AreEqual(expectedLayer->Weights().Get(i), actualLayer->Weights().Get(i));
+		for (uint32_t i = 0; i < expectedLayer->Biases().Size(); ++i)
+		  Assert::AreEqual(expectedLayer->Biases().Get(i), actualLayer->Biases().Get(i));
+	  }
+	}
+  };
+}
@@ -301,5 +301,165 @@ namespace FullyConnectedLayerTests
 		Assert::AreEqual(expectedBiases[i], layer.Biases().Get(i), 1e-5);
 	  }
 	}
+
+	TEST_METHOD(FullyConnectedLayerUpdateParametersInShares)
+	{
+	  const uint32_t inputSize = 4;
+	  const uint32_t layerSize = 3;
+	  Tensor weights(layerSize, inputSize);
+	  Tensor biases(layerSize);
+	  std::vector<Tensor> nablaW(3, Tensor(layerSize, inputSize));
+	  std::vector<Tensor> nablaB(3, Tensor(layerSize));
+	  Randomizer randomizer(1.0);
+	  randomizer.Fill(weights);
+	  randomizer.Fill(biases);
+	  for (uint32_t t = 0; t < 3; ++t)
+	  {
+		randomizer.Fill(nablaW[t]);
+		randomizer.Fill(nablaB[t]);
+	  }
+	  double scalar = 0.1;
+	  double decay = 0.9;
+
+	  // The same update, one trainer at a time.
+	  FullyConnectedLayer expected(std::make_unique<Tensor>(weights), std::make_unique<Tensor>(biases), nullptr);
+	  expected.DecayWeights(decay);
+	  for (uint32_t t = 0; t < 3; ++t)
+		expected.UpdateWeightsAndBiases(nablaW[t], nablaB[t], scalar);
+
+	  // In shares that split the weights, and the weights from the biases.
+	  FullyConnectedLayer layer(std::make_unique<Tensor>(weights), std::make_unique<Tensor>(biases), nullptr);
+	  Assert::AreEqual<size_t>(15, layer.ParameterCount());
+	  std::vector<const Tensor*> nw { &nablaW[0], &nablaW[1], &nablaW[2] };
+	  std::vector<const Tensor*> nb { &nablaB[0], &nablaB[1], &nablaB[2] };
+	  layer.UpdateParameters(nw, nb, scalar, decay, 0, 5);
+	  layer.UpdateParameters(nw, nb, scalar, decay, 5, 13);
+	  layer.UpdateParameters(nw, nb, scalar, decay, 13, 15);
+
+	  for (uint32_t i = 0; i < layerSize * inputSize; ++i)
+		Assert::AreEqual(expected.Weights().Get(i), layer.Weights().Get(i), 1e-5);
+	  for (uint32_t i = 0; i < layerSize; ++i)
+		Assert::AreEqual(expected.Biases().Get(i), layer.Biases().Get(i), 1e-5);
+	}
+
+	TEST_METHOD(FullyConnectedLayerAverageParametersOfClones)
+	{
+	  const uint32_t inputSize = 4;
+	  const uint32_t layerSize = 3;
+	  Tensor weights(layerSize, inputSize);
+	  Tensor biases(layerSize);
+	  std::vector<Tensor> nablaW(2, Tensor(layerSize, inputSize));
+	  std::vector<Tensor> nablaB(2, Tensor(layerSize));
+	  Randomizer randomizer(1.0);
+	  randomizer.Fill(weights);
+	  randomizer.Fill(biases);
+	  FullyConnectedLayer layer(std::make_unique<Tensor>(weights), std::make_unique<Tensor>(biases), std::make_unique<ReLU>());
+
+	  // Train each clone on its own errors. The layer itself mustn't change.
+	  std::vector<std::unique_ptr<Layer>> clones;
+	  std::vector<WeightedLayer*> replicas;
+	  for (uint32_t r = 0; r < 2; ++r)
+	  {
+		randomizer.Fill(nablaW[r]);
+		randomizer.Fill(nablaB[r]);
+		clones.emplace_back(layer.Clone());
+		replicas.push_back(static_cast<WeightedLayer*>(clones.back().get()));
+		Assert::IsTrue(replicas.back()->ActivationFunction()->Type() == ActivationFunction::Types::ReLU);
+		replicas.back()->UpdateParameters({ &nablaW[r] }, { &nablaB[r] }, 1.0, 1.0, 0, layer.ParameterCount());
+	  }
+	  for (uint32_t i = 0; i < layerSize * inputSize; ++i)
+		Assert::AreEqual(weights.Get(i), layer.Weights().Get(i));
+
+	  // In shares that split the weights, and the weights from the biases.
+	  layer.AverageParameters(replicas, 0, 5);
+	  layer.AverageParameters(replicas, 5, 13);
+	  layer.AverageParameters(replicas, 13, 15);
+
+	  for (uint32_t i = 0; i < layerSize * inputSize; ++i)
+	  {
+		double expected = weights.Get(i) - (nablaW[0].Get(i) + nablaW[1].Get(i)) / 2.0;
+		Assert::AreEqual(expected, layer.Weights().Get(i), 1e-5);
+		for (WeightedLayer* replica : replicas)
+		  Assert::AreEqual(layer.Weights().Get(i), replica->Weights().Get(i));
+	  }
+	  for (uint32_t i = 0; i < layerSize; ++i)
+	  {
+		double expected = biases.Get(i) - (nablaB[0].Get(i) + nablaB[1].Get(i)) / 2.0;
+		Assert::AreEqual(expected, layer.Biases().Get(i), 1e-5);
+		for (WeightedLayer* replica : replicas)
+		  Assert::AreEqual(layer.Biases().Get(i), replica->Biases().Get(i));
+	  }
+	}
+
+	TEST_METHOD(FullyConnectedLayerCopyParametersInShares)
+	{
+	  const uint32_t inputSize = 4;
+	  const uint32_t layerSize = 3;
+	  Tensor weights(layerSize, inputSize);
+	  Tensor biases(layerSize);
+	  Randomizer randomizer(1.0);
+	  randomizer.Fill(weights);
+	  randomizer.Fill(biases);
+	  FullyConnectedLayer source(std::make_unique<Tensor>(weights), std::make_unique<Tensor>(biases), nullptr);
+	  FullyConnectedLayer layer(std::make_unique<Tensor>(layerSize, inputSize), std::make_unique<Tensor>(layerSize), nullptr);
+
+	  // Only the first two shares are copied, so the last bias is left alone.
+	  layer.CopyParameters(source, 0, 5);
+	  layer.CopyParameters(source, 5, 14);
+
+	  for (uint32_t i = 0; i < layerSize * inputSize; ++i)
+		Assert::AreEqual(weights.Get(i), layer.Weights().Get(i));
+	  Assert::AreEqual(biases.Get(0), layer.Biases().Get(0));
+	  Assert::AreEqual(biases.Get(1), layer.Biases().Get(1));
+	  Assert::AreEqual(Real(0.0), layer.Biases().Get(2));
+	}
+
+	TEST_METHOD(FullyConnectedLayerBatchMatchesSingleExamples)
+	{
+	  const uint32_t batchSize = 5;
+	  const uint32_t inputSize = 7;
+	  const uint32_t layerSize = 3;
+	  FullyConnectedLayer layer(inputSize, layerSize, nullptr, 0.5);
+	  layer.InitializeWeights();
+	  Tensor inputs(batchSize, 1, 1, inputSize);
+	  Randomizer(1.0).Fill(inputs);
+	  Tensor delta(batchSize, 1, 1, layerSize);
+	  Randomizer(1.0).Fill(delta);
+	  DropoutMask batchMask({ true, false, true, true, true, true, false, false, true,
+		false, true, true, true, true, false });
+
+	  Tensor outputs(batchSize, 1, 1, layerSize);
+	  layer.FeedForwardBatch(inputs, outputs, &batchMask);
+	  Tensor errors(batchSize, 1, 1, inputSize);
+	  layer.BackpropagateErrorBatch(delta, errors, &batchMask);
+	  Tensor nablaW(layerSize, inputSize);
+	  Tensor nablaB(layerSize);
+	  layer.UpdateWeightAndBiasErrorsBatch(delta, inputs, nablaW, nablaB, &batchMask);
+
+	  Tensor expectedNablaW(layerSize, inputSize);
+	  Tensor expectedNablaB(layerSize);
+	  for (uint32_t example = 0; example < batchSize; ++example)
+	  {
+		DropoutMask mask({ batchMask.Get(example * layerSize), batchMask.Get((example * layerSize) + 1),
+		  batchMask.Get((example * layerSize) + 2) });
+		Tensor input(1, 1, inputSize);
+		input = inputs.HyperplaneView(example);
+		Tensor output(layerSize);
+		layer.FeedForward(input, output, &mask);
+		for (uint32_t i = 0; i < layerSize; ++i)
+		  Assert::AreEqual(output.Get(i), outputs.Get((example * layerSize) + i), 1e-12);
+		Tensor exampleDelta(1, 1, layerSize);
+		exampleDelta = delta.HyperplaneView(example);
+		Tensor error(inputSize);
+		layer.BackpropagateError(exampleDelta, error, &mask);
+		for (uint32_t i = 0; i < inputSize; ++i)
+		  Assert::AreEqual(error.Get(i), errors.Get((example * inputSize) + i), 1e-12);
+		layer.UpdateWeightAndBiasErrors(exampleDelta, input, expectedNablaW, expectedNablaB, &mask);
+	  }
+	  for (uint32_t i = 0; i < nablaW.Size(); ++i)
+		Assert::AreEqual(expectedNablaW.Get(i), nablaW.Get(i), 1e-12);
+	  for (uint32_t i = 0; i < nablaB.Size(); ++i)
+		Assert::AreEqual(expectedNablaB.Get(i), nablaB.Get(i), 1e-12);
+	}
   };
 }
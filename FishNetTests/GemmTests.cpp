@@ -0,0 +1,136 @@
+#include "stdafx.h"
+#include "CppUnitTest.h"
+#include "Gemm.h"
+#include "Layer.h"
+
+using namespace Microsoft::VisualStudio::CppUnitTestFramework;
+
+namespace FishNetTests
+{
+  TEST_CLASS(GemmTests)
+  {
+  public:
+	// The sizes are chosen so that there are partial tiles on both edges and more than one block of depth, and the
+	// leading dimensions are wider than the matrices so that the strides are checked too.
+	TEST_METHOD(MultiplyMatricesMatchesNaiveProduct)
+	{
+	  const uint32_t m = 13;
+	  const uint32_t n = 37;
+	  const uint32_t k = 300;
+	  const size_t padding = 3;
+	  for (int transposeA = 0; transposeA < 2; ++transposeA)
+	  {
+		for (int transposeB = 0; transposeB < 2; ++transposeB)
+		{
+		  size_t lda = (transposeA ? m : k) + padding;
+		  size_t ldb = (transposeB ? k : n) + padding;
+		  size_t ldc = n + padding;
+		  Tensor a(1, transposeA ? k : m, static_cast<uint32_t>(lda));
+		  Tensor b(1, transposeB ? n : k, static_cast<uint32_t>(ldb));
+		  Tensor c(1, m, static_cast<uint32_t>(ldc));
+		  Randomizer(1.0).Fill(a);
+		  Randomizer(1.0).Fill(b);
+		  Randomizer(1.0).Fill(c);
+		  Tensor expected(c);
+		  for (uint32_t i = 0; i < m; ++i)
+		  {
+			for (uint32_t j = 0; j < n; ++j)
+			{
+			  double sum = expected.Get(i, j);
+			  for (uint32_t p = 0; p < k; ++p)
+				sum += (transposeA ? a.Get(p, i) : a.Get(i, p)) * (transposeB ? b.Get(j, p) : b.Get(p, j));
+			  expected.Set(i, j, sum);
+			}
+		  }
+		  MultiplyMatrices(transposeA != 0, transposeB != 0, m, n, k, a.Elements(), lda, b.Elements(), ldb, c.Elements(), ldc);
+		  for (size_t i = 0; i < c.Size(); ++i)
+			Assert::AreEqual(expected.Elements()[i], c.Elements()[i], 1e-9);
+		}
+	  }
+	}
+
+	TEST_METHOD(MultiplyMatrixByVectorMatchesNaiveProduct)
+	{
+	  const uint32_t m = 11;
+	  const uint32_t n = 23;
+	  const size_t lda = n + 2;
+	  Tensor a(1, m, static_cast<uint32_t>(lda));
+	  Tensor x(1, 1, n);
+	  Tensor y(1, 1, m);
+	  Randomizer(1.0).Fill(a);
+	  Randomizer(1.0).Fill(x);
+	  Randomizer(1.0).Fill(y);
+	  Tensor expected(y);
+	  for (uint32_t i = 0; i < m; ++i)
+	  {
+		double sum = expected.Get(i);
+		for (uint32_t j = 0; j < n; ++j)
+		  sum += a.Get(i, j) * x.Get(j);
+		expected.Set(i, sum);
+	  }
+	  MultiplyMatrixByVector(false, m, n, a.Elements(), lda, x.Elements(), y.Elements());
+	  for (uint32_t i = 0; i < m; ++i)
+		Assert::AreEqual(expected.Get(i), y.Get(i), 1e-9);
+	}
+
+	TEST_METHOD(MultiplyTransposedMatrixByVectorMatchesNaiveProduct)
+	{
+	  const uint32_t m = 10;
+	  const uint32_t n = 29;
+	  const size_t lda = n + 1;
+	  Tensor a(1, m, static_cast<uint32_t>(lda));
+	  Tensor x(1, 1, m);
+	  Tensor y(1, 1, n);
+	  Randomizer(1.0).Fill(a);
+	  Randomizer(1.0).Fill(x);
+	  Randomizer(1.0).Fill(y);
+	  Tensor expected(y);
+	  for (uint32_t j = 0; j < n; ++j)
+	  {
+		double sum = expected.Get(j);
+		for (uint32_t i = 0; i < m; ++i)
+		  sum += a.Get(i, j) * x.Get(i);
+		expected.Set(j, sum);
+	  }
+	  MultiplyMatrixByVector(true, m, n, a.Elements(), lda, x.Elements(), y.Elements());
+	  for (uint32_t j = 0; j < n; ++j)
+		Assert::AreEqual(expected.Get(j), y.Get(j), 1e-9);
+	}
+
+	TEST_METHOD(ExternalBlasMatchesBuiltInKernels)
+	{
+	  if (!ExternalBlasAvailable())
+	  {
+		bool caught = false;
+		try
+		{
+		  UseExternalBlas(true);
+		}
+		catch (const std::exception& e)
+		{
+		  Assert::AreEqual<std::string>("FishNet was not built with an external BLAS library.", e.what());
+		  caught = true;
+		}
+		Assert::IsTrue(caught);
+		Assert::IsTrue(!UseExternalBlas());
+		return;
+	  }
+	  const uint32_t m = 21;
+	  const uint32_t n = 19;
+	  const uint32_t k = 40;
+	  Tensor a(1, k, m);
+	  Tensor b(1, n, k);
+	  Tensor builtIn(1, m, n);
+	  Randomizer(1.0).Fill(a);
+	  Randomizer(1.0).Fill(b);
+	  Randomizer(1.0).Fill(builtIn);
+	  Tensor external(builtIn);
+	  UseExternalBlas(false);
+	  MultiplyMatrices(true, true, m, n, k, a.Elements(), m, b.Elements(), k, builtIn.Elements(), n);
+	  UseExternalBlas(true);
+	  MultiplyMatrices(true, true, m, n, k, a.Elements(), m, b.Elements(), k, external.Elements(), n);
+	  for (size_t i = 0; i < builtIn.Size(); ++i)
+		Assert::AreEqual(builtIn.Elements()[i], external.Elements()[i], 1e-9);
+	}
+  };
+}
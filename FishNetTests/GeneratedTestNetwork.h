@@ -0,0 +1,268 @@
+// Generated by FishNet from the network generated test, trained for 0 epochs.
+#include <cmath>
+#include <cstddef>
+#include <cstring>
+
+namespace GeneratedTestNetwork
+{
+
+typedef double Real;
+
+constexpr unsigned InputChannels = 2;
+constexpr unsigned InputRows = 8;
+constexpr unsigned InputColumns = 8;
+constexpr unsigned OutputSize = 5;
+
+namespace
+{
+
+struct NoActivation
+{
+  static Real Apply(Real x, Real) { return x; }
+};
+
+struct ReLUActivation
+{
+  static Real Apply(Real x, Real) { return x < 0.0 ? Real(0.0) : x; }
+};
+
+struct LeakyReLUActivation
+{
+  static Real Apply(Real x, Real leakiness) { return x < 0.0 ? x * leakiness : x; }
+};
+
+struct SigmoidActivation
+{
+  static Real Apply(Real x, Real) { return Real(1.0 / (1.0 + std::exp(-x))); }
+};
+
+struct TanHActivation
+{
+  static Real Apply(Real x, Real) { return Real(2.0 / (1.0 + std::exp(-2.0 * x)) - 1.0); }
+};
+
+// Works out FB filters at XB neighbouring positions of one output row, starting at filter f and column ox. The
+// tile is added up in local sums, which the compiler can keep in registers while it goes through every weight.
+template <unsigned C, unsigned PH, unsigned PW, unsigned K, unsigned S, unsigned OW, unsigned FB, unsigned XB,
+  class Activation>
+inline void ConvolutionTile(const Real* weights, const Real* biases, const Real* in, Real* output, unsigned f,
+  unsigned oy, unsigned ox, unsigned planeSize, Real parameter)
+{
+  Real sums[FB][XB];
+  for (unsigned fb = 0; fb < FB; ++fb)
+    for (unsigned xb = 0; xb < XB; ++xb)
+      sums[fb][xb] = biases[f + fb];
+  for (unsigned c = 0; c < C; ++c)
+  {
+    for (unsigned ky = 0; ky < K; ++ky)
+    {
+      const Real* row = in + (size_t(c * PH + oy * S + ky) * PW) + (ox * S);
+      const Real* w = weights + (size_t(f * C + c) * K + ky) * K;
+      for (unsigned kx = 0; kx < K; ++kx)
+        for (unsigned fb = 0; fb < FB; ++fb)
+          for (unsigned xb = 0; xb < XB; ++xb)
+            sums[fb][xb] += w[(size_t(fb) * C * K * K) + kx] * row[xb * S + kx];
+    }
+  }
+  for (unsigned fb = 0; fb < FB; ++fb)
+    for (unsigned xb = 0; xb < XB; ++xb)
+      output[((f + fb) * planeSize) + (oy * OW) + ox + xb] = Activation::Apply(sums[fb][xb], parameter);
+}
+
+// The input has C planes of H by W, and the weights are in filter, input channel, row, column order. The output is
+// worked out in tiles of 8 filters by 8 columns, with smaller tiles at the edges.
+template <unsigned C, unsigned H, unsigned W, unsigned F, unsigned K, unsigned S, unsigned P, class Activation>
+inline void Convolution(const Real* weights, const Real* biases, const Real* input, Real* output, Real* padded,
+  Real parameter)
+{
+  constexpr unsigned PH = H + 2 * P;
+  constexpr unsigned PW = W + 2 * P;
+  constexpr unsigned OH = (PH - K) / S + 1;
+  constexpr unsigned OW = (PW - K) / S + 1;
+  constexpr unsigned FB = F < 8 ? F : 8;
+  constexpr unsigned XB = OW < 8 ? OW : 8;
+  constexpr unsigned FT = F % FB == 0 ? FB : F % FB;
+  constexpr unsigned XT = OW % XB == 0 ? XB : OW % XB;
+  const Real* in = input;
+  if (P > 0)
+  {
+    std::memset(padded, 0, sizeof(Real) * C * PH * PW);
+    for (unsigned c = 0; c < C; ++c)
+      for (unsigned y = 0; y < H; ++y)
+        std::memcpy(padded + (size_t(c * PH + y + P) * PW) + P, input + (size_t(c * H + y) * W), sizeof(Real) * W);
+    in = padded;
+  }
+  for (unsigned f = 0; f < F; f += FB)
+  {
+    for (unsigned oy = 0; oy < OH; ++oy)
+    {
+      unsigned ox = 0;
+      for (; ox + XB <= OW; ox += XB)
+      {
+        if (f + FB <= F)
+          ConvolutionTile<C, PH, PW, K, S, OW, FB, XB, Activation>(weights, biases, in, output, f, oy, ox, OH * OW, parameter);
+        else
+          ConvolutionTile<C, PH, PW, K, S, OW, FT, XB, Activation>(weights, biases, in, output, f, oy, ox, OH * OW, parameter);
+      }
+      if (ox < OW)
+      {
+        if (f + FB <= F)
+          ConvolutionTile<C, PH, PW, K, S, OW, FB, XT, Activation>(weights, biases, in, output, f, oy, ox, OH * OW, parameter);
+        else
+          ConvolutionTile<C, PH, PW, K, S, OW, FT, XT, Activation>(weights, biases, in, output, f, oy, ox, OH * OW, parameter);
+      }
+    }
+  }
+}
+
+template <unsigned C, unsigned H, unsigned W>
+inline void MaxPooling(const Real* input, Real* output)
+{
+  for (unsigned c = 0; c < C; ++c)
+  {
+    for (unsigned oy = 0; oy < H / 2; ++oy)
+    {
+      const Real* row1 = input + (size_t(c * H + 2 * oy) * W);
+      const Real* row2 = row1 + W;
+      Real* out = output + (size_t(c * (H / 2) + oy) * (W / 2));
+      for (unsigned ox = 0; ox < W / 2; ++ox)
+      {
+        Real m = row1[2 * ox];
+        if (row1[2 * ox + 1] > m)
+          m = row1[2 * ox + 1];
+        if (row2[2 * ox] > m)
+          m = row2[2 * ox];
+        if (row2[2 * ox + 1] > m)
+          m = row2[2 * ox + 1];
+        out[ox] = m;
+      }
+    }
+  }
+}
+
+// The weights have one row of N for each of the M neurons. Each row is added up in 8 separate sums, so the compiler
+// can vectorize it without reordering the additions itself.
+template <unsigned N, unsigned M, class Activation>
+inline void FullyConnected(const Real* weights, const Real* biases, const Real* input, Real* output, Real parameter)
+{
+  for (unsigned o = 0; o < M; ++o)
+  {
+    const Real* row = weights + (size_t(o) * N);
+    Real sums[8] = {};
+    unsigned i = 0;
+    for (; i + 8 <= N; i += 8)
+      for (unsigned l = 0; l < 8; ++l)
+        sums[l] += row[i + l] * input[i + l];
+    Real sum = biases[o];
+    for (; i < N; ++i)
+      sum += row[i] * input[i];
+    for (unsigned l = 0; l < 8; ++l)
+      sum += sums[l];
+    output[o] = Activation::Apply(sum, parameter);
+  }
+}
+
+}
+
+alignas(64) constexpr Real layer0Weights[72] =
+{
+  -0.390625, -0.1015625, 0.1875, -0.3125, -0.0234375, 0.265625, -0.234375, 0.0546875,
+  0.34375, -0.15625, 0.1328125, -0.3671875, -0.078125, 0.2109375, -0.2890625, 0,
+  0.2890625, -0.2109375, 0.078125, 0.3671875, -0.1328125, 0.15625, -0.34375, -0.0546875,
+  0.234375, -0.265625, 0.0234375, 0.3125, -0.1875, 0.1015625, 0.390625, -0.109375,
+  0.1796875, -0.3203125, -0.03125, 0.2578125, -0.2421875, 0.046875, 0.3359375, -0.1640625,
+  0.125, -0.375, -0.0859375, 0.203125, -0.296875, -0.0078125, 0.28125, -0.21875,
+  0.0703125, 0.359375, -0.140625, 0.1484375, -0.3515625, -0.0625, 0.2265625, -0.2734375,
+  0.015625, 0.3046875, -0.1953125, 0.09375, 0.3828125, -0.1171875, 0.171875, -0.328125,
+  -0.0390625, 0.25, -0.25, 0.0390625, 0.328125, -0.171875, 0.1171875, -0.3828125
+};
+
+alignas(64) constexpr Real layer0Biases[4] =
+{
+  -0.3046875, -0.015625, 0.2734375, -0.2265625
+};
+
+alignas(64) constexpr Real layer2Weights[108] =
+{
+  -0.21875, 0.0703125, 0.359375, -0.140625, 0.1484375, -0.3515625, -0.0625, 0.2265625,
+  -0.2734375, 0.015625, 0.3046875, -0.1953125, 0.09375, 0.3828125, -0.1171875, 0.171875,
+  -0.328125, -0.0390625, 0.25, -0.25, 0.0390625, 0.328125, -0.171875, 0.1171875,
+  -0.3828125, -0.09375, 0.1953125, -0.3046875, -0.015625, 0.2734375, -0.2265625, 0.0625,
+  0.3515625, -0.1484375, 0.140625, -0.359375, -0.0703125, 0.21875, -0.28125, 0.0078125,
+  0.296875, -0.203125, 0.0859375, 0.375, -0.125, 0.1640625, -0.3359375, -0.046875,
+  0.2421875, -0.2578125, 0.03125, 0.3203125, -0.1796875, 0.109375, -0.390625, -0.1015625,
+  0.1875, -0.3125, -0.0234375, 0.265625, -0.234375, 0.0546875, 0.34375, -0.15625,
+  0.1328125, -0.3671875, -0.078125, 0.2109375, -0.2890625, 0, 0.2890625, -0.2109375,
+  0.078125, 0.3671875, -0.1328125, 0.15625, -0.34375, -0.0546875, 0.234375, -0.265625,
+  0.0234375, 0.3125, -0.1875, 0.1015625, 0.390625, -0.109375, 0.1796875, -0.3203125,
+  -0.03125, 0.2578125, -0.2421875, 0.046875, 0.3359375, -0.1640625, 0.125, -0.375,
+  -0.0859375, 0.203125, -0.296875, -0.0078125, 0.28125, -0.21875, 0.0703125, 0.359375,
+  -0.140625, 0.1484375, -0.3515625, -0.0625
+};
+
+alignas(64) constexpr Real layer2Biases[3] =
+{
+  -0.1328125, 0.15625, -0.34375
+};
+
+alignas(64) constexpr Real layer3Weights[108] =
+{
+  -0.046875, 0.2421875, -0.2578125, 0.03125, 0.3203125, -0.1796875, 0.109375, -0.390625,
+  -0.1015625, 0.1875, -0.3125, -0.0234375, 0.265625, -0.234375, 0.0546875, 0.34375,
+  -0.15625, 0.1328125, -0.3671875, -0.078125, 0.2109375, -0.2890625, 0, 0.2890625,
+  -0.2109375, 0.078125, 0.3671875, -0.1328125, 0.15625, -0.34375, -0.0546875, 0.234375,
+  -0.265625, 0.0234375, 0.3125, -0.1875, 0.1015625, 0.390625, -0.109375, 0.1796875,
+  -0.3203125, -0.03125, 0.2578125, -0.2421875, 0.046875, 0.3359375, -0.1640625, 0.125,
+  -0.375, -0.0859375, 0.203125, -0.296875, -0.0078125, 0.28125, -0.21875, 0.0703125,
+  0.359375, -0.140625, 0.1484375, -0.3515625, -0.0625, 0.2265625, -0.2734375, 0.015625,
+  0.3046875, -0.1953125, 0.09375, 0.3828125, -0.1171875, 0.171875, -0.328125, -0.0390625,
+  0.25, -0.25, 0.0390625, 0.328125, -0.171875, 0.1171875, -0.3828125, -0.09375,
+  0.1953125, -0.3046875, -0.015625, 0.2734375, -0.2265625, 0.0625, 0.3515625, -0.1484375,
+  0.140625, -0.359375, -0.0703125, 0.21875, -0.28125, 0.0078125, 0.296875, -0.203125,
+  0.0859375, 0.375, -0.125, 0.1640625, -0.3359375, -0.046875, 0.2421875, -0.2578125,
+  0.03125, 0.3203125, -0.1796875, 0.109375
+};
+
+alignas(64) constexpr Real layer3Biases[9] =
+{
+  0.0390625, 0.328125, -0.171875, 0.1171875, -0.3828125, -0.09375, 0.1953125, -0.3046875,
+  -0.015625
+};
+
+alignas(64) constexpr Real layer4Weights[45] =
+{
+  0.0625, -0.1875, -0.04296875, 0.1015625, -0.1484375, -0.00390625, 0.140625, -0.109375,
+  0.03515625, 0.1796875, -0.0703125, 0.07421875, -0.17578125, -0.03125, 0.11328125, -0.13671875,
+  0.0078125, 0.15234375, -0.09765625, 0.046875, 0.19140625, -0.05859375, 0.0859375, -0.1640625,
+  -0.01953125, 0.125, -0.125, 0.01953125, 0.1640625, -0.0859375, 0.05859375, -0.19140625,
+  -0.046875, 0.09765625, -0.15234375, -0.0078125, 0.13671875, -0.11328125, 0.03125, 0.17578125,
+  -0.07421875, 0.0703125, -0.1796875, -0.03515625, 0.109375
+};
+
+alignas(64) constexpr Real layer4Biases[5] =
+{
+  0.2109375, -0.2890625, 0, 0.2890625, -0.2109375
+};
+
+void FeedForward(const Real* input, Real* output)
+{
+  alignas(64) static thread_local Real buffers[3][256];
+  Convolution<2, 8, 8, 4, 3, 1, 1, LeakyReLUActivation>(layer0Weights, layer0Biases, input, buffers[0], buffers[2], 0.125);
+  MaxPooling<4, 8, 8>(buffers[0], buffers[1]);
+  Convolution<4, 4, 4, 3, 3, 2, 1, TanHActivation>(layer2Weights, layer2Biases, buffers[1], buffers[0], buffers[2], 0);
+  FullyConnected<12, 9, ReLUActivation>(layer3Weights, layer3Biases, buffers[0], buffers[1], 0);
+  FullyConnected<9, 5, SigmoidActivation>(layer4Weights, layer4Biases, buffers[1], output, 0);
+}
+
+unsigned Classify(const Real* input)
+{
+  Real output[OutputSize];
+  FeedForward(input, output);
+  unsigned highest = 0;
+  for (unsigned i = 1; i < OutputSize; ++i)
+    if (output[i] > output[highest])
+      highest = i;
+  return highest;
+}
+
+}
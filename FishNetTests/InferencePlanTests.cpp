@@ -0,0 +1,75 @@
+#include "stdafx.h"
+#include "CppUnitTest.h"
+#include "ConvolutionalLayer.h"
+#include "CostFunction.h"
+#include "FeedForwardNetwork.h"
+#include "InferencePlan.h"
+
+using namespace Microsoft::VisualStudio::CppUnitTestFramework;
+
+namespace FishNetTests
+{
+  TEST_CLASS(InferencePlanTests)
+  {
+  public:
+	TEST_METHOD(PlanOutputsMatchLayers)
+	{
+	  // The first convolution has more output positions than the Gemm kernel's column block and the hidden layer has
+	  // more neurons than the fully connected kernel's row block, so the partial blocks are covered.
+	  FeedForwardNetwork network("plan", 3, 14, 14, std::make_unique<CrossEntropyCostFunction>(), 1, 0, 0.1, 0.0);
+	  network.AddConvolutionalLayer(6, 3, 1, 1, std::make_unique<LeakyReLU>(0.1));
+	  network.AddMaxPoolingLayer();
+	  network.AddConvolutionalLayer(5, 3, 1, 1, std::make_unique<TanH>());
+	  network.AddFullyConnectedLayer(70, std::make_unique<ReLU>(), 0.5);
+	  network.AddFullyConnectedLayer(10, std::make_unique<Sigmoid>(), 1.0);
+	  for (auto& layer : network.Layers())
+		layer->InitializeWeights();
+	  std::default_random_engine generator(5);
+	  std::uniform_real_distribution<double> pixel(0.0, 1.0);
+	  Tensor input(3, 14, 14);
+	  for (uint32_t i = 0; i < input.Size(); ++i)
+		input.Set(i, pixel(generator));
+
+	  for (auto algorithm : { ConvolutionalLayer::Algorithms::Gemm, ConvolutionalLayer::Algorithms::Direct })
+	  {
+		for (auto& layer : network.Layers())
+		{
+		  auto cl = dynamic_cast<ConvolutionalLayer*>(layer.get());
+		  if (cl)
+			cl->Algorithm(algorithm);
+		}
+		const FullyConnectedLayer& hidden = static_cast<const FullyConnectedLayer&>(*network.Layers()[3]);
+		Tensor trainingWeights(hidden.Weights());
+		std::unique_ptr<InferencePlan> plan = network.CompileForInference();
+		// Compiling uses the testing weights, but must leave the network with its training weights.
+		for (uint32_t i = 0; i < trainingWeights.Size(); ++i)
+		  Assert::AreEqual<double>(trainingWeights.Get(i), hidden.Weights().Get(i));
+		Assert::AreEqual<size_t>(network.Layers().size(), plan->StepCount());
+
+		for (auto& layer : network.Layers())
+		  layer->SwitchToTestingWeights();
+		std::vector<Tensor> activations;
+		activations.reserve(network.Layers().size());
+		const Tensor* layerInput = &input;
+		for (const auto& layer : network.Layers())
+		{
+		  activations.emplace_back(layer->OutputPlanes(), layer->OutputRows(), layer->OutputColumns());
+		  layer->FeedForward(*layerInput, activations.back(), nullptr);
+		  auto wl = dynamic_cast<const WeightedLayer*>(layer.get());
+		  if (wl)
+			wl->ApplyActivationFunction(activations.back());
+		  layerInput = &activations.back();
+		}
+		for (auto& layer : network.Layers())
+		  layer->SwitchToTrainingWeights();
+
+		InferencePlan::Workspace workspace(*plan);
+		Tensor outputs = plan->FeedForward(input, workspace);
+		Assert::AreEqual(activations.back().Size(), outputs.Size());
+		for (uint32_t i = 0; i < outputs.Size(); ++i)
+		  Assert::AreEqual(activations.back().Get(i), outputs.Get(i), 1e-9);
+		Assert::AreEqual(activations.back().HighestValueIndex(), plan->Classify(input, workspace));
+	  }
+	}
+  };
+}
@@ -62,6 +62,23 @@ namespace MaxPoolLayerTests
 	  }
 	}
 
+	TEST_METHOD(MaxPoolingLayerChannelBlockedMatchesPlanar)
+	{
+	  Tensor inputs(5, 6, 8);
+	  Randomizer(1.0).Fill(inputs);
+	  MaxPoolingLayer layer(5, 6, 8);
+	  Tensor expected(5, 3, 4);
+	  layer.FeedForward(inputs, expected, nullptr);
+	  Tensor blockedInputs(Tensor::ChannelBlocks(5), 6, 8, Tensor::ChannelBlockSize);
+	  inputs.ToChannelBlocked(blockedInputs);
+	  Tensor blockedOutputs(Tensor::ChannelBlocks(5), 3, 4, Tensor::ChannelBlockSize);
+	  layer.FeedForwardChannelBlocked(blockedInputs, blockedOutputs);
+	  Tensor actual(5, 3, 4);
+	  blockedOutputs.FromChannelBlocked(actual);
+	  for (uint32_t i = 0; i < expected.Size(); ++i)
+		Assert::AreEqual(expected.Get(i), actual.Get(i));
+	}
+
 	TEST_METHOD(MaxPoolingLayerBackpropagateError)
 	{
 	  double inputs[3 * 6 * 6] =
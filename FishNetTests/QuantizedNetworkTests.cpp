@@ -0,0 +1,67 @@
+#include "stdafx.h"
+#include "CppUnitTest.h"
+#include "CostFunction.h"
+#include "FeedForwardNetwork.h"
+#include "Image.h"
+#include "QuantizedNetwork.h"
+
+using namespace Microsoft::VisualStudio::CppUnitTestFramework;
+
+namespace FishNetTests
+{
+  TEST_CLASS(QuantizedNetworkTests)
+  {
+  public:
+	TEST_METHOD(QuantizedOutputsMatchFullPrecision)
+	{
+	  // Padding, a stride of 2 and an input size that isn't a multiple of the kernels' vector length are all covered.
+	  FeedForwardNetwork network("quantized", 3, 12, 12, std::make_unique<CrossEntropyCostFunction>(), 1, 0, 0.1, 0.0);
+	  network.AddConvolutionalLayer(6, 3, 1, 1, std::make_unique<ReLU>());
+	  network.AddMaxPoolingLayer();
+	  network.AddConvolutionalLayer(5, 3, 2, 1, std::make_unique<ReLU>());
+	  network.AddFullyConnectedLayer(20, std::make_unique<ReLU>(), 0.5);
+	  network.AddFullyConnectedLayer(10, std::make_unique<Sigmoid>(), 1.0);
+	  for (auto& layer : network.Layers())
+		layer->InitializeWeights();
+	  std::vector<std::unique_ptr<Image>> images;
+	  std::vector<Image*> calibrationImages;
+	  std::default_random_engine generator(3);
+	  std::uniform_real_distribution<double> pixel(0.0, 1.0);
+	  for (uint32_t i = 0; i < 20; ++i)
+	  {
+		auto data = std::make_unique<Real[]>(3 * 12 * 12);
+		for (uint32_t j = 0; j < 3 * 12 * 12; ++j)
+		  data[j] = pixel(generator);
+		images.emplace_back(std::make_unique<Image>(std::move(data), 3, 12, 12, i % 10));
+		calibrationImages.push_back(images.back().get());
+	  }
+	  const FullyConnectedLayer& hidden = static_cast<const FullyConnectedLayer&>(*network.Layers()[3]);
+	  Tensor trainingWeights(hidden.Weights());
+	  QuantizedNetwork quantized(network, calibrationImages);
+	  // Quantizing uses the testing weights, but must leave the network with its training weights.
+	  for (uint32_t i = 0; i < trainingWeights.Size(); ++i)
+		Assert::AreEqual<double>(trainingWeights.Get(i), hidden.Weights().Get(i));
+
+	  for (auto& layer : network.Layers())
+		layer->SwitchToTestingWeights();
+	  for (const auto& image : images)
+	  {
+		std::vector<Tensor> activations;
+		activations.reserve(network.Layers().size());
+		const Tensor* input = &image->Inputs();
+		for (const auto& layer : network.Layers())
+		{
+		  activations.emplace_back(layer->OutputPlanes(), layer->OutputRows(), layer->OutputColumns());
+		  layer->FeedForward(*input, activations.back(), nullptr);
+		  auto wl = dynamic_cast<const WeightedLayer*>(layer.get());
+		  if (wl)
+			wl->ApplyActivationFunction(activations.back());
+		  input = &activations.back();
+		}
+		Tensor outputs = quantized.FeedForward(image->Inputs());
+		for (uint32_t i = 0; i < outputs.Size(); ++i)
+		  Assert::AreEqual(activations.back().Get(i), outputs.Get(i), 0.02);
+	  }
+	}
+  };
+}
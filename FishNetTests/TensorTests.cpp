@@ -239,5 +239,70 @@ namespace FishNetTests
 	  Assert::AreEqual<double>(0, result.Get(3));
 	  Assert::AreEqual<double>(363, result.Get(4));
 	}
+
+	TEST_METHOD(HyperplaneViewSharesElements)
+	{
+	  Tensor batch(3, 2, 2, 2);
+	  for (uint32_t i = 0; i < batch.Size(); ++i)
+		batch.Set(i, i);
+	  Tensor example = batch.HyperplaneView(1);
+	  Assert::AreEqual<uint32_t>(1, example.Hyperplanes());
+	  Assert::AreEqual<uint32_t>(8, example.Size());
+	  Assert::AreEqual<double>(8, example.Get(0));
+	  Assert::AreEqual<double>(13, example.Get(1, 0, 1));
+	  example.Set(0, -1.0);
+	  Assert::AreEqual<double>(-1, batch.Get(8));
+	  Tensor lastTwo = batch.HyperplaneView(1, 2);
+	  Assert::AreEqual<uint32_t>(16, lastTwo.Size());
+	  Assert::AreEqual<double>(23, lastTwo.Get(15));
+	  // Copying a view gives a tensor with its own elements.
+	  Tensor copy(example);
+	  copy.Set(1, 100.0);
+	  Assert::AreEqual<double>(9, batch.Get(9));
+	}
+
+	TEST_METHOD(ChannelBlockedRoundTrip)
+	{
+	  Tensor planar(6, 2, 3);
+	  for (uint32_t i = 0; i < planar.Size(); ++i)
+		planar.Set(i, i + 1.0);
+	  Tensor blocked(Tensor::ChannelBlocks(6), 2, 3, Tensor::ChannelBlockSize);
+	  Assert::AreEqual<uint32_t>(2, blocked.Hyperplanes());
+	  planar.ToChannelBlocked(blocked);
+	  // The first block holds planes 0 to 3 interleaved, the second holds planes 4 and 5 and two planes of zeros.
+	  Assert::AreEqual<double>(1, blocked.Get(0, 0, 0, 0));
+	  Assert::AreEqual<double>(7, blocked.Get(0, 0, 0, 1));
+	  Assert::AreEqual<double>(19, blocked.Get(0, 0, 0, 3));
+	  Assert::AreEqual<double>(6, blocked.Get(0, 1, 2, 0));
+	  Assert::AreEqual<double>(34, blocked.Get(1, 1, 0, 1));
+	  Assert::AreEqual<double>(0, blocked.Get(1, 1, 0, 2));
+	  Assert::AreEqual<double>(0, blocked.Get(1, 1, 2, 3));
+	  Tensor restored(6, 2, 3);
+	  blocked.FromChannelBlocked(restored);
+	  for (uint32_t i = 0; i < planar.Size(); ++i)
+		Assert::AreEqual(planar.Get(i), restored.Get(i));
+	}
+
+	TEST_METHOD(LoadConvertsSinglePrecisionElements)
+	{
+	  const char* fileName = "TensorLoadTest.tmp";
+	  {
+		std::ofstream os(fileName, std::ios::binary);
+		uint32_t dimensions[4] = { 1, 1, 2, 3 };
+		float elements[6] = { 1.5f, -2.0f, 0.25f, 3.0f, -0.5f, 100.0f };
+		os.write((const char*)dimensions, sizeof(dimensions));
+		os.write((const char*)elements, sizeof(elements));
+	  }
+	  std::ifstream is(fileName, std::ios::binary);
+	  auto t = Tensor::Load(is, sizeof(float));
+	  is.close();
+	  std::remove(fileName);
+	  Assert::AreEqual<uint32_t>(2, t->Rows());
+	  Assert::AreEqual<uint32_t>(3, t->Columns());
+	  Assert::AreEqual<double>(1.5, t->Get(0, 0));
+	  Assert::AreEqual<double>(-2.0, t->Get(0, 1));
+	  Assert::AreEqual<double>(3.0, t->Get(1, 0));
+	  Assert::AreEqual<double>(100.0, t->Get(1, 2));
+	}
   };
 }
\ No newline at end of file
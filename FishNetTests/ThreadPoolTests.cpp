@@ -0,0 +1,85 @@
+#include "stdafx.h"
+#include "CppUnitTest.h"
+#include "ThreadPool.h"
+
+using namespace Microsoft::VisualStudio::CppUnitTestFramework;
+
+namespace FishNetTests
+{
+  TEST_CLASS(ThreadPoolTests)
+  {
+  public:
+	TEST_METHOD(RunsEachTaskOnce)
+	{
+	  ThreadPool pool(3);
+	  Assert::AreEqual<uint32_t>(3, pool.ThreadCount());
+	  // More tasks than threads, so some wait for a worker to finish its first one.
+	  for (uint32_t count : { 1, 2, 3, 7 })
+	  {
+		std::vector<std::atomic<uint32_t>> runs(count);
+		std::thread::id callingThread;
+		pool.Run(count, [&runs, &callingThread](uint32_t t)
+		{
+		  if (t == 0)
+			callingThread = std::this_thread::get_id();
+		  ++runs[t];
+		});
+		for (const auto& r : runs)
+		  Assert::AreEqual<uint32_t>(1, r);
+		Assert::IsTrue(callingThread == std::this_thread::get_id());
+	  }
+	}
+
+	TEST_METHOD(RethrowsExceptionFromWorker)
+	{
+	  ThreadPool pool(2);
+	  std::atomic<uint32_t> finished(0);
+	  auto task = [&finished](uint32_t t)
+	  {
+		if (t == 1)
+		  throw std::runtime_error("task failed");
+		++finished;
+	  };
+	  bool caught = false;
+	  try
+	  {
+		pool.Run(2, task);
+	  }
+	  catch (const std::exception& e)
+	  {
+		caught = true;
+		Assert::AreEqual<std::string>("task failed", e.what());
+	  }
+	  Assert::IsTrue(caught);
+	  Assert::AreEqual<uint32_t>(1, finished);
+	  // The pool can still be used afterwards.
+	  pool.Run(2, [&finished](uint32_t) { ++finished; });
+	  Assert::AreEqual<uint32_t>(3, finished);
+	}
+
+	TEST_METHOD(RecordsWaitTime)
+	{
+	  ThreadPool pool(2);
+	  Assert::AreEqual<int64_t>(0, pool.WaitTime().count());
+	  // The calling thread finishes straight away and waits for the worker.
+	  pool.Run(2, [](uint32_t t)
+	  {
+		if (t == 1)
+		  std::this_thread::sleep_for(std::chrono::milliseconds(20));
+	  });
+	  Assert::IsTrue(pool.WaitTime() >= std::chrono::milliseconds(20));
+	  Assert::IsTrue(pool.RunTime() >= pool.WaitTime());
+	  pool.ResetStatistics();
+	  Assert::AreEqual<int64_t>(0, pool.WaitTime().count());
+	  Assert::AreEqual<int64_t>(0, pool.RunTime().count());
+	}
+
+	TEST_METHOD(SharedPoolGrows)
+	{
+	  ThreadPool& pool = ThreadPool::Shared(2);
+	  Assert::IsTrue(pool.ThreadCount() >= 2);
+	  Assert::IsTrue(&ThreadPool::Shared(4) == &pool);
+	  Assert::IsTrue(pool.ThreadCount() >= 4);
+	}
+  };
+}
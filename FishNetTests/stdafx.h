@@ -14,8 +14,11 @@
 
 #include <array>
 #include <atomic>
+#include <complex>
 #include <condition_variable>
+#include <functional>
 #include <iostream>
+#include <map>
 #include <memory>
 #include <random>
 #include <vector>
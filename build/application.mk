@@ -10,7 +10,7 @@ endif
 LinkerName             :=$(CXX)
 LinkOptions            :=
 OutputFile             :=$(BinDir)/$(Project)
-Libs                   := $(addprefix -l, $(Dependencies) $(Libraries))
+Libs                   := $(addprefix -l, $(Dependencies) $(Libraries) $(BlasLibrary))
 
 .PHONY: all clean
 all: $(ObjDir) $(BinDir) $(OutputFile)
@@ -11,15 +11,52 @@ else
     $(error Mode must be either Debug or Release.)
 endif
 
+# Precision sets the type of the elements of every Tensor. Single precision builds go in their own output directory,
+# since their objects can't be mixed with double precision ones.
+Precision = double
+ifeq ($(Precision),single)
+    CXXFLAGS += -DFISHNET_SINGLE_PRECISION
+else ifneq ($(Precision),double)
+    $(error Precision must be either single or double.)
+endif
+
+# The default build runs on any machine of the same architecture. Setting Arch to native, or to a processor name that
+# -march accepts, lets the compiler use the vector instructions of that processor, such as AVX2 or AVX-512.
+Arch =
+ifneq ($(Arch),)
+    CXXFLAGS += -march=$(Arch)
+endif
+
 ifeq ($(OS),FreeBSD)
     CXX := /usr/local/bin/clang++
 else
     CXX := /usr/bin/clang++
 endif
 
+# Setting Blas to the name of a locally installed CBLAS library, such as openblas or blis, makes the matrix products in
+# FishNet/Gemm.cpp call its cblas_dgemm and cblas_dgemv, or cblas_sgemm and cblas_sgemv with Precision=single. If the
+# library can't be found, the built in kernels are used.
+# The trainers already run in parallel, so a threaded BLAS should be limited to one thread, with OPENBLAS_NUM_THREADS=1
+# or BLIS_NUM_THREADS=1.
+Blas =
+ifneq ($(Blas),)
+    BlasCheck := $(shell printf '\043include <cblas.h>\nint main() { cblas_ddot(0, 0, 1, 0, 1); }\n' | \
+        $(CXX) -x c++ - -l$(Blas) -o /dev/null 2>/dev/null && echo found)
+    ifeq ($(BlasCheck),found)
+        CXXFLAGS += -DFISHNET_BLAS
+        BlasLibrary = $(Blas)
+    else
+        $(warning Could not build with the $(Blas) BLAS library, so the built in matrix kernels will be used.)
+    endif
+endif
+
 MKDIR	:= mkdir -p
 
-OutputDir = $(RootDir)/$(Mode)
+ifeq ($(Precision),single)
+    OutputDir = $(RootDir)/$(Mode)Single
+else
+    OutputDir = $(RootDir)/$(Mode)
+endif
 DepDir = $(OutputDir)/depend/$(Project)
 ObjDir = $(OutputDir)/obj/$(Project)
 LibDir = $(OutputDir)/lib